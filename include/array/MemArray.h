@@ -33,24 +33,214 @@
 #include <array/Array.h>
 #include <vector>
 #include <map>
+#include <deque>
 #include <assert.h>
 #include <boost/shared_ptr.hpp>
 #include <boost/weak_ptr.hpp>
 #include <boost/shared_array.hpp>
+#include <boost/unordered_map.hpp>
 #include <query/Query.h>
 #include <util/FileIO.h>
 #include <util/Lru.h>
 #include <util/CoordinatesMapper.h>
 #include <array/Tile.h>
 #include <util/DataStore.h>
+#include <util/Event.h>
+#include <util/Job.h>
+#include <util/JobQueue.h>
+#include <util/ThreadPool.h>
 
 using namespace std;
 using namespace boost;
 
 namespace scidb
 {
+    /**
+     * Directory of the chunks of a MemArray.
+     *
+     * Point lookups go through a hash table. When the chunk grid of the array fits into 64 bits,
+     * the position of a chunk is packed into one integer (the chunk numbers along each dimension,
+     * most significant first), which is both a collision-free hash and the sort key. Otherwise the
+     * coordinates are hashed and compared one by one.
+     *
+     * Iteration goes through a separate per-attribute index ordered by chunk position, which is the
+     * order of the map<Address, LruMemChunk> this directory replaced. The index is sorted lazily, so
+     * a burst of out-of-order insertions (e.g. chunks arriving through SG) costs O(1) each plus one
+     * sort at the next scan.
+     *
+     * The directory is not thread-safe: MemArray serializes access to it with its mutex.
+     */
+    class MemChunkDirectory
+    {
+      public:
+        typedef std::vector<LruMemChunk*> OrderedChunks;
+
+      private:
+        struct AddressHash
+        {
+            MemChunkDirectory const* _dir;
+            AddressHash(MemChunkDirectory const* dir) : _dir(dir) {}
+            size_t operator()(Address const& addr) const;
+        };
+        typedef boost::unordered_map<Address, LruMemChunk, AddressHash> ChunkTable;
+
+        struct AttributeIndex
+        {
+            OrderedChunks _chunks;
+            bool _sorted;
+            AttributeIndex() : _sorted(true) {}
+        };
+
+        ChunkTable _table;
+        std::vector<AttributeIndex> _ordered;
+        uint64_t _version;
+
+        void sort(AttributeIndex& index);
+
+        // Packing of chunk positions into 64-bit keys, used for hashing if _packed.
+        // Keys also give the chunk order unless a chunk outside of the dimension bounds
+        // has been inserted, which clears _keyOrdered.
+        bool _packed;
+        bool _keyOrdered;
+        Coordinates _origin;             // start of each dimension
+        Coordinates _last;               // end of each dimension
+        std::vector<uint64_t> _interval; // chunk interval of each dimension
+        std::vector<size_t> _shift;      // bit position of each dimension's chunk number
+
+        MemChunkDirectory(const MemChunkDirectory&);
+        MemChunkDirectory& operator=(const MemChunkDirectory&);
+
+      public:
+        typedef ChunkTable::iterator iterator;
+
+        explicit MemChunkDirectory(ArrayDesc const& desc);
+
+        /**
+         * @return the chunk at addr, or NULL if there is none
+         */
+        LruMemChunk* find(Address const& addr);
+
+        /**
+         * @return the chunk at addr, default-constructed if there was none (like map::operator[])
+         */
+        LruMemChunk& get(Address const& addr);
+
+        /**
+         * Remove the chunk at addr.
+         */
+        void erase(Address const& addr);
+
+        /**
+         * @return the chunks of an attribute ordered by their position
+         */
+        OrderedChunks const& getOrdered(AttributeID attId);
+
+        /**
+         * The version changes whenever chunks move within an ordered index (erase, sort).
+         * A position in an ordered index is valid only as long as the version is the same.
+         */
+        uint64_t getVersion() const
+        {
+            return _version;
+        }
+
+        /**
+         * @return true if the chunk at position left precedes the chunk at position right
+         */
+        bool precedes(Coordinates const& left, Coordinates const& right) const;
+
+        /**
+         * @return true if chunk positions are packed into 64-bit keys
+         */
+        bool isPacked() const
+        {
+            return _packed;
+        }
+
+        /**
+         * @return the 64-bit key of a chunk position; only valid if isPacked()
+         */
+        uint64_t pack(Coordinates const& chunkPos) const
+        {
+            assert(_packed);
+            uint64_t key = 0;
+            for (size_t i = 0, n = chunkPos.size(); i < n; ++i) {
+                key |= ((uint64_t(chunkPos[i]) - uint64_t(_origin[i])) / _interval[i]) << _shift[i];
+            }
+            return key;
+        }
+
+        /**
+         * Iteration over all chunks, in no particular order.
+         */
+        iterator begin()
+        {
+            return _table.begin();
+        }
+
+        iterator end()
+        {
+            return _table.end();
+        }
+
+        size_t size() const
+        {
+            return _table.size();
+        }
+    };
+
+    /**
+     * A pending background operation on the body of an LruMemChunk: either writing a
+     * swapped-out body to the datastore or reading one back ahead of a forward scan.
+     * All fields except the I/O buffers are protected by the SharedMemCache mutex.
+     */
+    class SpillRequest
+    {
+    public:
+        enum Kind
+        {
+            WRITE,
+            PREFETCH
+        };
+
+        SpillRequest(Kind kind, LruMemChunk* chunk, MemArray* array) :
+            _kind(kind),
+            _chunk(chunk),
+            _array(array),
+            _size(0),
+            _stripe(0),
+            _dsOffset(-1),
+            _dsAlloc(0),
+            _dsSize(0),
+            _inFlight(false),
+            _cancelled(false),
+            _failed(false)
+        {}
+
+        Kind _kind;
+        LruMemChunk* _chunk;
+        MemArray* _array;
+        boost::shared_ptr<DataStore> _datastore;
+        boost::shared_array<char> _data;  // uncompressed chunk body
+        size_t _size;                     // uncompressed size of the body
+        size_t _stripe;                   // datastore stripe the body goes to (or comes from)
+        off_t  _dsOffset;                 // location of the body in the datastore
+        size_t _dsAlloc;                  // size of the allocated region in the datastore
+        size_t _dsSize;                   // number of bytes the body occupies in the datastore
+        bool _inFlight;                   // picked up by a spill thread
+        bool _cancelled;                  // the chunk no longer needs the result
+        bool _failed;                     // the I/O has thrown
+    };
+
     /**
      * Structure to share mem chunks.
+     *
+     * When the chunks of all MemArrays exceed the memory threshold, the least recently used
+     * unpinned chunks are swapped out. The victim bodies are handed to a pool of spill threads
+     * (one per spill directory) which compress them and write them to per-array datastores striped
+     * over the spill directories. The bytes waiting to be written are bounded: a thread that needs
+     * to swap out more than that blocks until the spill threads catch up. The same threads read
+     * chunks back ahead of a MemArrayIterator that scans forward.
      */
     class SharedMemCache
     {
@@ -63,17 +253,121 @@ namespace scidb
         Mutex _mutex;
         size_t _swapNum;
         size_t _loadsNum;
+        size_t _prefetchNum;
         uint64_t _genCount;
-        DataStores _datastores;
+        std::vector< boost::shared_ptr<DataStores> > _datastores;
         static SharedMemCache _sharedMemCache;
 
+        /**
+         * Spill thread main loop: pick up requests until the cache is shut down.
+         */
+        class SpillJob : public Job
+        {
+        private:
+            SharedMemCache* _cache;
+
+        public:
+            SpillJob(SharedMemCache* cache):
+                Job(boost::shared_ptr<Query>()),
+                _cache(cache)
+                {}
+
+            virtual void run();
+        };
+
+        std::deque< boost::shared_ptr<SpillRequest> > _spillQueue;
+        uint64_t _spillPendingSize;       // bytes of chunk bodies waiting to be written
+        uint64_t _spillPendingThreshold;  // above this, swapOut() waits for the spill threads
+        size_t _prefetchPending;          // number of queued prefetch requests
+        size_t _prefetchDepth;            // chunks to read ahead of a forward scan
+        bool _compressSpill;
+        bool _spillRunning;
+        bool _spillFailed;                // a background write has failed, swap out synchronously
+        Event _spillQueued;
+        Event _spillDone;
+        boost::shared_ptr<JobQueue> _spillJobQueue;
+        boost::shared_ptr<ThreadPool> _spillThreadPool;
+        std::vector< boost::shared_ptr<SpillJob> > _spillJobs;
+
+        /**
+         * Swap out the body of victim, either by queueing it to the spill threads or by writing it
+         * on the calling thread. Must be called under _mutex.
+         */
+        void spillChunk(LruMemChunk& victim);
+
+        /**
+         * Read the swapped-out body of chunk back from the datastore into memory. Must be called
+         * under _mutex.
+         */
+        void loadChunk(LruMemChunk& chunk);
+
+        /**
+         * Take back the body of a pinned chunk with an outstanding spill request, or wait for the
+         * request to complete if a spill thread is working on it. Must be called under _mutex.
+         */
+        void reclaimChunk(LruMemChunk& chunk);
+
+        /**
+         * Remove request from the queue (if it is still there) and mark it cancelled. If the request
+         * carries a chunk body, the body is released. Must be called under _mutex.
+         */
+        void cancelRequest(boost::shared_ptr<SpillRequest> request);
+
+        /**
+         * Wait until a spill thread completes some request. Must be called under _mutex.
+         */
+        void waitSpillDone();
+
+        /**
+         * Wait for a queued request and hand it to the calling spill thread.
+         * @return the request, or NULL if the cache is shut down and the queue is drained
+         */
+        boost::shared_ptr<SpillRequest> nextRequest();
+
+        /**
+         * Do the I/O part of a request: compress and write, or read and decompress.
+         * Called without _mutex.
+         */
+        void processRequest(SpillRequest& request);
+
+        /**
+         * Install the result of a processed request. Must be called under _mutex.
+         */
+        void completeRequest(SpillRequest& request);
+
+        /**
+         * Stop the spill threads after they have drained the queue.
+         */
+        void stopSpilling();
+
+        /**
+         * Get the datastore holding the chunks of array that are swapped out to the given stripe,
+         * creating it if necessary. Must be called under _mutex.
+         */
+        boost::shared_ptr<DataStore> const& getDataStore(MemArray& array, size_t stripe);
+
     public:
         SharedMemCache();
+        ~SharedMemCache();
         void pinChunk(LruMemChunk& chunk);
         void unpinChunk(LruMemChunk& chunk);
         void swapOut();
         void deleteChunk(LruMemChunk& chunk);
         void cleanupArray(MemArray &array);
+
+        /**
+         * Queue background reads of the next swapped-out chunks of a forward scan so that they are
+         * in memory by the time the scan reaches them. At most the configured prefetch depth
+         * of chunks is considered. Prefetching never evicts other chunks: it stops when the cache
+         * is full or the prefetch queue is. Must be called under the array mutex.
+         * @param array the array the chunks belong to
+         * @param chunks the ordered chunks of the scanned attribute
+         * @param from index of the first chunk to consider
+         */
+        void prefetchChunks(MemArray& array,
+                            MemChunkDirectory::OrderedChunks const& chunks,
+                            size_t from);
+
         static SharedMemCache& getInstance() {
             return _sharedMemCache;
         }
@@ -98,13 +392,41 @@ namespace scidb
             return _loadsNum;
         }
 
+        size_t getPrefetchNum() const {
+            return _prefetchNum;
+        }
+
+        /**
+         * @return the number of bytes of swapped-out chunk bodies that are still waiting to be
+         * written by the spill threads. These are not included in getUsedMemSize().
+         */
+        uint64_t getSpillPendingSize() const {
+            return _spillPendingSize;
+        }
+
+        /**
+         * @return the number of directories the swapped-out chunks are striped over.
+         */
+        size_t getNumStripes() const {
+            return _datastores.size();
+        }
+
         /**
          * Initialize the datastores used for the temporary disk storage needed
-         * by mem arrays.
+         * by mem arrays and start the spill threads.
          * @param memThreshold size of the in-memory cache
-         * @param basePath directory where datastores for spilled data will live
+         * @param basePaths directories where datastores for spilled data will live;
+         *                  chunks are striped over all of them, each one gets a spill thread
+         * @param spillQueueSize maximum number of bytes waiting to be written by the spill threads;
+         *                       0 means that chunks are written synchronously on swap out
+         * @param prefetchDepth number of chunks read ahead of a forward scan; 0 disables prefetch
+         * @param compress whether to compress chunk bodies on the way to disk
          */
-        void initSharedMemCache(uint64_t memThreshold, const char* basePath);
+        void initSharedMemCache(uint64_t memThreshold,
+                                std::vector<std::string> const& basePaths,
+                                uint64_t spillQueueSize,
+                                size_t prefetchDepth,
+                                bool compress);
 
         /**
          * Update the memory threshold.
@@ -192,8 +514,11 @@ namespace scidb
         void swapOut();
         void pinChunk(LruMemChunk& chunk);
         void unpinChunk(LruMemChunk& chunk);
-        shared_ptr<DataStore> _datastore;
-        map<Address, LruMemChunk> _chunks;
+
+        vector< shared_ptr<DataStore> > _datastores;  // one per spill directory, created lazily
+        size_t _nextStripe;                           // stripe for the next chunk swapped out
+        size_t _spillsInFlight;                       // requests a spill thread is working on
+        MemChunkDirectory _chunks;
         Mutex _mutex;
     private:
         MemArray(const MemArray&);
@@ -205,16 +530,22 @@ namespace scidb
     class MemArrayIterator : public ArrayIterator
     {
       private:
-        map<Address, LruMemChunk>::iterator curr;
-        map<Address, LruMemChunk>::iterator last;
         MemArray& _array;
         Address addr;
         Chunk* currChunk;
         boost::shared_ptr<Array> parent;
         bool positioned;
+        size_t _currIndex;   // position of currChunk in the ordered chunks of the attribute
+        uint64_t _version;   // directory version _currIndex refers to
 
         void position();
 
+        /**
+         * Ask the cache to read ahead the chunks following the current one.
+         * Must be called under the array mutex.
+         */
+        void prefetch(MemChunkDirectory::OrderedChunks const& chunks);
+
       public:
         void setParentArray(boost::shared_ptr<Array> arr) {
             parent = arr;
@@ -170,6 +170,7 @@ namespace scidb
 	#ifndef SCIDB_CLIENT
 	friend class MemArray;
         friend class MemArrayIterator;
+        friend class MemChunkDirectory;
         friend class SharedMemCache;
 	#endif
       protected:
@@ -276,6 +277,7 @@ namespace scidb
 
 #ifndef SCIDB_CLIENT
     class LruMemChunk;
+    class SpillRequest;
     typedef LRUSecondary<LruMemChunk*> MemChunkLru;
     typedef LRUSecondary<LruMemChunk*>::ListIterator MemChunkLruIterator;
 
@@ -315,6 +317,23 @@ namespace scidb
          */
         size_t       _sizeAtLastUnPin;
 
+        /**
+         * The number of bytes the chunk body occupies in the datastore. Smaller than size
+         * if the body was compressed when it was swapped out.
+         */
+        size_t       _dsSize;
+
+        /**
+         * The datastore stripe (spill directory) holding the swapped-out body.
+         */
+        size_t       _dsStripe;
+
+        /**
+         * A background write or prefetch of the chunk body that has not completed yet.
+         * Protected by the SharedMemCache mutex.
+         */
+        boost::shared_ptr<SpillRequest> _spillRequest;
+
       public:
         /**
          * Create a new chunk, not in LRU with size 0.
@@ -0,0 +1,142 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.
+* Copyright (C) 2008-2014 SciDB, Inc.
+*
+* SciDB is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with SciDB.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+/*
+ *  NormalizedKeys.h
+ *
+ *  The sort keys of a tuple encoded into a string of bytes that sorts like the tuple.
+ */
+#ifndef NORMALIZED_KEYS_H
+#define NORMALIZED_KEYS_H
+
+#include <array/TupleArray.h>
+
+namespace scidb
+{
+
+/**
+ * Sorts tuples on normalized keys. The sort keys of every tuple are encoded into a fixed-width
+ * string of bytes, such that comparing two strings with memcmp orders their tuples the way
+ * TupleComparator does. The strings are then sorted instead of the tuples, without calling
+ * the comparison functions of the types and without following the tuple pointers.
+ * <br>
+ * <br>
+ * Every encoded key column starts with a byte for null < NaN < regular value, followed by the
+ * value: integers in big-endian order with the sign bit flipped, floating-point numbers with the
+ * sign bit flipped if positive and all bits flipped if negative, booleans as one byte, strings as
+ * their first STRING_PREFIX bytes padded with zeros. All the bytes of a descending column are
+ * inverted.
+ * <br>
+ * <br>
+ * The prefix of a string does not decide the order of longer strings, so the encoding stops after
+ * the first string column, as well as before the first column of a type it does not know
+ * (user-defined types). Tuples with equal encoded keys are then compared with the TupleComparator.
+ * Complete encodings are sorted with an LSD radix sort, the others with a comparison sort over
+ * compact (key prefix, row) entries.
+ */
+class NormalizedKeys
+{
+public:
+    /**
+     * Number of bytes of a string that are encoded.
+     */
+    static const size_t STRING_PREFIX = 8;
+
+    /**
+     * Minimal number of tuples for a radix sort; fewer tuples are sorted by comparison.
+     */
+    static const size_t RADIX_SORT_THRESHOLD = 1024;
+
+    /**
+     * @param keys the sort keys
+     * @param desc the schema of the tuples, as given to the TupleComparator
+     */
+    NormalizedKeys(vector<Key> const& keys, ArrayDesc const& desc);
+
+    /**
+     * @return true if at least the first key column can be encoded
+     */
+    bool isUsable() const
+    {
+        return !_columns.empty();
+    }
+
+    /**
+     * @return true if the encoded keys alone decide the order of the tuples
+     */
+    bool isComplete() const
+    {
+        return _complete;
+    }
+
+    /**
+     * @return the number of bytes of an encoded key
+     */
+    size_t getKeySize() const
+    {
+        return _keySize;
+    }
+
+    /**
+     * Encode the sort keys of a tuple.
+     * @param[out] key getKeySize() bytes
+     */
+    void encode(Tuple const& tuple, uint8_t* key) const;
+
+    /**
+     * Sort tuples in the order of a comparator built from the same keys.
+     */
+    void sort(vector< boost::shared_ptr<Tuple> >& tuples, TupleComparator& tcomp) const;
+
+private:
+    enum Encoding
+    {
+        SIGNED,
+        UNSIGNED,
+        FLOATING,
+        BOOLEAN,
+        STRING
+    };
+
+    struct Column
+    {
+        size_t columnNo;
+        bool ascent;
+        Encoding encoding;
+        size_t size;                // bytes of the encoded value, without the null/NaN byte
+        DoubleFloatOther nanType;
+    };
+
+    vector<Column> _columns;
+    size_t _keySize;
+    bool _complete;
+
+    void radixSort(uint8_t const* keys, size_t nTuples, vector<size_t>& order) const;
+    void comparisonSort(uint8_t const* keys,
+                        vector< boost::shared_ptr<Tuple> > const& tuples,
+                        TupleComparator& tcomp,
+                        vector<size_t>& order) const;
+};
+
+} //namespace scidb
+
+#endif /* NORMALIZED_KEYS_H */
@@ -0,0 +1,153 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.
+* Copyright (C) 2008-2014 SciDB, Inc.
+*
+* SciDB is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with SciDB.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+/*
+ * NormalizedKeysUnitTests.h
+ */
+
+#ifndef NORMALIZEDKEYSUNITTESTS_H_
+#define NORMALIZEDKEYSUNITTESTS_H_
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <cmath>
+#include <limits>
+#include <sstream>
+
+#include "array/NormalizedKeys.h"
+
+using namespace scidb;
+
+class NormalizedKeysTests: public CppUnit::TestFixture
+{
+CPPUNIT_TEST_SUITE(NormalizedKeysTests);
+CPPUNIT_TEST(testCompleteKeys);
+CPPUNIT_TEST(testStringKeys);
+CPPUNIT_TEST_SUITE_END();
+
+private:
+    ArrayDesc _desc;
+
+    /**
+     * Random tuples <i:int32 null, d:double null, s:string, u:uint8>, with many ties, nulls and NaNs.
+     */
+    void makeTuples(size_t n, vector< boost::shared_ptr<Tuple> >& tuples)
+    {
+        tuples.resize(n);
+        for (size_t k = 0; k < n; k++)
+        {
+            boost::shared_ptr<Tuple> t(new Tuple(4));
+            Tuple& tuple = *t;
+            int r = rand();
+            tuple[0] = Value(TypeLibrary::getType(TID_INT32));
+            if (r % 17 == 0) {
+                tuple[0].setNull(r % 3);
+            } else {
+                tuple[0].setInt32(r % 50 - 25);
+            }
+            r = rand();
+            tuple[1] = Value(TypeLibrary::getType(TID_DOUBLE));
+            if (r % 13 == 0) {
+                tuple[1].setNull();
+            } else if (r % 11 == 0) {
+                tuple[1].setDouble(std::numeric_limits<double>::quiet_NaN());
+            } else {
+                tuple[1].setDouble((r % 21 - 10) * 0.25);
+            }
+            std::ostringstream s;
+            s << "prefix_" << rand() % 20;
+            tuple[2].setString(s.str().c_str());
+            tuple[3] = Value(TypeLibrary::getType(TID_UINT8));
+            tuple[3].setUint8(rand() % 256);
+            tuples[k] = t;
+        }
+    }
+
+    void checkSorted(vector<Key> const& keys, size_t n)
+    {
+        vector< boost::shared_ptr<Tuple> > tuples;
+        makeTuples(n, tuples);
+        TupleComparator tcomp(keys, _desc);
+        NormalizedKeys normalized(keys, _desc);
+        CPPUNIT_ASSERT(normalized.isUsable());
+        normalized.sort(tuples, tcomp);
+        CPPUNIT_ASSERT(tuples.size() == n);
+        for (size_t k = 1; k < n; k++)
+        {
+            CPPUNIT_ASSERT(tcomp.compare(*tuples[k - 1], *tuples[k]) <= 0);
+        }
+    }
+
+public:
+    void setUp()
+    {
+        Attributes attrs;
+        attrs.push_back(AttributeDesc(0, "i", TID_INT32, AttributeDesc::IS_NULLABLE, 0));
+        attrs.push_back(AttributeDesc(1, "d", TID_DOUBLE, AttributeDesc::IS_NULLABLE, 0));
+        attrs.push_back(AttributeDesc(2, "s", TID_STRING, 0, 0));
+        attrs.push_back(AttributeDesc(3, "u", TID_UINT8, 0, 0));
+        Dimensions dims(1, DimensionDesc("n", 0, MAX_COORDINATE, 1000, 0));
+        _desc = ArrayDesc("tuples", attrs, dims);
+        srand(1);
+    }
+
+    void tearDown()
+    {
+    }
+
+    void testCompleteKeys()
+    {
+        vector<Key> keys(3);
+        keys[0].columnNo = 1;
+        keys[0].ascent = false;
+        keys[1].columnNo = 0;
+        keys[1].ascent = true;
+        keys[2].columnNo = 3;
+        keys[2].ascent = false;
+        CPPUNIT_ASSERT(NormalizedKeys(keys, _desc).isComplete());
+        CPPUNIT_ASSERT(NormalizedKeys(keys, _desc).getKeySize() == 9 + 5 + 2);
+
+        // comparison sort, then radix sort
+        checkSorted(keys, NormalizedKeys::RADIX_SORT_THRESHOLD - 1);
+        checkSorted(keys, 10 * NormalizedKeys::RADIX_SORT_THRESHOLD);
+    }
+
+    void testStringKeys()
+    {
+        // the string prefix does not decide the order: the keys after it are compared by tcomp
+        vector<Key> keys(2);
+        keys[0].columnNo = 2;
+        keys[0].ascent = true;
+        keys[1].columnNo = 0;
+        keys[1].ascent = false;
+        NormalizedKeys normalized(keys, _desc);
+        CPPUNIT_ASSERT(!normalized.isComplete());
+        CPPUNIT_ASSERT(normalized.getKeySize() == 1 + NormalizedKeys::STRING_PREFIX);
+
+        checkSorted(keys, 10 * NormalizedKeys::RADIX_SORT_THRESHOLD);
+    }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(NormalizedKeysTests);
+
+#endif /* NORMALIZEDKEYSUNITTESTS_H_ */
@@ -44,7 +44,14 @@ namespace scidb
     using namespace boost;
 
     //
-    // Array implementation materializing current chunk
+    // Array implementation materializing current chunk.
+    //
+    // Chunks of each attribute are produced ahead of the consumer by ChunkPrefetchJobs running on
+    // the global operator queue. The number of jobs in flight for an attribute (its prefetch depth)
+    // adapts to the ratio of the time the consumer waits for a chunk to the time a job spends
+    // producing it: the depth grows while the consumer is starved and shrinks while chunks are
+    // ready before they are requested. Jobs of all arrays of the instance share a global budget
+    // (CONFIG_PREFETCH_BUDGET).
     //
     class ParallelAccumulatorArray : public StreamArray, public boost::enable_shared_from_this<ParallelAccumulatorArray>
     {
@@ -72,6 +79,7 @@ namespace scidb
             AttributeID _attrId;
             MemChunk    _accChunk;
             ConstChunk const* _resultChunk;
+            uint64_t    _productionTime;
 
           public:
             ChunkPrefetchJob(const boost::shared_ptr<ParallelAccumulatorArray>& array,
@@ -89,17 +97,53 @@ namespace scidb
 
             ConstChunk const* getResult();
 
+            /**
+             * @return time in nanoseconds the last run of the job took
+             */
+            uint64_t getProductionTime() const {
+                return _productionTime;
+            }
+
             virtual void run();
 
             void cleanup();
         };
 
-        void doNewJob(boost::shared_ptr<ChunkPrefetchJob>& job);
+        /**
+         * Prefetch state of an attribute.
+         */
+        struct PrefetchState
+        {
+            size_t   depth;          // target number of jobs
+            size_t   jobs;           // jobs owned by the attribute, each holding a budget slot
+            uint64_t productionTime; // smoothed time a job takes to produce a chunk (ns)
+            uint64_t waitTime;       // smoothed time the consumer waits for a chunk (ns)
+            size_t   nReady;         // chunks in a row that did not make the consumer wait
+            size_t   nChunks;        // chunks consumed
+
+            PrefetchState() : depth(1), jobs(0), productionTime(0), waitTime(0), nReady(0), nChunks(0) {}
+        };
+
+        bool doNewJob(boost::shared_ptr<ChunkPrefetchJob>& job);
+        void addJobs(AttributeID attId, const boost::shared_ptr<Query>& query);
+        void adaptDepth(AttributeID attId, uint64_t waitTime, uint64_t productionTime);
+
+        /**
+         * Take up to n slots of the global prefetch budget.
+         * @param force take the slots even if the budget is exhausted
+         * @return number of slots taken
+         */
+        static size_t acquireBudget(size_t n, bool force);
+        static void releaseBudget(size_t n);
 
         std::vector< boost::shared_ptr<ConstArrayIterator> > iterators;
         boost::shared_ptr<Array> pipe;
         std::vector< std::list< boost::shared_ptr<ChunkPrefetchJob> > > activeJobs;
         std::vector< boost::shared_ptr<ChunkPrefetchJob> > completedJobs;
+        std::vector<PrefetchState> prefetch;
+        size_t maxDepth;
+        boost::weak_ptr<Query> queryLink;
+        Statistics* statistics;
    };
 }
 
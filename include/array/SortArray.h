@@ -32,6 +32,7 @@
 #include <array/Array.h>
 #include <array/MemArray.h>
 #include <array/TupleArray.h>
+#include <array/SortRun.h>
 
 #include <stdio.h>
 #include <ctype.h>
@@ -70,11 +71,14 @@ public:
      * @param[in] inputArray array to sort, schema must match input schema
      * @param[in] query query context
      * @param[in] tcomp class which provides comparison operator
+     * @param[in] start position of the first sorted cell; the distributed sort places
+     *            the key range of every instance after those of the previous instances
      * @return sorted one-dimensional array.
      */
     boost::shared_ptr<MemArray> getSortedArray(boost::shared_ptr<Array> inputArray,
                                                boost::shared_ptr<Query> query,
-                                               boost::shared_ptr<TupleComparator> tcomp);
+                                               boost::shared_ptr<TupleComparator> tcomp,
+                                               Coordinate start = 0);
 
     /**
      * @return the array descriptor for the output array
@@ -115,10 +119,10 @@ private:
 
     /**
      * A SortJob is a Job that partitions part of the array into a mem-sized chunk
-     * and sorts it.  The result of producing this sorted run is a MemArray constructed
-     * from a TupleArray (each one of which fits in memory).  Note that the input array
-     * being sorted may or may not have an empty tag, but the sort job produces a
-     * result with an empty tag.
+     * and sorts it.  A sorted run that fills the memory limit is written to a run
+     * file (see SortRun); the last, partial run of a partition stays in memory as a
+     * TupleArray.  Note that the input array being sorted may or may not have an
+     * empty tag, but the sort job produces a result with an empty tag.
      */
     class SortJob : public Job, protected SelfStatistics
     {
@@ -140,8 +144,8 @@ private:
 
 
     /**
-     * A MergeJob is a Job that merges sorted runs into larger sorted runs.
-     * It uses a MergeSortArray to do the merging
+     * A MergeJob is a Job that merges sorted runs into a larger run file.
+     * It uses a LoserTree to do the merging
      */
     class MergeJob : public Job, protected SelfStatistics
     {
@@ -163,17 +167,29 @@ private:
      */
     void calcOutputSchema(const ArrayDesc& inputSchema, size_t chunkSize);
 
+    /**
+     * @return the number of runs the next merge should take out of nRuns, so that
+     * every merge pass but the first one - and in particular the final merge into the
+     * output - merges _nStreams runs
+     */
+    size_t getMergeWidth(size_t nRuns) const;
+
+    /**
+     * Merge all the remaining runs into the output array, from position start on.
+     */
+    boost::shared_ptr<MemArray> mergeToOutput(boost::shared_ptr<Query> const& query, Coordinate start);
+
     boost::shared_ptr<Array> _input;                 // array to sort
     boost::shared_ptr<ArrayDesc> _outputSchema;      // shape of output
     boost::shared_ptr<TupleComparator> _tupleComp;   // comparison to use between cells
 
     size_t _memLimit;           // how big are the sorted runs
-    size_t _nStreams;           // how many runs to merge at once
+    size_t _nStreams;           // how many runs to merge at once, limited by the read buffers that fit in _memLimit
     size_t _pipelineLimit;      // how many runs to allow in the pipeline
     size_t _tupleSize;          // how big is each cell
 
     // list which accumulates sorted runs
-    std::list< boost::shared_ptr<Array> > _results;
+    std::list< boost::shared_ptr<SortRun> > _results;
 
     // state to track sort/merge progress and jobs
     Mutex  _sortLock;
@@ -0,0 +1,225 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.
+* Copyright (C) 2008-2014 SciDB, Inc.
+*
+* SciDB is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with SciDB.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+/*
+ *  SortRun.h
+ *
+ *  The sorted runs of the external merge sort of SortArray, and the loser tree that merges them.
+ */
+#ifndef SORT_RUN_H
+#define SORT_RUN_H
+
+#include <array/TupleArray.h>
+#include <util/FileIO.h>
+
+namespace scidb
+{
+
+/**
+ * A sequence of tuples in sort order: either a sorted TupleArray kept in memory, or a temporary
+ * file in CONFIG_TMP_PATH written by a SortRunWriter.
+ * <br>
+ * <br>
+ * A run file is a sequence of blocks of about BLOCK_SIZE bytes of rows, each compressed with the
+ * fastest zlib level, or stored raw if it does not shrink. A row holds the attributes of the tuple
+ * without the empty tag: for every attribute a byte that is 0xFF for a value and the missing reason
+ * of a null otherwise, followed by the value - the bytes of a fixed-size type, or a 32-bit length
+ * and the bytes of a variable-size type. The directory of the blocks stays in memory, so a reader
+ * fetches every block with a single sequential read.
+ */
+class SortRun
+{
+public:
+    /**
+     * Bytes of rows per block of a run file.
+     */
+    static const size_t BLOCK_SIZE = 1024 * 1024;
+
+    struct Block
+    {
+        uint64_t offset;        // position in the file
+        uint32_t rawSize;       // bytes of rows
+        uint32_t storedSize;    // bytes in the file; rawSize if not compressed
+    };
+
+    /**
+     * An in-memory run.
+     * @param tuples sorted tuples
+     */
+    explicit SortRun(boost::shared_ptr<TupleArray> const& tuples);
+
+    /**
+     * A run file, see SortRunWriter::finish().
+     */
+    SortRun(File::FilePtr const& file, vector<Block> const& blocks, uint64_t nTuples);
+
+    bool isInMemory() const
+    {
+        return _tuples.get() != NULL;
+    }
+
+    uint64_t getNumberOfTuples() const
+    {
+        return _nTuples;
+    }
+
+    boost::shared_ptr<TupleArray> const& getTupleArray() const
+    {
+        return _tuples;
+    }
+
+    File::FilePtr const& getFile() const
+    {
+        return _file;
+    }
+
+    vector<Block> const& getBlocks() const
+    {
+        return _blocks;
+    }
+
+private:
+    boost::shared_ptr<TupleArray> _tuples;
+    File::FilePtr _file;
+    vector<Block> _blocks;
+    uint64_t _nTuples;
+};
+
+/**
+ * Writes tuples in sort order to a new run file.
+ */
+class SortRunWriter
+{
+public:
+    /**
+     * @param desc the schema of the tuples; its empty tag, if any, is not written
+     */
+    explicit SortRunWriter(ArrayDesc const& desc);
+
+    void append(Tuple const& tuple);
+
+    /**
+     * Write the last block.
+     * @return the run; no tuples may be appended afterwards
+     */
+    boost::shared_ptr<SortRun> finish();
+
+private:
+    vector<size_t> _columns;        // the stored attributes
+    vector<size_t> _sizes;          // their sizes, 0 if variable
+    vector<char> _block;
+    vector<char> _compressed;
+    File::FilePtr _file;
+    uint64_t _fileSize;
+    vector<SortRun::Block> _blocks;
+    uint64_t _nTuples;
+
+    void flushBlock();
+};
+
+/**
+ * Reads the tuples of a run in order.
+ */
+class SortRunReader
+{
+public:
+    /**
+     * @param run the run to read
+     * @param desc the schema of the tuples, as given to the SortRunWriter
+     */
+    SortRunReader(boost::shared_ptr<SortRun> const& run, ArrayDesc const& desc);
+
+    bool end() const
+    {
+        return _end;
+    }
+
+    /**
+     * @return the current tuple, valid until the next call to next()
+     */
+    Tuple const& getTuple() const
+    {
+        return _tuples != NULL ? *(*_tuples)[_tupleNo] : _tuple;
+    }
+
+    void next();
+
+private:
+    boost::shared_ptr<SortRun> _run;
+    vector< boost::shared_ptr<Tuple> > const* _tuples;    // of an in-memory run, NULL for a file
+    uint64_t _tupleNo;
+    bool _end;
+
+    vector<size_t> _columns;
+    vector<size_t> _sizes;
+    Tuple _tuple;
+    size_t _blockNo;
+    vector<char> _block;
+    vector<char> _compressed;
+    size_t _blockPos;
+
+    void readBlock();
+    void readTuple();
+};
+
+/**
+ * A tournament tree over sorted runs: every internal node keeps the loser of the match played
+ * there, and the overall winner is kept apart. Advancing the winner replays only the matches on
+ * the path from its leaf to the root, i.e. log2(k) comparisons for k runs, against the previous
+ * losers of those matches. Ties go to the run with the smaller number, so the merge is stable.
+ */
+class LoserTree
+{
+public:
+    /**
+     * @param readers the runs to merge, at least one
+     * @param tcomp the order of the runs
+     */
+    LoserTree(vector< boost::shared_ptr<SortRunReader> > const& readers, TupleComparator& tcomp);
+
+    bool end() const
+    {
+        return _readers[_nodes[0]]->end();
+    }
+
+    /**
+     * @return the smallest tuple of all the runs
+     */
+    Tuple const& getTuple() const
+    {
+        return _readers[_nodes[0]]->getTuple();
+    }
+
+    void next();
+
+private:
+    vector< boost::shared_ptr<SortRunReader> > _readers;
+    TupleComparator& _tcomp;
+    vector<size_t> _nodes;      // _nodes[0] is the winner, _nodes[1..k-1] the losers of the matches
+
+    bool beats(size_t run1, size_t run2) const;
+    size_t play(size_t node);
+};
+
+} //namespace scidb
+
+#endif /* SORT_RUN_H */
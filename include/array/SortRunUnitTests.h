@@ -0,0 +1,318 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.
+* Copyright (C) 2008-2014 SciDB, Inc.
+*
+* SciDB is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with SciDB.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+/*
+ * SortRunUnitTests.h
+ */
+
+#ifndef SORTRUNUNITTESTS_H_
+#define SORTRUNUNITTESTS_H_
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "array/SortRun.h"
+
+using namespace scidb;
+
+class SortRunTests: public CppUnit::TestFixture
+{
+CPPUNIT_TEST_SUITE(SortRunTests);
+CPPUNIT_TEST(testLoserTree);
+CPPUNIT_TEST(testRunFile);
+CPPUNIT_TEST(testMixedMerge);
+CPPUNIT_TEST_SUITE_END();
+
+private:
+    ArrayDesc _desc;
+    ArrayDesc _fileDesc;        // <k:int32 null, n:int64, s:string null> and an empty tag
+
+    /**
+     * A sorted in-memory run of tuples <k:int32, n:int64>, where n numbers the tuples of all the runs.
+     */
+    boost::shared_ptr<SortRun> makeRun(size_t n, int64_t& serial, TupleComparator& tcomp)
+    {
+        vector< boost::shared_ptr<Tuple> > tuples(n);
+        for (size_t i = 0; i < n; i++)
+        {
+            tuples[i].reset(new Tuple(2));
+            (*tuples[i])[0] = Value(TypeLibrary::getType(TID_INT32));
+            (*tuples[i])[0].setInt32(rand() % 100);
+            (*tuples[i])[1] = Value(TypeLibrary::getType(TID_INT64));
+            (*tuples[i])[1].setInt64(serial++);
+        }
+        boost::shared_ptr<TupleArray> array(new TupleArray(_desc, tuples));
+        array->sort(boost::shared_ptr<TupleComparator>(new TupleComparator(tcomp)));
+        return boost::shared_ptr<SortRun>(new SortRun(array));
+    }
+
+    /**
+     * Tuple n of _fileDesc. Every 7th k is null, with a missing reason of its own. The strings are
+     * null for every 11th tuple, empty for every 13th, and otherwise of up to 2000 bytes, either
+     * repeated text, which compresses well, or random bytes, which do not compress at all.
+     */
+    static Tuple makeFileTuple(int64_t n, bool compressible)
+    {
+        Tuple tuple(4);
+        tuple[0] = Value(TypeLibrary::getType(TID_INT32));
+        if (n % 7 == 0)
+        {
+            tuple[0].setNull(static_cast<int>(n % 3));
+        }
+        else
+        {
+            tuple[0].setInt32(rand() % 100);
+        }
+        tuple[1] = Value(TypeLibrary::getType(TID_INT64));
+        tuple[1].setInt64(n);
+        tuple[2] = Value(TypeLibrary::getType(TID_STRING));
+        if (n % 11 == 0)
+        {
+            tuple[2].setNull();
+        }
+        else
+        {
+            size_t const size = n % 13 == 0 ? 0 : rand() % 2000;
+            vector<char> bytes(size + 1, 0);
+            for (size_t i = 0; i < size; i++)
+            {
+                bytes[i] = compressible ? "sorted runs "[i % 12] : static_cast<char>(rand() % 255 + 1);
+            }
+            tuple[2].setString(&bytes[0]);
+        }
+        tuple[3] = Value(TypeLibrary::getType(TID_INDICATOR));
+        tuple[3].setBool(true);
+        return tuple;
+    }
+
+    static bool sameValue(Value const& v1, Value const& v2)
+    {
+        if (v1.isNull() || v2.isNull())
+        {
+            return v1.isNull() && v2.isNull() && v1.getMissingReason() == v2.getMissingReason();
+        }
+        return v1.size() == v2.size() && memcmp(v1.data(), v2.data(), v1.size()) == 0;
+    }
+
+    static bool sameTuple(Tuple const& t1, Tuple const& t2, size_t nColumns)
+    {
+        for (size_t i = 0; i < nColumns; i++)
+        {
+            if (!sameValue(t1[i], t2[i]))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+public:
+    void setUp()
+    {
+        Attributes attrs;
+        attrs.push_back(AttributeDesc(0, "k", TID_INT32, 0, 0));
+        attrs.push_back(AttributeDesc(1, "n", TID_INT64, 0, 0));
+        Dimensions dims(1, DimensionDesc("i", 0, MAX_COORDINATE, 1000, 0));
+        _desc = ArrayDesc("tuples", attrs, dims);
+
+        Attributes fileAttrs;
+        fileAttrs.push_back(AttributeDesc(0, "k", TID_INT32, AttributeDesc::IS_NULLABLE, 0));
+        fileAttrs.push_back(AttributeDesc(1, "n", TID_INT64, 0, 0));
+        fileAttrs.push_back(AttributeDesc(2, "s", TID_STRING, AttributeDesc::IS_NULLABLE, 0));
+        fileAttrs.push_back(AttributeDesc(3, DEFAULT_EMPTY_TAG_ATTRIBUTE_NAME, TID_INDICATOR,
+                                          AttributeDesc::IS_EMPTY_INDICATOR, 0));
+        _fileDesc = ArrayDesc("tuples", fileAttrs, dims);
+        srand(1);
+    }
+
+    void tearDown()
+    {
+    }
+
+    void testLoserTree()
+    {
+        vector<Key> keys(1);
+        keys[0].columnNo = 0;
+        keys[0].ascent = true;
+        TupleComparator tcomp(keys, _desc);
+
+        // 1 to 9 runs, some of them empty, so that the tree is not always complete
+        for (size_t nRuns = 1; nRuns < 10; nRuns++)
+        {
+            vector< boost::shared_ptr<SortRunReader> > readers(nRuns);
+            int64_t serial = 0;
+            for (size_t r = 0; r < nRuns; r++)
+            {
+                readers[r].reset(new SortRunReader(makeRun(r % 3 == 1 ? 0 : 50 + r, serial, tcomp), _desc));
+            }
+
+            LoserTree tree(readers, tcomp);
+            int64_t count = 0;
+            Tuple previous;
+            for (; !tree.end(); tree.next(), count++)
+            {
+                Tuple const& tuple = tree.getTuple();
+                if (count != 0)
+                {
+                    int res = tcomp.compare(previous, tuple);
+                    CPPUNIT_ASSERT(res <= 0);
+                    // ties keep the order of the runs, as the runs were numbered in order
+                    CPPUNIT_ASSERT(res < 0 || previous[1].getInt64() < tuple[1].getInt64());
+                }
+                previous = tuple;
+            }
+            CPPUNIT_ASSERT(count == serial);
+        }
+    }
+
+    /**
+     * Write tuples to a run file and read them back: blocks of repeated text get compressed, blocks
+     * of random bytes are stored raw, the tuple that fills a block goes past BLOCK_SIZE, and a string
+     * longer than BLOCK_SIZE makes a block of its own.
+     */
+    void testRunFile()
+    {
+        vector<Tuple> tuples;
+        for (int64_t n = 0; n < 3000; n++)
+        {
+            tuples.push_back(makeFileTuple(n, n < 1500));
+        }
+        Tuple big = makeFileTuple(3001, true);
+        vector<char> bytes(SortRun::BLOCK_SIZE + 100, 'x');
+        bytes.back() = 0;
+        big[2].setString(&bytes[0]);
+        tuples.push_back(big);
+        tuples.push_back(makeFileTuple(3002, false));
+
+        SortRunWriter writer(_fileDesc);
+        for (size_t i = 0; i < tuples.size(); i++)
+        {
+            writer.append(tuples[i]);
+        }
+        boost::shared_ptr<SortRun> run = writer.finish();
+        CPPUNIT_ASSERT(!run->isInMemory());
+        CPPUNIT_ASSERT(run->getNumberOfTuples() == tuples.size());
+
+        vector<SortRun::Block> const& blocks = run->getBlocks();
+        size_t nCompressed = 0;
+        size_t nRaw = 0;
+        size_t nOversized = 0;
+        for (size_t i = 0; i < blocks.size(); i++)
+        {
+            CPPUNIT_ASSERT(blocks[i].storedSize <= blocks[i].rawSize);
+            nCompressed += blocks[i].storedSize < blocks[i].rawSize;
+            nRaw += blocks[i].storedSize == blocks[i].rawSize;
+            nOversized += blocks[i].rawSize > SortRun::BLOCK_SIZE;
+        }
+        CPPUNIT_ASSERT(nCompressed != 0);
+        CPPUNIT_ASSERT(nRaw != 0);
+        CPPUNIT_ASSERT(nOversized != 0);
+
+        SortRunReader reader(run, _fileDesc);
+        size_t count = 0;
+        for (; !reader.end(); reader.next(), count++)
+        {
+            CPPUNIT_ASSERT(count < tuples.size());
+            CPPUNIT_ASSERT(sameTuple(reader.getTuple(), tuples[count], 3));
+            CPPUNIT_ASSERT(reader.getTuple()[3].getBool());
+        }
+        CPPUNIT_ASSERT(count == tuples.size());
+    }
+
+    /**
+     * Merge run files with in-memory runs: the merge is sorted and stable, and every tuple comes out
+     * whole.
+     */
+    void testMixedMerge()
+    {
+        vector<Key> keys(1);
+        keys[0].columnNo = 0;
+        keys[0].ascent = true;
+        TupleComparator tcomp(keys, _fileDesc);
+
+        size_t const nRuns = 6;
+        vector<Tuple> all;
+        vector< boost::shared_ptr<SortRunReader> > readers(nRuns);
+        for (size_t r = 0; r < nRuns; r++)
+        {
+            vector< boost::shared_ptr<Tuple> > tuples(r == 4 ? 0 : 400 + 100 * r);
+            for (size_t i = 0; i < tuples.size(); i++)
+            {
+                tuples[i].reset(new Tuple(makeFileTuple(all.size() + i, r % 2 == 0)));
+            }
+            boost::shared_ptr<TupleArray> array(new TupleArray(_fileDesc, tuples));
+            array->sort(boost::shared_ptr<TupleComparator>(new TupleComparator(tcomp)));
+            for (size_t i = 0; i < tuples.size(); i++)
+            {
+                // serial numbers in the order of the runs and of the sorted tuples
+                (*array->getTuples()[i])[1].setInt64(all.size());
+                all.push_back(*array->getTuples()[i]);
+            }
+
+            boost::shared_ptr<SortRun> run;
+            if (r % 2 == 0)
+            {
+                run.reset(new SortRun(array));
+            }
+            else
+            {
+                SortRunWriter writer(_fileDesc);
+                for (size_t i = 0; i < tuples.size(); i++)
+                {
+                    writer.append(*array->getTuples()[i]);
+                }
+                run = writer.finish();
+            }
+            readers[r].reset(new SortRunReader(run, _fileDesc));
+        }
+
+        vector<Tuple const*> bySerial(all.size());
+        for (size_t i = 0; i < all.size(); i++)
+        {
+            bySerial[all[i][1].getInt64()] = &all[i];
+        }
+
+        // ties go to the run with the smaller number
+        LoserTree tree(readers, tcomp);
+        size_t count = 0;
+        Tuple previous;
+        for (; !tree.end(); tree.next(), count++)
+        {
+            Tuple const& tuple = tree.getTuple();
+            int64_t const n = tuple[1].getInt64();
+            CPPUNIT_ASSERT(n >= 0 && static_cast<size_t>(n) < all.size());
+            CPPUNIT_ASSERT(sameTuple(tuple, *bySerial[n], 3));
+            if (count != 0)
+            {
+                int res = tcomp.compare(previous, tuple);
+                CPPUNIT_ASSERT(res <= 0);
+                CPPUNIT_ASSERT(res < 0 || previous[1].getInt64() < n);
+            }
+            previous = tuple;
+        }
+        CPPUNIT_ASSERT(count == all.size());
+    }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(SortRunTests);
+
+#endif /* SORTRUNUNITTESTS_H_ */
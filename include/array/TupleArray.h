@@ -98,6 +98,14 @@ class TupleComparator
 	int compare(Tuple const& t1, Tuple const& t2);
 
 	TupleComparator(vector<Key> const& keys, const ArrayDesc& arrayDesc);
+
+	vector<Key> const& getKeys() const {
+		return _keys;
+	}
+
+	ArrayDesc const& getArrayDesc() const {
+		return _arrayDesc;
+	}
 };
 
 struct SortContext
@@ -111,7 +119,11 @@ class TupleArray : public Array
 	friend class TupleChunkIterator;
 	friend class TupleArrayIterator;
   public:
-        void sort(boost::shared_ptr<TupleComparator> tcomp);
+	/**
+	 * Sort the tuples on normalized keys (see NormalizedKeys.h), or with iqsort if the first key
+	 * has a type that NormalizedKeys does not encode.
+	 */
+	void sort(boost::shared_ptr<TupleComparator> tcomp);
 
 	virtual ArrayDesc const& getArrayDesc() const;
 
@@ -147,6 +159,10 @@ class TupleArray : public Array
 		return tuples.size();
 	}
 
+	vector< boost::shared_ptr<Tuple> > const& getTuples() const {
+		return tuples;
+	}
+
 	/**
 	 * Compute the memory footprint of a single tuple. Useful for planning purposes.
 	 * This is NOT equal to the size of a cell inside a structure like a MemArray. MemArrays use RLEPayloads which exhibit
@@ -0,0 +1,213 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.
+* Copyright (C) 2008-2014 SciDB, Inc.
+*
+* SciDB is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with SciDB.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+/**
+ * @file TypedChunkView.h
+ *
+ * @brief Typed access to the values of a chunk of a fixed-size primitive attribute, without
+ * copying every cell into a Value.
+ */
+
+#ifndef TYPED_CHUNK_VIEW_H_
+#define TYPED_CHUNK_VIEW_H_
+
+#include <array/RLE.h>
+#include <query/TypeSystem.h>
+
+namespace scidb
+{
+    class ConstChunk;
+
+    /**
+     * Read-only view of the RLE payload of a chunk.
+     *
+     * The payload holds the values of the non-empty cells of the chunk in stride-major order, cut
+     * into runs (segments) of distinct values, repeated values or nulls. The view is only valid when
+     * that sequence of values is exactly what a chunk iterator with IGNORE_EMPTY_CELLS|IGNORE_OVERLAPS
+     * would return: the chunk must be materialized in RLE format, must have no overlap region and its
+     * attribute must be of a fixed-size non-boolean type. Callers check isValid() and fall back to
+     * chunk iterators otherwise.
+     *
+     * The chunk stays pinned as long as the view exists.
+     */
+    class ConstChunkPayloadView
+    {
+      private:
+        ConstChunk const& _chunk;
+        bool _pinned;
+        bool _valid;
+        ConstRLEPayload _payload;
+
+        ConstChunkPayloadView(const ConstChunkPayloadView&);
+        ConstChunkPayloadView& operator=(const ConstChunkPayloadView&);
+
+        static char const* getPayloadData(ConstChunk const& chunk, bool& valid);
+
+      public:
+        /**
+         * @param chunk the chunk to view; it must outlive the view
+         */
+        explicit ConstChunkPayloadView(ConstChunk const& chunk);
+
+        ~ConstChunkPayloadView();
+
+        /**
+         * @return true if the type is a builtin fixed-size type a view can be created for
+         */
+        static bool isSupportedType(TypeId const& type)
+        {
+            return type == TID_INT8 || type == TID_INT16 || type == TID_INT32 || type == TID_INT64 ||
+                type == TID_UINT8 || type == TID_UINT16 || type == TID_UINT32 || type == TID_UINT64 ||
+                type == TID_FLOAT || type == TID_DOUBLE || type == TID_CHAR ||
+                type == TID_DATETIME;
+        }
+
+        /**
+         * @return true if the chunk can be accessed through the view
+         */
+        bool isValid() const
+        {
+            return _valid;
+        }
+
+        /**
+         * @return the payload of the chunk; only valid if isValid()
+         */
+        ConstRLEPayload const& getPayload() const
+        {
+            assert(_valid);
+            return _payload;
+        }
+
+        /**
+         * @return true if the chunk has at least one non-null value; only valid if isValid()
+         */
+        bool hasValues() const
+        {
+            assert(_valid);
+            for (size_t i = 0, n = _payload.nSegments(); i < n; i++) {
+                if (!_payload.getSegment(i)._null) {
+                    return true;
+                }
+            }
+            return false;
+        }
+    };
+
+    /**
+     * Typed runs of values over the payload of a chunk or a tile.
+     *
+     * @code
+     *   ConstTypedChunkView<double> view(chunk);
+     *   if (view.isValid()) {
+     *       for (size_t i = 0, n = view.nRuns(); i < n; i++) {
+     *           ConstTypedChunkView<double>::Run run = view.getRun(i);
+     *           ...
+     *       }
+     *   }
+     * @endcode
+     *
+     * @tparam T the C++ type of the attribute; its size must match the element size of the payload
+     */
+    template<typename T>
+    class ConstTypedChunkView
+    {
+      public:
+        /**
+         * A run of cells. Values of a run with 'same' set are all equal to values[0]; values of
+         * other non-null runs are values[0..length-1]. Null runs have no values.
+         */
+        struct Run
+        {
+            T const* values;
+            size_t   length;
+            bool     same;
+            bool     null;
+            int32_t  missingReason;
+        };
+
+      private:
+        ConstChunkPayloadView* _chunkView;
+        ConstRLEPayload const* _payload;
+
+        ConstTypedChunkView(const ConstTypedChunkView&);
+        ConstTypedChunkView& operator=(const ConstTypedChunkView&);
+
+      public:
+        /**
+         * View the values of a chunk.
+         */
+        explicit ConstTypedChunkView(ConstChunk const& chunk)
+        : _chunkView(new ConstChunkPayloadView(chunk)),
+          _payload(NULL)
+        {
+            if (_chunkView->isValid() && _chunkView->getPayload().elementSize() == sizeof(T)) {
+                _payload = &_chunkView->getPayload();
+            }
+        }
+
+        /**
+         * View the values of a payload, e.g. a tile. The payload must outlive the view.
+         */
+        explicit ConstTypedChunkView(ConstRLEPayload const* payload)
+        : _chunkView(NULL),
+          _payload(payload->elementSize() == sizeof(T) && !payload->isBool() ? payload : NULL)
+        {}
+
+        ~ConstTypedChunkView()
+        {
+            delete _chunkView;
+        }
+
+        bool isValid() const
+        {
+            return _payload != NULL;
+        }
+
+        /**
+         * @return the number of runs
+         */
+        size_t nRuns() const
+        {
+            assert(_payload);
+            return _payload->nSegments();
+        }
+
+        /**
+         * @return the i-th run
+         */
+        Run getRun(size_t i) const
+        {
+            assert(_payload);
+            ConstRLEPayload::Segment const& seg = _payload->getSegment(i);
+            Run run;
+            run.length = seg.length();
+            run.same = seg._same;
+            run.null = seg._null;
+            run.missingReason = seg._null ? seg._valueIndex : -1;
+            run.values = seg._null ? NULL : reinterpret_cast<T const*>(_payload->getRawValue(seg._valueIndex));
+            return run;
+        }
+    };
+}
+
+#endif
@@ -38,6 +38,7 @@
 #include "query/TypeSystem.h"
 #include "array/Metadata.h"
 #include "array/RLE.h"
+#include "array/TypedChunkView.h"
 #include "query/TileFunctions.h"
 #include "util/arena/Vector.h"
 
@@ -207,6 +208,46 @@ public:
     virtual void finalResult(Value& result, Value const& state) = 0;
 };
 
+/**
+ * Feed the non-null values of a payload to the state of aggregate A, run by run.
+ * Fixed-size values are read in place through ConstTypedChunkView and handed to the
+ * run kernel of A (see TileFunctions.h); other payloads (bit-packed booleans) go
+ * through getPayloadValue one value at a time.
+ */
+template<template <typename TS, typename TSR> class A, typename T, typename TR>
+inline void aggregatePayloadRuns(typename A<T, TR>::State& s, ConstRLEPayload const* tile)
+{
+    ConstTypedChunkView<T> view(tile);
+    if (!view.isValid()) {
+        for (size_t i = 0; i < tile->nSegments(); i++)
+        {
+            const RLEPayload::Segment& v = tile->getSegment(i);
+            if (v._null)
+                continue;
+            if (v._same) {
+                A<T, TR>::multAggregate(s, getPayloadValue<T>(tile, v._valueIndex), v.length());
+            } else {
+                const size_t end = v._valueIndex + v.length();
+                for (size_t j = v._valueIndex; j < end; j++) {
+                    A<T, TR>::aggregate(s, getPayloadValue<T>(tile, j));
+                }
+            }
+        }
+        return;
+    }
+    for (size_t i = 0, n = view.nRuns(); i < n; i++)
+    {
+        typename ConstTypedChunkView<T>::Run const run = view.getRun(i);
+        if (run.null)
+            continue;
+        if (run.same) {
+            A<T, TR>::multAggregate(s, run.values[0], run.length);
+        } else {
+            A<T, TR>::aggregateRun(s, run.values, run.length);
+        }
+    }
+}
+
 template<template <typename TS, typename TSR> class A, typename T, typename TR, bool asterisk = false>
 class BaseAggregate: public Aggregate
 {
@@ -256,22 +297,7 @@ public:
     virtual void accumulatePayload(Value& state, ConstRLEPayload const* tile)
     {
         typename A<T, TR>::State& s = *static_cast< typename A<T, TR>::State* >(state.data());
-        for (size_t i = 0; i < tile->nSegments(); i++)
-        {
-            const RLEPayload::Segment& v = tile->getSegment(i);
-            if (v._null)
-                continue;
-            if (v._same) {
-                T value = getPayloadValue<T>(tile, v._valueIndex);
-                A<T, TR>::multAggregate(s, value, v.length());
-            } else {
-                const size_t end = v._valueIndex + v.length();
-                for (size_t j = v._valueIndex; j < end; j++) {
-                    T value = getPayloadValue<T>(tile, j);
-                    A<T, TR>::aggregate(s, value);
-                }
-            }
-        }
+        aggregatePayloadRuns<A, T, TR>(s, tile);
     }
 
     void merge(Value& dstState, Value const& srcState)
@@ -368,20 +394,7 @@ public:
         }
 
         typename A<T, TR>::State& s = *static_cast< typename A<T, TR>::State* >(state.data());
-        for (size_t i = 0; i < tile->nSegments(); i++)
-        {
-            const RLEPayload::Segment& v = tile->getSegment(i);
-            if (v._null)
-                continue;
-            if (v._same) {
-                A<T, TR>::multAggregate(s, getPayloadValue<T>(tile, v._valueIndex), v.length());
-            } else {
-                const size_t end = v._valueIndex + v.length();
-                for (size_t j = v._valueIndex; j < end; j++) {
-                    A<T, TR>::aggregate(s, getPayloadValue<T>(tile, j));
-                }
-            }
-        }
+        aggregatePayloadRuns<A, T, TR>(s, tile);
     }
 
     void merge(Value& dstState, Value const& srcState)
@@ -0,0 +1,137 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.
+* Copyright (C) 2008-2014 SciDB, Inc.
+*
+* SciDB is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with SciDB.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+/*
+ *  HyperLogLog.h
+ *
+ *  The state of the approximate distinct count aggregate.
+ */
+#ifndef HYPER_LOG_LOG_H
+#define HYPER_LOG_LOG_H
+
+#include <query/TypeSystem.h>
+
+namespace scidb
+{
+
+/**
+ * A HyperLogLog sketch (Flajolet et al. 2007, with the sparse representation of Heule et al. 2013)
+ * kept in a binary Value, such as an aggregate state. Values are hashed with 64-bit MurmurHash3,
+ * so there is no large-range correction. With precision p the sketch has 2^p registers and a
+ * standard error of 1.04 / sqrt(2^p), 0.8% for the default p = 14.
+ * <br>
+ * <br>
+ * A sketch starts sparse: a list of 32-bit entries, each the first SPARSE_PRECISION bits of a hash
+ * and the rank of its remaining bits. The first entries of the list are sorted and unique, the
+ * others are appended as they come and folded in when the list is full; the list grows by doubling.
+ * Small cardinalities are then counted almost exactly, by linear counting over 2^25 registers, in
+ * a few bytes per value. Once the list would take as much room as the registers, the sketch turns
+ * dense: one byte per register.
+ * <br>
+ * <br>
+ * Sketches of different precisions merge into one of the smaller precision.
+ */
+class HyperLogLog
+{
+public:
+    static const uint32_t MIN_PRECISION = 4;
+    static const uint32_t MAX_PRECISION = 18;
+    static const uint32_t DEFAULT_PRECISION = 14;
+    static const uint32_t SPARSE_PRECISION = 25;
+
+    /**
+     * @param state the Value holding the sketch
+     */
+    explicit HyperLogLog(Value& state) : _state(state)
+    {
+    }
+
+    /**
+     * Make the state an empty sparse sketch.
+     * @param precision clamped to [MIN_PRECISION, MAX_PRECISION]
+     */
+    void initialize(uint32_t precision);
+
+    /**
+     * Add a value, given by its bytes.
+     */
+    void add(void const* data, size_t size);
+
+    /**
+     * Add the values of another sketch.
+     */
+    void merge(Value const& other);
+
+    uint32_t getPrecision() const
+    {
+        return getHeader(_state).precision;
+    }
+
+    bool isSparse() const
+    {
+        return !getHeader(_state).dense;
+    }
+
+    /**
+     * @return the estimated number of distinct values
+     */
+    uint64_t estimate() const;
+
+private:
+    struct Header
+    {
+        uint8_t precision;
+        uint8_t dense;
+        uint16_t reserved;
+        uint32_t nEntries;          // sparse: entries in the list
+        uint32_t nSorted;           // sparse: how many of them are sorted and unique
+        uint32_t capacity;          // sparse: room for entries
+    };
+
+    Value& _state;
+
+    static Header& getHeader(Value const& state)
+    {
+        return *static_cast<Header*>(state.data());
+    }
+
+    static uint32_t* getEntries(Value const& state)
+    {
+        return reinterpret_cast<uint32_t*>(static_cast<char*>(state.data()) + sizeof(Header));
+    }
+
+    static uint8_t* getRegisters(Value const& state)
+    {
+        return static_cast<uint8_t*>(state.data()) + sizeof(Header);
+    }
+
+    void addEntry(uint32_t entry);
+    void normalize();
+    void resize(uint32_t capacity);
+    void toDense();
+    void mergeRegisters(uint8_t const* registers, uint32_t precision);
+    void mergeEntries(uint32_t const* entries, uint32_t nEntries);
+};
+
+} //namespace scidb
+
+#endif /* HYPER_LOG_LOG_H */
@@ -42,6 +42,7 @@
 #include <string>
 #include <stdio.h>
 #include <utility>
+#include <limits>
 
 #include <boost/shared_ptr.hpp>
 #include <boost/enable_shared_from_this.hpp>
@@ -2106,6 +2107,20 @@ class PhysicalOperator
         return PhysicalBoundaries::createFromFullSchema(_schema);
     }
 
+    /**
+     *  [Optimizer API] Describe the choices the operator makes from the sizes of its inputs, for
+     *  explain_physical. Same conventions as toString().
+     *  @param out stream to write to
+     *  @param indent number of spacer characters to start every line with
+     *  @param inputBoundaries the boundaries of inputs that will be provided in order same as inputSchemas
+     *  @param inputSchemas shapes of all arrays that will given as inputs
+     */
+    virtual void inputsToString(std::ostream &out, int indent,
+                                std::vector<PhysicalBoundaries> const& inputBoundaries,
+                                std::vector<ArrayDesc> const& inputSchemas) const
+    {
+    }
+
     /**
      *  [Optimizer API] Determine if the operator requires a repart node.
      *  @param inputSchema shape of array that will given as input (op must be unary)
@@ -2182,6 +2197,14 @@ class PhysicalOperator
      */
     static boost::shared_ptr<JobQueue>  getGlobalQueueForOperators();
 
+    /**
+     * Get the number of jobs over which an operator spreads independent pieces of work on the
+     * global operator queue: CONFIG_AGGREGATE_THREADS, or CONFIG_EXEC_THREADS if that is 0.
+     * @param nPieces the number of pieces of work; there are no more jobs than pieces
+     * @return a number of jobs, at least 1
+     */
+    static size_t getParallelJobsCount(size_t nPieces = std::numeric_limits<size_t>::max());
+
   private:
     // global thread pool for operators, that is automatically created in getGlobalQueueForOperators()
     static boost::shared_ptr<ThreadPool> _globalThreadPoolForOperators;
@@ -0,0 +1,205 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.
+* Copyright (C) 2008-2014 SciDB, Inc.
+*
+* SciDB is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with SciDB.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+/*
+ *  QuantileSketch.h
+ *
+ *  A mergeable approximate quantile summary of bounded size, the state of the approximate
+ *  quantile aggregates.
+ */
+#ifndef QUANTILE_SKETCH_H
+#define QUANTILE_SKETCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <assert.h>
+#include <vector>
+
+#include <query/TypeSystem.h>
+
+namespace scidb
+{
+
+/**
+ * A KLL sketch of a stream of doubles, kept in a binary Value, such as an aggregate state. Items
+ * are kept in levels: an item of level h stands for 2^h values. New values go to level 0. When a
+ * level reaches its capacity it is compacted: its items are sorted and every other one moves up a
+ * level, the others are dropped. The capacity of the top level is k and shrinks by 2/3 per level
+ * down, but never below 2, so a sketch holds less than 3k + 2 * MAX_LEVELS items whatever the
+ * number of values. The rank error of a quantile is about 1.7 / k of the number of values (1% for
+ * k = 200).
+ * <br>
+ * <br>
+ * Two sketches merge by concatenating their levels and compacting them again, which gives the same
+ * guarantees as a sketch of all the values; the merged sketch keeps the smaller k. The Value holds
+ * a header and an array of items in which the levels follow each other from the top one down to
+ * level 0, so that inserting a value is an append. The array starts with room for a few items and
+ * doubles until it has room for all the items of the sketch, getSize(k) bytes in all, so that a
+ * sketch of a few values, such as the state of a small group, stays small.
+ */
+class QuantileSketch
+{
+public:
+    static const uint32_t MIN_K = 8;
+    static const uint32_t MAX_K = 65535;
+    static const uint32_t DEFAULT_K = 200;
+
+    /**
+     * Number of levels. An item of the top level would stand for 2^63 values, so the levels never
+     * run out before the 64-bit count of values does.
+     */
+    static const uint32_t MAX_LEVELS = 64;
+
+    /**
+     * @return the size in bytes of a sketch with parameter k, once it is full
+     */
+    static size_t getSize(uint32_t k);
+
+    /**
+     * @param state the Value holding the sketch
+     */
+    explicit QuantileSketch(Value& state) : _state(state)
+    {
+    }
+
+    /**
+     * Make the state an empty sketch.
+     * @param k the accuracy parameter, clamped to [MIN_K, MAX_K]
+     */
+    void initialize(uint32_t k);
+
+    void insert(double value)
+    {
+        Header* header = getHeader();
+        if (header->nItems == header->capacity)
+        {
+            makeRoom();
+            header = getHeader();
+        }
+        getItems()[header->nItems++] = value;
+        header->levelSizes[0]++;
+        updateRange(value);
+        header->count++;
+    }
+
+    /**
+     * Insert count copies of a value.
+     */
+    void insert(double value, uint64_t count);
+
+    /**
+     * Add the values summarized by another sketch to this one.
+     */
+    void merge(Value const& other);
+
+    /**
+     * @return the number of values inserted
+     */
+    uint64_t getCount() const
+    {
+        return getHeader()->count;
+    }
+
+    uint32_t getK() const
+    {
+        return getHeader()->k;
+    }
+
+    /**
+     * @return the number of items kept, at most getCapacity(getK())
+     */
+    uint32_t getNumberOfItems() const
+    {
+        return getHeader()->nItems;
+    }
+
+    /**
+     * @param fraction in [0, 1]
+     * @return a value whose rank is approximately fraction * getCount(), exactly the smallest
+     * or the largest value for 0 and 1; the sketch must not be empty
+     */
+    double getQuantile(double fraction) const;
+
+private:
+    struct Header
+    {
+        uint32_t k;
+        uint32_t nLevels;
+        uint64_t count;
+        uint64_t nCompactions;                  // parity of the next compaction
+        uint32_t nItems;
+        uint32_t capacity;                      // room for items in the Value
+        double minValue;                        // exact extremes of the values
+        double maxValue;
+        uint32_t levelSizes[MAX_LEVELS];
+    };
+
+    typedef std::vector< std::vector<double> > Levels;
+
+    /**
+     * Room for items of a new sketch.
+     */
+    static const uint32_t INITIAL_CAPACITY = 8;
+
+    Value& _state;
+
+    Header* getHeader() const
+    {
+        return static_cast<Header*>(_state.data());
+    }
+
+    double* getItems() const
+    {
+        return reinterpret_cast<double*>(static_cast<char*>(_state.data()) + sizeof(Header));
+    }
+
+    static size_t getCapacity(uint32_t k)
+    {
+        return 3 * k + 3 * MAX_LEVELS;
+    }
+
+    void updateRange(double value)
+    {
+        Header* header = getHeader();
+        if (header->count == 0 || value < header->minValue)
+        {
+            header->minValue = value;
+        }
+        if (header->count == 0 || value > header->maxValue)
+        {
+            header->maxValue = value;
+        }
+    }
+
+    static size_t getLevelCapacity(uint32_t k, size_t level, size_t nLevels);
+
+    void reserve(size_t nItems);
+    void makeRoom();
+    void unpack(Levels& levels) const;
+    void pack(Levels const& levels);
+    void compress(Levels& levels);
+    void compress();
+};
+
+} //namespace scidb
+
+#endif /* QUANTILE_SKETCH_H */
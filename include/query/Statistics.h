@@ -69,11 +69,20 @@ public:
     volatile uint64_t allocatedSize;  /**< A number of allocated bytes */
     volatile uint64_t allocatedChunks; /**< A number of allocated chunks */
 
+    // result prefetch
+    volatile uint64_t prefetchedChunks; /**< A number of chunks produced by prefetch jobs */
+    volatile uint64_t prefetchWaitTime; /**< Time the consumer waited for prefetched chunks, in microseconds */
+    volatile uint64_t prefetchDepthIncreases; /**< A number of times the prefetch depth of an attribute was increased */
+    volatile uint64_t prefetchDepthDecreases; /**< A number of times the prefetch depth of an attribute was decreased */
+    volatile uint64_t prefetchMaxDepth; /**< The largest prefetch depth of an attribute */
+
     Statistics(): executionTime(0),
         sentSize(0), sentMessages(0), receivedSize(0), receivedMessages(0),
         writtenSize(0), writtenChunks(0), readSize(0), readChunks(0),
         pinnedSize(0), pinnedChunks(0),
-        allocatedSize(0), allocatedChunks(0)
+        allocatedSize(0), allocatedChunks(0),
+        prefetchedChunks(0), prefetchWaitTime(0),
+        prefetchDepthIncreases(0), prefetchDepthDecreases(0), prefetchMaxDepth(0)
     {
     }
 };
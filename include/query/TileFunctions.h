@@ -585,6 +585,112 @@ void inferIsNullArgTypes(const ArgTypes& factInputArgs, std::vector<ArgTypes>& p
 void rle_unary_bool_is_null(const Value** args, Value* result, void*);
 void rle_unary_null_to_any(const Value** args, Value* result, void*);
 
+/**
+ * Run kernels
+ *
+ * The aggregators below also accumulate a whole run of values at once (aggregateRun), when a
+ * payload keeps its fixed-size values contiguous. The run loops keep several independent partial
+ * results, so that the additions do not wait on each other and the compiler can vectorize them;
+ * the partial results are combined at the end of the run.
+ */
+static const size_t AGGREGATE_RUN_LANES = 4;
+
+template <typename TS, typename TSR>
+struct RunSumTerm
+{
+    static TSR get(const TS& value)
+    {
+        return static_cast<TSR>(value);
+    }
+};
+
+template <typename TS, typename TSR>
+struct RunSquareTerm
+{
+    static TSR get(const TS& value)
+    {
+        return static_cast<TSR>(value * value);
+    }
+};
+
+/**
+ * Sum of the terms of a run of values.
+ */
+template <typename TS, typename TSR, template <typename, typename> class Term>
+struct RunSum
+{
+    static TSR sum(const TS* values, size_t n)
+    {
+        TSR s0 = TSR(), s1 = TSR(), s2 = TSR(), s3 = TSR();
+        size_t i = 0;
+        for (; i + AGGREGATE_RUN_LANES <= n; i += AGGREGATE_RUN_LANES)
+        {
+            s0 += Term<TS, TSR>::get(values[i]);
+            s1 += Term<TS, TSR>::get(values[i + 1]);
+            s2 += Term<TS, TSR>::get(values[i + 2]);
+            s3 += Term<TS, TSR>::get(values[i + 3]);
+        }
+        for (; i < n; i++)
+        {
+            s0 += Term<TS, TSR>::get(values[i]);
+        }
+        s0 += s1;
+        s2 += s3;
+        s0 += s2;
+        return s0;
+    }
+};
+
+/**
+ * Compensated (Neumaier) sum of the terms of a run of floating-point values: the rounding error of
+ * every addition is collected separately and added back at the end, so that long runs of values of
+ * mixed magnitudes do not lose their small values.
+ */
+template <typename TS, template <typename, typename> class Term>
+struct CompensatedRunSum
+{
+    static void add(double& sum, double& compensation, double term)
+    {
+        double const t = sum + term;
+        compensation += fabs(sum) >= fabs(term) ? (sum - t) + term : (term - t) + sum;
+        sum = t;
+    }
+
+    static double sum(const TS* values, size_t n)
+    {
+        double s[AGGREGATE_RUN_LANES] = { 0, 0, 0, 0 };
+        double c[AGGREGATE_RUN_LANES] = { 0, 0, 0, 0 };
+        size_t i = 0;
+        for (; i + AGGREGATE_RUN_LANES <= n; i += AGGREGATE_RUN_LANES)
+        {
+            for (size_t l = 0; l < AGGREGATE_RUN_LANES; l++)
+            {
+                add(s[l], c[l], Term<TS, double>::get(values[i + l]));
+            }
+        }
+        for (; i < n; i++)
+        {
+            add(s[0], c[0], Term<TS, double>::get(values[i]));
+        }
+        double total = 0;
+        double compensation = 0;
+        for (size_t l = 0; l < AGGREGATE_RUN_LANES; l++)
+        {
+            add(total, compensation, s[l]);
+            add(total, compensation, c[l]);
+        }
+        return total + compensation;
+    }
+};
+
+template <template <typename, typename> class Term>
+struct RunSum<double, double, Term> : public CompensatedRunSum<double, Term>
+{};
+
+template <template <typename, typename> class Term>
+struct RunSum<float, double, Term> : public CompensatedRunSum<float, Term>
+{};
+
 /**
  * Aggregator classes
  */
@@ -611,6 +717,11 @@ public:
         state._sum += static_cast<TSR>(value) * count;
     }
 
+    static void aggregateRun(State& state, const TS* values, size_t n)
+    {
+        state._sum += RunSum<TS, TSR, RunSumTerm>::sum(values, n);
+    }
+
     static void merge(State& state, const State& new_state)
     {
         state._sum += new_state._sum;
@@ -650,6 +761,14 @@ public:
         state._prod *= static_cast<TSR>( pow(static_cast<double>(value), static_cast<double>(count)) );
     }
 
+    static void aggregateRun(State& state, const TS* values, size_t n)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            aggregate(state, values[i]);
+        }
+    }
+
     static void merge(State& state, const State& newState)
     {
         state._prod *= newState._prod;
@@ -685,6 +804,11 @@ public:
         state._count += count;
     }
 
+    static void aggregateRun(State& state, const TS* values, size_t n)
+    {
+        state._count += n;
+    }
+
     static void merge(State& state, const State& new_state)
     {
         state._count += new_state._count;
@@ -740,6 +864,32 @@ public:
             state._min = value;
     }
 
+    static void aggregateRun(State& state, const TS* values, size_t n)
+    {
+        State lanes[AGGREGATE_RUN_LANES];
+        for (size_t l = 0; l < AGGREGATE_RUN_LANES; l++)
+        {
+            lanes[l] = state;
+        }
+        size_t i = 0;
+        for (; i + AGGREGATE_RUN_LANES <= n; i += AGGREGATE_RUN_LANES)
+        {
+            for (size_t l = 0; l < AGGREGATE_RUN_LANES; l++)
+            {
+                aggregate(lanes[l], values[i + l]);
+            }
+        }
+        for (; i < n; i++)
+        {
+            aggregate(lanes[0], values[i]);
+        }
+        for (size_t l = 1; l < AGGREGATE_RUN_LANES; l++)
+        {
+            merge(lanes[0], lanes[l]);
+        }
+        state = lanes[0];
+    }
+
     static void merge(State& state, const State& new_state)
     {
         if (new_state._min < state._min || isNanValue(new_state._min))
@@ -780,6 +930,32 @@ public:
             state._max = value;
     }
 
+    static void aggregateRun(State& state, const TS* values, size_t n)
+    {
+        State lanes[AGGREGATE_RUN_LANES];
+        for (size_t l = 0; l < AGGREGATE_RUN_LANES; l++)
+        {
+            lanes[l] = state;
+        }
+        size_t i = 0;
+        for (; i + AGGREGATE_RUN_LANES <= n; i += AGGREGATE_RUN_LANES)
+        {
+            for (size_t l = 0; l < AGGREGATE_RUN_LANES; l++)
+            {
+                aggregate(lanes[l], values[i + l]);
+            }
+        }
+        for (; i < n; i++)
+        {
+            aggregate(lanes[0], values[i]);
+        }
+        for (size_t l = 1; l < AGGREGATE_RUN_LANES; l++)
+        {
+            merge(lanes[0], lanes[l]);
+        }
+        state = lanes[0];
+    }
+
     static void merge(State& state, const State& new_state)
     {
         if (new_state._max > state._max || isNanValue(new_state._max))
@@ -822,6 +998,12 @@ public:
         state._count += count;
     }
 
+    static void aggregateRun(State& state, const TS* values, size_t n)
+    {
+        state._sum += RunSum<TS, TSR, RunSumTerm>::sum(values, n);
+        state._count += n;
+    }
+
     static void merge(State& state, const State& new_state)
     {
         state._sum += new_state._sum;
@@ -868,6 +1050,13 @@ public:
         state._count += count;
     }
 
+    static void aggregateRun(State& state, const TS* values, size_t n)
+    {
+        state._m += RunSum<TS, TSR, RunSumTerm>::sum(values, n);
+        state._m2 += RunSum<TS, TSR, RunSquareTerm>::sum(values, n);
+        state._count += n;
+    }
+
     static void merge(State& state, const State& new_state)
     {
         state._m += new_state._m;
@@ -917,6 +1106,13 @@ public:
         state._count += count;
     }
 
+    static void aggregateRun(State& state, const TS* values, size_t n)
+    {
+        state._m += RunSum<TS, TSR, RunSumTerm>::sum(values, n);
+        state._m2 += RunSum<TS, TSR, RunSquareTerm>::sum(values, n);
+        state._count += n;
+    }
+
     static void merge(State& state, const State& new_state)
     {
         state._m += new_state._m;
@@ -0,0 +1,295 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.
+* Copyright (C) 2008-2014 SciDB, Inc.
+*
+* SciDB is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with SciDB.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+/**
+ * @file TupleExchange.h
+ *
+ * @brief Exchange of tuples (rows of values) between instances.
+ *
+ * Operators that partition data by attribute values rather than by coordinates (hash joins, hash
+ * group-by) write every tuple to the instance chosen by a hash of its key values. TupleExchange
+ * collects the tuples into a local array laid out so that redistribute() with psByRow delivers
+ * them to their destinations, TupleReader scans the tuples of the resulting array, and
+ * TupleWriter numbers the result tuples of an instance in the output array. Operators whose
+ * output is sorted (distributed sort, build_index) rather send every tuple to the instance of its
+ * key range, given by a RangePartitioner.
+ */
+
+#ifndef TUPLE_EXCHANGE_H_
+#define TUPLE_EXCHANGE_H_
+
+#include <vector>
+#include <boost/shared_ptr.hpp>
+
+#include "array/Array.h"
+#include "array/Metadata.h"
+#include "array/TupleArray.h"
+
+namespace scidb
+{
+    class Query;
+    class MemArray;
+
+    /**
+     * Sends tuples to instances chosen by the caller.
+     *
+     * The local array has dimensions [dst=0:N-1,1,0, src=0:N-1,1,0, seq=0:*,chunkSize,0] where N
+     * is the number of instances. Chunks of row 'dst' go to instance 'dst' under psByRow; the
+     * 'src' dimension keeps the cells sent by different instances apart.
+     *
+     * Appends are single-threaded.
+     */
+    class TupleExchange
+    {
+      private:
+        struct Destination
+        {
+            Coordinate nextSeq;
+            std::vector< boost::shared_ptr<ChunkIterator> > chunkIterators;
+
+            Destination() : nextSeq(0) {}
+        };
+
+        boost::shared_ptr<Query> _query;
+        size_t _nAttrs;
+        size_t _chunkSize;
+        boost::shared_ptr<MemArray> _array;
+        std::vector< boost::shared_ptr<ArrayIterator> > _arrayIterators;
+        std::vector<Destination> _destinations;
+        uint64_t _nTuples;
+
+      public:
+        /**
+         * @param name the name of the local array
+         * @param attributes the attributes of a tuple, without the empty tag
+         * @param chunkSize the number of tuples per chunk
+         * @param query the query context
+         */
+        TupleExchange(std::string const& name,
+                      Attributes const& attributes,
+                      size_t chunkSize,
+                      boost::shared_ptr<Query> const& query);
+
+        /**
+         * Append a tuple to the tuples sent to an instance.
+         * @param dst the logical id of the destination instance
+         * @param tuple as many values as there are attributes
+         */
+        void append(InstanceID dst, std::vector<Value> const& tuple);
+
+        /**
+         * @return the number of tuples appended so far
+         */
+        uint64_t getTupleCount() const
+        {
+            return _nTuples;
+        }
+
+        /**
+         * Send the appended tuples to their destinations. All instances of the query must call
+         * it, in the same order with respect to other redistributions.
+         * @return the tuples sent to this instance by all instances
+         */
+        boost::shared_ptr<Array> exchange();
+
+        /**
+         * How a key value is hashed and compared: byte-wise, or as a floating-point number, so that
+         * -0.0 equals 0.0 and all NaNs are equal whatever their payload.
+         */
+        enum KeyKind
+        {
+            KEY_BYTES,
+            KEY_FLOAT,
+            KEY_DOUBLE
+        };
+
+        typedef std::vector<KeyKind> KeyKinds;
+
+        /**
+         * @return the kinds of the first n attributes, the keys of a tuple
+         */
+        static KeyKinds getKeyKinds(Attributes const& attributes, size_t n);
+
+        /**
+         * Hash the first values of a tuple, its keys.
+         * @param tuple the values
+         * @param keys the kinds of the keys, one per value to hash
+         * @param seed the seed of the hash; different seeds give independent hashes
+         */
+        static uint64_t hashTuple(std::vector<Value> const& tuple, KeyKinds const& keys, uint32_t seed);
+
+        /**
+         * @return true if the keys of the tuples are equal; equal keys have equal hashes
+         */
+        static bool equalTuples(std::vector<Value> const& left, std::vector<Value> const& right,
+                                KeyKinds const& keys);
+    };
+
+    /**
+     * Sequential reader of the tuples stored in the non-empty cells of an array, e.g. one
+     * returned by TupleExchange::exchange(). The empty tag is not part of the tuple.
+     */
+    class TupleReader
+    {
+      private:
+        size_t _nAttrs;
+        std::vector< boost::shared_ptr<ConstArrayIterator> > _arrayIterators;
+        std::vector< boost::shared_ptr<ConstChunkIterator> > _chunkIterators;
+        std::vector<Value> _tuple;
+        bool _end;
+
+        void fetch();
+
+      public:
+        explicit TupleReader(boost::shared_ptr<Array> const& array);
+
+        bool end() const
+        {
+            return _end;
+        }
+
+        /**
+         * @return the current tuple; valid until the reader is moved
+         */
+        std::vector<Value> const& getTuple() const
+        {
+            assert(!_end);
+            return _tuple;
+        }
+
+        void operator ++();
+    };
+
+    /**
+     * Writes the tuples produced by this instance as the cells [instance_id, 0], [instance_id, 1],
+     * ... of a local array with dimensions [instance_id=0:N-1,1,0, value_no=0:*,chunkSize,0], the
+     * output layout of operators whose results have no meaningful coordinates.
+     */
+    class TupleWriter
+    {
+      private:
+        boost::shared_ptr<Query> _query;
+        boost::shared_ptr<MemArray> _array;
+        size_t _nAttrs;
+        size_t _chunkSize;
+        Coordinates _position;
+        std::vector< boost::shared_ptr<ArrayIterator> > _arrayIterators;
+        std::vector< boost::shared_ptr<ChunkIterator> > _chunkIterators;
+
+      public:
+        /**
+         * @param schema the schema of the output; its second dimension gives the chunk size
+         * @param query the query context
+         */
+        TupleWriter(ArrayDesc const& schema, boost::shared_ptr<Query> const& query);
+
+        /**
+         * Write a tuple to the next cell.
+         * @param tuple as many values as there are attributes, without the empty tag
+         */
+        void write(std::vector<Value> const& tuple);
+
+        /**
+         * @return the number of tuples written so far
+         */
+        Coordinate getTupleCount() const
+        {
+            return _position[1];
+        }
+
+        /**
+         * @return the written array; no tuples may be written afterwards
+         */
+        boost::shared_ptr<Array> finish();
+    };
+
+    /**
+     * Splits the key space of a TupleComparator into one range per instance, with about as many
+     * tuples in each. Every instance sends regularly spaced samples of its tuples to all instances,
+     * weighted by the number of tuples each one stands for; all instances then pick the same N-1
+     * splitters, the weighted quantiles of the samples. The samples are best taken from sorted
+     * tuples, but any order that does not follow a period of the sampling will do.
+     */
+    class RangePartitioner
+    {
+      private:
+        boost::shared_ptr<TupleComparator> _tcomp;
+        std::vector< boost::shared_ptr<Tuple> > _splitters;   // the largest tuple of every range but the last
+
+      public:
+        /**
+         * Exchange the samples and pick the splitters. All instances of the query must call it.
+         * @param tuples the local tuples, e.g. a sorted array or one returned by TupleExchange::exchange()
+         * @param tcomp the order of the tuples
+         * @param samplesPerInstance the number of samples an instance contributes
+         * @param query the query context
+         */
+        RangePartitioner(boost::shared_ptr<Array> const& tuples,
+                         boost::shared_ptr<TupleComparator> const& tcomp,
+                         size_t samplesPerInstance,
+                         boost::shared_ptr<Query> const& query);
+
+        /**
+         * @return the logical id of the instance whose key range holds a tuple
+         */
+        InstanceID getRange(Tuple const& tuple) const;
+
+        /**
+         * Exchange the number of tuples of every key range. All instances of the query must call it.
+         * @param count the number of tuples of the key range of this instance
+         * @return the number of tuples of the key ranges of the instances before this one
+         */
+        static uint64_t getRangeStart(uint64_t count, boost::shared_ptr<Query> const& query);
+    };
+
+    /**
+     * Flush the current chunks of the attributes of an array, if any, and start new chunks at a
+     * position. The empty bitmap is written along with the first attribute, so the chunks of the
+     * other attributes are written without checking it.
+     * @param arrayIters the iterators of the attributes, without the empty tag
+     * @param chunkIters the chunk iterators of the attributes, replaced by those of the new chunks
+     * @param chunkPos the position of the new chunks
+     * @param query the query context
+     */
+    void newChunks(std::vector< boost::shared_ptr<ArrayIterator> > const& arrayIters,
+                   std::vector< boost::shared_ptr<ChunkIterator> >& chunkIters,
+                   Coordinates const& chunkPos,
+                   boost::shared_ptr<Query> const& query);
+
+    /**
+     * Flush and release the chunk iterators written by newChunks(), if any.
+     */
+    void flushChunks(std::vector< boost::shared_ptr<ChunkIterator> >& chunkIters);
+
+    /**
+     * @return the number of non-empty cells of an array whose chunks know their counts,
+     *         e.g. a MemArray returned by redistribute()
+     */
+    uint64_t getCellCount(boost::shared_ptr<Array> const& array);
+
+    /**
+     * @return the total size in bytes of the chunks of all the attributes of an array
+     */
+    uint64_t getChunksSize(boost::shared_ptr<Array> const& array);
+}
+
+#endif
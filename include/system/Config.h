@@ -132,7 +132,17 @@ enum
     CONFIG_REDIM_CHUNKSIZE,
     CONFIG_MAX_OPEN_FDS,
     CONFIG_PREALLOCATE_SHM,
-    CONFIG_INSTALL_ROOT
+    CONFIG_INSTALL_ROOT,
+    CONFIG_MEM_ARRAY_SPILL_PATHS,
+    CONFIG_MEM_ARRAY_SPILL_QUEUE,
+    CONFIG_MEM_ARRAY_PREFETCH,
+    CONFIG_MEM_ARRAY_COMPRESS_SPILL,
+    CONFIG_PREFETCH_BUDGET,
+    CONFIG_AGGREGATE_THREADS,
+    CONFIG_DISTRIBUTED_SORT,
+    CONFIG_QUANTILE_SKETCH_K,
+    CONFIG_APPROX_COUNT_DISTINCT_PRECISION,
+    CONFIG_INDEX_LOOKUP_CACHE
 };
 
 enum RepartAlgorithm
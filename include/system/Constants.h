@@ -66,6 +66,8 @@ const size_t EiB = 1024*PiB;                        ///< exbibyte
 
 const size_t MAX_NUM_DIMS_SUPPORTED         = 100;  ///< The maximum number of array dimensions supported.
 const size_t DEFAULT_MEM_THRESHOLD          = 1*KiB;
+const size_t DEFAULT_MEM_SPILL_QUEUE        = 64;    ///< MiB of swapped-out MemArray chunks waiting to be written
+const size_t DEFAULT_INDEX_LOOKUP_CACHE     = 256;   ///< MiB of index_lookup tables kept across queries
 const double DEFAULT_DENSE_CHUNK_THRESHOLD  = 1.0;
 const double DEFAULT_SPARSE_CHUNK_INIT_SIZE = 0.01;
 const int    DEFAULT_STRING_SIZE_ESTIMATION = 10;
@@ -34,6 +34,7 @@
 #include <assert.h>
 #include <boost/shared_ptr.hpp>
 #include <boost/scoped_array.hpp>
+#include <vector>
 
 
 
@@ -41,15 +42,36 @@ namespace scidb
 {
 
 /**
- * Map coordinates to offset within chunk
+ * Map coordinates to offset within chunk.
+ *
+ * The conversions run per cell in the chunk iterators, so the mapper picks the cheapest way to do them
+ * once, when it is initialized for a chunk:
+ * - 1-D chunks need neither multiplication nor division;
+ * - when every chunk interval is a power of two, positions are split with shifts and masks;
+ * - otherwise, for chunks of at most 2^32 logical cells, division by an interval is replaced with a
+ *   multiplication by its precomputed 64-bit reciprocal, and 2-D to 4-D chunks are unrolled.
+ * Larger chunks fall back to div/mod per dimension.
  */
 class CoordinatesMapper
 {
 protected:
+    /// Strategy of pos2coord and coord2pos, chosen by init()
+    enum Layout
+    {
+        LAYOUT_1D,
+        LAYOUT_POW2,
+        LAYOUT_RECIPROCAL,
+        LAYOUT_GENERIC
+    };
+
     size_t      _nDims;
     uint64_t    _logicalChunkSize;
     Coordinates _origin;
     Coordinates _chunkIntervals;
+    Coordinates _strides;               // _strides[i] is the product of the intervals after i
+    std::vector<uint64_t> _reciprocals; // ceil(2^64 / _chunkIntervals[i]), for LAYOUT_RECIPROCAL
+    std::vector<uint32_t> _shifts;      // log2(_chunkIntervals[i]), for LAYOUT_POW2
+    Layout      _layout;
 
     // Internal init function that is shared by the constructors.
     void init(Coordinates const& firstPosition, Coordinates const& lastPosition)
@@ -60,6 +82,7 @@ protected:
         _origin = firstPosition;
         _nDims = _origin.size();
         _chunkIntervals.resize(_nDims);
+        _strides.resize(_nDims);
         _logicalChunkSize = 1;
 
         for (size_t i = 0; i < _nDims; i++)
@@ -69,9 +92,148 @@ protected:
             _logicalChunkSize *= _chunkIntervals[i];
         }
 
+        bool pow2 = true;
+        bool unitInterval = false;
+        Coordinate stride = 1;
+        for (size_t i = _nDims; i-- > 0; )
+        {
+            _strides[i] = stride;
+            stride *= _chunkIntervals[i];
+            pow2 = pow2 && (_chunkIntervals[i] & (_chunkIntervals[i] - 1)) == 0;
+            unitInterval = unitInterval || _chunkIntervals[i] == 1;
+        }
+
+        _reciprocals.clear();
+        _shifts.clear();
+        if (_nDims == 1) {
+            _layout = LAYOUT_1D;
+        } else if (pow2) {
+            _layout = LAYOUT_POW2;
+            _shifts.resize(_nDims);
+            for (size_t i = 0; i < _nDims; i++) {
+                uint32_t shift = 0;
+                while ((Coordinate(1) << shift) < _chunkIntervals[i]) {
+                    ++shift;
+                }
+                _shifts[i] = shift;
+            }
+        } else if (_logicalChunkSize <= (uint64_t(1) << 32) && !unitInterval) {
+            // the reciprocal of 1 does not fit into 64 bits
+            _layout = LAYOUT_RECIPROCAL;
+            _reciprocals.resize(_nDims);
+            for (size_t i = 0; i < _nDims; i++) {
+                _reciprocals[i] = ~uint64_t(0) / uint64_t(_chunkIntervals[i]) + 1;
+            }
+        } else {
+            _layout = LAYOUT_GENERIC;
+        }
+
         assert(_origin.size()>0);
     }
 
+    /**
+     * Divide a position by the interval of a dimension without a division instruction.
+     * Exact for pos < 2^32 and 1 < interval <= 2^32 (D. Lemire et al., "Faster Remainder by
+     * Direct Computation", 2019). As pos has 32 bits, the high 64 bits of the 96-bit product of
+     * the reciprocal and pos come from two 32x32-bit products, without a 128-bit type.
+     * @param pos      the dividend
+     * @param i        the dimension
+     * @param[out] rem the remainder
+     * @return the quotient
+     */
+    position_t divideByInterval(position_t pos, size_t i, Coordinate& rem) const
+    {
+        assert(pos >= 0 && static_cast<uint64_t>(pos) < (uint64_t(1) << 32));
+        uint64_t const p = static_cast<uint64_t>(pos);
+        uint64_t const high = (_reciprocals[i] >> 32) * p;
+        uint64_t const low = (_reciprocals[i] & 0xFFFFFFFF) * p;
+        position_t q = static_cast<position_t>((high + (low >> 32)) >> 32);
+        rem = pos - q * _chunkIntervals[i];
+        assert(q == pos / _chunkIntervals[i]);
+        return q;
+    }
+
+    /// pos2coord for LAYOUT_RECIPROCAL, unrolled for NDIMS dimensions
+    template<size_t NDIMS>
+    void pos2coordReciprocal(position_t pos, Coordinates& coord) const
+    {
+        Coordinate rem;
+        for (size_t i = NDIMS; --i > 0; ) {
+            pos = divideByInterval(pos, i, rem);
+            coord[i] = _origin[i] + rem;
+        }
+        coord[0] = _origin[0] + pos;
+        assert(pos < _chunkIntervals[0]);
+    }
+
+    /// coord2pos for LAYOUT_RECIPROCAL and LAYOUT_GENERIC, unrolled for NDIMS dimensions
+    template<size_t NDIMS>
+    position_t coord2posStrided(Coordinates const& coord) const
+    {
+        position_t pos = coord[NDIMS-1] - _origin[NDIMS-1];
+        for (size_t i = 0; i < NDIMS-1; i++) {
+            pos += (coord[i] - _origin[i]) * _strides[i];
+        }
+        return pos;
+    }
+
+    /// pos2coord for chunks of more than one dimension
+    void pos2coordMultiDim(position_t pos, Coordinates& coord) const
+    {
+        if (_layout == LAYOUT_POW2) {
+            for (size_t i = _nDims; --i > 0; ) {
+                coord[i] = _origin[i] + (pos & (_chunkIntervals[i] - 1));
+                pos >>= _shifts[i];
+            }
+            coord[0] = _origin[0] + pos;
+            assert(pos < _chunkIntervals[0]);
+        } else if (_layout == LAYOUT_RECIPROCAL) {
+            if (_nDims == 2) {
+                pos2coordReciprocal<2>(pos, coord);
+            } else if (_nDims == 3) {
+                pos2coordReciprocal<3>(pos, coord);
+            } else if (_nDims == 4) {
+                pos2coordReciprocal<4>(pos, coord);
+            } else {
+                for (size_t i = _nDims; --i > 0; ) {
+                    Coordinate rem;
+                    pos = divideByInterval(pos, i, rem);
+                    coord[i] = _origin[i] + rem;
+                }
+                coord[0] = _origin[0] + pos;
+                assert(pos < _chunkIntervals[0]);
+            }
+        } else {
+            for (ssize_t i = static_cast<ssize_t>(_nDims); --i >= 0;) {
+                coord[i] = _origin[i] + (pos % _chunkIntervals[i]);
+                pos /= _chunkIntervals[i];
+            }
+            assert(pos == 0);
+        }
+    }
+
+    /// coord2pos for chunks of more than one dimension
+    position_t coord2posMultiDim(Coordinates const& coord) const
+    {
+        position_t pos = 0;
+        if (_layout == LAYOUT_POW2) {
+            for (size_t i = 0, n = _nDims; i < n; i++) {
+                pos = (pos << _shifts[i]) | (coord[i] - _origin[i]);
+            }
+        } else if (_nDims == 2) {
+            pos = coord2posStrided<2>(coord);
+        } else if (_nDims == 3) {
+            pos = coord2posStrided<3>(coord);
+        } else if (_nDims == 4) {
+            pos = coord2posStrided<4>(coord);
+        } else {
+            for (size_t i = 0, n = _nDims; i < n; i++) {
+                pos += (coord[i] - _origin[i]) * _strides[i];
+            }
+        }
+        return pos;
+    }
+
 public:
     /**
      * Constructor.
@@ -117,20 +279,16 @@ public:
         assert(_nDims>0);
         coord.resize(_nDims);
 
-        if (_nDims == 1) {
-            coord[0] = _origin[0] + pos;
-            assert(pos < _chunkIntervals[0]);
-        } else if (_nDims == 2) {
-            coord[1] = _origin[1] + (pos % _chunkIntervals[1]);
-            pos /= _chunkIntervals[1];
+        if (_layout == LAYOUT_1D) {
             coord[0] = _origin[0] + pos;
             assert(pos < _chunkIntervals[0]);
+        } else if (_nDims == 2 && _layout == LAYOUT_RECIPROCAL) {
+            pos2coordReciprocal<2>(pos, coord);
+        } else if (_nDims == 2 && _layout == LAYOUT_POW2) {
+            coord[1] = _origin[1] + (pos & (_chunkIntervals[1] - 1));
+            coord[0] = _origin[0] + (pos >> _shifts[1]);
         } else {
-            for (ssize_t i = static_cast<ssize_t>(_nDims); --i >= 0;) {
-                coord[i] = _origin[i] + (pos % _chunkIntervals[i]);
-                pos /= _chunkIntervals[i];
-            }
-            assert(pos == 0);
+            pos2coordMultiDim(pos, coord);
         }
     }
 
@@ -140,17 +298,13 @@ public:
         assert(coord.size() == _nDims);
         position_t pos(-1);
 
-        if (_nDims == 1) {
+        if (_layout == LAYOUT_1D) {
             pos = coord[0] - _origin[0];
             assert(pos < _chunkIntervals[0]);
         } else if (_nDims == 2) {
-            pos = (coord[0] - _origin[0])*_chunkIntervals[1] + (coord[1] - _origin[1]);
+            pos = coord2posStrided<2>(coord);
         } else {
-            pos = 0;
-            for (size_t i = 0, n = _nDims; i < n; i++) {
-                pos *= _chunkIntervals[i];
-                pos += coord[i] - _origin[i];
-            }
+            pos = coord2posMultiDim(coord);
         }
         assert(pos >= 0 && static_cast<uint64_t>(pos)<_logicalChunkSize);
         return pos;
@@ -156,10 +156,24 @@ public:
 /**
  * The class SpatialRanges is essentially a vector of SpatialRange objects,
  * with some additional capabilities.
+ *
+ * The find functions scan the ranges linearly, starting at a hint. With many ranges, buildIndex()
+ * bulk-loads a packed R-tree over them, which the find functions then descend instead of scanning.
  */
 class SpatialRanges
 {
 public:
+    /**
+     * Maximum number of children of an R-tree node.
+     */
+    static const size_t RTREE_FANOUT = 16;
+
+    /**
+     * The number of ranges from which buildIndex() builds an R-tree.
+     * With fewer ranges, the linear scan starting at the hint is as fast.
+     */
+    static const size_t RTREE_MIN_RANGES = 64;
+
     /**
      * Number of dimensions.
      */
@@ -174,7 +188,7 @@ public:
      * Every newly added SpatialRange object will have numDims dimensions.
      */
     SpatialRanges(size_t numDims)
-    : _numDims(numDims)
+    : _numDims(numDims), _numLeaves(0), _numIndexed(0)
     {}
 
     /**
@@ -208,6 +222,68 @@ public:
      * @param[inout] hint  the index to look first; will be changed to the index in _ranges (successful search), or -1.
      */
     bool findOneThatContains(SpatialRange const& queryRange, size_t& hint) const;
+
+    /**
+     * Bulk-load an R-tree over the ranges, if there are at least RTREE_MIN_RANGES of them.
+     * The tree is packed with the Sort-Tile-Recursive algorithm (Leutenegger et al. 1997): the ranges
+     * are sorted by the center of one dimension, cut into slabs, and every slab is sorted and cut by
+     * the next dimension, so that every leaf holds RTREE_FANOUT neighboring ranges; the levels above
+     * are packed the same way from the bounding boxes of the level below.
+     * @note the ranges are reordered, so that the ranges of a leaf are adjacent in _ranges;
+     *       the tree is ignored if ranges are added afterwards.
+     */
+    void buildIndex();
+
+    /**
+     * @return whether the find functions use an R-tree.
+     */
+    bool hasIndex() const
+    {
+        return !_nodes.empty() && _numIndexed == _ranges.size();
+    }
+
+private:
+    /**
+     * A node of the R-tree. The children of a leaf are _ranges[_begin, _end),
+     * those of an inner node are _nodes[_begin, _end).
+     */
+    struct RTreeNode
+    {
+        size_t _begin;
+        size_t _end;
+    };
+
+    /**
+     * The nodes of the R-tree, level by level from the leaves up; the root is the last one.
+     */
+    std::vector<RTreeNode> _nodes;
+
+    /**
+     * The bounding box of every node: _numDims low coordinates followed by _numDims high coordinates.
+     */
+    std::vector<Coordinate> _bounds;
+
+    /**
+     * The leaves are _nodes[0, _numLeaves).
+     */
+    size_t _numLeaves;
+
+    /**
+     * How many ranges the R-tree was built over.
+     */
+    size_t _numIndexed;
+
+    /**
+     * Search the subtree of a node for a range that contains, or intersects, the query box.
+     * @return the index in _ranges of the range found, or -1.
+     */
+    size_t searchIndex(size_t node, Coordinate const* queryLow, Coordinate const* queryHigh, bool containment) const;
+
+    /**
+     * Search the R-tree for a range that contains, or intersects, the query box.
+     * @return the index in _ranges of the range found, or -1.
+     */
+    size_t searchIndex(Coordinate const* queryLow, Coordinate const* queryHigh, bool containment) const;
 };
 
 }
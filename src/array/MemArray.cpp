@@ -30,6 +30,10 @@
  * @author others
  */
 
+#include <zlib.h>
+#include <algorithm>
+#include <boost/make_shared.hpp>
+#include <boost/scoped_array.hpp>
 #include <log4cxx/logger.h>
 #include <util/Platform.h>
 #include <util/FileIO.h>
@@ -42,6 +46,7 @@
 #include <system/Utils.h>
 #include <array/Tile.h>
 #include <array/TileIteratorAdaptors.h>
+#include <util/Hashing.h>
 
 namespace scidb
 {
@@ -55,19 +60,186 @@ namespace scidb
     // Logger for operator. static to prevent visibility of variable outside of file
     static log4cxx::LoggerPtr logger(log4cxx::Logger::getLogger("scidb.array.memarray"));
 
+    //
+    // Chunk directory
+    //
+
+    /**
+     * Orders chunks by their position.
+     */
+    struct ChunkPositionLess
+    {
+        MemChunkDirectory const& _dir;
+        ChunkPositionLess(MemChunkDirectory const& dir) : _dir(dir) {}
+
+        bool operator()(LruMemChunk const* left, LruMemChunk const* right) const
+        {
+            return _dir.precedes(left->getAddress().coords, right->getAddress().coords);
+        }
+
+        bool operator()(LruMemChunk const* left, Coordinates const& right) const
+        {
+            return _dir.precedes(left->getAddress().coords, right);
+        }
+
+        bool operator()(Coordinates const& left, LruMemChunk const* right) const
+        {
+            return _dir.precedes(left, right->getAddress().coords);
+        }
+    };
+
+    MemChunkDirectory::MemChunkDirectory(ArrayDesc const& desc)
+    : _table(64, AddressHash(this)),
+      _ordered(desc.getAttributes().size()),
+      _version(0),
+      _packed(false),
+      _keyOrdered(false)
+    {
+        Dimensions const& dims = desc.getDimensions();
+        size_t const nDims = dims.size();
+        _origin.resize(nDims);
+        _last.resize(nDims);
+        _interval.resize(nDims);
+        _shift.resize(nDims);
+        size_t bits = 0;
+        for (size_t i = nDims; i-- > 0; ) {
+            _origin[i] = dims[i].getStartMin();
+            _last[i] = dims[i].getEndMax();
+            _interval[i] = dims[i].getChunkInterval();
+            uint64_t nChunks = (uint64_t(_last[i]) - uint64_t(_origin[i])) / _interval[i] + 1;
+            size_t dimBits = 0;
+            while (dimBits < 64 && (uint64_t(1) << dimBits) < nChunks) {
+                ++dimBits;
+            }
+            _shift[i] = bits;
+            bits += dimBits;
+        }
+        _packed = _keyOrdered = (nDims != 0 && bits <= 64);
+    }
+
+    size_t MemChunkDirectory::AddressHash::operator()(Address const& addr) const
+    {
+        if (_dir->_packed) {
+            return fmix(_dir->pack(addr.coords) ^ (uint64_t(addr.attId) << 32 | addr.attId));
+        }
+        uint64_t h = fmix(uint64_t(addr.attId));
+        for (size_t i = 0, n = addr.coords.size(); i < n; ++i) {
+            h = h * 31 + fmix(uint64_t(addr.coords[i]));
+        }
+        return h;
+    }
+
+    bool MemChunkDirectory::precedes(Coordinates const& left, Coordinates const& right) const
+    {
+        assert(left.size() == right.size());
+        for (size_t i = 0, n = left.size(); i < n; ++i) {
+            if (left[i] != right[i]) {
+                return left[i] < right[i];
+            }
+        }
+        return false;
+    }
+
+    LruMemChunk* MemChunkDirectory::find(Address const& addr)
+    {
+        ChunkTable::iterator i = _table.find(addr);
+        return i == _table.end() ? NULL : &i->second;
+    }
+
+    LruMemChunk& MemChunkDirectory::get(Address const& addr)
+    {
+        size_t const nChunks = _table.size();
+        LruMemChunk& chunk = _table[addr];
+        if (_table.size() != nChunks) {
+            if (_keyOrdered) {
+                for (size_t i = 0, n = addr.coords.size(); i < n; ++i) {
+                    if (addr.coords[i] < _origin[i] || addr.coords[i] > _last[i]) {
+                        _keyOrdered = false;
+                        break;
+                    }
+                }
+            }
+            // the ordered index compares chunk addresses, which are otherwise only set
+            // once the caller initializes the chunk
+            chunk.addr = addr;
+            AttributeIndex& index = _ordered[addr.attId];
+            if (index._sorted && !index._chunks.empty() &&
+                !precedes(index._chunks.back()->getAddress().coords, addr.coords)) {
+                index._sorted = false;
+            }
+            index._chunks.push_back(&chunk);
+        }
+        return chunk;
+    }
+
+    void MemChunkDirectory::erase(Address const& addr)
+    {
+        ChunkTable::iterator i = _table.find(addr);
+        if (i == _table.end()) {
+            return;
+        }
+        LruMemChunk* chunk = &i->second;
+        OrderedChunks& chunks = _ordered[addr.attId]._chunks;
+        OrderedChunks::iterator pos;
+        if (_ordered[addr.attId]._sorted) {
+            pos = std::lower_bound(chunks.begin(), chunks.end(), addr.coords, ChunkPositionLess(*this));
+        } else {
+            pos = std::find(chunks.begin(), chunks.end(), chunk);
+        }
+        assert(pos != chunks.end() && *pos == chunk);
+        chunks.erase(pos);
+        ++_version;
+        _table.erase(i);
+    }
+
+    void MemChunkDirectory::sort(AttributeIndex& index)
+    {
+        OrderedChunks& chunks = index._chunks;
+        if (_keyOrdered) {
+            // sorting integer keys is much cheaper than comparing coordinate vectors
+            std::vector< std::pair<uint64_t, LruMemChunk*> > keys(chunks.size());
+            for (size_t i = 0, n = chunks.size(); i < n; ++i) {
+                keys[i] = std::make_pair(pack(chunks[i]->getAddress().coords), chunks[i]);
+            }
+            std::sort(keys.begin(), keys.end());
+            for (size_t i = 0, n = chunks.size(); i < n; ++i) {
+                chunks[i] = keys[i].second;
+            }
+        } else {
+            std::sort(chunks.begin(), chunks.end(), ChunkPositionLess(*this));
+        }
+        index._sorted = true;
+        ++_version;
+    }
+
+    MemChunkDirectory::OrderedChunks const& MemChunkDirectory::getOrdered(AttributeID attId)
+    {
+        AttributeIndex& index = _ordered[attId];
+        if (!index._sorted) {
+            sort(index);
+        }
+        return index._chunks;
+    }
+
     //
     // MemArray
     //
 
     MemArray::MemArray(ArrayDesc const& arr, boost::shared_ptr<Query> const& query)
-    : desc(arr)
+    : desc(arr),
+      _nextStripe(0),
+      _spillsInFlight(0),
+      _chunks(desc)
     {
         _query=query;
         initLRU();
     }
 
     MemArray::MemArray(boost::shared_ptr<Array>& input, boost::shared_ptr<Query> const& query, bool vertical)
-    : desc(input->getArrayDesc())
+    : desc(input->getArrayDesc()),
+      _nextStripe(0),
+      _spillsInFlight(0),
+      _chunks(desc)
     {
         _query=query;
         initLRU();
@@ -123,7 +295,7 @@ namespace scidb
     Chunk& MemArray::operator[](Address const& addr)
     {
         ScopedMutexLock cs(_mutex);
-        LruMemChunk& chunk = _chunks[addr];
+        LruMemChunk& chunk = _chunks.get(addr);
         if (!chunk.isInitialized()) {
             AttributeDesc const* bitmapAttr = desc.getEmptyBitmapAttribute();
             Chunk* bitmapChunk = NULL;
@@ -153,6 +325,46 @@ namespace scidb
         return ((MemArray*)this)->getIterator(attId);
     }
 
+    /**
+     * Compress a chunk body on its way to a spill file. Spilling is on the critical
+     * path of sort and redimension, so the fastest zlib level is used.
+     * @return the compressed size, or size if the body does not shrink
+     */
+    static size_t compressSpilledBody(char* dst, char const* src, size_t size)
+    {
+        uLongf dstLen = size;
+        int rc = compress2((Bytef*)dst, &dstLen, (Bytef const*)src, size, Z_BEST_SPEED);
+        return (rc == Z_OK && dstLen < size) ? dstLen : size;
+    }
+
+    /**
+     * Read a spilled chunk body from a datastore, decompressing it if necessary.
+     * @param ds the datastore
+     * @param off location of the body in the datastore
+     * @param dst buffer of size bytes for the uncompressed body
+     * @param size uncompressed size of the body
+     * @param dsSize number of bytes the body occupies in the datastore
+     */
+    static void readSpilledBody(DataStore& ds, off_t off, char* dst, size_t size, size_t dsSize)
+    {
+        if (dsSize == size) {
+            ds.readData(off, dst, size);
+            return;
+        }
+        scoped_array<char> buf(new char[dsSize]);
+        ds.readData(off, buf.get(), dsSize);
+        uLongf dstLen = size;
+        int rc = uncompress((Bytef*)dst, &dstLen, (Bytef const*)buf.get(), dsSize);
+        if (rc != Z_OK || dstLen != size) {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_STORAGE, SCIDB_LE_CANT_DECOMPRESS_CHUNK);
+        }
+    }
+
+    /**
+     * The prefetch requests that may be queued at once, across all scans.
+     */
+    const size_t MAX_QUEUED_PREFETCHES = 64;
+
     /**
      * @brief SharedMemCache::SharedMemCache
      */
@@ -162,18 +374,261 @@ namespace scidb
         _usedMemThreshold(DEFAULT_MEM_THRESHOLD * MiB), /*<< must be rewritten after config load */
         _swapNum(0),
         _loadsNum(0),
-        _genCount(0)
+        _prefetchNum(0),
+        _genCount(0),
+        _spillPendingSize(0),
+        _spillPendingThreshold(0),
+        _prefetchPending(0),
+        _prefetchDepth(0),
+        _compressSpill(false),
+        _spillRunning(false),
+        _spillFailed(false)
+    {
+    }
+
+    SharedMemCache::~SharedMemCache()
     {
+        stopSpilling();
     }
 
     /* Initialize the datastores used for the temporary disk storage needed
-       by mem arrays.
+       by mem arrays, and start one spill thread per directory.
      */
-    void SharedMemCache::initSharedMemCache(uint64_t memThreshold, const char* basePath)
+    void SharedMemCache::initSharedMemCache(uint64_t memThreshold,
+                                            std::vector<std::string> const& basePaths,
+                                            uint64_t spillQueueSize,
+                                            size_t prefetchDepth,
+                                            bool compress)
     {
+        SCIDB_ASSERT(!basePaths.empty());
         _usedMemThreshold = memThreshold;
-        _datastores.initDataStores(basePath);
-        _datastores.clearAllDataStores();
+        _spillPendingThreshold = spillQueueSize;
+        _prefetchDepth = prefetchDepth;
+        _compressSpill = compress;
+        for (size_t i = 0; i < basePaths.size(); ++i)
+        {
+            shared_ptr<DataStores> datastores(new DataStores());
+            datastores->initDataStores(basePaths[i].c_str());
+            datastores->clearAllDataStores();
+            _datastores.push_back(datastores);
+        }
+
+        if (spillQueueSize == 0 && prefetchDepth == 0) {
+            return;
+        }
+        _spillJobQueue = make_shared<JobQueue>();
+        _spillThreadPool = make_shared<ThreadPool>(basePaths.size(), _spillJobQueue);
+        _spillThreadPool->start();
+        {
+            ScopedMutexLock cs(_mutex);
+            _spillRunning = true;
+        }
+        for (size_t i = 0; i < basePaths.size(); ++i)
+        {
+            shared_ptr<SpillJob> job = make_shared<SpillJob>(this);
+            _spillJobs.push_back(job);
+            _spillJobQueue->pushJob(job);
+        }
+        LOG4CXX_DEBUG(logger, "SharedMemCache: " << basePaths.size() << " spill threads, spill queue of "
+                      << spillQueueSize << " bytes, prefetch depth " << prefetchDepth
+                      << (compress ? ", compressed" : ", uncompressed"));
+    }
+
+    void SharedMemCache::stopSpilling()
+    {
+        {
+            ScopedMutexLock cs(_mutex);
+            if (!_spillRunning) {
+                return;
+            }
+            _spillRunning = false;
+            _spillQueued.signal();
+        }
+        for (size_t i = 0; i < _spillJobs.size(); ++i)
+        {
+            if (!_spillJobs[i]->wait()) {
+                LOG4CXX_ERROR(logger, "SharedMemCache: error on stopping spill thread");
+            }
+        }
+        _spillJobs.clear();
+    }
+
+    /* Main loop of a spill thread: do the I/O of queued requests outside of the cache mutex.
+       The thread exits when the cache is shut down and the queue is drained.
+     */
+    void SharedMemCache::SpillJob::run()
+    {
+        while (true)
+        {
+            shared_ptr<SpillRequest> request = _cache->nextRequest();
+            if (!request) {
+                return;
+            }
+            try {
+                _cache->processRequest(*request);
+            } catch (std::exception const& e) {
+                LOG4CXX_ERROR(logger, "SharedMemCache: background "
+                              << (request->_kind == SpillRequest::WRITE ? "write" : "read")
+                              << " of a chunk failed: " << e.what());
+                request->_failed = true;
+            }
+            ScopedMutexLock cs(_cache->_mutex);
+            _cache->completeRequest(*request);
+        }
+    }
+
+    shared_ptr<SpillRequest> SharedMemCache::nextRequest()
+    {
+        ScopedMutexLock cs(_mutex);
+        Event::ErrorChecker noopEc;
+        while (_spillRunning && _spillQueue.empty()) {
+            _spillQueued.wait(_mutex, noopEc);
+        }
+        if (_spillQueue.empty()) {
+            return shared_ptr<SpillRequest>();
+        }
+        shared_ptr<SpillRequest> request = _spillQueue.front();
+        _spillQueue.pop_front();
+        request->_inFlight = true;
+        ++request->_array->_spillsInFlight;
+        if (request->_kind == SpillRequest::WRITE) {
+            // the request now owns the previous location of the body, if any
+            LruMemChunk& chunk = *request->_chunk;
+            request->_dsOffset = chunk._dsOffset;
+            request->_dsAlloc = chunk._dsAlloc;
+            chunk._dsOffset = -1;
+            chunk._dsAlloc = 0;
+        }
+        return request;
+    }
+
+    void SharedMemCache::processRequest(SpillRequest& request)
+    {
+        DataStore& ds = *request._datastore;
+        if (request._kind == SpillRequest::PREFETCH) {
+            request._data.reset(new char[request._size]);
+            readSpilledBody(ds, request._dsOffset, request._data.get(), request._size, request._dsSize);
+            return;
+        }
+
+        char const* body = request._data.get();
+        size_t dsSize = request._size;
+        scoped_array<char> compressed;
+        if (_compressSpill) {
+            compressed.reset(new char[request._size]);
+            dsSize = compressSpilledBody(compressed.get(), body, request._size);
+            if (dsSize < request._size) {
+                body = compressed.get();
+            }
+        }
+        if (request._dsOffset < 0 || (request._dsAlloc - ds.getOverhead() < dsSize)) {
+            if (request._dsOffset >= 0) {
+                LOG4CXX_TRACE(logger, "SharedMemCache::processRequest : freeing chunk at offset " <<
+                              request._dsOffset);
+                ds.freeChunk(request._dsOffset, request._dsAlloc);
+                request._dsOffset = -1;
+            }
+            request._dsOffset = ds.allocateSpace(dsSize, request._dsAlloc);
+        }
+        ds.writeData(request._dsOffset, body, dsSize, request._dsAlloc);
+        request._dsSize = dsSize;
+    }
+
+    void SharedMemCache::completeRequest(SpillRequest& request)
+    {
+        // this function must be called under _mutex lock
+        SCIDB_ASSERT(request._inFlight);
+        LruMemChunk& chunk = *request._chunk;
+        request._inFlight = false;
+        --request._array->_spillsInFlight;
+
+        if (request._kind == SpillRequest::WRITE) {
+            _spillPendingSize -= request._size;
+            if (request._cancelled) {
+                // the chunk is being deleted, give the space back
+                if (request._dsOffset >= 0) {
+                    try {
+                        request._datastore->freeChunk(request._dsOffset, request._dsAlloc);
+                    } catch (std::exception const& e) {
+                        LOG4CXX_ERROR(logger, "SharedMemCache: failed to free spilled chunk: " << e.what());
+                    }
+                }
+            } else if (request._failed) {
+                // keep the body in memory; later swap outs are done synchronously and report the error
+                chunk._dsOffset = request._dsOffset;
+                chunk._dsAlloc = request._dsAlloc;
+                chunk.data = request._data;
+                _usedMemSize += chunk.size;
+                if (chunk._accessCount == 0) {
+                    chunk._sizeAtLastUnPin = chunk.size;
+                    chunk.pushToLru();
+                }
+                _spillFailed = true;
+            } else {
+                chunk._dsOffset = request._dsOffset;
+                chunk._dsAlloc = request._dsAlloc;
+                chunk._dsSize = request._dsSize;
+                chunk._dsStripe = request._stripe;
+                ++_swapNum;
+            }
+        } else {
+            --_prefetchPending;
+            // a chunk pinned in the meantime waits for this request, so take the body regardless of the threshold
+            if (!request._cancelled && !request._failed && chunk.getData() == NULL &&
+                (chunk._accessCount > 0 || _usedMemSize + chunk.size <= _usedMemThreshold)) {
+                chunk.data = request._data;
+                _usedMemSize += chunk.size;
+                ++_loadsNum;
+                ++_prefetchNum;
+                if (chunk._accessCount == 0) {
+                    chunk._sizeAtLastUnPin = chunk.size;
+                    chunk.pushToLru();
+                }
+            }
+        }
+        if (chunk._spillRequest.get() == &request) {
+            chunk._spillRequest.reset();
+        }
+        request._data.reset();
+        _spillDone.signal();
+    }
+
+    void SharedMemCache::cancelRequest(shared_ptr<SpillRequest> request)
+    {
+        // this function must be called under _mutex lock
+        SCIDB_ASSERT(!request->_inFlight);
+        deque< shared_ptr<SpillRequest> >::iterator i = find(_spillQueue.begin(), _spillQueue.end(), request);
+        if (i != _spillQueue.end()) {
+            _spillQueue.erase(i);
+        }
+        if (request->_kind == SpillRequest::WRITE) {
+            _spillPendingSize -= request->_size;
+        } else {
+            --_prefetchPending;
+        }
+        request->_cancelled = true;
+        request->_data.reset();
+        request->_chunk->_spillRequest.reset();
+    }
+
+    void SharedMemCache::waitSpillDone()
+    {
+        // this function must be called under _mutex lock
+        Event::ErrorChecker noopEc;
+        _spillDone.wait(_mutex, noopEc);
+    }
+
+    shared_ptr<DataStore> const& SharedMemCache::getDataStore(MemArray& array, size_t stripe)
+    {
+        // this function must be called under _mutex lock
+        SCIDB_ASSERT(stripe < _datastores.size());
+        if (array._datastores.size() <= stripe) {
+            array._datastores.resize(_datastores.size());
+        }
+        if (!array._datastores[stripe]) {
+            array._datastores[stripe] = _datastores[stripe]->getDataStore(_genCount++);
+        }
+        return array._datastores[stripe];
     }
 
     /*
@@ -183,6 +638,8 @@ namespace scidb
      *  Invariant: if a chunk is on the LRU, its size equals _sizeAtLastUnPin.
      *  If a chunk is pinned, it could be accessed, or modified. We know nothing about its real "size". We only know "_sizeAtLastUnPin".
      *  _usedMemSize is the sum of the sizes of all the pinned chunks AND all the chunks on the LRU.
+     *  A chunk whose body is queued for writing has no data and is not on the LRU; its size is
+     *  accounted in _spillPendingSize until the write completes or the chunk is pinned again.
      * -AP 1/30/13
      */
 
@@ -191,28 +648,55 @@ namespace scidb
         ScopedMutexLock cs(_mutex);
         if (chunk._accessCount++ == 0) {
             chunk._sizeAtLastUnPin = chunk.size;  //mostly redundant. just in case someone is doing something clever
+            if (chunk.getData() == NULL && chunk._spillRequest) {
+                reclaimChunk(chunk);
+            }
             if (chunk.getData() == NULL) {
                 if (_usedMemSize > _usedMemThreshold) {
                     swapOut();
                 }
                 if (chunk.size != 0) {
-                    assert(chunk._dsOffset >= 0);
-                    chunk.data.reset(new char[chunk.size]);
-                    if (!chunk.getData())
-                        throw SYSTEM_EXCEPTION(SCIDB_SE_NO_MEMORY, SCIDB_LE_CANT_ALLOCATE_MEMORY);
-                    const MemArray* array = (const MemArray*)chunk.array;
-                    assert(array->_datastore);
-                    array->_datastore->readData(chunk._dsOffset, chunk.getData(), chunk.size);
-                    ++_loadsNum;
-                    _usedMemSize += chunk.size;
+                    loadChunk(chunk);
                 }
-            } else {
-                assert(!chunk.isEmpty());
+            } else if (!chunk.isEmpty()) {
                 chunk.removeFromLru();
             }
         }
     }
 
+    void SharedMemCache::reclaimChunk(LruMemChunk& chunk)
+    {
+        // this function must be called under _mutex lock
+        shared_ptr<SpillRequest> request = chunk._spillRequest;
+        if (request->_inFlight) {
+            // completeRequest() settles the chunk
+            while (chunk._spillRequest == request) {
+                waitSpillDone();
+            }
+            return;
+        }
+        if (request->_kind == SpillRequest::WRITE) {
+            // the body has not left memory yet
+            chunk.data = request->_data;
+            _usedMemSize += chunk.size;
+        }
+        cancelRequest(request);
+    }
+
+    void SharedMemCache::loadChunk(LruMemChunk& chunk)
+    {
+        // this function must be called under _mutex lock
+        assert(chunk._dsOffset >= 0);
+        chunk.data.reset(new char[chunk.size]);
+        if (!chunk.getData())
+            throw SYSTEM_EXCEPTION(SCIDB_SE_NO_MEMORY, SCIDB_LE_CANT_ALLOCATE_MEMORY);
+        MemArray* array = (MemArray*)chunk.array;
+        shared_ptr<DataStore> const& ds = getDataStore(*array, chunk._dsStripe);
+        readSpilledBody(*ds, chunk._dsOffset, (char*)chunk.getData(), chunk.size, chunk._dsSize);
+        ++_loadsNum;
+        _usedMemSize += chunk.size;
+    }
+
     void SharedMemCache::unpinChunk(LruMemChunk &chunk)
     {
         ScopedMutexLock cs(_mutex);
@@ -252,42 +736,121 @@ namespace scidb
             assert(victim->_accessCount == 0);
             assert(victim->getData() != NULL);
             assert(!victim->isEmpty());
+            assert(!victim->_spillRequest);
             victim->prune();
             _usedMemSize -= victim->size; //victim is not pinned, so the size is correct
-            MemArray* array = (MemArray*)victim->array;
-            if (!array->_datastore) {
-                array->_datastore = _datastores.getDataStore(_genCount++);
-            }
-            size_t overhead = array->_datastore->getOverhead();
-            if (victim->_dsOffset < 0 || (victim->_dsAlloc - overhead < victim->size)) {
-                if (victim->_dsOffset >= 0)
-                {
-                    LOG4CXX_TRACE(logger, "SharedMemCache::swapOut : freeing chunk at offset " << 
-                                  victim->_dsOffset);
-                    array->_datastore->freeChunk(victim->_dsOffset, victim->_dsAlloc);
-                }
-                victim->_dsOffset = array->_datastore->allocateSpace(victim->size, victim->_dsAlloc);
+            spillChunk(*victim);
+        }
+        SCIDB_ASSERT(sizeCoherent());
+    }
+
+    void SharedMemCache::spillChunk(LruMemChunk& victim)
+    {
+        // this function must be called under _mutex lock
+        MemArray* array = (MemArray*)victim.array;
+        size_t stripe = victim._dsOffset >= 0 ? victim._dsStripe : array->_nextStripe++ % _datastores.size();
+        shared_ptr<SpillRequest> request = make_shared<SpillRequest>(SpillRequest::WRITE, &victim, array);
+        request->_datastore = getDataStore(*array, stripe);
+        request->_stripe = stripe;
+        request->_size = victim.size;
+        request->_data = victim.data;
+        victim.data.reset();
+
+        if (!_spillRunning || _spillPendingThreshold == 0 || _spillFailed) {
+            // write on the calling thread
+            request->_dsOffset = victim._dsOffset;
+            request->_dsAlloc = victim._dsAlloc;
+            try {
+                processRequest(*request);
+            } catch (...) {
+                victim.data = request->_data;
+                _usedMemSize += victim.size;
+                victim.pushToLru();
+                throw;
             }
-            array->_datastore->writeData(victim->_dsOffset, victim->getData(), victim->size, victim->_dsAlloc);
+            victim._dsOffset = request->_dsOffset;
+            victim._dsAlloc = request->_dsAlloc;
+            victim._dsSize = request->_dsSize;
+            victim._dsStripe = stripe;
+            _spillFailed = false;
             ++_swapNum;
-            victim->free();
+            return;
+        }
+
+        victim._spillRequest = request;
+        _spillQueue.push_back(request);
+        _spillPendingSize += request->_size;
+        _spillQueued.signal();
+        // bound the memory held by bodies that are waiting to be written
+        while (_spillRunning && _spillPendingSize > _spillPendingThreshold) {
+            waitSpillDone();
+        }
+    }
+
+    void SharedMemCache::prefetchChunks(MemArray& array,
+                                        MemChunkDirectory::OrderedChunks const& chunks,
+                                        size_t from)
+    {
+        ScopedMutexLock cs(_mutex);
+        if (!_spillRunning || _prefetchDepth == 0) {
+            return;
+        }
+        size_t n = 0;
+        for (size_t i = from; i < chunks.size() && n < _prefetchDepth; ++i, ++n)
+        {
+            LruMemChunk& chunk = *chunks[i];
+            if (chunk.getData() != NULL || chunk._spillRequest || chunk._accessCount != 0 ||
+                chunk.size == 0 || chunk._dsOffset < 0) {
+                continue;
+            }
+            if (_prefetchPending >= MAX_QUEUED_PREFETCHES || _usedMemSize + chunk.size > _usedMemThreshold) {
+                break;
+            }
+            shared_ptr<SpillRequest> request = make_shared<SpillRequest>(SpillRequest::PREFETCH, &chunk, &array);
+            request->_datastore = getDataStore(array, chunk._dsStripe);
+            request->_stripe = chunk._dsStripe;
+            request->_size = chunk.size;
+            request->_dsOffset = chunk._dsOffset;
+            request->_dsAlloc = chunk._dsAlloc;
+            request->_dsSize = chunk._dsSize;
+            chunk._spillRequest = request;
+            _spillQueue.push_back(request);
+            ++_prefetchPending;
+            _spillQueued.signal();
         }
-        SCIDB_ASSERT(sizeCoherent());
     }
 
     void SharedMemCache::deleteChunk(LruMemChunk &chunk)
     {
         ScopedMutexLock cs(_mutex);
         assert(chunk._accessCount == 0);
+        if (chunk._spillRequest) {
+            shared_ptr<SpillRequest> request = chunk._spillRequest;
+            if (request->_inFlight) {
+                request->_cancelled = true;
+                while (chunk._spillRequest == request) {
+                    waitSpillDone();
+                }
+            } else {
+                cancelRequest(request);
+            }
+        }
         chunk.removeFromLru();
     }
 
     void SharedMemCache::cleanupArray(MemArray &array)
     {
         ScopedMutexLock cs(_mutex);
-        for (map<Address, LruMemChunk>::iterator i = array._chunks.begin(); i != array._chunks.end(); i++)
+        for (MemChunkDirectory::iterator i = array._chunks.begin(); i != array._chunks.end(); i++)
         {
             LruMemChunk &chunk = i->second;
+            if (chunk._spillRequest) {
+                if (chunk._spillRequest->_inFlight) {
+                    chunk._spillRequest->_cancelled = true;
+                } else {
+                    cancelRequest(chunk._spillRequest);
+                }
+            }
             if (chunk.getData() != NULL) {
                 //chunk could be pinned or just on the LRU.
                 _usedMemSize -= chunk._sizeAtLastUnPin;
@@ -300,15 +863,22 @@ namespace scidb
                 chunk.removeFromLru();
             }
         }
+        // the spill threads must be done with the chunks and the datastores of the array
+        while (array._spillsInFlight > 0) {
+            waitSpillDone();
+        }
         SCIDB_ASSERT(sizeCoherent());
 
-        /* Remove the data store for this array from disk (it will be unlinked when the
+        /* Remove the data stores for this array from disk (they will be unlinked when the
            array itself is destroyed
          */
-        if (array._datastore)
+        for (size_t stripe = 0; stripe < array._datastores.size(); ++stripe)
         {
-            DataStore::Guid guid = array._datastore->getGuid();
-            _datastores.closeDataStore(guid, true /* and remove from disk */);
+            if (array._datastores[stripe])
+            {
+                DataStore::Guid guid = array._datastores[stripe]->getGuid();
+                _datastores[stripe]->closeDataStore(guid, true /* and remove from disk */);
+            }
         }
     }
 
@@ -352,8 +922,9 @@ namespace scidb
     {
         addr.attId = attId;
         currChunk = NULL;
-        last = _array._chunks.end();
         positioned = false;
+        _currIndex = 0;
+        _version = 0;
     }
 
     ConstChunk const& MemArrayIterator::getChunk()
@@ -373,8 +944,28 @@ namespace scidb
     void MemArrayIterator::operator ++()
     {
         position();
-        ++curr;
-        setCurrent();
+        if (!currChunk) {
+            return;
+        }
+        ScopedMutexLock cs(_array._mutex);
+        MemChunkDirectory::OrderedChunks const& chunks = _array._chunks.getOrdered(addr.attId);
+        if (_version == _array._chunks.getVersion()) {
+            ++_currIndex;
+        } else {
+            // chunks moved since the last step: find the successor of the current chunk
+            _currIndex = std::upper_bound(chunks.begin(), chunks.end(), currChunk->getFirstPosition(false),
+                                          ChunkPositionLess(_array._chunks)) - chunks.begin();
+            _version = _array._chunks.getVersion();
+        }
+        currChunk = _currIndex < chunks.size() ? chunks[_currIndex] : NULL;
+        if (currChunk) {
+            prefetch(chunks);
+        }
+    }
+
+    void MemArrayIterator::prefetch(MemChunkDirectory::OrderedChunks const& chunks)
+    {
+        SharedMemCache::getInstance().prefetchChunks(_array, chunks, _currIndex + 1);
     }
 
     Coordinates const& MemArrayIterator::getPosition()
@@ -391,28 +982,25 @@ namespace scidb
         currChunk = NULL;
         addr.coords = pos;
         _array.desc.getChunkPositionFor(addr.coords);
-        curr = _array._chunks.find(addr);
+        currChunk = _array._chunks.find(addr);
         positioned = true;
-        if (curr != last) {
-            currChunk = &_array._chunks[addr];
-            return true;
-        } else {
-            return false;
-        }
+        // the index of the chunk is looked up by the next step, if any
+        _version = ~uint64_t(0);
+        return currChunk != NULL;
     }
 
     void MemArrayIterator::setCurrent()
     {
-        currChunk = (curr != last && curr->second.addr.attId == addr.attId) ? &curr->second : NULL;
+        MemChunkDirectory::OrderedChunks const& chunks = _array._chunks.getOrdered(addr.attId);
+        _version = _array._chunks.getVersion();
+        currChunk = _currIndex < chunks.size() ? chunks[_currIndex] : NULL;
     }
 
     void MemArrayIterator::reset()
     {
+        ScopedMutexLock cs(_array._mutex);
         positioned = true;
-        curr = _array._chunks.begin();
-        while (curr != last && curr->second.addr.attId != addr.attId) {
-            ++curr;
-        }
+        _currIndex = 0;
         setCurrent();
     }
 
@@ -421,6 +1009,7 @@ namespace scidb
         LruMemChunk& chunk = (LruMemChunk&)aChunk;
         chunk._accessCount = 0;
         SharedMemCache::getInstance().deleteChunk(chunk);
+        ScopedMutexLock cs(_array._mutex);
         _array._chunks.erase(chunk.addr);
     }
 
@@ -421,6 +421,8 @@ namespace scidb
         _dsAlloc = 0;
         _accessCount = 0;
         _sizeAtLastUnPin = 0;
+        _dsSize = 0;
+        _dsStripe = 0;
     }
 
     LruMemChunk::~LruMemChunk()
@@ -0,0 +1,372 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.
+* Copyright (C) 2008-2014 SciDB, Inc.
+*
+* SciDB is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with SciDB.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+/*
+ *  NormalizedKeys.cpp
+ */
+
+#include <string.h>
+#include <algorithm>
+
+#include <array/NormalizedKeys.h>
+
+using namespace std;
+using namespace boost;
+
+namespace scidb {
+
+    namespace {
+
+        /**
+         * Write the low size bytes of a value in big-endian order.
+         */
+        inline void putBigEndian(uint64_t value, size_t size, uint8_t* dst)
+        {
+            for (size_t i = size; i != 0; --i)
+            {
+                dst[i - 1] = static_cast<uint8_t>(value);
+                value >>= 8;
+            }
+        }
+
+        inline int64_t getSigned(Value const& v, size_t size)
+        {
+            switch (size)
+            {
+            case 1: { int8_t x;  memcpy(&x, v.data(), 1); return x; }
+            case 2: { int16_t x; memcpy(&x, v.data(), 2); return x; }
+            case 4: { int32_t x; memcpy(&x, v.data(), 4); return x; }
+            default: { int64_t x; memcpy(&x, v.data(), 8); return x; }
+            }
+        }
+
+        inline uint64_t getUnsigned(Value const& v, size_t size)
+        {
+            switch (size)
+            {
+            case 1: { uint8_t x;  memcpy(&x, v.data(), 1); return x; }
+            case 2: { uint16_t x; memcpy(&x, v.data(), 2); return x; }
+            case 4: { uint32_t x; memcpy(&x, v.data(), 4); return x; }
+            default: { uint64_t x; memcpy(&x, v.data(), 8); return x; }
+            }
+        }
+
+        /**
+         * Entry of the comparison sort: the first bytes of the key of a row, as an integer.
+         */
+        struct PrefixEntry
+        {
+            uint64_t prefix;
+            size_t row;
+        };
+
+        class PrefixEntryLess
+        {
+        public:
+            PrefixEntryLess(uint8_t const* keys,
+                            size_t keySize,
+                            vector< shared_ptr<Tuple> > const& tuples,
+                            TupleComparator& tcomp,
+                            bool complete):
+                _keys(keys),
+                _keySize(keySize),
+                _tuples(tuples),
+                _tcomp(&tcomp),
+                _complete(complete)
+            {}
+
+            bool operator()(PrefixEntry const& e1, PrefixEntry const& e2) const
+            {
+                if (e1.prefix != e2.prefix)
+                {
+                    return e1.prefix < e2.prefix;
+                }
+                if (_keySize > sizeof(uint64_t))
+                {
+                    int res = memcmp(_keys + e1.row * _keySize + sizeof(uint64_t),
+                                     _keys + e2.row * _keySize + sizeof(uint64_t),
+                                     _keySize - sizeof(uint64_t));
+                    if (res != 0)
+                    {
+                        return res < 0;
+                    }
+                }
+                if (!_complete)
+                {
+                    int res = _tcomp->compare(*_tuples[e1.row], *_tuples[e2.row]);
+                    if (res != 0)
+                    {
+                        return res < 0;
+                    }
+                }
+                return e1.row < e2.row;
+            }
+
+        private:
+            uint8_t const* _keys;
+            size_t _keySize;
+            vector< shared_ptr<Tuple> > const& _tuples;
+            TupleComparator* _tcomp;
+            bool _complete;
+        };
+    }
+
+    NormalizedKeys::NormalizedKeys(vector<Key> const& keys, ArrayDesc const& desc) :
+        _keySize(0),
+        _complete(true)
+    {
+        Attributes const& attrs = desc.getAttributes();
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            TypeId const& type = attrs[keys[i].columnNo].getType();
+            Column c;
+            c.columnNo = keys[i].columnNo;
+            c.ascent = keys[i].ascent;
+            c.nanType = getDoubleFloatOther(type);
+            if (type == TID_INT8 || type == TID_INT16 || type == TID_INT32 || type == TID_INT64 ||
+                type == TID_CHAR || type == TID_DATETIME)
+            {
+                c.encoding = SIGNED;
+                c.size = TypeLibrary::getType(type).byteSize();
+            }
+            else if (type == TID_UINT8 || type == TID_UINT16 || type == TID_UINT32 || type == TID_UINT64)
+            {
+                c.encoding = UNSIGNED;
+                c.size = TypeLibrary::getType(type).byteSize();
+            }
+            else if (type == TID_DOUBLE || type == TID_FLOAT)
+            {
+                c.encoding = FLOATING;
+                c.size = TypeLibrary::getType(type).byteSize();
+            }
+            else if (type == TID_BOOL)
+            {
+                c.encoding = BOOLEAN;
+                c.size = 1;
+            }
+            else if (type == TID_STRING)
+            {
+                c.encoding = STRING;
+                c.size = STRING_PREFIX;
+            }
+            else
+            {
+                _complete = false;
+                break;
+            }
+            _columns.push_back(c);
+            _keySize += 1 + c.size;
+            if (c.encoding == STRING)
+            {
+                _complete = false;
+                break;
+            }
+        }
+    }
+
+    void NormalizedKeys::encode(Tuple const& tuple, uint8_t* key) const
+    {
+        for (size_t i = 0, n = _columns.size(); i < n; i++)
+        {
+            Column const& c = _columns[i];
+            Value const& v = tuple[c.columnNo];
+            uint8_t* const start = key;
+            NullNanRegular what = getNullNanRegular(v, c.nanType);
+            *key++ = static_cast<uint8_t>(what);
+            if (what != REGULAR_VALUE)
+            {
+                memset(key, 0, c.size);
+            }
+            else
+            {
+                switch (c.encoding)
+                {
+                case SIGNED:
+                {
+                    uint64_t const signBit = static_cast<uint64_t>(1) << (c.size * 8 - 1);
+                    putBigEndian(static_cast<uint64_t>(getSigned(v, c.size)) ^ signBit, c.size, key);
+                    break;
+                }
+                case UNSIGNED:
+                    putBigEndian(getUnsigned(v, c.size), c.size, key);
+                    break;
+                case FLOATING:
+                {
+                    uint64_t bits;
+                    if (c.size == sizeof(double))
+                    {
+                        double d = v.getDouble();
+                        if (d == 0)
+                        {
+                            d = 0;    // -0 and 0 are equal
+                        }
+                        memcpy(&bits, &d, sizeof(d));
+                    }
+                    else
+                    {
+                        float f = v.getFloat();
+                        if (f == 0)
+                        {
+                            f = 0;
+                        }
+                        uint32_t fbits;
+                        memcpy(&fbits, &f, sizeof(f));
+                        bits = fbits;
+                    }
+                    uint64_t const signBit = static_cast<uint64_t>(1) << (c.size * 8 - 1);
+                    bits = (bits & signBit) ? ~bits : bits ^ signBit;
+                    putBigEndian(bits, c.size, key);
+                    break;
+                }
+                case BOOLEAN:
+                    *key = v.getBool() ? 1 : 0;
+                    break;
+                case STRING:
+                {
+                    char const* s = v.getString();
+                    size_t len = strnlen(s, std::min<size_t>(c.size, v.size()));
+                    memcpy(key, s, len);
+                    memset(key + len, 0, c.size - len);
+                    break;
+                }
+                }
+            }
+            key += c.size;
+            if (!c.ascent)
+            {
+                for (uint8_t* b = start; b != key; ++b)
+                {
+                    *b = ~*b;
+                }
+            }
+        }
+    }
+
+    /**
+     * LSD radix sort of (key, row) records, one byte per pass from the last one. A pass is
+     * skipped when all the keys have the same byte, which is common for the high bytes of
+     * integers and for the null/NaN bytes.
+     */
+    void NormalizedKeys::radixSort(uint8_t const* keys, size_t nTuples, vector<size_t>& order) const
+    {
+        size_t const recordSize = _keySize + sizeof(size_t);
+        vector<uint8_t> records(nTuples * recordSize);
+        vector<uint8_t> scratch(nTuples * recordSize);
+        for (size_t row = 0; row < nTuples; row++)
+        {
+            uint8_t* record = &records[row * recordSize];
+            memcpy(record, keys + row * _keySize, _keySize);
+            memcpy(record + _keySize, &row, sizeof(size_t));
+        }
+
+        size_t counts[256];
+        for (size_t byte = _keySize; byte != 0; --byte)
+        {
+            size_t const b = byte - 1;
+            memset(counts, 0, sizeof(counts));
+            for (size_t row = 0; row < nTuples; row++)
+            {
+                counts[records[row * recordSize + b]]++;
+            }
+            if (counts[records[b]] == nTuples)
+            {
+                continue;
+            }
+            size_t offset = 0;
+            for (size_t i = 0; i < 256; i++)
+            {
+                size_t const count = counts[i];
+                counts[i] = offset;
+                offset += count;
+            }
+            for (size_t row = 0; row < nTuples; row++)
+            {
+                uint8_t const* record = &records[row * recordSize];
+                memcpy(&scratch[counts[record[b]]++ * recordSize], record, recordSize);
+            }
+            records.swap(scratch);
+        }
+
+        order.resize(nTuples);
+        for (size_t i = 0; i < nTuples; i++)
+        {
+            memcpy(&order[i], &records[i * recordSize + _keySize], sizeof(size_t));
+        }
+    }
+
+    void NormalizedKeys::comparisonSort(uint8_t const* keys,
+                                        vector< shared_ptr<Tuple> > const& tuples,
+                                        TupleComparator& tcomp,
+                                        vector<size_t>& order) const
+    {
+        size_t const nTuples = tuples.size();
+        size_t const prefixSize = std::min(_keySize, sizeof(uint64_t));
+        vector<PrefixEntry> entries(nTuples);
+        for (size_t row = 0; row < nTuples; row++)
+        {
+            uint8_t const* key = keys + row * _keySize;
+            uint64_t prefix = 0;
+            for (size_t i = 0; i < sizeof(uint64_t); i++)
+            {
+                prefix = (prefix << 8) | (i < prefixSize ? key[i] : 0);
+            }
+            entries[row].prefix = prefix;
+            entries[row].row = row;
+        }
+        std::sort(entries.begin(), entries.end(), PrefixEntryLess(keys, _keySize, tuples, tcomp, _complete));
+
+        order.resize(nTuples);
+        for (size_t i = 0; i < nTuples; i++)
+        {
+            order[i] = entries[i].row;
+        }
+    }
+
+    void NormalizedKeys::sort(vector< shared_ptr<Tuple> >& tuples, TupleComparator& tcomp) const
+    {
+        size_t const nTuples = tuples.size();
+        vector<uint8_t> keys(nTuples * _keySize);
+        for (size_t row = 0; row < nTuples; row++)
+        {
+            encode(*tuples[row], &keys[row * _keySize]);
+        }
+
+        vector<size_t> order;
+        if (_complete && nTuples >= RADIX_SORT_THRESHOLD)
+        {
+            radixSort(&keys[0], nTuples, order);
+        }
+        else
+        {
+            comparisonSort(&keys[0], tuples, tcomp, order);
+        }
+        keys.clear();
+
+        vector< shared_ptr<Tuple> > sorted(nTuples);
+        for (size_t i = 0; i < nTuples; i++)
+        {
+            sorted[i].swap(tuples[order[i]]);
+        }
+        tuples.swap(sorted);
+    }
+
+}  // namespace scidb
@@ -34,6 +34,8 @@
 #include "system/Config.h"
 #include "system/SciDBConfigOptions.h"
 #include "query/Operator.h"
+#include "util/Mutex.h"
+#include "util/Thread.h"
 
 namespace scidb
 {
@@ -42,6 +44,31 @@ namespace scidb
 
     static log4cxx::LoggerPtr logger(log4cxx::Logger::getLogger("scidb.qproc.processor"));
 
+    /**
+     * The consumer of an attribute is starved when it waits for a chunk more than
+     * 1/PREFETCH_STARVATION_RATIO of the time a job takes to produce one.
+     */
+    static const uint64_t PREFETCH_STARVATION_RATIO = 8;
+
+    /**
+     * A chunk is considered ready when the consumer waited for it less than
+     * 1/PREFETCH_READY_RATIO of the time a job took to produce it.
+     */
+    static const uint64_t PREFETCH_READY_RATIO = 64;
+
+    static Mutex prefetchBudgetMutex;
+    static size_t prefetchBudgetUsed = 0;
+
+    static size_t getPrefetchBudget()
+    {
+        Config* cfg = Config::getInstance();
+        int budget = cfg->getOption<int>(CONFIG_PREFETCH_BUDGET);
+        if (budget <= 0) {
+            budget = cfg->getOption<int>(CONFIG_PREFETCHED_CHUNKS) * std::max(cfg->getOption<int>(CONFIG_MAX_JOBS), 1);
+        }
+        return std::max(budget, 1);
+    }
+
     //
     // ParallelAccumulatorArray
     //
@@ -72,7 +99,8 @@ namespace scidb
       _arrayLink(array),
       _iterator(array->pipe->getConstIterator(attr)),
       _attrId(attr),
-      _resultChunk(NULL)
+      _resultChunk(NULL),
+      _productionTime(0)
     {
         assert(query);
     }
@@ -82,6 +110,7 @@ namespace scidb
         static int pass = 0; // DEBUG ONLY
         pass++;
         StatisticsScope sScope(_statistics);
+        uint64_t const startTime = getTimeInNanoSecs();
 
         _query = _queryLink.lock();
         if (!_query) {
@@ -134,6 +163,7 @@ namespace scidb
         } catch (Exception const& x) {
             _error = x.copy();
         }
+        _productionTime = getTimeInNanoSecs() - startTime;
     }
 
     ParallelAccumulatorArray::ParallelAccumulatorArray(const shared_ptr<Array>& array)
@@ -141,7 +171,10 @@ namespace scidb
       iterators(array->getArrayDesc().getAttributes().size()),
       pipe(array),
       activeJobs(iterators.size()),
-      completedJobs(iterators.size())
+      completedJobs(iterators.size()),
+      prefetch(iterators.size()),
+      maxDepth(1),
+      statistics(currentStatistics)
     {
         if (iterators.size() <= 0) {
             LOG4CXX_FATAL(logger, "Array descriptor arrId = " << array->getArrayDesc().getId()
@@ -160,13 +193,95 @@ namespace scidb
         for (size_t i = 0; i < nAttrs; i++) {
             iterators[i] = pipe->getConstIterator(i);
         }
-        int nPrefetchedChunks = Config::getInstance()->getOption<int>(CONFIG_PREFETCHED_CHUNKS);
-        do {
-            for (size_t i = 0; i < nAttrs; i++) {
-                shared_ptr<ChunkPrefetchJob> job = make_shared<ChunkPrefetchJob>(shared_from_this(), i, query);
-                doNewJob(job);
+        queryLink = query;
+
+        // Start with CONFIG_PREFETCHED_CHUNKS jobs spread over the attributes and let every
+        // attribute grow up to twice the number of execution threads.
+        size_t nPrefetchedChunks = std::max(Config::getInstance()->getOption<int>(CONFIG_PREFETCHED_CHUNKS), 1);
+        size_t nThreads = std::max(Config::getInstance()->getOption<int>(CONFIG_EXEC_THREADS), 1);
+        size_t depth = (nPrefetchedChunks + nAttrs - 1) / nAttrs;
+        maxDepth = std::max(depth, 2*nThreads);
+        for (size_t i = 0; i < nAttrs; i++) {
+            prefetch[i].depth = depth;
+            addJobs(i, query);
+        }
+        if (statistics->prefetchMaxDepth < depth) {
+            statistics->prefetchMaxDepth = depth;
+        }
+    }
+
+    size_t ParallelAccumulatorArray::acquireBudget(size_t n, bool force)
+    {
+        size_t const budget = getPrefetchBudget();
+        ScopedMutexLock cs(prefetchBudgetMutex);
+        if (!force) {
+            n = prefetchBudgetUsed < budget ? std::min(n, budget - prefetchBudgetUsed) : 0;
+        }
+        prefetchBudgetUsed += n;
+        return n;
+    }
+
+    void ParallelAccumulatorArray::releaseBudget(size_t n)
+    {
+        ScopedMutexLock cs(prefetchBudgetMutex);
+        assert(prefetchBudgetUsed >= n);
+        prefetchBudgetUsed -= n;
+    }
+
+    void ParallelAccumulatorArray::addJobs(AttributeID attId, const shared_ptr<Query>& query)
+    {
+        PrefetchState& state = prefetch[attId];
+        while (state.jobs < state.depth && !iterators[attId]->end()) {
+            // The first job of an attribute is always started, so that every query makes progress
+            if (acquireBudget(1, state.jobs == 0) == 0) {
+                LOG4CXX_DEBUG(logger, "ParallelAccumulatorArray: prefetch budget exhausted, depth of attribute "
+                              << attId << " limited to " << state.jobs);
+                state.depth = state.jobs;
+                break;
+            }
+            state.jobs += 1;
+            shared_ptr<ChunkPrefetchJob> job = make_shared<ChunkPrefetchJob>(shared_from_this(), attId, query);
+            doNewJob(job);
+        }
+    }
+
+    void ParallelAccumulatorArray::adaptDepth(AttributeID attId, uint64_t waitTime, uint64_t productionTime)
+    {
+        PrefetchState& state = prefetch[attId];
+        statistics->prefetchedChunks += 1;
+        statistics->prefetchWaitTime += waitTime / 1000;
+
+        state.waitTime = (state.waitTime*3 + waitTime) / 4;
+        state.productionTime = (state.productionTime*3 + productionTime) / 4;
+
+        // The first chunks are produced concurrently with the first request: the consumer always waits for them
+        if (++state.nChunks <= state.depth) {
+            return;
+        }
+        if (state.waitTime*PREFETCH_STARVATION_RATIO > state.productionTime) {
+            state.nReady = 0;
+            if (state.depth < maxDepth) {
+                state.depth += 1;
+                statistics->prefetchDepthIncreases += 1;
+                if (statistics->prefetchMaxDepth < state.depth) {
+                    statistics->prefetchMaxDepth = state.depth;
+                }
+                LOG4CXX_TRACE(logger, "ParallelAccumulatorArray: prefetch depth of attribute " << attId
+                              << " increased to " << state.depth << ", wait " << state.waitTime
+                              << "ns, production " << state.productionTime << "ns");
+            }
+        } else if (waitTime*PREFETCH_READY_RATIO <= productionTime) {
+            if (++state.nReady >= 2*state.depth && state.depth > 1) {
+                state.nReady = 0;
+                state.depth -= 1;
+                statistics->prefetchDepthDecreases += 1;
+                LOG4CXX_TRACE(logger, "ParallelAccumulatorArray: prefetch depth of attribute " << attId
+                              << " decreased to " << state.depth << ", wait " << state.waitTime
+                              << "ns, production " << state.productionTime << "ns");
             }
-        } while ((nPrefetchedChunks -= nAttrs) > 0);
+        } else {
+            state.nReady = 0;
+        }
     }
 
     ParallelAccumulatorArray::~ParallelAccumulatorArray()
@@ -178,9 +293,14 @@ namespace scidb
                 (*j)->skip();
             }
         }
+        size_t nJobs = 0;
+        for (size_t i = 0; i < prefetch.size(); i++) {
+            nJobs += prefetch[i].jobs;
+        }
+        releaseBudget(nJobs);
     }
 
-    void ParallelAccumulatorArray::doNewJob(shared_ptr<ChunkPrefetchJob>& job)
+    bool ParallelAccumulatorArray::doNewJob(shared_ptr<ChunkPrefetchJob>& job)
     {
         AttributeID attrId = job->getAttributeID();
         if (!iterators[attrId]->end()) {
@@ -188,23 +308,40 @@ namespace scidb
             PhysicalOperator::getGlobalQueueForOperators()->pushJob(job);
             activeJobs[attrId].push_back(job);
             ++(*iterators[attrId]);
+            return true;
         }
+        return false;
     }
 
 
     ConstChunk const* ParallelAccumulatorArray::nextChunk(AttributeID attId, MemChunk& chunk)
     {
         //XXX TODO: should this method be synchronized ?
+        PrefetchState& state = prefetch[attId];
         if (completedJobs[attId]) {
-            doNewJob(completedJobs[attId]);
+            // Reuse the job unless the attribute has more jobs than its depth
+            if (state.jobs > state.depth || !doNewJob(completedJobs[attId])) {
+                state.jobs -= 1;
+                releaseBudget(1);
+            }
             completedJobs[attId].reset();
         }
+        if (state.jobs < state.depth) {
+            shared_ptr<Query> query = queryLink.lock();
+            if (query) {
+                addJobs(attId, query);
+            }
+        }
         if (activeJobs[attId].empty()) {
             return NULL;
         }
         completedJobs[attId] = activeJobs[attId].front();
         activeJobs[attId].pop_front();
-        return completedJobs[attId]->getResult();
+
+        uint64_t const startTime = getTimeInNanoSecs();
+        ConstChunk const* result = completedJobs[attId]->getResult();
+        adaptDepth(attId, getTimeInNanoSecs() - startTime, completedJobs[attId]->getProductionTime());
+        return result;
     }
 
 }
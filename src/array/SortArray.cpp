@@ -27,6 +27,7 @@
  *  Based on implementation of operator sort
  */
 
+#include <algorithm>
 #include <vector>
 #include <list>
 
@@ -35,7 +36,8 @@
 #include <array/TupleArray.h>
 #include <array/MemArray.h>
 #include <system/Config.h>
-#include <array/MergeSortArray.h>
+#include <query/Operator.h>
+#include <query/TupleExchange.h>
 #include <util/Timing.h>
 #include <boost/scope_exit.hpp>
 
@@ -46,6 +48,25 @@ namespace scidb {
 
     log4cxx::LoggerPtr SortArray::logger(log4cxx::Logger::getLogger("scidb.array.SortArray"));
 
+    /**
+     * Bytes of the read buffers of a run file being merged: a block and its compressed form.
+     */
+    static const size_t MERGE_STREAM_BUFFER = 2 * SortRun::BLOCK_SIZE;
+
+    /**
+     * Write a sorted TupleArray to a run file.
+     */
+    static shared_ptr<SortRun> writeRun(TupleArray const& buffer, ArrayDesc const& desc)
+    {
+        SortRunWriter writer(desc);
+        vector< shared_ptr<Tuple> > const& tuples = buffer.getTuples();
+        for (size_t i = 0, n = tuples.size(); i < n; i++)
+        {
+            writer.append(*tuples[i]);
+        }
+        return writer.finish();
+    }
+
     /**
      * Helper class SortIterators
      */
@@ -114,8 +135,8 @@ namespace scidb {
 
     /**
      * Here we try to partition part of the array into manageable sized chunks
-     * and then sort them in-memory.  Each resulting sorted run is converted to
-     * a MemArray and pushed onto the result list.  If we run out of input, or
+     * and then sort them in-memory.  Each resulting sorted run is written to a
+     * run file and pushed onto the result list.  If we run out of input, or
      * we reach the limit on the size of the result list, we stop
      */
     void SortArray::SortJob::run()
@@ -149,15 +170,16 @@ namespace scidb {
             size_t currentSize = buffer->getNumberOfTuples() * _sorter._tupleSize;
             if (currentSize > _sorter._memLimit)
             {
-                shared_ptr<Array> baseBuffer =
-                    static_pointer_cast<TupleArray, Array> (buffer);
                 buffer->sort(_sorter._tupleComp);
-                buffer->truncate();
+                shared_ptr<SortRun> run = writeRun(*buffer, *(_sorter._outputSchema));
+                buffer.reset();
                 {
                     ScopedMutexLock sm(_sorter._sortLock);
-                    _sorter._results.push_back(shared_ptr<Array> (new MemArray(baseBuffer, getQuery())));
+                    _sorter._results.push_back(run);
                     _sorter._runsProduced++;
-                    LOG4CXX_DEBUG(logger, "[SortArray] Produced sorted run # " << _sorter._runsProduced);
+                    LOG4CXX_DEBUG(logger, "[SortArray] Produced sorted run # " << _sorter._runsProduced
+                                  << " of " << run->getNumberOfTuples() << " tuples in "
+                                  << run->getBlocks().size() << " block(s)");
                     if (_sorter._results.size() > _sorter._pipelineLimit)
                     {
                         limitReached = true;
@@ -173,13 +195,11 @@ namespace scidb {
         {
             if (buffer->getNumberOfTuples())
             {
-                shared_ptr<Array> baseBuffer =
-                    static_pointer_cast<TupleArray, Array> (buffer);
                 buffer->sort(_sorter._tupleComp);
                 buffer->truncate();
                 {
                     ScopedMutexLock sm(_sorter._sortLock);
-                    _sorter._results.push_back(shared_ptr<Array> (new MemArray(baseBuffer, getQuery())));
+                    _sorter._results.push_back(make_shared<SortRun>(buffer));
                     _sorter._runsProduced++;
                     LOG4CXX_DEBUG(logger, "[SortArray] Produced sorted run # " << _sorter._runsProduced);
                 }
@@ -206,14 +226,13 @@ namespace scidb {
     }
 
     /**
-     * Remove a group of arrays from the list, merge them using a MergeSortArray,
-     * then add the result back to the end of the list.
+     * Remove a group of runs from the list, merge them using a LoserTree into
+     * a new run file, then add the result back to the end of the list.
      */
     void SortArray::MergeJob::run()
     {
-        vector< shared_ptr<Array> > mergeStreams;
-        shared_ptr<Array> merged;
-        shared_ptr<Array> materialized;
+        vector< shared_ptr<SortRunReader> > mergeStreams;
+        shared_ptr<SortRun> materialized;
 
         // At the end of run(), we must always put the result (if it exists) on the end of the
         // list, mark ourselves on the stopped job list, and signal the main thread
@@ -235,30 +254,42 @@ namespace scidb {
         {
             ScopedMutexLock sm(_sorter._sortLock);
 
+            // while the input is being sorted, merges are forced by the pipeline limit
+            // and take as many runs as they can; afterwards they follow the plan.
+            // Other merge jobs scheduled in the same pass may have claimed the runs
+            // since, so the width is taken from the runs still in the list.
             size_t nSortedRuns = _sorter._results.size();
-            size_t currentStreams =
-                nSortedRuns < _sorter._nStreams ? nSortedRuns : _sorter._nStreams;
-            mergeStreams.resize(currentStreams);
+            bool inputComplete = std::find(_sorter._partitionComplete.begin(),
+                                           _sorter._partitionComplete.end(),
+                                           false) == _sorter._partitionComplete.end();
+            size_t currentStreams = inputComplete ? _sorter.getMergeWidth(nSortedRuns) :
+                std::min(nSortedRuns, _sorter._nStreams);
 
             LOG4CXX_DEBUG(logger, "[SortArray] Found " << currentStreams << " runs to merge");
 
+            // a single run is left in the list as it is, for a later merge
+            if (currentStreams < 2)
+            {
+                return;
+            }
+            mergeStreams.resize(currentStreams);
+
             for (size_t i = 0; i < currentStreams; i++)
             {
-                mergeStreams[i] = _sorter._results.front();
+                mergeStreams[i] = make_shared<SortRunReader>(_sorter._results.front(),
+                                                             *(_sorter._outputSchema));
                 _sorter._results.pop_front();
             }
         }
 
-        // merge the streams -- true means the array contains local data only
-        merged.reset(new MergeSortArray(getQuery(),
-                                        *(_sorter._outputSchema),
-                                        mergeStreams,
-                                        _sorter._tupleComp,
-                                        true));
-
-        // false means perform a horizontal copy (copy all attributes for chunk 1,
-        // all attributes for chunk 2,...)
-        materialized.reset(new MemArray(merged, getQuery(), false));
+        LoserTree tree(mergeStreams, *(_sorter._tupleComp));
+        SortRunWriter writer(*(_sorter._outputSchema));
+        for (; !tree.end(); tree.next())
+        {
+            writer.append(tree.getTuple());
+        }
+        mergeStreams.clear();
+        materialized = writer.finish();
     }
 
 
@@ -305,15 +336,76 @@ namespace scidb {
     }
 
 
+    size_t SortArray::getMergeWidth(size_t nRuns) const
+    {
+        if (nRuns <= _nStreams)
+        {
+            return nRuns;
+        }
+        // after merging the first width runs, the number of runs is a multiple of
+        // _nStreams - 1 plus one, so that all the later merges are full
+        size_t width = (nRuns - 1) % (_nStreams - 1) + 1;
+        return width > 1 ? width : _nStreams;
+    }
+
+    /**
+     * The final merge writes the output chunks directly, instead of a last run file.
+     * The first and the last chunk may be partial when start is not a chunk boundary.
+     */
+    shared_ptr<MemArray> SortArray::mergeToOutput(shared_ptr<Query> const& query, Coordinate start)
+    {
+        vector< shared_ptr<SortRunReader> > readers;
+        for (list< shared_ptr<SortRun> >::iterator i = _results.begin(); i != _results.end(); ++i)
+        {
+            readers.push_back(make_shared<SortRunReader>(*i, *_outputSchema));
+        }
+        LoserTree tree(readers, *_tupleComp);
+
+        shared_ptr<MemArray> output = make_shared<MemArray>(*_outputSchema, query);
+        size_t const nAttrs = _outputSchema->getAttributes(true).size();
+        Coordinate const chunkSize = _outputSchema->getDimensions()[0].getChunkInterval();
+        vector< shared_ptr<ArrayIterator> > arrayIters(nAttrs);
+        vector< shared_ptr<ChunkIterator> > chunkIters(nAttrs);
+        for (size_t i = 0; i < nAttrs; i++)
+        {
+            arrayIters[i] = output->getIterator(i);
+        }
+        Coordinates pos(1, start);
+        for (; !tree.end(); tree.next())
+        {
+            if (pos[0] % chunkSize == 0 || !chunkIters[0])
+            {
+                Coordinates chunkPos(pos);
+                _outputSchema->getChunkPositionFor(chunkPos);
+                newChunks(arrayIters, chunkIters, chunkPos, query);
+                for (size_t i = 0; i < nAttrs; i++)
+                {
+                    chunkIters[i]->setPosition(pos);
+                }
+            }
+            Tuple const& tuple = tree.getTuple();
+            for (size_t i = 0; i < nAttrs; i++)
+            {
+                chunkIters[i]->writeItem(tuple[i]);
+                ++(*chunkIters[i]);
+            }
+            pos[0] += 1;
+        }
+        flushChunks(chunkIters);
+        _results.clear();
+        return output;
+    }
+
     /***
-     * Sort works by first tansforming the input array into a series of sorted TupleArrays.
-     * Then the TupleArrays are linked under a single MergeSortArray which encodes the merge
-     * logic within its iterator classes.  To complete the sort, we materialize the merge
-     * Array.
+     * Sort works by first tansforming the input array into a series of sorted runs, which
+     * are written to run files (see SortRun).  The runs are merged with a LoserTree, as
+     * many at once as the memory limit allows, and the final merge writes the output array.
+     * A single run that fits in memory is returned as is.
      */
     shared_ptr<MemArray> SortArray::getSortedArray(boost::shared_ptr<Array> inputArray,
                                                    boost::shared_ptr<Query> query,
-                                                   boost::shared_ptr<TupleComparator> tcomp)
+                                                   boost::shared_ptr<TupleComparator> tcomp,
+                                                   Coordinate start)
     {
         // Timing for Sort
         LOG4CXX_DEBUG(logger, "[SortArray] Sort for array " << _outputSchema->getName() << " begins");
@@ -335,6 +427,7 @@ namespace scidb {
         {
             _nStreams = 2;
         }
+        _nStreams = std::min(_nStreams, std::max<size_t>(2, _memLimit / MERGE_STREAM_BUFFER));
         if (_pipelineLimit < _nStreams)
         {
             _pipelineLimit = _nStreams;
@@ -470,26 +563,25 @@ namespace scidb {
             _failedJob->rethrow();
         }
 
-        // If there were no failed jobs, we still may need one last merge
-        if (_results.size() > 1)
+        // If there were no failed jobs, we still need the final merge
+        shared_ptr<MemArray> ret;
+        if (_results.size() == 0)
         {
-            shared_ptr<Job> lastJob(new MergeJob(*this,
-                                                 query,
-                                                 0));
-            queue->pushJob(lastJob);
-            lastJob->wait();
+            ret = make_shared<MemArray>(*_outputSchema, query);
         }
-
-        timing.logTiming(logger, "[SortArray] merge sorted chunks complete");
-
-        // Return the result
-        if (_results.size() == 0)
+        else if (_results.size() == 1 && _results.front()->isInMemory() && start == 0)
         {
-            shared_ptr<Array> materialized(new MemArray(*_outputSchema, query));
-            _results.push_back(materialized);
+            shared_ptr<Array> baseBuffer =
+                static_pointer_cast<TupleArray, Array> (_results.front()->getTupleArray());
+            ret.reset(new MemArray(baseBuffer, query));
+            _results.clear();
+        }
+        else
+        {
+            ret = mergeToOutput(query, start);
         }
 
-        shared_ptr<MemArray> ret = dynamic_pointer_cast<MemArray, Array> (_results.front());
+        timing.logTiming(logger, "[SortArray] merge sorted chunks complete");
         return ret;
     }
 
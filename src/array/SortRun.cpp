@@ -0,0 +1,330 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.
+* Copyright (C) 2008-2014 SciDB, Inc.
+*
+* SciDB is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with SciDB.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+/*
+ *  SortRun.cpp
+ */
+
+#include <string.h>
+#include <zlib.h>
+
+#include <array/SortRun.h>
+#include <system/Exceptions.h>
+
+using namespace std;
+using namespace boost;
+
+namespace scidb {
+
+    namespace {
+
+        uint8_t const REGULAR_VALUE_FLAG = 0xFF;
+
+        /**
+         * The columns of the tuples that a run file stores - all but the empty tag - and their
+         * sizes, 0 if variable.
+         */
+        void getStoredColumns(ArrayDesc const& desc, vector<size_t>& columns, vector<size_t>& sizes)
+        {
+            Attributes const& attrs = desc.getAttributes();
+            for (size_t i = 0; i < attrs.size(); i++)
+            {
+                if (!attrs[i].isEmptyIndicator())
+                {
+                    columns.push_back(i);
+                    sizes.push_back(TypeLibrary::getType(attrs[i].getType()).byteSize());
+                }
+            }
+        }
+
+        inline void put(vector<char>& block, void const* data, size_t size)
+        {
+            char const* bytes = static_cast<char const*>(data);
+            block.insert(block.end(), bytes, bytes + size);
+        }
+    }
+
+    /**
+     * SortRun
+     */
+
+    SortRun::SortRun(shared_ptr<TupleArray> const& tuples) :
+        _tuples(tuples),
+        _nTuples(tuples->getNumberOfTuples())
+    {
+    }
+
+    SortRun::SortRun(File::FilePtr const& file, vector<Block> const& blocks, uint64_t nTuples) :
+        _file(file),
+        _blocks(blocks),
+        _nTuples(nTuples)
+    {
+    }
+
+    /**
+     * SortRunWriter
+     */
+
+    SortRunWriter::SortRunWriter(ArrayDesc const& desc) :
+        _fileSize(0),
+        _nTuples(0)
+    {
+        getStoredColumns(desc, _columns, _sizes);
+        _block.reserve(SortRun::BLOCK_SIZE + SortRun::BLOCK_SIZE / 8);
+        _file = FileManager::getInstance()->createTemporary("sort_run");
+    }
+
+    void SortRunWriter::append(Tuple const& tuple)
+    {
+        for (size_t i = 0; i < _columns.size(); i++)
+        {
+            Value const& v = tuple[_columns[i]];
+            if (v.isNull())
+            {
+                _block.push_back(static_cast<char>(v.getMissingReason()));
+                continue;
+            }
+            _block.push_back(static_cast<char>(REGULAR_VALUE_FLAG));
+            if (_sizes[i] == 0)
+            {
+                uint32_t const size = v.size();
+                put(_block, &size, sizeof(size));
+                put(_block, v.data(), size);
+            }
+            else
+            {
+                assert(v.size() == _sizes[i]);
+                put(_block, v.data(), _sizes[i]);
+            }
+        }
+        _nTuples++;
+        if (_block.size() >= SortRun::BLOCK_SIZE)
+        {
+            flushBlock();
+        }
+    }
+
+    /**
+     * Compress the rows of the block with the fastest zlib level, like the chunks that a MemArray
+     * spills, and append them to the file.
+     */
+    void SortRunWriter::flushBlock()
+    {
+        if (_block.empty())
+        {
+            return;
+        }
+        SortRun::Block block;
+        block.offset = _fileSize;
+        block.rawSize = _block.size();
+        _compressed.resize(_block.size());
+        uLongf dstLen = _block.size();
+        int rc = compress2((Bytef*)&_compressed[0], &dstLen, (Bytef const*)&_block[0], _block.size(), Z_BEST_SPEED);
+        if (rc == Z_OK && dstLen < _block.size())
+        {
+            block.storedSize = dstLen;
+            _file->writeAll(&_compressed[0], dstLen, _fileSize);
+        }
+        else
+        {
+            block.storedSize = block.rawSize;
+            _file->writeAll(&_block[0], _block.size(), _fileSize);
+        }
+        _fileSize += block.storedSize;
+        _blocks.push_back(block);
+        _block.clear();
+    }
+
+    shared_ptr<SortRun> SortRunWriter::finish()
+    {
+        flushBlock();
+        shared_ptr<SortRun> run(new SortRun(_file, _blocks, _nTuples));
+        _file.reset();
+        _blocks.clear();
+        return run;
+    }
+
+    /**
+     * SortRunReader
+     */
+
+    SortRunReader::SortRunReader(shared_ptr<SortRun> const& run, ArrayDesc const& desc) :
+        _run(run),
+        _tuples(run->isInMemory() ? &run->getTupleArray()->getTuples() : NULL),
+        _tupleNo(0),
+        _end(run->getNumberOfTuples() == 0),
+        _tuple(desc.getAttributes().size()),
+        _blockNo(0),
+        _blockPos(0)
+    {
+        if (_tuples != NULL || _end)
+        {
+            return;
+        }
+        Attributes const& attrs = desc.getAttributes();
+        getStoredColumns(desc, _columns, _sizes);
+        for (size_t i = 0; i < attrs.size(); i++)
+        {
+            _tuple[i] = Value(TypeLibrary::getType(attrs[i].getType()));
+            if (attrs[i].isEmptyIndicator())
+            {
+                _tuple[i].setBool(true);
+            }
+        }
+        readBlock();
+        readTuple();
+    }
+
+    /**
+     * Fetch the next block of the file with one read, decompressing it if necessary.
+     */
+    void SortRunReader::readBlock()
+    {
+        SortRun::Block const& block = _run->getBlocks()[_blockNo++];
+        _block.resize(block.rawSize);
+        if (block.storedSize == block.rawSize)
+        {
+            _run->getFile()->readAll(&_block[0], block.rawSize, block.offset);
+        }
+        else
+        {
+            _compressed.resize(block.storedSize);
+            _run->getFile()->readAll(&_compressed[0], block.storedSize, block.offset);
+            uLongf dstLen = block.rawSize;
+            int rc = uncompress((Bytef*)&_block[0], &dstLen, (Bytef const*)&_compressed[0], block.storedSize);
+            if (rc != Z_OK || dstLen != block.rawSize)
+            {
+                throw SYSTEM_EXCEPTION(SCIDB_SE_STORAGE, SCIDB_LE_CANT_DECOMPRESS_CHUNK);
+            }
+        }
+        _blockPos = 0;
+    }
+
+    void SortRunReader::readTuple()
+    {
+        if (_blockPos == _block.size())
+        {
+            readBlock();
+        }
+        char const* p = &_block[_blockPos];
+        for (size_t i = 0; i < _columns.size(); i++)
+        {
+            Value& v = _tuple[_columns[i]];
+            uint8_t const flag = *p++;
+            if (flag != REGULAR_VALUE_FLAG)
+            {
+                v.setNull(flag);
+                continue;
+            }
+            size_t size = _sizes[i];
+            if (size == 0)
+            {
+                uint32_t varSize;
+                memcpy(&varSize, p, sizeof(varSize));
+                p += sizeof(varSize);
+                size = varSize;
+            }
+            v.setData(p, size);
+            p += size;
+        }
+        _blockPos = p - &_block[0];
+    }
+
+    void SortRunReader::next()
+    {
+        if (++_tupleNo == _run->getNumberOfTuples())
+        {
+            _end = true;
+        }
+        else if (_tuples == NULL)
+        {
+            readTuple();
+        }
+    }
+
+    /**
+     * LoserTree
+     */
+
+    LoserTree::LoserTree(vector< shared_ptr<SortRunReader> > const& readers, TupleComparator& tcomp) :
+        _readers(readers),
+        _tcomp(tcomp),
+        _nodes(readers.size())
+    {
+        assert(!readers.empty());
+        _nodes[0] = play(1);
+    }
+
+    /**
+     * @return true if the current tuple of run1 comes first; an exhausted run never does
+     */
+    bool LoserTree::beats(size_t run1, size_t run2) const
+    {
+        if (_readers[run1]->end())
+        {
+            return false;
+        }
+        if (_readers[run2]->end())
+        {
+            return true;
+        }
+        int res = _tcomp.compare(_readers[run1]->getTuple(), _readers[run2]->getTuple());
+        return res < 0 || (res == 0 && run1 < run2);
+    }
+
+    /**
+     * Play the matches of the subtree of a node: internal nodes are 1..k-1, the leaves k..2k-1.
+     * @return the winner of the subtree
+     */
+    size_t LoserTree::play(size_t node)
+    {
+        size_t const k = _readers.size();
+        if (node >= k)
+        {
+            return node - k;
+        }
+        size_t const winner1 = play(2 * node);
+        size_t const winner2 = play(2 * node + 1);
+        if (beats(winner1, winner2))
+        {
+            _nodes[node] = winner2;
+            return winner1;
+        }
+        _nodes[node] = winner1;
+        return winner2;
+    }
+
+    void LoserTree::next()
+    {
+        size_t winner = _nodes[0];
+        _readers[winner]->next();
+        for (size_t node = (winner + _readers.size()) / 2; node != 0; node /= 2)
+        {
+            if (beats(_nodes[node], winner))
+            {
+                std::swap(_nodes[node], winner);
+            }
+        }
+        _nodes[0] = winner;
+    }
+
+}  // namespace scidb
@@ -31,6 +31,7 @@
 
 #include "util/iqsort.h"
 #include "array/TupleArray.h"
+#include "array/NormalizedKeys.h"
 #include "system/Exceptions.h"
 #include "query/Expression.h"
 #include "query/FunctionDescription.h"
@@ -101,7 +102,12 @@ TupleComparator::TupleComparator(vector<Key> const& keys, const ArrayDesc& array
 void TupleArray::sort(shared_ptr<TupleComparator> tcomp)
 {
     if (tuples.size() != 0) {
-        iqsort(&tuples[0], tuples.size(), *tcomp);
+        NormalizedKeys keys(tcomp->getKeys(), tcomp->getArrayDesc());
+        if (keys.isUsable()) {
+            keys.sort(tuples, *tcomp);
+        } else {
+            iqsort(&tuples[0], tuples.size(), *tcomp);
+        }
     }
 }
 
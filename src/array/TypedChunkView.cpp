@@ -0,0 +1,75 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.
+* Copyright (C) 2008-2014 SciDB, Inc.
+*
+* SciDB is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with SciDB.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+/**
+ * @file TypedChunkView.cpp
+ *
+ * @brief Typed access to the values of a chunk
+ */
+
+#include <array/TypedChunkView.h>
+#include <array/Array.h>
+
+namespace scidb
+{
+    char const* ConstChunkPayloadView::getPayloadData(ConstChunk const& chunk, bool& valid)
+    {
+        valid = false;
+        AttributeDesc const& attr = chunk.getAttributeDesc();
+        if (!chunk.isMaterialized() || !chunk.isRLE() || attr.isEmptyIndicator() ||
+            !isSupportedType(attr.getType()) ||
+            chunk.getFirstPosition(true) != chunk.getFirstPosition(false) ||
+            chunk.getLastPosition(true) != chunk.getLastPosition(false)) {
+            return NULL;
+        }
+        char const* data = static_cast<char const*>(chunk.getData());
+        if (data == NULL) {
+            return NULL;
+        }
+        valid = true;
+        return data;
+    }
+
+    ConstChunkPayloadView::ConstChunkPayloadView(ConstChunk const& chunk)
+    : _chunk(chunk),
+      _pinned(chunk.pin()),
+      _valid(false),
+      _payload(getPayloadData(chunk, _valid))
+    {
+        // Without an empty bitmap every cell of the chunk is present, so the payload must cover
+        // all of them; anything else is a layout this view does not understand.
+        if (_valid && chunk.getArrayDesc().getEmptyBitmapAttribute() == NULL &&
+            _payload.count() != chunk.getNumberOfElements(false)) {
+            _valid = false;
+        }
+        if (_valid && (_payload.isBool() || _payload.elementSize() == 0)) {
+            _valid = false;
+        }
+    }
+
+    ConstChunkPayloadView::~ConstChunkPayloadView()
+    {
+        if (_pinned) {
+            _chunk.unPin();
+        }
+    }
+}
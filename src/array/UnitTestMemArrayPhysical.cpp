@@ -0,0 +1,236 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.
+* Copyright (C) 2008-2014 SciDB, Inc.
+*
+* SciDB is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with SciDB.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+#include <query/Operator.h>
+#include <array/Metadata.h>
+#include <array/MemArray.h>
+#include <query/Query.h>
+#include <boost/foreach.hpp>
+#include <system/Exceptions.h>
+#include <log4cxx/logger.h>
+
+using namespace boost;
+using namespace std;
+
+namespace scidb
+{
+static log4cxx::LoggerPtr logger(log4cxx::Logger::getLogger("scidb.unittest"));
+
+class UnitTestMemArrayPhysical: public PhysicalOperator
+{
+    typedef set<Coordinates> ChunkSet;
+
+public:
+
+    UnitTestMemArrayPhysical(const string& logicalName, const string& physicalName,
+                    const Parameters& parameters, const ArrayDesc& schema)
+    : PhysicalOperator(logicalName, physicalName, parameters, schema)
+    {
+    }
+
+    void preSingleExecute(shared_ptr<Query> query)
+    {
+    }
+
+    void fail(string const& what)
+    {
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_UNITTEST_FAILED) << "UnitTestMemArray" << what;
+    }
+
+    /**
+     * Create the chunk at a position, storing the first coordinate of the chunk in its first cell.
+     */
+    void addChunk(shared_ptr<Query>& query, ArrayIterator& arrayIter, Coordinates const& pos)
+    {
+        Chunk& chunk = arrayIter.newChunk(pos);
+        shared_ptr<ChunkIterator> chunkIter = chunk.getIterator(query, ChunkIterator::SEQUENTIAL_WRITE);
+        chunkIter->setPosition(pos);
+        Value value;
+        value.setInt64(pos[0]);
+        chunkIter->writeItem(value);
+        chunkIter->flush();
+    }
+
+    /**
+     * Check that a scan of an attribute returns exactly the chunks of the reference set, in order.
+     */
+    void checkScan(MemArray& array, AttributeID attId, ChunkSet const& expected)
+    {
+        shared_ptr<ConstArrayIterator> arrayIter = array.getConstIterator(attId);
+        ChunkSet::const_iterator i = expected.begin();
+        for (; !arrayIter->end(); ++(*arrayIter), ++i) {
+            if (i == expected.end() || arrayIter->getPosition() != *i) {
+                fail("chunks are scanned out of order");
+            }
+            shared_ptr<ConstChunkIterator> chunkIter = arrayIter->getChunk().getConstIterator();
+            if (chunkIter->end() || chunkIter->getItem().getInt64() != (*i)[0]) {
+                fail("wrong chunk returned by the scan");
+            }
+        }
+        if (i != expected.end()) {
+            fail("scan missed chunks");
+        }
+    }
+
+    /**
+     * Fill a 2-d array with randomly placed chunks and check lookups, scans, inserts during a scan and deletes
+     * against a std::set of the chunk positions.
+     *
+     * @param[in]   query
+     * @param[in]   start    the start coordinate of both dims
+     * @param[in]   end      the end coordinate of both dims
+     * @param[in]   chunkInterval  the chunk interval of both dims
+     * @param[in]   nChunks  the number of chunks to create
+     *
+     * @throw SCIDB_SE_INTERNAL::SCIDB_LE_UNITTEST_FAILED
+     */
+    void testOnce_Directory(shared_ptr<Query>& query,
+                            Coordinate start,
+                            Coordinate end,
+                            uint32_t chunkInterval,
+                            size_t nChunks)
+    {
+        LOG4CXX_DEBUG(logger, "MemArray UnitTest Attempt [start=" << start << "][end=" << end <<
+                      "][chunkInterval=" << chunkInterval << "][nChunks=" << nChunks << "]");
+
+        const size_t nattrs = 2;
+        vector<AttributeDesc> attributes(nattrs);
+        for (size_t i = 0; i < nattrs; i++)
+        {
+            std::stringstream ss;
+            ss << "X" << i;
+            attributes[i] = AttributeDesc((AttributeID)i, ss.str(), TID_INT64, 0, 0);
+        }
+        vector<DimensionDesc> dimensions(2);
+        dimensions[0] = DimensionDesc(string("i"), start, end, chunkInterval, 0);
+        dimensions[1] = DimensionDesc(string("j"), start, end, chunkInterval, 0);
+        ArrayDesc schema("dummy_array", addEmptyTagAttribute(attributes), dimensions);
+        MemArray array(schema, query);
+
+        // Chunks are created in random order, which is how SG delivers them.
+        // Positions are drawn near the origin so that unbounded dimensions work too.
+        const Coordinate span = 64;
+        ChunkSet chunks;
+        vector< shared_ptr<ArrayIterator> > arrayIters(nattrs);
+        for (size_t a = 0; a < nattrs; a++) {
+            arrayIters[a] = array.getIterator(a);
+        }
+        while (chunks.size() < nChunks) {
+            Coordinates pos(2);
+            pos[0] = start + (rand() % span) * chunkInterval;
+            pos[1] = start + (rand() % span) * chunkInterval;
+            if (chunks.insert(pos).second) {
+                for (size_t a = 0; a < nattrs; a++) {
+                    addChunk(query, *arrayIters[a], pos);
+                }
+            }
+        }
+        for (size_t a = 0; a < nattrs; a++) {
+            checkScan(array, a, chunks);
+        }
+
+        // Point lookups
+        for (size_t k = 0; k < nChunks; k++) {
+            Coordinates pos(2);
+            pos[0] = start + (rand() % span) * chunkInterval + rand() % chunkInterval;
+            pos[1] = start + (rand() % span) * chunkInterval + rand() % chunkInterval;
+            Coordinates chunkPos(pos);
+            schema.getChunkPositionFor(chunkPos);
+            bool found = arrayIters[0]->setPosition(pos);
+            if (found != (chunks.find(chunkPos) != chunks.end())) {
+                fail("setPosition disagrees with the reference");
+            }
+            if (found && arrayIters[0]->getPosition() != chunkPos) {
+                fail("setPosition found the wrong chunk");
+            }
+        }
+
+        // Chunks inserted during a scan are visited if they follow the current chunk
+        {
+            ChunkSet visited;
+            ChunkSet mustVisit;
+            shared_ptr<ConstArrayIterator> scan = array.getConstIterator(1);
+            for (size_t k = 0; !scan->end(); ++(*scan), ++k) {
+                Coordinates const& curr = scan->getPosition();
+                if (!visited.empty() && !(*visited.rbegin() < curr)) {
+                    fail("chunks inserted during a scan broke the order");
+                }
+                visited.insert(curr);
+                if (k % 4 == 0) {
+                    Coordinates pos(2);
+                    pos[0] = start + (rand() % span) * chunkInterval;
+                    pos[1] = start + (span + rand() % span) * chunkInterval;
+                    if (chunks.insert(pos).second) {
+                        addChunk(query, *arrayIters[1], pos);
+                        addChunk(query, *arrayIters[0], pos);
+                        if (curr < pos) {
+                            mustVisit.insert(pos);
+                        }
+                    }
+                }
+            }
+            BOOST_FOREACH(Coordinates const& pos, mustVisit) {
+                if (visited.find(pos) == visited.end()) {
+                    fail("a chunk inserted after the current one was not visited");
+                }
+            }
+        }
+
+        // Deletes
+        ChunkSet remaining;
+        BOOST_FOREACH(Coordinates const& pos, chunks) {
+            if (rand() % 2) {
+                remaining.insert(pos);
+                continue;
+            }
+            for (size_t a = 0; a < nattrs; a++) {
+                if (!arrayIters[a]->setPosition(pos)) {
+                    fail("chunk to delete not found");
+                }
+                arrayIters[a]->deleteChunk((Chunk&)arrayIters[a]->getChunk());
+            }
+        }
+        for (size_t a = 0; a < nattrs; a++) {
+            checkScan(array, a, remaining);
+        }
+
+        LOG4CXX_DEBUG(logger, "MemArray UnitTest Success [start=" << start << "][end=" << end <<
+                      "][chunkInterval=" << chunkInterval << "][nChunks=" << nChunks << "]");
+    }
+
+    boost::shared_ptr<Array> execute(vector< boost::shared_ptr<Array> >& inputArrays, boost::shared_ptr<Query> query)
+    {
+        srand(time(NULL));
+
+        // chunk positions packed into 64-bit keys
+        testOnce_Directory(query, 0, 19999, 100, 1000);
+        testOnce_Directory(query, -5000, 4999, 10, 3000);
+        // unbounded dimensions do not fit into 64 bits
+        testOnce_Directory(query, 0, MAX_COORDINATE, 100, 1000);
+
+        return shared_ptr<Array> (new MemArray(_schema,query));
+    }
+
+};
+
+REGISTER_PHYSICAL_OPERATOR_FACTORY(UnitTestMemArrayPhysical, "test_mem_array", "UnitTestMemArrayPhysical");
+}
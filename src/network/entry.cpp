@@ -35,6 +35,7 @@
 #include <boost/shared_ptr.hpp>
 #include <boost/make_shared.hpp>
 #include <boost/asio.hpp>
+#include <boost/algorithm/string.hpp>
 
 #include <dlfcn.h>
 #include <signal.h>
@@ -47,6 +48,7 @@
 #include <sys/types.h>
 #include <malloc.h>
 #include <fstream>
+#include <algorithm>
 
 #include <dense_linear_algebra/blas/initMathLibs.h>
 #include "network/NetworkManager.h"
@@ -181,11 +183,24 @@ void runSciDB()
 
 #ifndef __APPLE__
    const size_t memThreshold = Config::getInstance()->getOption<size_t>(CONFIG_MEM_ARRAY_THRESHOLD);
-   std::string memArrayBasePath = cfg->getOption<string>(CONFIG_TMP_PATH);
-
-   memArrayBasePath += "/memarray";
+   std::vector<std::string> memArrayBasePaths;
+   std::string spillPaths = cfg->getOption<string>(CONFIG_MEM_ARRAY_SPILL_PATHS);
+   boost::split(memArrayBasePaths, spillPaths, boost::is_any_of(","), boost::token_compress_on);
+   memArrayBasePaths.erase(std::remove(memArrayBasePaths.begin(), memArrayBasePaths.end(), std::string()),
+                           memArrayBasePaths.end());
+   if (memArrayBasePaths.empty()) {
+       memArrayBasePaths.push_back(cfg->getOption<string>(CONFIG_TMP_PATH));
+   }
+   for (size_t i = 0; i < memArrayBasePaths.size(); ++i) {
+       memArrayBasePaths[i] += "/memarray";
+   }
+   const size_t spillQueueSize = cfg->getOption<size_t>(CONFIG_MEM_ARRAY_SPILL_QUEUE);
+   const int prefetchDepth = cfg->getOption<int>(CONFIG_MEM_ARRAY_PREFETCH);
    SharedMemCache::getInstance().initSharedMemCache(memThreshold * MiB,
-                                                    memArrayBasePath.c_str());
+                                                    memArrayBasePaths,
+                                                    spillQueueSize * MiB,
+                                                    std::max(prefetchDepth, 0),
+                                                    cfg->getOption<bool>(CONFIG_MEM_ARRAY_COMPRESS_SPILL));
 
    int largeMemLimit = cfg->getOption<int>(CONFIG_LARGE_MEMALLOC_LIMIT);
    if (largeMemLimit>0 && (0==mallopt(M_MMAP_MAX, largeMemLimit))) {
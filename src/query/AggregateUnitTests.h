@@ -38,6 +38,7 @@
 #include <boost/shared_ptr.hpp>
 
 #include "query/Aggregate.h"
+#include "query/QuantileSketch.h"
 
 using namespace scidb;
 
@@ -48,6 +49,10 @@ CPPUNIT_TEST(testIntegerSum);
 CPPUNIT_TEST(testFloatSum);
 CPPUNIT_TEST(testIntegerAvg);
 CPPUNIT_TEST(testDoubleAvg);
+CPPUNIT_TEST(testPayloadAccumulate);
+CPPUNIT_TEST(testCompensatedPayloadSum);
+CPPUNIT_TEST(testQuantileSketch);
+CPPUNIT_TEST(testApproxCountDistinct);
 CPPUNIT_TEST_SUITE_END();
 
 private:
@@ -223,7 +228,241 @@ public:
         ///
     }
 
+    void testPayloadAccumulate()
+    {
+        AggregateLibrary* al = AggregateLibrary::getInstance();
+        Type tInt64 = TypeLibrary::getType(TID_INT64);
+
+        RLEPayload payload(tInt64);
+        {
+            RLEPayload::append_iterator appender(&payload);
+            Value v(tInt64);
+            v.setInt64(7);
+            appender.add(v, 10);
+            for (int64_t i = 1; i <= 20; i++) {
+                v.setInt64(i);
+                appender.add(v);
+            }
+            v.setNull(3);
+            appender.add(v, 5);
+            v.setInt64(-4);
+            appender.add(v, 3);
+            appender.flush();
+        }
+
+        ConstTypedChunkView<int64_t> view(&payload);
+        CPPUNIT_ASSERT(view.isValid());
+        CPPUNIT_ASSERT(!ConstTypedChunkView<int32_t>(&payload).isValid());
+        size_t nValues = 0;
+        size_t nNulls = 0;
+        int64_t total = 0;
+        for (size_t i = 0, n = view.nRuns(); i < n; i++) {
+            ConstTypedChunkView<int64_t>::Run run = view.getRun(i);
+            if (run.null) {
+                CPPUNIT_ASSERT(run.missingReason == 3);
+                nNulls += run.length;
+                continue;
+            }
+            for (size_t j = 0; j < run.length; j++) {
+                total += run.values[run.same ? 0 : j];
+            }
+            nValues += run.length;
+        }
+        CPPUNIT_ASSERT(nValues == 33);
+        CPPUNIT_ASSERT(nNulls == 5);
+        CPPUNIT_ASSERT(total == 70 + 210 - 12);
+
+        char const* names[] = { "sum", "min", "max", "avg", "var", "stdev" };
+        for (size_t k = 0; k < sizeof(names) / sizeof(names[0]); k++) {
+            AggregatePtr agg = al->createAggregate(names[k], tInt64);
+            CPPUNIT_ASSERT(agg.get() != 0);
+
+            Value tileState(agg->getStateType());
+            Value cellState(agg->getStateType());
+            agg->initializeState(tileState);
+            agg->initializeState(cellState);
+
+            agg->accumulatePayload(tileState, &payload);
+            for (RLEPayload::iterator i(&payload); !i.end(); ++i) {
+                Value v;
+                i.getItem(v);
+                if (!v.isNull()) {
+                    agg->accumulate(cellState, v);
+                }
+            }
+
+            Value tileResult(agg->getResultType());
+            Value cellResult(agg->getResultType());
+            agg->finalResult(tileResult, tileState);
+            agg->finalResult(cellResult, cellState);
+            CPPUNIT_ASSERT(tileResult == cellResult);
+        }
+    }
+
+    void testCompensatedPayloadSum()
+    {
+        AggregateLibrary* al = AggregateLibrary::getInstance();
+        Type tDouble = TypeLibrary::getType(TID_DOUBLE);
+
+        // One run of distinct values (alternating, so that they are not stored as a repeated value).
+        // The small values are lost to rounding unless the sum is compensated.
+        RLEPayload payload(tDouble);
+        {
+            RLEPayload::append_iterator appender(&payload);
+            Value v(tDouble);
+            v.setDouble(1e16);
+            appender.add(v);
+            for (int64_t i = 0; i < 1001; i++) {
+                v.setDouble(i % 2 ? 1.0 : 1.0 + std::numeric_limits<double>::epsilon());
+                appender.add(v);
+            }
+            v.setDouble(-1e16);
+            appender.add(v);
+            appender.flush();
+        }
+
+        AggregatePtr sum = al->createAggregate("sum", tDouble);
+        Value state(sum->getStateType());
+        sum->initializeState(state);
+        sum->accumulatePayload(state, &payload);
+        Value result(sum->getResultType());
+        sum->finalResult(result, state);
+        CPPUNIT_ASSERT( std::fabs(result.getDouble() - 1001.0) < 1e-9 );
 
+        AggregatePtr avg = al->createAggregate("avg", tDouble);
+        avg->initializeState(state);
+        avg->accumulatePayload(state, &payload);
+        avg->finalResult(result, state);
+        CPPUNIT_ASSERT( std::fabs(result.getDouble() - 1001.0 / 1003.0) < 1e-9 );
+    }
+
+
+
+    void testQuantileSketch()
+    {
+        AggregateLibrary* al = AggregateLibrary::getInstance();
+        Type tInt64 = TypeLibrary::getType(TID_INT64);
+        AggregatePtr median = al->createAggregate("approxmedian", tInt64);
+        AggregatePtr p99 = al->createAggregate("approxp99", tInt64);
+
+        // A permutation of 0..n-1 spread over several states, half of them fed by payloads,
+        // then merged. The states grow up to a bound whatever the number of values.
+        const int64_t n = 200000;
+        const size_t nStates = 4;
+        std::vector<Value> states(nStates);
+        for (size_t s = 0; s < nStates; s++) {
+            median->initializeState(states[s]);
+        }
+        const size_t stateSize = QuantileSketch::getSize(QuantileSketch::DEFAULT_K);
+        CPPUNIT_ASSERT(states[0].size() < 512);
+        for (size_t s = 0; s < nStates; s++) {
+            RLEPayload payload(tInt64);
+            RLEPayload::append_iterator appender(&payload);
+            Value v(tInt64);
+            for (int64_t i = s; i < n; i += nStates) {
+                v.setInt64((i * 7919) % n);
+                if (s % 2) {
+                    appender.add(v);
+                } else {
+                    median->accumulate(states[s], v);
+                }
+            }
+            appender.flush();
+            if (s % 2) {
+                median->accumulatePayload(states[s], &payload);
+            }
+            CPPUNIT_ASSERT(states[s].size() <= stateSize);
+        }
+        for (size_t s = 1; s < nStates; s++) {
+            median->merge(states[0], states[s]);
+        }
+        CPPUNIT_ASSERT(states[0].size() <= stateSize);
+        CPPUNIT_ASSERT(QuantileSketch(states[0]).getCount() == static_cast<uint64_t>(n));
+
+        Value result(median->getResultType());
+        median->finalResult(result, states[0]);
+        CPPUNIT_ASSERT( std::fabs(result.getDouble() - n / 2) < n * 0.02 );
+        p99->finalResult(result, states[0]);
+        CPPUNIT_ASSERT( std::fabs(result.getDouble() - n * 0.99) < n * 0.02 );
+
+        // a few values fit in a small state, and grow it one doubling at a time
+        Value small;
+        median->initializeState(small);
+        const size_t initialSize = small.size();
+        Value v(tInt64);
+        for (int64_t i = 0; i < 20; i++) {
+            v.setInt64(i);
+            median->accumulate(small, v);
+        }
+        CPPUNIT_ASSERT(small.size() > initialSize && small.size() < stateSize / 10);
+        median->finalResult(result, small);
+        CPPUNIT_ASSERT(result.getDouble() == 9);
+
+        // no values
+        Value empty;
+        median->initializeState(empty);
+        median->finalResult(result, empty);
+        CPPUNIT_ASSERT(result.isNull());
+    }
+
+    void testApproxCountDistinct()
+    {
+        AggregateLibrary* al = AggregateLibrary::getInstance();
+        Type tInt64 = TypeLibrary::getType(TID_INT64);
+        AggregatePtr acd = al->createAggregate("approx_count_distinct", tInt64);
+        Value result(acd->getResultType());
+
+        // few values: the sparse state counts them exactly, in little room
+        Value small;
+        acd->initializeState(small);
+        Value v(tInt64);
+        for (int64_t i = 0; i < 1000; i++) {
+            v.setInt64(i % 10);
+            acd->accumulate(small, v);
+        }
+        CPPUNIT_ASSERT(small.size() < 1024);
+        acd->finalResult(result, small);
+        CPPUNIT_ASSERT(result.getUint64() == 10);
+
+        // overlapping values over several states, half of them fed by payloads with repeated values
+        const int64_t nDistinct = 50000;
+        const size_t nStates = 4;
+        std::vector<Value> states(nStates);
+        for (size_t s = 0; s < nStates; s++) {
+            acd->initializeState(states[s]);
+            RLEPayload payload(tInt64);
+            RLEPayload::append_iterator appender(&payload);
+            for (int64_t i = s * nDistinct / 8; i < nDistinct; i += 2) {
+                v.setInt64(i);
+                if (s % 2) {
+                    appender.add(v, 3);
+                } else {
+                    acd->accumulate(states[s], v);
+                }
+                v.setInt64(i + 1);
+                if (s % 2) {
+                    appender.add(v);
+                } else {
+                    acd->accumulate(states[s], v);
+                }
+            }
+            appender.flush();
+            if (s % 2) {
+                acd->accumulatePayload(states[s], &payload);
+            }
+        }
+        for (size_t s = 1; s < nStates; s++) {
+            acd->merge(states[0], states[s]);
+        }
+        acd->finalResult(result, states[0]);
+        CPPUNIT_ASSERT(std::fabs(static_cast<double>(result.getUint64()) - nDistinct) < nDistinct * 0.04);
+
+        // no values
+        Value empty;
+        acd->initializeState(empty);
+        acd->finalResult(result, empty);
+        CPPUNIT_ASSERT(result.getUint64() == 0);
+    }
 };
 
 CPPUNIT_TEST_SUITE_REGISTRATION(AggregateTests);
@@ -30,6 +30,9 @@
 #include "query/FunctionLibrary.h"
 #include "query/Expression.h"
 #include "query/TileFunctions.h"
+#include "query/QuantileSketch.h"
+#include "query/HyperLogLog.h"
+#include "system/Config.h"
 
 #include "query/ops/analyze/AnalyzeAggregate.h"
 
@@ -280,6 +283,241 @@ public:
     }
 };
 
+/**
+ * Run kernels feeding a QuantileSketch, see aggregatePayloadRuns. NaNs have no rank and are skipped.
+ */
+template <typename TS, typename TSR>
+class AggQuantileSketch
+{
+public:
+    typedef QuantileSketch State;
+
+    static void aggregate(State& state, const TS& value)
+    {
+        double const v = static_cast<double>(value);
+        if (!isnan(v)) {
+            state.insert(v);
+        }
+    }
+
+    static void multAggregate(State& state, const TS& value, uint64_t count)
+    {
+        double const v = static_cast<double>(value);
+        if (!isnan(v)) {
+            state.insert(v, count);
+        }
+    }
+
+    static void aggregateRun(State& state, const TS* values, size_t n)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            aggregate(state, values[i]);
+        }
+    }
+};
+
+/**
+ * An approximate quantile of a numeric attribute, computed over a QuantileSketch. The state grows
+ * with the number of values up to a bound set by the quantile-sketch-k option, so that many small
+ * groups or windows stay cheap, and merges like any other aggregate state, so the aggregate runs
+ * through redistributeAggregate.
+ * Aggregate calls take a single argument, so every quantile is a separate aggregate name.
+ */
+template<typename T>
+class QuantileSketchAggregate : public Aggregate
+{
+private:
+    double _fraction;
+    uint32_t _k;
+
+public:
+    QuantileSketchAggregate(const string& name, Type const& aggregateType, double fraction,
+                            uint32_t k = QuantileSketch::DEFAULT_K):
+        Aggregate(name, aggregateType, TypeLibrary::getType(TID_DOUBLE)),
+        _fraction(fraction),
+        _k(k)
+    {}
+
+    AggregatePtr clone() const
+    {
+        return AggregatePtr(new QuantileSketchAggregate(getName(), getAggregateType(), _fraction, _k));
+    }
+
+    AggregatePtr clone(Type const& aggregateType) const
+    {
+        int k = Config::getInstance()->getOption<int>(CONFIG_QUANTILE_SKETCH_K);
+        return AggregatePtr(new QuantileSketchAggregate(getName(), aggregateType, _fraction,
+                                                        k > 0 ? k : QuantileSketch::DEFAULT_K));
+    }
+
+    bool ignoreNulls() const
+    {
+        return true;
+    }
+
+    Type getStateType() const
+    {
+        return TypeLibrary::getType(TID_BINARY);
+    }
+
+    void initializeState(Value& state)
+    {
+        QuantileSketch(state).initialize(_k);
+        state.setNull(-1);
+    }
+
+    void accumulate(Value& state, Value const& input)
+    {
+        QuantileSketch sketch(state);
+        AggQuantileSketch<T, double>::aggregate(sketch, *reinterpret_cast<T*>(input.data()));
+    }
+
+    void accumulatePayload(Value& state, ConstRLEPayload const* tile)
+    {
+        QuantileSketch sketch(state);
+        aggregatePayloadRuns<AggQuantileSketch, T, double>(sketch, tile);
+    }
+
+    void merge(Value& dstState, Value const& srcState)
+    {
+        if (srcState.isNull()) {
+            return;
+        }
+        if (dstState.isNull()) {
+            dstState = srcState;
+            return;
+        }
+        QuantileSketch(dstState).merge(srcState);
+    }
+
+    void finalResult(Value& result, Value const& state)
+    {
+        QuantileSketch const sketch(const_cast<Value&>(state));
+        if (state.isNull() || sketch.getCount() == 0) {
+            result.setNull();
+            return;
+        }
+        result.setDouble(sketch.getQuantile(_fraction));
+    }
+};
+
+/**
+ * Register the approximate quantile aggregate of a fraction for all the numeric types.
+ */
+static void addQuantileSketchAggregates(AggregateLibrary& library, const string& name, double fraction)
+{
+    library.addAggregate(make_shared<QuantileSketchAggregate<int8_t> >(name, TypeLibrary::getType(TID_INT8), fraction));
+    library.addAggregate(make_shared<QuantileSketchAggregate<int16_t> >(name, TypeLibrary::getType(TID_INT16), fraction));
+    library.addAggregate(make_shared<QuantileSketchAggregate<int32_t> >(name, TypeLibrary::getType(TID_INT32), fraction));
+    library.addAggregate(make_shared<QuantileSketchAggregate<int64_t> >(name, TypeLibrary::getType(TID_INT64), fraction));
+    library.addAggregate(make_shared<QuantileSketchAggregate<uint8_t> >(name, TypeLibrary::getType(TID_UINT8), fraction));
+    library.addAggregate(make_shared<QuantileSketchAggregate<uint16_t> >(name, TypeLibrary::getType(TID_UINT16), fraction));
+    library.addAggregate(make_shared<QuantileSketchAggregate<uint32_t> >(name, TypeLibrary::getType(TID_UINT32), fraction));
+    library.addAggregate(make_shared<QuantileSketchAggregate<uint64_t> >(name, TypeLibrary::getType(TID_UINT64), fraction));
+    library.addAggregate(make_shared<QuantileSketchAggregate<float> >(name, TypeLibrary::getType(TID_FLOAT), fraction));
+    library.addAggregate(make_shared<QuantileSketchAggregate<double> >(name, TypeLibrary::getType(TID_DOUBLE), fraction));
+}
+
+/**
+ * The approximate number of distinct values of an attribute of any type, from a HyperLogLog
+ * sketch of the bytes of the values. The precision comes from the approx-count-distinct-precision
+ * option. Small states stay sparse, so that aggregating many small groups or windows is cheap.
+ */
+class ApproxCountDistinctAggregate : public Aggregate
+{
+private:
+    uint32_t _precision;
+
+public:
+    ApproxCountDistinctAggregate(Type const& aggregateType, uint32_t precision = HyperLogLog::DEFAULT_PRECISION):
+        Aggregate("approx_count_distinct", aggregateType, TypeLibrary::getType(TID_UINT64)),
+        _precision(precision)
+    {}
+
+    AggregatePtr clone() const
+    {
+        return AggregatePtr(new ApproxCountDistinctAggregate(getAggregateType(), _precision));
+    }
+
+    AggregatePtr clone(Type const& aggregateType) const
+    {
+        int precision = Config::getInstance()->getOption<int>(CONFIG_APPROX_COUNT_DISTINCT_PRECISION);
+        return AggregatePtr(new ApproxCountDistinctAggregate(aggregateType,
+                                                             precision > 0 ? precision : HyperLogLog::DEFAULT_PRECISION));
+    }
+
+    bool ignoreNulls() const
+    {
+        return true;
+    }
+
+    Type getStateType() const
+    {
+        return TypeLibrary::getType(TID_BINARY);
+    }
+
+    void initializeState(Value& state)
+    {
+        HyperLogLog(state).initialize(_precision);
+        state.setNull(-1);
+    }
+
+    void accumulate(Value& state, Value const& input)
+    {
+        HyperLogLog(state).add(input.data(), input.size());
+    }
+
+    /**
+     * A repeated value is added once.
+     */
+    void accumulatePayload(Value& state, ConstRLEPayload const* tile)
+    {
+        HyperLogLog hll(state);
+        ConstRLEPayload::iterator iter = tile->getIterator();
+        Value val;
+        while (!iter.end())
+        {
+            if (iter.isNull())
+            {
+                iter.toNextSegment();
+                continue;
+            }
+            iter.getItem(val);
+            hll.add(val.data(), val.size());
+            if (iter.isSame())
+            {
+                iter.toNextSegment();
+            }
+            else
+            {
+                ++iter;
+            }
+        }
+    }
+
+    void merge(Value& dstState, Value const& srcState)
+    {
+        if (srcState.isNull()) {
+            return;
+        }
+        if (dstState.isNull()) {
+            dstState = srcState;
+            return;
+        }
+        HyperLogLog(dstState).merge(srcState);
+    }
+
+    void finalResult(Value& result, Value const& state)
+    {
+        if (state.isNull()) {
+            result.setUint64(0);
+            return;
+        }
+        result.setUint64(HyperLogLog(const_cast<Value&>(state)).estimate());
+    }
+};
+
 AggregateLibrary::AggregateLibrary()
 {
     /** SUM **/
@@ -377,6 +615,15 @@ AggregateLibrary::AggregateLibrary()
     addAggregate(make_shared<BaseAggregate<AggStDev, float, double> >("stdev", TypeLibrary::getType(TID_FLOAT), TypeLibrary::getType(TID_DOUBLE)));
     addAggregate(make_shared<BaseAggregate<AggStDev, double, double> >("stdev", TypeLibrary::getType(TID_DOUBLE), TypeLibrary::getType(TID_DOUBLE)));
 
+    /** APPROXIMATE QUANTILES **/
+    addQuantileSketchAggregates(*this, "approxmedian", 0.5);
+    addQuantileSketchAggregates(*this, "approxp90", 0.9);
+    addQuantileSketchAggregates(*this, "approxp95", 0.95);
+    addQuantileSketchAggregates(*this, "approxp99", 0.99);
+
+    /** APPROX_COUNT_DISTINCT **/
+    addAggregate(make_shared<ApproxCountDistinctAggregate>(TypeLibrary::getType(TID_VOID)));
+
     /** ApproxDC (ANALYZE) **/
     addAggregate(make_shared<AnalyzeAggregate>());
 }
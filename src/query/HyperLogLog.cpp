@@ -0,0 +1,307 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.
+* Copyright (C) 2008-2014 SciDB, Inc.
+*
+* SciDB is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with SciDB.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+/*
+ *  HyperLogLog.cpp
+ */
+
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+#include "MurmurHash/MurmurHash3.h"
+
+#include <query/HyperLogLog.h>
+
+using namespace std;
+
+namespace scidb {
+
+    const uint32_t HyperLogLog::MIN_PRECISION;
+    const uint32_t HyperLogLog::MAX_PRECISION;
+    const uint32_t HyperLogLog::DEFAULT_PRECISION;
+    const uint32_t HyperLogLog::SPARSE_PRECISION;
+
+    namespace {
+
+        uint32_t const HASH_SEED = 0x5C1DB;
+        uint32_t const INITIAL_CAPACITY = 16;
+        uint32_t const RANK_BITS = 6;
+
+        /**
+         * @return 1 + the number of leading zeros of the bits of a hash after its first
+         * indexBits bits
+         */
+        inline uint8_t getRank(uint64_t hash, uint32_t indexBits)
+        {
+            uint64_t const rest = hash << indexBits;
+            return rest == 0 ? 64 - indexBits + 1 : __builtin_clzll(rest) + 1;
+        }
+
+        /**
+         * Register index and rank at precision p of a sparse entry.
+         */
+        inline void getRegister(uint32_t entry, uint32_t p, uint32_t& index, uint8_t& rank)
+        {
+            uint32_t const sparseIndex = entry >> RANK_BITS;
+            uint32_t const shift = HyperLogLog::SPARSE_PRECISION - p;
+            uint32_t const low = sparseIndex & ((1U << shift) - 1);
+            index = sparseIndex >> shift;
+            rank = low != 0 ? __builtin_clz(low) - (32 - shift) + 1 : shift + (entry & ((1U << RANK_BITS) - 1));
+        }
+
+        /**
+         * Entries sort by index, then by rank: the last entry of an index has its highest rank.
+         */
+        uint32_t uniqueEntries(uint32_t* entries, uint32_t nEntries)
+        {
+            uint32_t n = 0;
+            for (uint32_t i = 0; i < nEntries; i++)
+            {
+                if (n != 0 && (entries[n - 1] >> RANK_BITS) == (entries[i] >> RANK_BITS))
+                {
+                    n--;
+                }
+                entries[n++] = entries[i];
+            }
+            return n;
+        }
+    }
+
+    void HyperLogLog::initialize(uint32_t precision)
+    {
+        vector<char> buf(sizeof(Header) + INITIAL_CAPACITY * sizeof(uint32_t), 0);
+        Header& header = *reinterpret_cast<Header*>(&buf[0]);
+        header.precision = std::min(std::max(precision, MIN_PRECISION), MAX_PRECISION);
+        header.capacity = INITIAL_CAPACITY;
+        _state.setData(&buf[0], buf.size());
+    }
+
+    void HyperLogLog::add(void const* data, size_t size)
+    {
+        uint64_t hash[2];
+        MurmurHash3_x64_128(data, size, HASH_SEED, hash);
+        Header& header = getHeader(_state);
+        if (header.dense)
+        {
+            uint8_t* registers = getRegisters(_state);
+            uint32_t const index = hash[0] >> (64 - header.precision);
+            registers[index] = std::max(registers[index], getRank(hash[0], header.precision));
+            return;
+        }
+        uint32_t const sparseIndex = hash[0] >> (64 - SPARSE_PRECISION);
+        addEntry((sparseIndex << RANK_BITS) | getRank(hash[0], SPARSE_PRECISION));
+    }
+
+    void HyperLogLog::addEntry(uint32_t entry)
+    {
+        Header* header = &getHeader(_state);
+        if (!header->dense && header->nEntries == header->capacity)
+        {
+            normalize();
+            if (header->nEntries > header->capacity / 2)
+            {
+                uint32_t const capacity = header->capacity * 2;
+                if (capacity * sizeof(uint32_t) >= (static_cast<size_t>(1) << header->precision))
+                {
+                    toDense();
+                }
+                else
+                {
+                    resize(capacity);
+                }
+                header = &getHeader(_state);
+            }
+        }
+        if (header->dense)
+        {
+            uint32_t index;
+            uint8_t rank;
+            getRegister(entry, header->precision, index, rank);
+            uint8_t* registers = getRegisters(_state);
+            registers[index] = std::max(registers[index], rank);
+            return;
+        }
+        getEntries(_state)[header->nEntries++] = entry;
+    }
+
+    /**
+     * Sort the appended entries, merge them with the sorted ones and drop the duplicates.
+     */
+    void HyperLogLog::normalize()
+    {
+        Header& header = getHeader(_state);
+        uint32_t* entries = getEntries(_state);
+        std::sort(entries + header.nSorted, entries + header.nEntries);
+        std::inplace_merge(entries, entries + header.nSorted, entries + header.nEntries);
+        header.nEntries = uniqueEntries(entries, header.nEntries);
+        header.nSorted = header.nEntries;
+    }
+
+    void HyperLogLog::resize(uint32_t capacity)
+    {
+        Header const& header = getHeader(_state);
+        vector<char> buf(sizeof(Header) + capacity * sizeof(uint32_t), 0);
+        memcpy(&buf[0], _state.data(), sizeof(Header) + header.nEntries * sizeof(uint32_t));
+        reinterpret_cast<Header*>(&buf[0])->capacity = capacity;
+        _state.setData(&buf[0], buf.size());
+    }
+
+    void HyperLogLog::toDense()
+    {
+        Header const& header = getHeader(_state);
+        uint32_t const* entries = getEntries(_state);
+        vector<char> buf(sizeof(Header) + (static_cast<size_t>(1) << header.precision), 0);
+        Header& dense = *reinterpret_cast<Header*>(&buf[0]);
+        dense.precision = header.precision;
+        dense.dense = true;
+        uint8_t* registers = reinterpret_cast<uint8_t*>(&buf[sizeof(Header)]);
+        for (uint32_t i = 0; i < header.nEntries; i++)
+        {
+            uint32_t index;
+            uint8_t rank;
+            getRegister(entries[i], header.precision, index, rank);
+            registers[index] = std::max(registers[index], rank);
+        }
+        _state.setData(&buf[0], buf.size());
+    }
+
+    /**
+     * Take the maximum of the registers of a dense sketch with a precision at least ours. A register
+     * of a higher precision folds into the register of its leading index bits; the other index bits
+     * count towards the rank, as if the hash had been split at our precision.
+     */
+    void HyperLogLog::mergeRegisters(uint8_t const* registers, uint32_t precision)
+    {
+        Header const& header = getHeader(_state);
+        assert(header.dense && precision >= header.precision);
+        uint8_t* ours = getRegisters(_state);
+        uint32_t const shift = precision - header.precision;
+        for (uint32_t i = 0, m = 1U << precision; i < m; i++)
+        {
+            if (registers[i] == 0)
+            {
+                continue;
+            }
+            uint32_t const low = i & ((1U << shift) - 1);
+            uint8_t const rank = low != 0 ? __builtin_clz(low) - (32 - shift) + 1 : shift + registers[i];
+            ours[i >> shift] = std::max(ours[i >> shift], rank);
+        }
+    }
+
+    void HyperLogLog::mergeEntries(uint32_t const* entries, uint32_t nEntries)
+    {
+        for (uint32_t i = 0; i < nEntries; i++)
+        {
+            addEntry(entries[i]);
+        }
+    }
+
+    void HyperLogLog::merge(Value const& other)
+    {
+        Header const& theirs = getHeader(other);
+        if (!theirs.dense)
+        {
+            // sparse entries do not depend on the precision
+            if (getHeader(_state).dense && theirs.precision < getHeader(_state).precision)
+            {
+                Value copy(_state);
+                initialize(theirs.precision);
+                toDense();
+                mergeRegisters(getRegisters(copy), getHeader(copy).precision);
+            }
+            else if (!getHeader(_state).dense)
+            {
+                Header& ours = getHeader(_state);
+                ours.precision = std::min(ours.precision, theirs.precision);
+                if (ours.capacity * sizeof(uint32_t) >= (static_cast<size_t>(1) << ours.precision))
+                {
+                    toDense();
+                }
+            }
+            mergeEntries(getEntries(other), theirs.nEntries);
+            return;
+        }
+        if (!getHeader(_state).dense)
+        {
+            Header& ours = getHeader(_state);
+            ours.precision = std::min(ours.precision, theirs.precision);
+            toDense();
+        }
+        else if (theirs.precision < getHeader(_state).precision)
+        {
+            Value copy(_state);
+            initialize(theirs.precision);
+            toDense();
+            mergeRegisters(getRegisters(copy), getHeader(copy).precision);
+        }
+        mergeRegisters(getRegisters(other), theirs.precision);
+    }
+
+    uint64_t HyperLogLog::estimate() const
+    {
+        Header const& header = getHeader(_state);
+        if (!header.dense)
+        {
+            // linear counting over the 2^SPARSE_PRECISION registers of the entries
+            vector<uint32_t> entries(getEntries(_state), getEntries(_state) + header.nEntries);
+            std::sort(entries.begin(), entries.end());
+            double const n = uniqueEntries(entries.empty() ? NULL : &entries[0], entries.size());
+            double const m = static_cast<double>(1U << SPARSE_PRECISION);
+            return static_cast<uint64_t>(floor(m * log(m / (m - n)) + 0.5));
+        }
+
+        uint32_t const m = 1U << header.precision;
+        double alpha;
+        switch (m)
+        {
+        case 16:
+            alpha = 0.673;
+            break;
+        case 32:
+            alpha = 0.697;
+            break;
+        case 64:
+            alpha = 0.709;
+            break;
+        default:
+            alpha = 0.7213 / (1 + 1.079 / m);
+            break;
+        }
+        uint8_t const* registers = getRegisters(_state);
+        double sum = 0;
+        uint32_t nZeros = 0;
+        for (uint32_t i = 0; i < m; i++)
+        {
+            sum += ldexp(1.0, -registers[i]);
+            nZeros += registers[i] == 0;
+        }
+        double estimate = alpha * m * m / sum;
+        if (estimate <= 2.5 * m && nZeros != 0)
+        {
+            estimate = m * log(static_cast<double>(m) / nZeros);
+        }
+        return static_cast<uint64_t>(floor(estimate + 0.5));
+    }
+
+}  // namespace scidb
@@ -1918,6 +1918,15 @@ boost::shared_ptr<JobQueue> PhysicalOperator::getGlobalQueueForOperators()
     return _globalQueueForOperators;
 }
 
+size_t PhysicalOperator::getParallelJobsCount(size_t nPieces)
+{
+    int nJobs = Config::getInstance()->getOption<int>(CONFIG_AGGREGATE_THREADS);
+    if (nJobs <= 0) {
+        nJobs = Config::getInstance()->getOption<int>(CONFIG_EXEC_THREADS);
+    }
+    return std::max<size_t>(std::min<size_t>(std::max(nJobs, 1), nPieces), 1);
+}
+
 void StoreJob::run()
 {
     ArrayDesc const& dstArrayDesc = _dstArray->getArrayDesc();
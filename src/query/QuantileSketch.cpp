@@ -0,0 +1,334 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.
+* Copyright (C) 2008-2014 SciDB, Inc.
+*
+* SciDB is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with SciDB.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+/*
+ *  QuantileSketch.cpp
+ */
+
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#include <query/QuantileSketch.h>
+
+using namespace std;
+
+namespace scidb {
+
+    const uint32_t QuantileSketch::MIN_K;
+    const uint32_t QuantileSketch::MAX_K;
+    const uint32_t QuantileSketch::DEFAULT_K;
+    const uint32_t QuantileSketch::MAX_LEVELS;
+
+    namespace {
+
+        inline uint32_t clampK(uint32_t k)
+        {
+            return std::min(std::max(k, QuantileSketch::MIN_K), QuantileSketch::MAX_K);
+        }
+
+        /**
+         * Inserting a repeated value through the levels pays off only for longer runs.
+         */
+        uint64_t const MIN_WEIGHTED_INSERT = 16;
+    }
+
+    const uint32_t QuantileSketch::INITIAL_CAPACITY;
+
+    size_t QuantileSketch::getSize(uint32_t k)
+    {
+        return sizeof(Header) + getCapacity(clampK(k)) * sizeof(double);
+    }
+
+    void QuantileSketch::initialize(uint32_t k)
+    {
+        vector<char> buf(sizeof(Header) + INITIAL_CAPACITY * sizeof(double), 0);
+        Header& header = *reinterpret_cast<Header*>(&buf[0]);
+        header.k = clampK(k);
+        header.nLevels = 1;
+        header.capacity = INITIAL_CAPACITY;
+        _state.setData(&buf[0], buf.size());
+    }
+
+    /**
+     * Make room for at least nItems items, doubling the room up to that of a full sketch.
+     */
+    void QuantileSketch::reserve(size_t nItems)
+    {
+        Header const& header = *getHeader();
+        if (nItems <= header.capacity)
+        {
+            return;
+        }
+        size_t capacity = std::min(std::max(static_cast<size_t>(header.capacity) * 2, static_cast<size_t>(INITIAL_CAPACITY)),
+                                   getCapacity(header.k));
+        capacity = std::max(capacity, nItems);
+        vector<char> buf(sizeof(Header) + capacity * sizeof(double), 0);
+        memcpy(&buf[0], _state.data(), sizeof(Header) + header.nItems * sizeof(double));
+        reinterpret_cast<Header*>(&buf[0])->capacity = capacity;
+        _state.setData(&buf[0], buf.size());
+    }
+
+    /**
+     * Make room for one more item: grow the sketch until it is full, then compact it.
+     */
+    void QuantileSketch::makeRoom()
+    {
+        Header const& header = *getHeader();
+        if (header.capacity < getCapacity(header.k))
+        {
+            reserve(header.nItems + 1);
+        }
+        else
+        {
+            compress();
+        }
+    }
+
+    /**
+     * The capacity of a level, k for the top one, 2/3 of the capacity of the level above for the
+     * others, and at least 2.
+     */
+    size_t QuantileSketch::getLevelCapacity(uint32_t k, size_t level, size_t nLevels)
+    {
+        double const capacity = ceil(k * pow(2.0 / 3.0, static_cast<double>(nLevels - 1 - level)));
+        return std::max(static_cast<size_t>(capacity), static_cast<size_t>(2));
+    }
+
+    void QuantileSketch::unpack(Levels& levels) const
+    {
+        Header const& header = *getHeader();
+        levels.resize(header.nLevels);
+        double const* item = getItems();
+        for (size_t h = header.nLevels; h != 0; --h)
+        {
+            uint32_t const size = header.levelSizes[h - 1];
+            levels[h - 1].assign(item, item + size);
+            item += size;
+        }
+    }
+
+    void QuantileSketch::pack(Levels const& levels)
+    {
+        assert(levels.size() <= MAX_LEVELS);
+        size_t nItems = 0;
+        for (size_t h = 0; h < levels.size(); h++)
+        {
+            nItems += levels[h].size();
+        }
+        assert(nItems <= getCapacity(getHeader()->k));
+        reserve(nItems);
+        Header& header = *getHeader();
+        header.nLevels = levels.size();
+        double* item = getItems();
+        for (size_t h = levels.size(); h != 0; --h)
+        {
+            vector<double> const& level = levels[h - 1];
+            header.levelSizes[h - 1] = level.size();
+            if (!level.empty())
+            {
+                memcpy(item, &level[0], level.size() * sizeof(double));
+            }
+            item += level.size();
+        }
+        header.nItems = nItems;
+    }
+
+    /**
+     * Compact the lowest level that reached its capacity, until the sketch holds fewer items than
+     * the sum of the capacities of its levels. A compaction sorts the level and promotes its items at
+     * either the even or the odd positions, alternately, so that the errors of consecutive
+     * compactions cancel out on average. With an odd number of items one of them stays behind, so
+     * the total weight is always the number of values.
+     */
+    void QuantileSketch::compress(Levels& levels)
+    {
+        uint32_t const k = getHeader()->k;
+        while (true)
+        {
+            size_t nItems = 0;
+            size_t capacity = 0;
+            size_t h = levels.size();
+            for (size_t i = 0; i < levels.size(); i++)
+            {
+                size_t const levelCapacity = getLevelCapacity(k, i, levels.size());
+                nItems += levels[i].size();
+                capacity += levelCapacity;
+                if (h == levels.size() && levels[i].size() >= levelCapacity)
+                {
+                    h = i;
+                }
+            }
+            if (nItems < capacity)
+            {
+                break;
+            }
+            assert(h < levels.size());
+            if (h + 1 == levels.size())
+            {
+                assert(levels.size() < MAX_LEVELS);
+                levels.push_back(vector<double>());
+            }
+            vector<double>& level = levels[h];
+            vector<double>& upper = levels[h + 1];
+            bool const odd = level.size() % 2 != 0;
+            double held = 0;
+            if (odd)
+            {
+                held = level.back();
+                level.pop_back();
+            }
+            std::sort(level.begin(), level.end());
+            for (size_t i = getHeader()->nCompactions++ % 2; i < level.size(); i += 2)
+            {
+                upper.push_back(level[i]);
+            }
+            level.clear();
+            if (odd)
+            {
+                level.push_back(held);
+            }
+        }
+    }
+
+    void QuantileSketch::compress()
+    {
+        Levels levels;
+        unpack(levels);
+        compress(levels);
+        pack(levels);
+    }
+
+    /**
+     * A long run goes straight to the levels of the binary digits of its length, one item per
+     * digit set below the top level and the rest of the run as items of the top level. The top
+     * level is raised first until the rest fits its capacity, as it would by inserting the values
+     * one by one.
+     */
+    void QuantileSketch::insert(double value, uint64_t count)
+    {
+        if (count < MIN_WEIGHTED_INSERT)
+        {
+            for (uint64_t i = 0; i < count; i++)
+            {
+                insert(value);
+            }
+            return;
+        }
+        Levels levels;
+        unpack(levels);
+        size_t top = levels.size() - 1;
+        while ((count >> top) > getHeader()->k && top + 1 < MAX_LEVELS)
+        {
+            top++;
+        }
+        levels.resize(top + 1);
+        for (size_t h = 0; h < top; h++)
+        {
+            if ((count >> h) & 1)
+            {
+                levels[h].push_back(value);
+            }
+        }
+        levels[top].insert(levels[top].end(), count >> top, value);
+        updateRange(value);
+        getHeader()->count += count;
+        compress(levels);
+        pack(levels);
+    }
+
+    void QuantileSketch::merge(Value const& otherState)
+    {
+        QuantileSketch const other(const_cast<Value&>(otherState));
+        if (other.getCount() == 0)
+        {
+            return;
+        }
+        Header const& theirs = *other.getHeader();
+        Levels levels;
+        Levels otherLevels;
+        unpack(levels);
+        other.unpack(otherLevels);
+        if (levels.size() < otherLevels.size())
+        {
+            levels.resize(otherLevels.size());
+        }
+        for (size_t h = 0; h < otherLevels.size(); h++)
+        {
+            levels[h].insert(levels[h].end(), otherLevels[h].begin(), otherLevels[h].end());
+        }
+        Header& ours = *getHeader();
+        ours.k = std::min(ours.k, theirs.k);
+        if (ours.count == 0)
+        {
+            ours.minValue = theirs.minValue;
+            ours.maxValue = theirs.maxValue;
+        }
+        else
+        {
+            updateRange(theirs.minValue);
+            updateRange(theirs.maxValue);
+        }
+        ours.count += theirs.count;
+        compress(levels);
+        pack(levels);
+    }
+
+    double QuantileSketch::getQuantile(double fraction) const
+    {
+        Header const& header = *getHeader();
+        assert(header.count != 0);
+        if (fraction <= 0)
+        {
+            return header.minValue;
+        }
+        if (fraction >= 1)
+        {
+            return header.maxValue;
+        }
+        vector< pair<double, uint64_t> > items;
+        items.reserve(header.nItems);
+        double const* item = getItems();
+        for (size_t h = header.nLevels; h != 0; --h)
+        {
+            uint64_t const weight = static_cast<uint64_t>(1) << (h - 1);
+            for (uint32_t i = 0; i < header.levelSizes[h - 1]; i++)
+            {
+                items.push_back(make_pair(*item++, weight));
+            }
+        }
+        std::sort(items.begin(), items.end());
+
+        double const rank = fraction * header.count;
+        uint64_t weight = 0;
+        for (size_t i = 0; i < items.size(); i++)
+        {
+            weight += items[i].second;
+            if (weight >= rank)
+            {
+                return items[i].first;
+            }
+        }
+        return items.back().first;
+    }
+
+}  // namespace scidb
@@ -129,6 +129,12 @@ void PhysicalQueryPlanNode::toString(std::ostream &out, int indent, bool childre
 
     out<<"[pNode] "<<_physicalOperator->getPhysicalName()<<" agg "<<isAgg()<<" ddl "<<isDdl()<<" tile "<<supportsTileMode()<<" children "<<_childNodes.size()<<"\n";
     _physicalOperator->toString(out,indent+1);
+    std::vector<PhysicalBoundaries> childBoundaries;
+    for (size_t i = 0; i < _childNodes.size(); i++)
+    {
+        childBoundaries.push_back(_childNodes[i]->getBoundaries());
+    }
+    _physicalOperator->inputsToString(out, indent+1, childBoundaries, getChildSchemas());
 
     if (children) {
         out << prefix(' ');
@@ -90,6 +90,11 @@ std::ostream& writeStatistics(std::ostream& os, const Statistics& s, size_t tab)
         tabStr << "Read " << printSize(s.readSize) << printSizeUnit(s.readSize) << " (" << s.readChunks << " chunks)" << endl <<
         tabStr << "Pinned " << printSize(s.pinnedSize) << printSizeUnit(s.pinnedSize) << " (" << s.pinnedChunks << " chunks)" << endl <<
         tabStr << "Allocated " << printSize(s.allocatedSize) << printSizeUnit(s.allocatedSize) << " (" << s.allocatedChunks << " chunks)" << endl;
+    if (s.prefetchedChunks != 0) {
+        os <<
+            tabStr << "Prefetched " << s.prefetchedChunks << " chunks (waited " << s.prefetchWaitTime / 1000 << "ms, depth increased " <<
+            s.prefetchDepthIncreases << " and decreased " << s.prefetchDepthDecreases << " times, max depth " << s.prefetchMaxDepth << ")" << endl;
+    }
 
     return os;
 }
@@ -0,0 +1,446 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.
+* Copyright (C) 2008-2014 SciDB, Inc.
+*
+* SciDB is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with SciDB.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+/**
+ * @file TupleExchange.cpp
+ *
+ * @brief Exchange of tuples between instances
+ */
+
+#include <string.h>
+#include <limits>
+#include <log4cxx/logger.h>
+
+#include "query/TupleExchange.h"
+#include "query/Operator.h"
+#include "query/Network.h"
+#include "array/MemArray.h"
+#include "util/Hashing.h"
+
+namespace scidb
+{
+    using namespace boost;
+    using namespace std;
+
+    static log4cxx::LoggerPtr logger(log4cxx::Logger::getLogger("scidb.qproc.tupleexchange"));
+
+    //
+    // TupleExchange
+    //
+    TupleExchange::TupleExchange(string const& name,
+                                 Attributes const& attributes,
+                                 size_t chunkSize,
+                                 shared_ptr<Query> const& query)
+    : _query(query),
+      _nAttrs(attributes.size()),
+      _chunkSize(chunkSize),
+      _destinations(query->getInstancesCount()),
+      _nTuples(0)
+    {
+        assert(_nAttrs > 0);
+        assert(_chunkSize > 0);
+        size_t const nInstances = query->getInstancesCount();
+        Dimensions dims(3);
+        dims[0] = DimensionDesc("dst", 0, nInstances-1, 1, 0);
+        dims[1] = DimensionDesc("src", 0, nInstances-1, 1, 0);
+        dims[2] = DimensionDesc("seq", 0, MAX_COORDINATE, _chunkSize, 0);
+        ArrayDesc schema(name, addEmptyTagAttribute(attributes), dims);
+
+        _array = make_shared<MemArray>(schema, query);
+        _arrayIterators.resize(_nAttrs);
+        for (size_t i = 0; i < _nAttrs; i++) {
+            _arrayIterators[i] = _array->getIterator(i);
+        }
+    }
+
+    void TupleExchange::append(InstanceID dstId, vector<Value> const& tuple)
+    {
+        assert(dstId < _destinations.size());
+        assert(tuple.size() >= _nAttrs);
+        Destination& dst = _destinations[dstId];
+
+        if (dst.nextSeq % _chunkSize == 0) {
+            Coordinates chunkPos(3);
+            chunkPos[0] = dstId;
+            chunkPos[1] = _query->getInstanceID();
+            chunkPos[2] = dst.nextSeq;
+            newChunks(_arrayIterators, dst.chunkIterators, chunkPos, _query);
+        }
+        for (size_t i = 0; i < _nAttrs; i++) {
+            dst.chunkIterators[i]->writeItem(tuple[i]);
+            ++(*dst.chunkIterators[i]);
+        }
+        dst.nextSeq += 1;
+        _nTuples += 1;
+        if (_nTuples % _chunkSize == 0) {
+            _query->validate();
+        }
+    }
+
+    shared_ptr<Array> TupleExchange::exchange()
+    {
+        for (size_t i = 0; i < _destinations.size(); i++) {
+            flushChunks(_destinations[i].chunkIterators);
+        }
+        _arrayIterators.clear();
+        LOG4CXX_DEBUG(logger, "TupleExchange: sending " << _nTuples << " tuples of "
+                      << _array->getArrayDesc().getName());
+        shared_ptr<Array> result = redistribute(_array, _query, psByRow);
+        _array.reset();
+        return result;
+    }
+
+    TupleExchange::KeyKinds TupleExchange::getKeyKinds(Attributes const& attributes, size_t n)
+    {
+        KeyKinds keys(n, KEY_BYTES);
+        for (size_t i = 0; i < n; i++) {
+            TypeId const& type = attributes[i].getType();
+            if (type == TID_DOUBLE) {
+                keys[i] = KEY_DOUBLE;
+            } else if (type == TID_FLOAT) {
+                keys[i] = KEY_FLOAT;
+            }
+        }
+        return keys;
+    }
+
+    /**
+     * @return the value of a floating-point key with one representation for zero and one for NaN
+     */
+    template <typename T>
+    static T normalizeKey(T value)
+    {
+        if (value == 0) {
+            return 0;
+        }
+        if (value != value) {
+            return std::numeric_limits<T>::quiet_NaN();
+        }
+        return value;
+    }
+
+    template <typename T>
+    static bool equalKeys(T left, T right)
+    {
+        return left == right || (left != left && right != right);
+    }
+
+    uint64_t TupleExchange::hashTuple(vector<Value> const& tuple, KeyKinds const& keys, uint32_t seed)
+    {
+        uint64_t h[2] = { seed, 0 };
+        for (size_t i = 0, n = keys.size(); i < n; i++) {
+            Value const& v = tuple[i];
+            uint32_t const s = static_cast<uint32_t>(h[0] ^ (h[0] >> 32));
+            if (v.isNull()) {
+                h[0] = fmix(h[0] + static_cast<uint64_t>(v.getMissingReason()) + 1);
+            } else if (keys[i] == KEY_DOUBLE) {
+                double const d = normalizeKey(v.getDouble());
+                MurmurHash3_x64_128(&d, sizeof(d), s, h);
+            } else if (keys[i] == KEY_FLOAT) {
+                float const f = normalizeKey(v.getFloat());
+                MurmurHash3_x64_128(&f, sizeof(f), s, h);
+            } else {
+                MurmurHash3_x64_128(v.data(), static_cast<int>(v.size()), s, h);
+            }
+        }
+        return h[0];
+    }
+
+    bool TupleExchange::equalTuples(vector<Value> const& left, vector<Value> const& right, KeyKinds const& keys)
+    {
+        for (size_t i = 0, n = keys.size(); i < n; i++) {
+            Value const& l = left[i];
+            Value const& r = right[i];
+            if (l.isNull() || r.isNull()) {
+                if (l.getMissingReason() != r.getMissingReason()) {
+                    return false;
+                }
+                continue;
+            }
+            if (keys[i] == KEY_DOUBLE) {
+                if (!equalKeys(l.getDouble(), r.getDouble())) {
+                    return false;
+                }
+            } else if (keys[i] == KEY_FLOAT) {
+                if (!equalKeys(l.getFloat(), r.getFloat())) {
+                    return false;
+                }
+            } else if (l.size() != r.size() || memcmp(l.data(), r.data(), l.size()) != 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    //
+    // TupleReader
+    //
+    TupleReader::TupleReader(shared_ptr<Array> const& array)
+    : _nAttrs(array->getArrayDesc().getAttributes(true).size()),
+      _arrayIterators(_nAttrs),
+      _chunkIterators(_nAttrs),
+      _tuple(_nAttrs),
+      _end(false)
+    {
+        for (size_t i = 0; i < _nAttrs; i++) {
+            _arrayIterators[i] = array->getConstIterator(i);
+        }
+        fetch();
+    }
+
+    void TupleReader::fetch()
+    {
+        while (!_chunkIterators[0] || _chunkIterators[0]->end()) {
+            if (_chunkIterators[0]) {
+                for (size_t i = 0; i < _nAttrs; i++) {
+                    _chunkIterators[i].reset();
+                    ++(*_arrayIterators[i]);
+                }
+            }
+            if (_arrayIterators[0]->end()) {
+                _end = true;
+                return;
+            }
+            for (size_t i = 0; i < _nAttrs; i++) {
+                _chunkIterators[i] = _arrayIterators[i]->getChunk().getConstIterator(ChunkIterator::IGNORE_EMPTY_CELLS);
+            }
+        }
+        for (size_t i = 0; i < _nAttrs; i++) {
+            _tuple[i] = _chunkIterators[i]->getItem();
+        }
+    }
+
+    void TupleReader::operator ++()
+    {
+        assert(!_end);
+        for (size_t i = 0; i < _nAttrs; i++) {
+            ++(*_chunkIterators[i]);
+        }
+        fetch();
+    }
+
+    //
+    // TupleWriter
+    //
+    TupleWriter::TupleWriter(ArrayDesc const& schema, shared_ptr<Query> const& query)
+    : _query(query),
+      _array(make_shared<MemArray>(schema, query)),
+      _nAttrs(schema.getAttributes(true).size()),
+      _chunkSize(schema.getDimensions()[1].getChunkInterval()),
+      _position(2),
+      _arrayIterators(_nAttrs),
+      _chunkIterators(_nAttrs)
+    {
+        assert(schema.getDimensions().size() == 2);
+        _position[0] = query->getInstanceID();
+        _position[1] = 0;
+        for (size_t i = 0; i < _nAttrs; i++) {
+            _arrayIterators[i] = _array->getIterator(i);
+        }
+    }
+
+    void TupleWriter::write(vector<Value> const& tuple)
+    {
+        assert(tuple.size() >= _nAttrs);
+        if (_position[1] % _chunkSize == 0) {
+            newChunks(_arrayIterators, _chunkIterators, _position, _query);
+        }
+        for (size_t i = 0; i < _nAttrs; i++) {
+            _chunkIterators[i]->writeItem(tuple[i]);
+            ++(*_chunkIterators[i]);
+        }
+        _position[1] += 1;
+    }
+
+    shared_ptr<Array> TupleWriter::finish()
+    {
+        flushChunks(_chunkIterators);
+        _arrayIterators.clear();
+        return _array;
+    }
+
+    //
+    // RangePartitioner
+    //
+    namespace {
+        class WeightedTupleLess
+        {
+          public:
+            WeightedTupleLess(TupleComparator& tcomp): _tcomp(&tcomp)
+            {}
+
+            bool operator()(pair<shared_ptr<Tuple>, double> const& t1, pair<shared_ptr<Tuple>, double> const& t2) const
+            {
+                return _tcomp->compare(*t1.first, *t2.first) < 0;
+            }
+
+          private:
+            TupleComparator* _tcomp;
+        };
+
+        /**
+         * Number of samples per chunk of the exchanged array.
+         */
+        size_t const SAMPLE_CHUNK_SIZE = 10000;
+    }
+
+    RangePartitioner::RangePartitioner(shared_ptr<Array> const& tuples,
+                                       shared_ptr<TupleComparator> const& tcomp,
+                                       size_t samplesPerInstance,
+                                       shared_ptr<Query> const& query)
+    : _tcomp(tcomp)
+    {
+        size_t const nInstances = query->getInstancesCount();
+        ArrayDesc const& desc = tuples->getArrayDesc();
+        Attributes attributes(desc.getAttributes(true));
+        size_t const nAttrs = attributes.size();
+        attributes.push_back(AttributeDesc(nAttrs, "weight", TID_DOUBLE, 0, 0));
+
+        TupleExchange samples(desc.getName() + "_samples", attributes, SAMPLE_CHUNK_SIZE, query);
+        uint64_t const count = getCellCount(tuples);
+        uint64_t const nSamples = std::min<uint64_t>(count, samplesPerInstance);
+        if (nSamples != 0) {
+            double const weight = static_cast<double>(count) / nSamples;
+            uint64_t tupleNo = 0;
+            uint64_t sampleNo = 0;
+            for (TupleReader reader(tuples); !reader.end() && sampleNo < nSamples; ++reader, ++tupleNo) {
+                if (tupleNo != (2 * sampleNo + 1) * count / (2 * nSamples)) {
+                    continue;
+                }
+                vector<Value> sample(reader.getTuple());
+                sample.resize(nAttrs + 1);
+                sample[nAttrs].setDouble(weight);
+                for (InstanceID dst = 0; dst < nInstances; dst++) {
+                    samples.append(dst, sample);
+                }
+                sampleNo++;
+            }
+        }
+
+        vector< pair<shared_ptr<Tuple>, double> > received;
+        double totalWeight = 0;
+        for (TupleReader reader(samples.exchange()); !reader.end(); ++reader) {
+            vector<Value> const& sample = reader.getTuple();
+            shared_ptr<Tuple> tuple(new Tuple(nAttrs));
+            for (size_t i = 0; i < nAttrs; i++) {
+                (*tuple)[i] = sample[i];
+            }
+            received.push_back(make_pair(tuple, sample[nAttrs].getDouble()));
+            totalWeight += sample[nAttrs].getDouble();
+        }
+        std::sort(received.begin(), received.end(), WeightedTupleLess(*_tcomp));
+
+        double cumulative = 0;
+        for (size_t i = 0, n = received.size(); i < n && _splitters.size() < nInstances - 1; i++) {
+            cumulative += received[i].second;
+            while (_splitters.size() < nInstances - 1 &&
+                   cumulative >= totalWeight * (_splitters.size() + 1) / nInstances) {
+                _splitters.push_back(received[i].first);
+            }
+        }
+    }
+
+    InstanceID RangePartitioner::getRange(Tuple const& tuple) const
+    {
+        // the first range whose splitter is not less than the tuple
+        size_t lo = 0;
+        size_t hi = _splitters.size();
+        while (lo < hi) {
+            size_t const mid = (lo + hi) / 2;
+            if (_tcomp->compare(tuple, *_splitters[mid]) > 0) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo;
+    }
+
+    uint64_t RangePartitioner::getRangeStart(uint64_t count, shared_ptr<Query> const& query)
+    {
+        InstanceID const myInstanceId = query->getInstanceID();
+        shared_ptr<SharedBuffer> buf(make_shared<MemoryBuffer>(static_cast<void*>(NULL), sizeof(uint64_t)));
+        *static_cast<uint64_t*>(buf->getData()) = count;
+        for (InstanceID i = 0; i < query->getInstancesCount(); ++i) {
+            if (i != myInstanceId) {
+                BufSend(i, buf, query);
+            }
+        }
+        uint64_t before = 0;
+        for (InstanceID i = 0; i < query->getInstancesCount(); ++i) {
+            if (i == myInstanceId) {
+                continue;
+            }
+            shared_ptr<SharedBuffer> received = BufReceive(i, query);
+            if (i < myInstanceId) {
+                before += *static_cast<uint64_t*>(received->getData());
+            }
+        }
+        return before;
+    }
+
+    void newChunks(vector< shared_ptr<ArrayIterator> > const& arrayIters,
+                   vector< shared_ptr<ChunkIterator> >& chunkIters,
+                   Coordinates const& chunkPos,
+                   shared_ptr<Query> const& query)
+    {
+        flushChunks(chunkIters);
+        chunkIters.resize(arrayIters.size());
+        // The empty bitmap is written along with the first attribute
+        int mode = ChunkIterator::SEQUENTIAL_WRITE;
+        for (size_t i = 0; i < arrayIters.size(); i++) {
+            Chunk& chunk = arrayIters[i]->newChunk(chunkPos, 0);
+            chunkIters[i] = chunk.getIterator(query, mode);
+            mode |= ChunkIterator::NO_EMPTY_CHECK;
+        }
+    }
+
+    void flushChunks(vector< shared_ptr<ChunkIterator> >& chunkIters)
+    {
+        for (size_t i = 0; i < chunkIters.size(); i++) {
+            if (chunkIters[i]) {
+                chunkIters[i]->flush();
+                chunkIters[i].reset();
+            }
+        }
+    }
+
+    uint64_t getCellCount(shared_ptr<Array> const& array)
+    {
+        uint64_t count = 0;
+        for (shared_ptr<ConstArrayIterator> i = array->getConstIterator(0); !i->end(); ++(*i)) {
+            count += i->getChunk().count();
+        }
+        return count;
+    }
+
+    uint64_t getChunksSize(shared_ptr<Array> const& array)
+    {
+        uint64_t size = 0;
+        for (size_t attr = 0, n = array->getArrayDesc().getAttributes().size(); attr < n; attr++) {
+            for (shared_ptr<ConstArrayIterator> i = array->getConstIterator(attr); !i->end(); ++(*i)) {
+                size += i->getChunk().getSize();
+            }
+        }
+        return size;
+    }
+}
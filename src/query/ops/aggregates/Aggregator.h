@@ -40,6 +40,8 @@
 #include "query/Aggregate.h"
 #include "array/DelegateArray.h"
 #include "system/Sysinfo.h"
+#include "util/Mutex.h"
+#include "util/Job.h"
 
 #include <boost/unordered_map.hpp>
 #include <boost/foreach.hpp>
@@ -272,6 +274,124 @@ public:
 };
 
 
+/**
+ * Hands out the chunks of one attribute of a random-access array to the jobs of a parallel
+ * aggregation, a morsel of consecutive chunks at a time. Jobs that finish their morsels early
+ * take more, so uneven chunks do not leave threads idle.
+ */
+class ChunkMorsels
+{
+private:
+    std::vector<Coordinates> _positions;
+    size_t _morselSize;
+    size_t _next;
+    Mutex _mutex;
+
+public:
+    /**
+     * Number of morsels per job, when there are enough chunks.
+     */
+    static const size_t MORSELS_PER_JOB = 16;
+
+    ChunkMorsels(boost::shared_ptr<Array> const& inputArray, AttributeID attrId, size_t nJobs):
+        _morselSize(1),
+        _next(0)
+    {
+        for (boost::shared_ptr<ConstArrayIterator> i = inputArray->getConstIterator(attrId); !i->end(); ++(*i))
+        {
+            _positions.push_back(i->getPosition());
+        }
+        _morselSize = std::max<size_t>(1, _positions.size() / (nJobs * MORSELS_PER_JOB));
+    }
+
+    size_t getNumChunks() const
+    {
+        return _positions.size();
+    }
+
+    Coordinates const& getPosition(size_t i) const
+    {
+        return _positions[i];
+    }
+
+    /**
+     * Take the next morsel.
+     * @param[out] begin the index of the first chunk of the morsel
+     * @param[out] end the index past the last chunk of the morsel
+     * @return false if all the morsels are taken
+     */
+    bool next(size_t& begin, size_t& end)
+    {
+        ScopedMutexLock cs(_mutex);
+        if (_next >= _positions.size())
+        {
+            return false;
+        }
+        begin = _next;
+        end = std::min(_next + _morselSize, _positions.size());
+        _next = end;
+        return true;
+    }
+};
+
+/**
+ * Visits the chunks of an input attribute: all of them in order, or the morsels taken by one job
+ * of a parallel aggregation.
+ */
+class InputChunks
+{
+private:
+    boost::shared_ptr<ConstArrayIterator> _iterator;
+    ChunkMorsels* _morsels;
+    size_t _current;
+    size_t _end;
+    bool _started;
+
+public:
+    /**
+     * @param morsels the shared morsels of a parallel aggregation, or NULL to visit all the chunks
+     */
+    InputChunks(boost::shared_ptr<Array> const& inputArray, AttributeID attrId, ChunkMorsels* morsels):
+        _iterator(inputArray->getConstIterator(attrId)),
+        _morsels(morsels),
+        _current(0),
+        _end(0),
+        _started(false)
+    {}
+
+    /**
+     * Move to the next chunk.
+     * @return false if there are no more chunks
+     */
+    bool next()
+    {
+        if (_morsels == NULL)
+        {
+            if (_started)
+            {
+                ++(*_iterator);
+            }
+            _started = true;
+            return !_iterator->end();
+        }
+        if (_current == _end && !_morsels->next(_current, _end))
+        {
+            return false;
+        }
+        if (!_iterator->setPosition(_morsels->getPosition(_current)))
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_QPROC, SCIDB_LE_OPERATION_FAILED) << "setPosition";
+        }
+        ++_current;
+        return true;
+    }
+
+    ConstChunk const& getChunk()
+    {
+        return _iterator->getChunk();
+    }
+};
+
 struct AggregationFlags
 {
     int iterationMode;
@@ -597,10 +717,10 @@ class AggregatePartitioningOperator : public PhysicalOperator
     void grandCount(Array* stateArray,
                     boost::shared_ptr<Array> & inputArray,
                     AggIOMapping const& mapping,
-                    AggregationFlags const& aggFlags)
+                    AggregationFlags const& aggFlags,
+                    ChunkMorsels* morsels)
     {
-        boost::shared_ptr<ConstArrayIterator> inArrayIterator =
-            inputArray->getConstIterator(mapping.getInputAttributeId());
+        InputChunks inChunks(inputArray, mapping.getInputAttributeId(), morsels);
         size_t nAggs = mapping.size();
 
         std::vector<uint64_t> counts(nAggs,0);
@@ -616,25 +736,24 @@ class AggregatePartitioningOperator : public PhysicalOperator
 
         if (dimBasedCount)
         {
-            while (!inArrayIterator->end())
+            while (inChunks.next())
             {
                 {
-                    ConstChunk const& chunk = inArrayIterator->getChunk();
+                    ConstChunk const& chunk = inChunks.getChunk();
                     uint64_t chunkCount = chunk.getNumberOfElements(false);
                     for (size_t i=0; i<nAggs; i++)
                     {
                         counts[i]+=chunkCount;
                     }
                 }
-                ++(*inArrayIterator);
             }
         }
         else
         {
-            while (!inArrayIterator->end())
+            while (inChunks.next())
             {
                 {
-                    ConstChunk const& chunk = inArrayIterator->getChunk();
+                    ConstChunk const& chunk = inChunks.getChunk();
                     uint64_t itemCount = 0;
                     uint64_t noNullCount = 0;
                     
@@ -667,7 +786,6 @@ class AggregatePartitioningOperator : public PhysicalOperator
                         }
                     }
                 }
-                ++(*inArrayIterator);
             }
         }
 
@@ -696,17 +814,17 @@ class AggregatePartitioningOperator : public PhysicalOperator
     void grandTileAggregate(Array* stateArray,
                             boost::shared_ptr<Array> & inputArray,
                             AggIOMapping const& mapping,
-                            AggregationFlags const& aggFlags)
+                            AggregationFlags const& aggFlags,
+                            ChunkMorsels* morsels)
     {
-        boost::shared_ptr<ConstArrayIterator> inArrayIterator =
-            inputArray->getConstIterator(mapping.getInputAttributeId());
+        InputChunks inChunks(inputArray, mapping.getInputAttributeId(), morsels);
         size_t nAggs = mapping.size();
         std::vector<Value> states(nAggs);
 
-        while (!inArrayIterator->end())
+        while (inChunks.next())
         {
             {
-                ConstChunk const& inChunk = inArrayIterator->getChunk();
+                ConstChunk const& inChunk = inChunks.getChunk();
                 boost::shared_ptr <ConstChunkIterator> inChunkIterator = inChunk.getConstIterator(
                     ChunkIterator::TILE_MODE|aggFlags.iterationMode);
                 while (!inChunkIterator->end())
@@ -728,7 +846,6 @@ class AggregatePartitioningOperator : public PhysicalOperator
                     ++(*inChunkIterator);
                 }
             }
-            ++(*inArrayIterator);
         }
 
         Coordinates outPos(_schema.getDimensions().size());
@@ -798,7 +915,8 @@ class AggregatePartitioningOperator : public PhysicalOperator
         boost::shared_ptr<Array> & inputArray,
         AggIOMapping const& mapping,
         AggregationFlags const& aggFlags,
-        size_t attSize)
+        size_t attSize,
+        ChunkMorsels* morsels)
     {
         const size_t VALUES_PER_TILE =
             Sysinfo::INTEL_L1_DATA_CACHE_BYTES / attSize;
@@ -841,12 +959,11 @@ class AggregatePartitioningOperator : public PhysicalOperator
             aggFlags.iterationMode & ChunkIterator::IGNORE_NULL_VALUES;
 
         // Input phase.  For each input chunk...
-        boost::shared_ptr<ConstArrayIterator> inArrayIterator =
-            inputArray->getConstIterator(mapping.getInputAttributeId());
-        while (!inArrayIterator->end())
+        InputChunks inChunks(inputArray, mapping.getInputAttributeId(), morsels);
+        while (inChunks.next())
         {
             // Obtain tile mode input chunk iterator.
-            ConstChunk const& chunk = inArrayIterator->getChunk();
+            ConstChunk const& chunk = inChunks.getChunk();
             boost::shared_ptr<ConstChunkIterator> rawInChunkIterator =
                 chunk.getConstIterator(aggFlags.iterationMode);
             // Wrap the ordinary chunk iterator with a tile mode iterator.
@@ -857,7 +974,6 @@ class AggregatePartitioningOperator : public PhysicalOperator
 
             // Empty chunk?  Next!
             if (inChunkIterator->end()) {
-                ++(*inArrayIterator);
                 continue;
             }
 
@@ -949,7 +1065,6 @@ class AggregatePartitioningOperator : public PhysicalOperator
             }
 
             outStateMap.clear();
-            ++(*inArrayIterator);
         }
 
         // Finally, flush the chunk iterators.
@@ -965,10 +1080,10 @@ class AggregatePartitioningOperator : public PhysicalOperator
     void grandAggregate(Array* stateArray,
                         boost::shared_ptr<Array> & inputArray,
                         AggIOMapping const& mapping,
-                        AggregationFlags const& aggFlags)
+                        AggregationFlags const& aggFlags,
+                        ChunkMorsels* morsels)
     {
-        boost::shared_ptr<ConstArrayIterator> inArrayIterator =
-            inputArray->getConstIterator(mapping.getInputAttributeId());
+        InputChunks inChunks(inputArray, mapping.getInputAttributeId(), morsels);
         size_t const nAggs = mapping.size();
         Value null;
         null.setNull(0);
@@ -976,11 +1091,41 @@ class AggregatePartitioningOperator : public PhysicalOperator
         int64_t chunkCount = 0;
         bool noNulls = aggFlags.iterationMode & ChunkIterator::IGNORE_NULL_VALUES;
 
-        while (!inArrayIterator->end())
+        // Chunks of fixed-size builtin types are handed to the aggregates as whole payloads, which
+        // they read in place, when the aggregates would skip null values anyway.
+        bool payloadMode = !(aggFlags.iterationMode & ChunkIterator::IGNORE_DEFAULT_VALUES) &&
+            ConstChunkPayloadView::isSupportedType(
+                inputArray->getArrayDesc().getAttributes()[mapping.getInputAttributeId()].getType());
+        for (size_t i =0; i<nAggs && payloadMode; i++)
+        {
+            payloadMode = mapping.getAggregate(i)->ignoreNulls();
+        }
+
+        while (inChunks.next())
         {
             {
-                ConstChunk const& inChunk = inArrayIterator->getChunk();
+                ConstChunk const& inChunk = inChunks.getChunk();
                 chunkCount += inChunk.getNumberOfElements(false);
+                if (payloadMode)
+                {
+                    ConstChunkPayloadView view(inChunk);
+                    if (view.isValid())
+                    {
+                        if (view.hasValues())
+                        {
+                            for (size_t i =0; i<nAggs; i++)
+                            {
+                                AggregatePtr agg = mapping.getAggregate(i);
+                                if(states[i].getMissingReason()==0)
+                                {
+                                    agg->initializeState(states[i]);
+                                }
+                                agg->accumulatePayload(states[i], &view.getPayload());
+                            }
+                        }
+                        continue;
+                    }
+                }
                 boost::shared_ptr <ConstChunkIterator> inChunkIterator =
                     inChunk.getConstIterator(aggFlags.iterationMode);
                 while (!inChunkIterator->end())
@@ -1007,7 +1152,6 @@ class AggregatePartitioningOperator : public PhysicalOperator
                     ++(*inChunkIterator);
                 }
             }
-            ++(*inArrayIterator);
         }
 
         Coordinates outPos(_schema.getDimensions().size());
@@ -1040,10 +1184,10 @@ class AggregatePartitioningOperator : public PhysicalOperator
     void groupedAggregate(Array* stateArray,
                           boost::shared_ptr<Array> & inputArray,
                           AggIOMapping const& mapping,
-                          AggregationFlags const& aggFlags)
+                          AggregationFlags const& aggFlags,
+                          ChunkMorsels* morsels)
     {
-        boost::shared_ptr<ConstArrayIterator> inArrayIterator =
-            inputArray->getConstIterator(mapping.getInputAttributeId());
+        InputChunks inChunks(inputArray, mapping.getInputAttributeId(), morsels);
         size_t const nAggs = mapping.size();
 
         bool noNulls = aggFlags.iterationMode & ChunkIterator::IGNORE_NULL_VALUES;
@@ -1055,11 +1199,11 @@ class AggregatePartitioningOperator : public PhysicalOperator
         }
         std::vector <boost::shared_ptr<ChunkIterator> > stateChunkIterators(nAggs);
         Coordinates outPos(_schema.getDimensions().size());
-        while (!inArrayIterator->end())
+        while (inChunks.next())
         {
             {
                 boost::shared_ptr <ConstChunkIterator> inChunkIterator =
-                    inArrayIterator->getChunk().getConstIterator( aggFlags.iterationMode);
+                    inChunks.getChunk().getConstIterator( aggFlags.iterationMode);
                 while (!inChunkIterator->end())
                 {
                     transformCoordinates(inChunkIterator->getPosition(), outPos);
@@ -1086,7 +1230,6 @@ class AggregatePartitioningOperator : public PhysicalOperator
                     ++(*inChunkIterator);
                 }
             }
-            ++(*inArrayIterator);
         }
 
         for (size_t i = 0; i <nAggs; i++)
@@ -1113,60 +1256,211 @@ class AggregatePartitioningOperator : public PhysicalOperator
         }
     }
 
-    boost::shared_ptr<Array>
-    execute(std::vector< boost::shared_ptr<Array> >& inputArrays, boost::shared_ptr<Query> query)
+    /**
+     * Accumulate the chunks of the input attribute of a mapping into stateArray, all of them or the
+     * morsels taken by one job.
+     */
+    void accumulate(Array* stateArray,
+                    boost::shared_ptr<Array> & inputArray,
+                    AggIOMapping const& mapping,
+                    AggregationFlags const& aggFlags,
+                    bool grand,
+                    ChunkMorsels* morsels)
     {
-        ArrayDesc const& inArrayDesc = inputArrays[0]->getArrayDesc();
-        initializeOperator(inArrayDesc);
+        if (grand)
+        {
+            if (_tileMode)
+            {
+                grandTileAggregate(stateArray, inputArray, mapping, aggFlags, morsels);
+            }
+            else if (aggFlags.countOnly)
+            {
+                grandCount(stateArray, inputArray, mapping, aggFlags, morsels);
+            }
+            else
+            {
+                grandAggregate(stateArray, inputArray, mapping, aggFlags, morsels);
+            }
+            return;
+        }
+        AttributeDesc const& inputAttr = inputArray->getArrayDesc().getAttributes()[mapping.getInputAttributeId()];
+        size_t attributeSize = inputAttr.getSize();
+        if (inputAttr.getType() != TID_BOOL && attributeSize > 0)
+        {
+            groupedTileFixedSizeAggregate(stateArray, inputArray, mapping, aggFlags, attributeSize, morsels);
+        }
+        else
+        {
+            groupedAggregate(stateArray, inputArray, mapping, aggFlags, morsels);
+        }
+    }
 
-        ArrayDesc stateDesc = createStateDesc();
-        boost::shared_ptr<MemArray> stateArray (new MemArray(stateDesc,query));
-        boost::shared_ptr<Array> inputArray = ensureRandomAccess(inputArrays[0], query);
+    /**
+     * One of the jobs of a parallel aggregation: accumulates the morsels it takes into its own
+     * state array.
+     */
+    class MorselJob : public Job
+    {
+    private:
+        AggregatePartitioningOperator& _op;
+        boost::shared_ptr<Array> _stateArray;
+        boost::shared_ptr<Array> _inputArray;
+        AggIOMapping const& _mapping;
+        AggregationFlags const& _aggFlags;
+        bool _grand;
+        ChunkMorsels& _morsels;
+
+    public:
+        MorselJob(AggregatePartitioningOperator& op,
+                  boost::shared_ptr<Array> const& stateArray,
+                  boost::shared_ptr<Array> const& inputArray,
+                  AggIOMapping const& mapping,
+                  AggregationFlags const& aggFlags,
+                  bool grand,
+                  ChunkMorsels& morsels,
+                  boost::shared_ptr<Query> const& query):
+            Job(query),
+            _op(op),
+            _stateArray(stateArray),
+            _inputArray(inputArray),
+            _mapping(mapping),
+            _aggFlags(aggFlags),
+            _grand(grand),
+            _morsels(morsels)
+        {}
+
+        virtual void run()
+        {
+            Query::setCurrentQueryID(_query->getQueryID());
+            _op.accumulate(_stateArray.get(), _inputArray, _mapping, _aggFlags, _grand, &_morsels);
+        }
+    };
 
-        if (_schema.getSize()==1)
+    /**
+     * Merge the states of the output attributes of a mapping from a job's state array into stateArray.
+     */
+    static void mergeStates(Array* stateArray,
+                            Array const& jobStateArray,
+                            AggIOMapping const& mapping,
+                            boost::shared_ptr<Query>& query)
+    {
+        for (size_t i = 0, n = mapping.size(); i < n; i++)
         {
-            for (size_t i=0; i<_ioMappings.size(); i++)
+            AttributeID const attrId = mapping.getOutputAttributeId(i);
+            AggregatePtr const agg = mapping.getAggregate(i);
+            boost::shared_ptr<ArrayIterator> dstIterator = stateArray->getIterator(attrId);
+            for (boost::shared_ptr<ConstArrayIterator> src = jobStateArray.getConstIterator(attrId);
+                 !src->end(); ++(*src))
             {
-                AggregationFlags aggFlags = composeFlags(inputArray, _ioMappings[i]);
-                logMapping(_ioMappings[i],aggFlags);
-
-                if (_tileMode)
-                {
-                    grandTileAggregate(stateArray.get(),inputArray, _ioMappings[i], aggFlags);
-                }
-                else
+                ConstChunk const& srcChunk = src->getChunk();
+                if (dstIterator->setPosition(src->getPosition()))
                 {
-                    if(aggFlags.countOnly)
+                    Chunk& dstChunk = dstIterator->updateChunk();
+                    //state arrays have no empty bitmap
+                    if (dstChunk.isRLE() && srcChunk.isRLE())
                     {
-                        grandCount(stateArray.get(), inputArray, _ioMappings[i], aggFlags);
+                        dstChunk.nonEmptyableAggregateMerge(srcChunk, agg, query);
                     }
                     else
                     {
-                        grandAggregate(stateArray.get(),inputArray, _ioMappings[i], aggFlags);
+                        dstChunk.aggregateMerge(srcChunk, agg, query);
                     }
                 }
+                else
+                {
+                    dstIterator->copyChunk(srcChunk);
+                }
             }
         }
-        else
+    }
+
+    /**
+     * Accumulate the input attribute of a mapping into stateArray. The chunks are spread over
+     * several jobs, each with its own state array, when the input has enough chunks and no aggregate
+     * of the mapping depends on the order of its input; the states of the jobs are then merged.
+     * See PhysicalOperator::getParallelJobsCount for the number of jobs.
+     * @param inputArray a random-access input
+     */
+    void aggregateMapping(Array* stateArray,
+                          ArrayDesc const& stateDesc,
+                          boost::shared_ptr<Array> & inputArray,
+                          AggIOMapping const& mapping,
+                          AggregationFlags const& aggFlags,
+                          bool grand,
+                          boost::shared_ptr<Query>& query)
+    {
+        size_t nJobs = getParallelJobsCount();
+        for (size_t i = 0, n = mapping.size(); i < n && nJobs > 1; i++)
         {
-            for (size_t i=0, n=_ioMappings.size(); i<n; i++)
+            if (mapping.getAggregate(i)->isOrderSensitive())
             {
-                AggregationFlags aggFlags = composeGroupedFlags( inputArray, _ioMappings[i]);
-                logMapping(_ioMappings[i], aggFlags);
-
-                size_t attributeSize = inArrayDesc.getAttributes()[_ioMappings[i].getInputAttributeId()].getSize();
-                if (inArrayDesc.getAttributes()[_ioMappings[i].getInputAttributeId()].getType() != TID_BOOL
-                    && attributeSize > 0)
-                {
-                    groupedTileFixedSizeAggregate(stateArray.get(), inputArray,
-                                                  _ioMappings[i], aggFlags, attributeSize);
-                }
-                else
-                {
-                    groupedAggregate(stateArray.get(), inputArray, _ioMappings[i], aggFlags);
-                }
+                nJobs = 1;
+            }
+        }
+        if (nJobs <= 1)
+        {
+            accumulate(stateArray, inputArray, mapping, aggFlags, grand, NULL);
+            return;
+        }
+        ChunkMorsels morsels(inputArray, mapping.getInputAttributeId(), nJobs);
+        if (morsels.getNumChunks() < 2)
+        {
+            accumulate(stateArray, inputArray, mapping, aggFlags, grand, NULL);
+            return;
+        }
+        nJobs = std::min<size_t>(nJobs, morsels.getNumChunks());
+        LOG4CXX_DEBUG(aggLogger, "Aggregating " << morsels.getNumChunks() << " chunks of input "
+                      << mapping.getInputAttributeId() << " with " << nJobs << " jobs");
+
+        boost::shared_ptr<JobQueue> queue = PhysicalOperator::getGlobalQueueForOperators();
+        std::vector< boost::shared_ptr<MemArray> > jobStates(nJobs);
+        std::vector< boost::shared_ptr<MorselJob> > jobs(nJobs);
+        for (int i = 0; i < nJobs; i++)
+        {
+            jobStates[i].reset(new MemArray(stateDesc, query));
+            jobs[i].reset(new MorselJob(*this, jobStates[i], inputArray, mapping, aggFlags, grand, morsels, query));
+        }
+        for (int i = 0; i < nJobs; i++)
+        {
+            queue->pushJob(jobs[i]);
+        }
+        int errorJob = -1;
+        for (int i = 0; i < nJobs; i++)
+        {
+            if (!jobs[i]->wait())
+            {
+                errorJob = i;
             }
         }
+        if (errorJob >= 0)
+        {
+            jobs[errorJob]->rethrow();
+        }
+        for (int i = 0; i < nJobs; i++)
+        {
+            mergeStates(stateArray, *jobStates[i], mapping, query);
+            jobStates[i].reset();
+        }
+    }
+
+    boost::shared_ptr<Array>
+    execute(std::vector< boost::shared_ptr<Array> >& inputArrays, boost::shared_ptr<Query> query)
+    {
+        ArrayDesc const& inArrayDesc = inputArrays[0]->getArrayDesc();
+        initializeOperator(inArrayDesc);
+
+        ArrayDesc stateDesc = createStateDesc();
+        boost::shared_ptr<MemArray> stateArray (new MemArray(stateDesc,query));
+        boost::shared_ptr<Array> inputArray = ensureRandomAccess(inputArrays[0], query);
+
+        bool const grand = _schema.getSize()==1;
+        for (size_t i=0, n=_ioMappings.size(); i<n; i++)
+        {
+            AggregationFlags aggFlags = grand ? composeFlags(inputArray, _ioMappings[i])
+                                              : composeGroupedFlags(inputArray, _ioMappings[i]);
+            logMapping(_ioMappings[i], aggFlags);
+            aggregateMapping(stateArray.get(), stateDesc, inputArray, _ioMappings[i], aggFlags, grand, query);
+        }
 
         boost::shared_ptr<Array> mergedArray = redistributeAggregate(stateArray, query, _aggs);
         stateArray.reset();
@@ -48,7 +48,7 @@ using namespace std;
  *   window( srcArray {, leftEdge, rightEdge}+ {, AGGREGATE_CALL}+ [, METHOD ] )
  *   <br> AGGREGATE_CALL := AGGREGATE_FUNC(inputAttr) [as resultName]
  *   <br> AGGREGATE_FUNC := approxdc | avg | count | max | min | sum | stdev | var | some_use_defined_aggregate_function
- *   <br> METHOD := 'materialize' | 'probe'
+ *   <br> METHOD := 'materialize' | 'probe' | 'incremental'
  *
  * @par Summary:
  *   Produces a result array with the same size and dimensions as the source 
@@ -68,14 +68,18 @@ using namespace std;
  *     The count aggregate may take * as the input attribute, meaning to count all the items in the group including null items.
  *     The default resultName for count(*) is 'count'.
  *   - An optional final argument that specifies how the operator is to perform
- *     its calculation. At the moment, we support two internal algorithms: 
+ *     its calculation. At the moment, we support three internal algorithms: 
  *     "materialize" (which materializes an entire source chunk before 
- *     computing the output windows) and "probe" (which probes the source 
- *     array for the data in each window). In general, materializing the input
- *     is a more efficient strategy, but when we're using thin(...) in 
- *     conjunction with window(...), we're often better off using probes, 
- *     rather than materilization. This is a decision that the optimizer needs 
- *     to make. 
+ *     computing the output windows), "probe" (which probes the source 
+ *     array for the data in each window) and "incremental" (which 
+ *     materializes the source chunk and slides the window over it one 
+ *     dimension at a time, merging aggregate states, so that the cost per 
+ *     cell does not grow with the size of the window). In general, 
+ *     materializing the input is a more efficient strategy, but when we're 
+ *     using thin(...) in conjunction with window(...), we're often better 
+ *     off using probes, rather than materilization. This is a decision that 
+ *     the optimizer needs to make. Without a METHOD, the operator chooses 
+ *     the incremental algorithm for dense chunks and large windows.
  *
  * @par Output array:
  *        <
@@ -223,10 +227,11 @@ PARAM_AGGREGATE_CALL)
                    { 
                        string s(boost::static_pointer_cast<Constant>(paramLogicalExpression->getExpression())->getValue().getString());
 
-                       if (!((s == WindowArray::PROBE) || (s == WindowArray::MATERIALIZE ))) 
+                       if (!((s == WindowArray::PROBE) || (s == WindowArray::MATERIALIZE ) ||
+                             (s == WindowArray::INCREMENTAL)))
                        {
                            stringstream ss; 
-                           ss << WindowArray::PROBE << " or " << WindowArray::MATERIALIZE;
+                           ss << WindowArray::PROBE << ", " << WindowArray::MATERIALIZE << " or " << WindowArray::INCREMENTAL;
                            throw USER_QUERY_EXCEPTION(SCIDB_SE_INFER_SCHEMA, 
                                                       SCIDB_LE_OP_WINDOW_ERROR5,
                                                       _parameters[i]->getParsingContext()) 
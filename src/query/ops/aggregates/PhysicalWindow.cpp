@@ -170,7 +170,7 @@ public:
             }
         }
  
-        return boost::shared_ptr<Array>(new WindowArray(_schema, inputArray, _window, inputAttrIDs, aggregates, method));
+        return boost::shared_ptr<Array>(new WindowArray(_schema, inputArray, _window, inputAttrIDs, aggregates, method, query));
     }
 };
     
@@ -34,6 +34,7 @@
 
 #include "system/Config.h"
 #include "system/SciDBConfigOptions.h"
+#include "query/Operator.h"
 
 #include "WindowArray.h"
 
@@ -86,6 +87,12 @@ namespace scidb
      */
     void MaterializedWindowChunkIterator::calculateNextValue()
     {
+        if (_chunk._incremental)
+        {
+            _aggregate->finalResult(_nextValue, _chunk._windowStates[_iter->first]);
+            return;
+        }
+
         Coordinates const& currPos = getPosition();
         Coordinates windowStart(_nDims);
         Coordinates windowEnd(_nDims);
@@ -531,7 +538,8 @@ namespace scidb
       _lastPos(_nDims),
       _attrID(attr),
       _materialized(false),
-      _mapper()
+      _mapper(),
+      _incremental(false)
     {
         if (arr._desc.getEmptyBitmapAttribute() == 0 || attr!=arr._desc.getEmptyBitmapAttribute()->getId())
         {
@@ -662,6 +670,7 @@ namespace scidb
     void WindowChunk::materialize()
     {
         _materialized = true;
+        _incremental = false;
         _stateMap.clear();
         _inputMap.clear();
 
@@ -734,6 +743,194 @@ namespace scidb
                 ++(*chunkIter);
             }
         }
+
+        if (isIncrementalEvaluationCheaper())
+        {
+            evaluateIncrementally();
+        }
+    }
+
+    /**
+     *  Private function that decides whether to evaluate the windows of a
+     * materialized chunk incrementally.
+     *
+     *  Scanning _inputMap costs, for every output cell, a visit of every input
+     * cell of its window. The incremental evaluation costs a few merges of
+     * aggregate states per position of the chunk, empty or not, in each
+     * dimension, whatever the size of the window. So it pays off for dense
+     * chunks and large windows. It needs an aggregate whose states merge in any
+     * order and have a fixed size, as it keeps two states per position.
+     */
+    bool WindowChunk::isIncrementalEvaluationCheaper() const
+    {
+        if (_aggregate->isOrderSensitive() || _aggregate->getStateType().variableSize() ||
+            _arrayIterator->getMethod() == WindowArray::MATERIALIZE ||
+            _arrayIterator->getMethod() == WindowArray::PROBE)
+        {
+            return false;
+        }
+
+        double nPositions = 1;
+        double windowSize = 1;
+        for (size_t i = 0; i < _nDims; i++)
+        {
+            nPositions *= _mapper->getChunkInterval(i);
+            windowSize *= _array._window[i]._boundaries.first + _array._window[i]._boundaries.second + 1;
+        }
+
+        size_t const stateSize = sizeof(Value) + _aggregate->getStateType().byteSize();
+        size_t const maxStatesSize = (
+            Config::getInstance()->getOption<int>(CONFIG_MATERIALIZED_WINDOW_THRESHOLD)
+            * MiB);
+        if (nPositions * 2 * stateSize > maxStatesSize)
+        {
+            return false;
+        }
+        if (_arrayIterator->getMethod() == WindowArray::INCREMENTAL)
+        {
+            return true;
+        }
+
+        double const scanCost = _stateMap.size() * windowSize * _inputMap.size() / nPositions;
+        double const incrementalCost = nPositions * (2 * _nDims + 1);
+        return incrementalCost < scanCost;
+    }
+
+    /**
+     *  Private function that merges an aggregate state into another one, either
+     * of which may be the null state of an empty window.
+     */
+    inline void WindowChunk::mergeState(Value& dstState, Value const& srcState) const
+    {
+        if (srcState.getMissingReason() == 0)
+        {
+            return;
+        }
+        if (dstState.getMissingReason() == 0)
+        {
+            dstState = srcState;
+        }
+        else
+        {
+            _aggregate->merge(dstState, srcState);
+        }
+    }
+
+    /**
+     *  Private function that slides a window along one line of positions of the
+     * materialized chunk: windows[base + i * stride] becomes the merge of the
+     * states[base + j * stride] for every j of the window around i.
+     *
+     *  The window is kept as a queue of two stacks. States enter at the back,
+     * where they are merged into a single running state. When the window leaves
+     * the front stack behind, the front stack is rebuilt from the states that
+     * entered since, each of its entries the merge of the states from there to
+     * its bottom. A window is then the merge of the top of the front stack with
+     * the running state of the back, and every state is merged at most three
+     * times, whatever the length of the window. Unlike subtracting the states
+     * that leave the window, this works for min and max, and the sums carry no
+     * cancellation error.
+     */
+    void WindowChunk::slideWindow(vector<Value> const& states, vector<Value>& windows, size_t base, size_t stride,
+                                  size_t length, WindowBoundaries const& window, vector<Value>& front) const
+    {
+        size_t const preceding = window._boundaries.first;
+        size_t const following = window._boundaries.second;
+        size_t frontStart = 0;  // the window starts at frontStart
+        size_t backStart = 0;   // front holds [frontStart, backStart), back holds the merge of [backStart, backEnd)
+        size_t backEnd = 0;
+        Value back;
+        back.setNull(0);
+
+        for (size_t i = 0; i < length; i++)
+        {
+            size_t const windowStart = i > preceding ? i - preceding : 0;
+            size_t const windowEnd = std::min(length, i + following + 1);
+            for (; backEnd < windowEnd; backEnd++)
+            {
+                mergeState(back, states[base + backEnd * stride]);
+            }
+            if (windowStart >= backStart && windowStart > frontStart)
+            {
+                for (size_t j = backEnd; j-- > windowStart; )
+                {
+                    front[j] = states[base + j * stride];
+                    if (j + 1 < backEnd)
+                    {
+                        mergeState(front[j], front[j + 1]);
+                    }
+                }
+                backStart = backEnd;
+                back.setNull(0);
+            }
+            frontStart = windowStart;
+
+            Value& result = windows[base + i * stride];
+            if (frontStart < backStart)
+            {
+                result = front[frontStart];
+            }
+            else
+            {
+                result.setNull(0);
+            }
+            mergeState(result, back);
+        }
+    }
+
+    /**
+     *  Private function that computes the window state of every position of the
+     * materialized chunk, one dimension after the other: after the pass over
+     * dimension i, the state of a position merges the cells of the window
+     * around it along the dimensions up to i. The window of an output cell lies
+     * within the overlap, so it is complete after the last pass.
+     */
+    void WindowChunk::evaluateIncrementally()
+    {
+        size_t nPositions = 1;
+        for (size_t i = 0; i < _nDims; i++)
+        {
+            nPositions *= _mapper->getChunkInterval(i);
+        }
+
+        vector<Value> states(nPositions);
+        for (size_t pos = 0; pos < nPositions; pos++)
+        {
+            states[pos].setNull(0);
+        }
+        for (map<uint64_t, Value>::const_iterator i = _inputMap.begin(); i != _inputMap.end(); ++i)
+        {
+            Value& state = states[i->first];
+            if (state.getMissingReason() == 0)
+            {
+                _aggregate->initializeState(state);
+            }
+            _aggregate->accumulate(state, i->second);
+        }
+        _inputMap.clear();
+
+        _windowStates.resize(nPositions);
+        vector<Value> front;
+        size_t stride = nPositions;
+        for (size_t i = 0; i < _nDims; i++)
+        {
+            size_t const length = _mapper->getChunkInterval(i);
+            size_t const lineStride = stride / length;
+            front.resize(length);
+            for (size_t outer = 0; outer < nPositions; outer += stride)
+            {
+                for (size_t inner = 0; inner < lineStride; inner++)
+                {
+                    slideWindow(states, _windowStates, outer + inner, lineStride, length, _array._window[i], front);
+                }
+            }
+            stride = lineStride;
+            if (i + 1 < _nDims)
+            {
+                states.swap(_windowStates);
+            }
+        }
+        _incremental = true;
     }
 
     /**
@@ -753,6 +950,7 @@ namespace scidb
             }
         }
         _materialized = false;
+        _incremental = false;
         if (_aggregate.get() == 0)
         {
             return;
@@ -808,7 +1006,8 @@ namespace scidb
             //   it needs to be. See detailed note in the materialize()
             //   function.
             //
-            if (_arrayIterator->getMethod() == WindowArray::MATERIALIZE)
+            if (_arrayIterator->getMethod() == WindowArray::MATERIALIZE ||
+                _arrayIterator->getMethod() == WindowArray::INCREMENTAL)
             {
                 materialize();
             } else if (_arrayIterator->getMethod() != WindowArray::PROBE)
@@ -855,17 +1054,147 @@ namespace scidb
         }
     }
 
+    // Window Chunk Job
+    WindowChunkJob::WindowChunkJob(WindowArray const& arr, AttributeID attrID, AttributeID inputAttrID,
+                                   string const& method, Coordinates const& pos, boost::shared_ptr<Query> const& query)
+    : Job(query),
+      _iterator(new WindowArrayIterator(arr, attrID, inputAttrID, method, 1)),
+      _pos(pos),
+      _result(NULL),
+      _owner(NOBODY)
+    {
+    }
+
+    /**
+     *  Private function that takes the job over for the given owner, unless
+     * it was already. Returns the owner of the job.
+     */
+    WindowChunkJob::Owner WindowChunkJob::claim(Owner owner)
+    {
+        ScopedMutexLock cs(_mutex);
+        if (_owner == NOBODY)
+        {
+            _owner = owner;
+        }
+        return _owner;
+    }
+
+    /**
+     *  Private function that computes the output chunk. Materializing it
+     * evaluates every window of the chunk.
+     */
+    void WindowChunkJob::evaluate()
+    {
+        if (!_iterator->setPosition(_pos))
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_EXECUTION, SCIDB_LE_OPERATION_FAILED) << "setPosition";
+        }
+        ConstChunk const& outputChunk = _iterator->getChunk();
+        _result = outputChunk.materialize();
+    }
+
+    void WindowChunkJob::run()
+    {
+        if (claim(WORKER) == WORKER)
+        {
+            evaluate();
+        }
+    }
+
+    ConstChunk const& WindowChunkJob::getResult()
+    {
+        if (claim(CONSUMER) == WORKER)
+        {
+            wait(true);
+        }
+        else if (_result == NULL)
+        {
+            evaluate();
+        }
+        SCIDB_ASSERT(_result != NULL);
+        return *_result;
+    }
+
+    /**
+     *  Only a job run by a thread of the queue is waited for. One run or
+     * dropped by the consumer is done as far as the consumer is concerned:
+     * the queue merely skips it when it gets to it, which may be never if
+     * every thread of the queue is a consumer itself.
+     */
+    void WindowChunkJob::cancel()
+    {
+        if (claim(CONSUMER) == WORKER)
+        {
+            wait();
+        }
+        _result = NULL;
+        _iterator.reset();
+    }
+
     // Window Array Iterator
-    WindowArrayIterator::WindowArrayIterator(WindowArray const& arr, AttributeID attrID, AttributeID input,  string const& method)
+    WindowArrayIterator::WindowArrayIterator(WindowArray const& arr, AttributeID attrID, AttributeID input,
+                                             string const& method, size_t prefetchDepth)
     : array(arr),
       iterator(arr._inputArray->getConstIterator(input)),
       currPos(arr._dimensions.size()),
       chunk(arr, attrID),
-      _method(method)
+      _method(method),
+      _attrID(attrID),
+      _inputAttrID(input),
+      _prefetchDepth(prefetchDepth),
+      _sequential(true)
     {
         reset();
     }
 
+    WindowArrayIterator::~WindowArrayIterator()
+    {
+        cancelPrefetch();
+    }
+
+    /**
+     *  Private function that queues jobs for the current position and the
+     * ones after it, up to _prefetchDepth of them.
+     */
+    void WindowArrayIterator::prefetch()
+    {
+        if (_jobs.empty())
+        {
+            _ahead = array._inputArray->getConstIterator(_inputAttrID);
+            if (!_ahead->setPosition(currPos))
+            {
+                throw SYSTEM_EXCEPTION(SCIDB_SE_EXECUTION, SCIDB_LE_OPERATION_FAILED) << "setPosition";
+            }
+        }
+        if (_jobs.size() < _prefetchDepth && !_ahead->end())
+        {
+            boost::shared_ptr<Query> query(Query::getValidQueryPtr(array._query));
+            boost::shared_ptr<JobQueue> queue = PhysicalOperator::getGlobalQueueForOperators();
+            while (_jobs.size() < _prefetchDepth && !_ahead->end())
+            {
+                boost::shared_ptr<WindowChunkJob> job(
+                    new WindowChunkJob(array, _attrID, _inputAttrID, _method, _ahead->getPosition(), query));
+                _jobs.push_back(job);
+                queue->pushJob(job);
+                ++(*_ahead);
+            }
+        }
+        SCIDB_ASSERT(_jobs.front()->getPosition() == currPos);
+    }
+
+    /**
+     *  Private function that drops the queued jobs.
+     */
+    void WindowArrayIterator::cancelPrefetch()
+    {
+        for (size_t i = 0; i < _jobs.size(); i++)
+        {
+            _jobs[i]->cancel();
+        }
+        _jobs.clear();
+        _ahead.reset();
+    }
+
     /**
      *  @see ConstIterator::operator ++()
      */
@@ -873,6 +1202,11 @@ namespace scidb
     {
         if (!hasCurrent)
             throw USER_EXCEPTION(SCIDB_SE_EXECUTION, SCIDB_LE_NO_CURRENT_ELEMENT);
+        if (!_jobs.empty())
+        {
+            _jobs.front()->cancel();
+            _jobs.pop_front();
+        }
         chunkInitialized = false;
         ++(*iterator);
         hasCurrent = !iterator->end();
@@ -905,6 +1239,8 @@ namespace scidb
      */
     bool WindowArrayIterator::setPosition(Coordinates const& pos)
     {
+        cancelPrefetch();
+        _sequential = false;
         chunkInitialized = false;
         if (!iterator->setPosition(pos))
         {
@@ -920,6 +1256,8 @@ namespace scidb
      */
     void WindowArrayIterator::reset()
     {
+        cancelPrefetch();
+        _sequential = true;
         chunkInitialized = false;
         iterator->reset();
         hasCurrent = !iterator->end();
@@ -934,6 +1272,13 @@ namespace scidb
      */
     ConstChunk const& WindowArrayIterator::getChunk()
     {
+        if (_sequential && _prefetchDepth > 1)
+        {
+            if (!hasCurrent)
+                throw USER_EXCEPTION(SCIDB_SE_EXECUTION, SCIDB_LE_NO_CURRENT_CHUNK);
+            prefetch();
+            return _jobs.front()->getResult();
+        }
         if (!chunkInitialized)
         {
             chunk.setPosition(this, currPos);
@@ -946,9 +1291,11 @@ namespace scidb
 
     const std::string WindowArray::PROBE="probe";
     const std::string WindowArray::MATERIALIZE="materialize";
+    const std::string WindowArray::INCREMENTAL="incremental";
 
     WindowArray::WindowArray(ArrayDesc const& desc, boost::shared_ptr<Array> const& inputArray,
-                             vector<WindowBoundaries> const& window, vector<AttributeID> const& inputAttrIDs, vector<AggregatePtr> const& aggregates, string const& method):
+                             vector<WindowBoundaries> const& window, vector<AttributeID> const& inputAttrIDs, vector<AggregatePtr> const& aggregates, string const& method,
+                             boost::shared_ptr<Query> const& query):
       _desc(desc),
       _inputDesc(inputArray->getArrayDesc()),
       _window(window),
@@ -956,8 +1303,15 @@ namespace scidb
       _inputArray(inputArray),
       _inputAttrIDs(inputAttrIDs),
       _aggregates(aggregates),
-      _method(method)
+      _method(method),
+      _query(query),
+      _prefetchDepth(1)
     {
+        //
+        //  Output chunks depend on their input chunk only, so a sequential
+        // reader gets as many of them computed ahead as there are threads
+        // for aggregation.
+        _prefetchDepth = PhysicalOperator::getParallelJobsCount();
     }
 
     /**
@@ -975,9 +1329,9 @@ namespace scidb
     {
         if (_desc.getEmptyBitmapAttribute() && attr == _desc.getEmptyBitmapAttribute()->getId())
         {
-            return boost::shared_ptr<ConstArrayIterator>(new WindowArrayIterator(*this, attr, _inputArray->getArrayDesc().getEmptyBitmapAttribute()->getId(), _method));
+            return boost::shared_ptr<ConstArrayIterator>(new WindowArrayIterator(*this, attr, _inputArray->getArrayDesc().getEmptyBitmapAttribute()->getId(), _method, 1));
         }
 
-        return boost::shared_ptr<ConstArrayIterator>(new WindowArrayIterator(*this, attr, _inputAttrIDs[attr], _method ));
+        return boost::shared_ptr<ConstArrayIterator>(new WindowArrayIterator(*this, attr, _inputAttrIDs[attr], _method, _prefetchDepth));
     }
 }
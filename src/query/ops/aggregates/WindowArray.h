@@ -35,12 +35,15 @@
 
 #include <string>
 #include <vector>
+#include <deque>
 #include "array/DelegateArray.h"
 #include "array/Metadata.h"
 #include "query/FunctionDescription.h"
 #include "query/Expression.h"
 #include "query/Aggregate.h"
 #include "array/MemArray.h"
+#include "util/Job.h"
+#include "util/Mutex.h"
 
 namespace scidb
 {
@@ -121,6 +124,11 @@ class WindowChunk : public ConstChunk
 
   private:
     void materialize();
+    bool isIncrementalEvaluationCheaper() const;
+    void evaluateIncrementally();
+    void slideWindow(vector<Value> const& states, vector<Value>& windows, size_t base, size_t stride, size_t length,
+                     WindowBoundaries const& window, vector<Value>& front) const;
+    void mergeState(Value& dstState, Value const& srcState) const;
     void pos2coord(uint64_t pos, Coordinates& coord) const;
     uint64_t coord2pos(const Coordinates& coord) const;
     inline bool valueIsNeededForAggregate (const Value & val, const ConstChunk & inputChunk) const;
@@ -152,6 +160,13 @@ class WindowChunk : public ConstChunk
     bool _materialized;
     boost::shared_ptr<CoordinatesMapper> _mapper;
 
+    //
+    //  When the window is evaluated incrementally, _windowStates holds, for
+    // every position of the materialized chunk (overlap included), the
+    // aggregate state of the window around it, and _inputMap is released.
+    bool _incremental;
+    std::vector<Value> _windowStates;
+
     /**
      *   Returns true if the chunk's processing algorithm materializes input chunk.
      */
@@ -236,6 +251,68 @@ private:
 
 };
 
+/**
+ *   Computes one output chunk of window(...) on the operator job queue.
+ *
+ *   A WindowArrayIterator that is read sequentially keeps a bounded queue of
+ *  these jobs ahead of its position. A job positions an iterator of its own on
+ *  the output chunk and materializes it. Whoever comes first runs the job: a
+ *  thread of the queue, or the consumer when it needs the chunk before any
+ *  thread picked the job up. So a consumer never waits for a job that has not
+ *  started, even if it runs on a thread of the queue itself, and never waits
+ *  for the queue at all once it ran or dropped the job itself.
+ */
+class WindowChunkJob : public Job
+{
+  public:
+    WindowChunkJob(WindowArray const& array, AttributeID attrID, AttributeID inputAttrID, string const& method,
+                   Coordinates const& pos, boost::shared_ptr<Query> const& query);
+
+    Coordinates const& getPosition() const { return _pos; }
+
+    /**
+     *  Return the output chunk, computing it on the calling thread if no
+     * thread started the job yet. The chunk is valid until cancel().
+     */
+    ConstChunk const& getResult();
+
+    /**
+     *  Prevent the job from running, or wait until it ends, and release the
+     * output chunk and the input iterators.
+     */
+    void cancel();
+
+  protected:
+    virtual void run();
+
+  private:
+    enum Owner
+    {
+        NOBODY,
+        CONSUMER,       // getResult() or cancel() took the job over
+        WORKER          // a thread of the queue runs it
+    };
+
+    Owner claim(Owner owner);
+    void evaluate();
+
+    boost::shared_ptr<WindowArrayIterator> _iterator;
+    Coordinates _pos;
+    ConstChunk const* _result;
+    Mutex _mutex;
+    Owner _owner;
+};
+
+/**
+ *   Iterates over the output chunks of window(...), one per input chunk.
+ *
+ *   An iterator moved with setPosition() computes the chunk it is on lazily,
+ *  on the calling thread: that is how the jobs of a ParallelAccumulatorArray
+ *  over the window read it, so they supply the parallelism. An iterator moved
+ *  with reset() and ++ computes the next prefetchDepth chunks in parallel on
+ *  the operator job queue as soon as it is asked for a chunk, and returns
+ *  them in the order of the input.
+ */
 class WindowArrayIterator : public ConstArrayIterator
 {
     friend class WindowChunk;
@@ -256,9 +333,14 @@ class WindowArrayIterator : public ConstArrayIterator
      */
     string const& getMethod() const { return _method; };
  
-    WindowArrayIterator(WindowArray const& array, AttributeID id, AttributeID input, string const& method);
+    WindowArrayIterator(WindowArray const& array, AttributeID id, AttributeID input, string const& method,
+                        size_t prefetchDepth);
+    virtual ~WindowArrayIterator();
 
   private:
+    void prefetch();
+    void cancelPrefetch();
+
     WindowArray const& array;
     boost::shared_ptr<ConstArrayIterator> iterator;
     Coordinates currPos;
@@ -267,6 +349,12 @@ class WindowArrayIterator : public ConstArrayIterator
     bool chunkInitialized;
     string _method;
 
+    AttributeID _attrID;
+    AttributeID _inputAttrID;
+    size_t _prefetchDepth;
+    bool _sequential;
+    std::deque< boost::shared_ptr<WindowChunkJob> > _jobs;  // for the current position and the ones after it
+    boost::shared_ptr<ConstArrayIterator> _ahead;            // input position of the next job
 };
 
 class WindowArray : public Array
@@ -275,6 +363,7 @@ class WindowArray : public Array
     friend class MaterializedWindowChunkIterator;
     friend class WindowChunkIterator;
     friend class WindowChunk;
+    friend class WindowChunkJob;
 
   public:
     virtual ArrayDesc const& getArrayDesc() const;
@@ -285,10 +374,12 @@ class WindowArray : public Array
                 vector<WindowBoundaries> const& window,
                 vector<AttributeID> const& inputAttrIDs,
                 vector <AggregatePtr> const& aggregates,
-                string const& method);
+                string const& method,
+                boost::shared_ptr<Query> const& query);
 
     static const std::string PROBE;
     static const std::string MATERIALIZE;
+    static const std::string INCREMENTAL;
 
   private:
     ArrayDesc _desc;
@@ -299,6 +390,8 @@ class WindowArray : public Array
     vector<AttributeID> _inputAttrIDs;
     vector <AggregatePtr> _aggregates;
     string _method;
+    boost::weak_ptr<Query> _query;
+    size_t _prefetchDepth;
 
 };
 
@@ -0,0 +1,179 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.
+* Copyright (C) 2008-2014 SciDB, Inc.
+*
+* SciDB is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with SciDB.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+/*
+ * @file BernoulliSettings.h
+ * The settings structure for the bernoulli operator.
+ * @see BuildIndexSettings.h
+ */
+
+#include <time.h>
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <query/Operator.h>
+
+#ifndef BERNOULLI_SETTINGS
+#define BERNOULLI_SETTINGS
+
+namespace scidb
+{
+
+/*
+ * Settings for the Bernoulli operator: the optional seed and sampling block that follow the probability.
+ */
+class BernoulliSettings
+{
+public:
+    static const size_t MAX_PARAMETERS = 3;
+
+private:
+    int _seed;
+    bool _seedSet;
+    bool _chunkSampling;
+    size_t _runLength;
+    bool _blockSet;
+
+    static void checkNotSet(bool isSet, string const& paramHeader)
+    {
+        if (isSet)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_OPERATOR, SCIDB_LE_CANNOT_BE_SET_MORE_THAN_ONCE) << paramHeader;
+        }
+    }
+
+    void parseBlock(string const& parameterString, string const& paramHeader)
+    {
+        string paramContent = parameterString.substr(paramHeader.size());
+        trim(paramContent);
+        if (paramContent == "chunk")
+        {
+            _chunkSampling = true;
+            return;
+        }
+        int64_t sval;
+        try
+        {
+            sval = lexical_cast<int64_t> (paramContent);
+        }
+        catch (bad_lexical_cast const& exn)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_OPERATOR, SCIDB_LE_CANNOT_PARSE_INTEGER_PARAMETER) << parameterString;
+        }
+        if (sval <= 0)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_OPERATOR, SCIDB_LE_PARAMETER_NOT_POSITIVE_INTEGER) << parameterString;
+        }
+        _runLength = sval;
+    }
+
+public:
+    /**
+     * @param operatorParameters as passed to the operator: the probability, then an int64 seed and a string
+     * @param logical true if called with Logical parameters, else physical
+     * @param query the query context
+     */
+    BernoulliSettings(vector<shared_ptr<OperatorParam> > const& operatorParameters,
+                      bool logical,
+                      shared_ptr<Query> const& query):
+        _seed                   ((int) time(NULL)),
+        _seedSet                (false),
+        _chunkSampling          (false),
+        _runLength              (1),
+        _blockSet               (false)
+    {
+        string const blockHeader          = "block=";
+        size_t nParams = operatorParameters.size();
+        if (nParams > MAX_PARAMETERS)
+        {   //assert-like exception. Caller should have taken care of this!
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION)
+                  << "illegal number of parameters passed to BernoulliSettings";
+        }
+        for (size_t i = 1; i<nParams; ++i)
+        {
+            shared_ptr<OperatorParam>const& param = operatorParameters[i];
+            TypeId type;
+            Value value;
+            if (logical)
+            {
+                shared_ptr<OperatorParamLogicalExpression> const& lParam =
+                    (shared_ptr<OperatorParamLogicalExpression> const&) param;
+                type = lParam->getExpectedType().typeId();
+                value = evaluate(lParam->getExpression(), query, type);
+            }
+            else
+            {
+                shared_ptr<Expression> const& pExpr =
+                    ((shared_ptr<OperatorParamPhysicalExpression> const&) param)->getExpression();
+                type = pExpr->getType();
+                value = pExpr->evaluate();
+            }
+            if (type == TID_INT64)
+            {
+                checkNotSet(_seedSet, "seed");
+                if (value.getInt64() < 0)
+                {
+                    throw USER_EXCEPTION(SCIDB_SE_OPERATOR, SCIDB_LE_OP_SAMPLE_ERROR1);
+                }
+                _seed = (int) value.getInt64();
+                _seedSet = true;
+            }
+            else if (starts_with(value.getString(), blockHeader))
+            {
+                checkNotSet(_blockSet, blockHeader);
+                parseBlock(value.getString(), blockHeader);
+                _blockSet = true;
+            }
+            else
+            {
+                throw SYSTEM_EXCEPTION(SCIDB_SE_OPERATOR, SCIDB_LE_UNRECOGNIZED_PARAMETER) << value.getString();
+            }
+        }
+    }
+
+    /**
+     * @return the seed of the random number generator; the current time if not given
+     */
+    int getSeed() const
+    {
+        return _seed;
+    }
+
+    /**
+     * @return true if whole chunks are sampled ('block=chunk')
+     */
+    bool isChunkSampling() const
+    {
+        return _chunkSampling;
+    }
+
+    /**
+     * @return the number of consecutive cells sampled together ('block=N'); 1 by default
+     */
+    size_t getRunLength() const
+    {
+        return _runLength;
+    }
+};
+
+}
+
+#endif //BERNOULLI_SETTINGS
@@ -30,6 +30,7 @@
 #include "query/Operator.h"
 #include "system/SystemCatalog.h"
 #include "system/Exceptions.h"
+#include "BernoulliSettings.h"
 
 using namespace std;
 
@@ -39,15 +40,21 @@ namespace scidb {
  * @brief The operator: bernoulli().
  *
  * @par Synopsis:
- *   bernoulli( srcArray, probability [, seed] )
+ *   bernoulli( srcArray, probability [, seed [, 'block=chunk' | 'block=N'] ] )
  *
  * @par Summary:
  *   Evaluates whether to include a cell in the result array by generating a random number and checks if it is less than probability.
+ *   <br> With 'block=chunk', whole chunks are included or not, each with the given probability: the chunks left out
+ *   are not read at all, so a small sample of a large stored array reads only a small part of it.
+ *   <br> With 'block=N', runs of N consecutive non-empty cells of a chunk are included, about a fraction probability
+ *   of the cells in all; only the chunks in which a run starts are read.
  *
  * @par Input:
  *   - srcArray: a source array with srcAttrs and srcDims.
  *   - probability: the probability threshold, in [0..1]
  *   - an optional seed for the random number generator.
+ *   - an optional sampling block, after the seed: 'block=chunk' for whole chunks, 'block=N' for runs of N cells;
+ *     cells by default.
  *
  * @par Output array:
  *        <
@@ -93,13 +100,18 @@ public:
 	{
 		std::vector<boost::shared_ptr<OperatorParamPlaceholder> > res;
         res.push_back(END_OF_VARIES_PARAMS());
-        res.push_back(PARAM_CONSTANT("int64"));
+        if (_parameters.size() == 1) {
+            res.push_back(PARAM_CONSTANT("int64"));
+        } else if (_parameters.size() < BernoulliSettings::MAX_PARAMETERS) {
+            res.push_back(PARAM_CONSTANT("string"));
+        }
         return res;
 	}
 
     ArrayDesc inferSchema(vector<ArrayDesc> schemas, boost::shared_ptr< Query> query)
     {
         assert(schemas.size() == 1);
+        BernoulliSettings settings(_parameters, true, query);
         return addEmptyTagAttribute(schemas[0]);
     }
 };
@@ -31,7 +31,9 @@
 #include "array/Metadata.h"
 #include "array/DelegateArray.h"
 #include "system/SciDBConfigOptions.h"
+#include "util/Hashing.h"
 #include "NumericOps.h"
+#include "BernoulliSettings.h"
 
 using namespace std;
 using namespace boost;
@@ -46,19 +48,17 @@ class BernoulliArrayIterator : public DelegateArrayIterator
   public:
 	virtual void operator ++()
     {
+        ++(*inputIterator);
+        if (chunkSampling) {
+            skipUnselectedChunks();
+            return;
+        }
+        // Replay the draws of the chunk iterator over the rest of the chunk
         while (nextElem < nChunkElems) { 
-            nextElem += nops.geomdist(probability);
+            nextElem += runLength - 1 + nops.geomdist(startProbability);
         }
         nextElem -= nChunkElems;
-        ++(*inputIterator);
-        while (!inputIterator->end()) { 
-            nChunkElems = inputIterator->getChunk().count();
-            if (nextElem < nChunkElems) {
-                return;
-            }
-            nextElem -= nChunkElems;
-            ++(*inputIterator);
-        }
+        skipChunksWithoutSample();
     }
 
     virtual bool setPosition(Coordinates const& pos) 
@@ -66,6 +66,9 @@ class BernoulliArrayIterator : public DelegateArrayIterator
         CoordinatesLess less;
         currPos = pos;
         inputDesc.getChunkPositionFor(currPos);
+        if (chunkSampling) {
+            return isSelected(currPos) && inputIterator->setPosition(currPos);
+        }
         if (end() || !less(inputIterator->getPosition(), currPos)) { 
             reset();
         }
@@ -78,22 +81,26 @@ class BernoulliArrayIterator : public DelegateArrayIterator
 	virtual void reset() 
     { 
         inputIterator->reset();
-        nops.ResetSeed(seed);
-        nextElem = nops.geomdist(probability);
-        while (!inputIterator->end()) { 
-            nChunkElems = inputIterator->getChunk().count();
-            if (nextElem < nChunkElems) {
-                return;
-            }
-            nextElem -= nChunkElems;
-            ++(*inputIterator);
+        if (chunkSampling) {
+            skipUnselectedChunks();
+            return;
         }
+        nops.ResetSeed(seed);
+        nextElem = nops.geomdist(startProbability);
+        skipChunksWithoutSample();
     }
 
+    /**
+     * @param runLen the number of consecutive cells sampled together, 1 to sample cells
+     * @param chunks true to sample whole chunks
+     */
     BernoulliArrayIterator(DelegateArray const& array, AttributeID attrID, shared_ptr<ConstArrayIterator> inputIterator,
-                           double prob, int rndGenSeed)
+                           double prob, int rndGenSeed, size_t runLen, bool chunks)
     : DelegateArrayIterator(array, attrID, inputIterator),
       probability(prob), seed(rndGenSeed), threshold((int)(RAND_MAX*probability)),
+      runLength(runLen),
+      startProbability(prob / (runLen - (runLen - 1) * prob)),
+      chunkSampling(chunks),
       nops(rndGenSeed),
       inputDesc(array.getInputArray()->getArrayDesc()),
       isPlainArray(inputDesc.getEmptyBitmapAttribute() == NULL)
@@ -103,9 +110,47 @@ class BernoulliArrayIterator : public DelegateArrayIterator
     }
 
   private:
+    /**
+     * Skip the chunks in which no run starts, by their element counts, without reading them.
+     */
+    void skipChunksWithoutSample()
+    {
+        while (!inputIterator->end()) { 
+            nChunkElems = inputIterator->getChunk().count();
+            if (nextElem < nChunkElems) {
+                return;
+            }
+            nextElem -= nChunkElems;
+            ++(*inputIterator);
+        }
+    }
+
+    /**
+     * Whether a chunk is sampled depends only on its position and the seed, so that the iterators of
+     * all the attributes, on all the instances, agree without drawing random numbers in the same order.
+     */
+    bool isSelected(Coordinates const& chunkPos) const
+    {
+        uint64_t hash = fmix(static_cast<uint64_t>(seed));
+        for (size_t i = 0; i < chunkPos.size(); i++) {
+            hash = fmix(hash + static_cast<uint64_t>(chunkPos[i]));
+        }
+        return (hash >> 11) * (1.0 / (static_cast<uint64_t>(1) << 53)) < probability;
+    }
+
+    void skipUnselectedChunks()
+    {
+        while (!inputIterator->end() && !isSelected(inputIterator->getPosition())) {
+            ++(*inputIterator);
+        }
+    }
+
     double probability;
     unsigned int seed;
     int threshold;
+    size_t runLength;
+    double startProbability;    // of a run at every cell, so that about probability of the cells are sampled
+    bool chunkSampling;
     NumericOperations nops;
     ArrayDesc const& inputDesc;
     size_t nextElem;
@@ -124,7 +169,17 @@ class BernoulliArrayIterator : public DelegateArrayIterator
         {
             if (!hasCurrent)
                 throw USER_EXCEPTION(SCIDB_SE_EXECUTION, SCIDB_LE_NO_CURRENT_ELEMENT);
-            nextElem += nops.geomdist(arrayIterator.probability);
+            if (arrayIterator.chunkSampling) {
+                ++(*inputIterator);
+                hasCurrent = !inputIterator->end();
+                return;
+            }
+            if (nextElem < runLast) {
+                nextElem += 1;
+            } else {
+                nextElem += nops.geomdist(arrayIterator.startProbability);
+                runLast = nextElem + arrayIterator.runLength - 1;
+            }
             if (nextElem < arrayIterator.nChunkElems) { 
                 setSamplePosition();
             } else { 
@@ -151,9 +206,14 @@ class BernoulliArrayIterator : public DelegateArrayIterator
           arrayIterator((BernoulliArrayIterator&)chunk->getArrayIterator()),                
           nops(arrayIterator.nops),
           nextElem(arrayIterator.nextElem),
+          runLast(nextElem + arrayIterator.runLength - 1),
           lastElem(0)
         {
-            setSamplePosition();        
+            if (arrayIterator.chunkSampling) {
+                hasCurrent = !inputIterator->end();
+            } else {
+                setSamplePosition();
+            }
             trueValue.setBool(true);
         }
 
@@ -185,6 +245,7 @@ class BernoulliArrayIterator : public DelegateArrayIterator
         BernoulliArrayIterator& arrayIterator;
         NumericOperations nops;
         size_t nextElem;
+        size_t runLast;         // the last element of the current run
         size_t lastElem;
         bool hasCurrent;
         Value trueValue;
@@ -195,18 +256,35 @@ class BernoulliArray : public DelegateArray
   public:
     virtual DelegateChunkIterator* createChunkIterator(DelegateChunk const* chunk, int iterationMode) const
     {
+        if (chunk->isDirectMapping()) {
+            return DelegateArray::createChunkIterator(chunk, iterationMode);
+        }
         return new BernoulliChunkIterator(chunk, iterationMode);
     }
 
+    /**
+     * A sampled chunk of an attribute of an emptyable input is the input chunk itself.
+     */
+    virtual DelegateChunk* createChunk(DelegateArrayIterator const* iterator, AttributeID id) const
+    {
+        bool const clone = chunkSampling && id < nAttrs
+            && inputArray->getArrayDesc().getEmptyBitmapAttribute() != NULL;
+        return new DelegateChunk(*this, *iterator, id, clone);
+    }
+
     virtual DelegateArrayIterator* createArrayIterator(AttributeID id) const 
     {
-        return new BernoulliArrayIterator(*this, id, inputArray->getConstIterator(id < nAttrs ? id : 0), probability, seed);
+        return new BernoulliArrayIterator(*this, id, inputArray->getConstIterator(id < nAttrs ? id : 0), probability, seed,
+                                          runLength, chunkSampling);
     }
 
-    BernoulliArray(ArrayDesc const& desc, boost::shared_ptr<Array> input, double prob, int rndGenSeed) 
+    BernoulliArray(ArrayDesc const& desc, boost::shared_ptr<Array> input, double prob, int rndGenSeed,
+                   size_t runLen, bool chunks) 
     : DelegateArray(desc, input),
       probability(prob),
-      seed(rndGenSeed)
+      seed(rndGenSeed),
+      runLength(runLen),
+      chunkSampling(chunks)
     {
         nAttrs = input->getArrayDesc().getAttributes().size();
     }
@@ -216,6 +294,8 @@ class BernoulliArray : public DelegateArray
     size_t nAttrs;
     double probability;
     int seed;
+    size_t runLength;
+    bool chunkSampling;
 };
 
 class PhysicalBernoulli: public PhysicalOperator
@@ -235,6 +315,9 @@ public:
 	/***
 	 * Bernoulli is a pipelined operator, hence it executes by returning an iterator-based array to the consumer
 	 * that overrides the chunkiterator method.
+	 * Cells are sampled by drawing the gaps between samples from a geometric distribution, so that the chunks
+	 * without a sample are skipped by their element counts. With 'block=N' the samples are runs of N cells,
+	 * with 'block=chunk' whole chunks, which are never fetched when left out.
 	 */
 	boost::shared_ptr<Array> execute(vector< boost::shared_ptr<Array> >& inputArrays, boost::shared_ptr<Query> query)
     {
@@ -242,15 +325,12 @@ public:
 
 		shared_ptr<Array> inputArray = ensureRandomAccess(inputArrays[0], query);
 
-        int seed = (_parameters.size() == 2)
-            ? (int)((boost::shared_ptr<OperatorParamPhysicalExpression>&)_parameters[1])->getExpression()->evaluate().getInt64()
-            : (int)time(NULL);
+        BernoulliSettings settings(_parameters, false, query);
         double probability = ((boost::shared_ptr<OperatorParamPhysicalExpression>&)_parameters[0])->getExpression()->evaluate().getDouble();
-        if (seed < 0)
-            throw USER_EXCEPTION(SCIDB_SE_OPERATOR, SCIDB_LE_OP_SAMPLE_ERROR1);
         if (probability <= 0 || probability > 1)
             throw USER_EXCEPTION(SCIDB_SE_OPERATOR, SCIDB_LE_OP_SAMPLE_ERROR2);
-        return boost::shared_ptr<Array>(new BernoulliArray(_schema, inputArray, probability, seed));
+        return boost::shared_ptr<Array>(new BernoulliArray(_schema, inputArray, probability, settings.getSeed(),
+                                                           settings.getRunLength(), settings.isChunkSampling()));
     }
 };
     
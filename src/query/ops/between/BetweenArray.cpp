@@ -437,6 +437,10 @@ namespace scidb
             array.getChunkPositionFor(newLow);
             _extendedSpatialRangesPtr->_ranges.push_back(SpatialRange(newLow, _spatialRangesPtr->_ranges[i]._high));
         }
+
+        // With many ranges (e.g. cross_between), the per-cell and per-chunk tests descend R-trees.
+        _spatialRangesPtr->buildIndex();
+        _extendedSpatialRangesPtr->buildIndex();
     }
     
     DelegateArrayIterator* BetweenArray::createArrayIterator(AttributeID attrID) const
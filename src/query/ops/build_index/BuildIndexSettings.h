@@ -0,0 +1,193 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.
+* Copyright (C) 2008-2014 SciDB, Inc.
+*
+* SciDB is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with SciDB.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+/*
+ * @file BuildIndexSettings.h
+ * The settings structure for the build_index operator.
+ * @see GroupedAggregateSettings.h
+ */
+
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <query/Operator.h>
+
+#ifndef BUILD_INDEX_SETTINGS
+#define BUILD_INDEX_SETTINGS
+
+namespace scidb
+{
+
+/*
+ * Settings for the BuildIndex operator.
+ */
+class BuildIndexSettings
+{
+public:
+    static const size_t DEFAULT_CHUNK_SIZE = 1000000;
+    static const size_t MAX_PARAMETERS = 3;
+
+private:
+    ArrayDesc const& _inputSchema;
+    AttributeID _inputAttributeId;
+    size_t _memoryLimit;
+    bool _memoryLimitSet;
+    size_t _chunkSize;
+    bool _chunkSizeSet;
+
+    static int64_t parsePositiveInteger(string const& parameterString, string const& paramHeader)
+    {
+        string paramContent = parameterString.substr(paramHeader.size());
+        trim(paramContent);
+        int64_t sval;
+        try
+        {
+            sval = lexical_cast<int64_t> (paramContent);
+        }
+        catch (bad_lexical_cast const& exn)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_OPERATOR, SCIDB_LE_CANNOT_PARSE_INTEGER_PARAMETER) << parameterString;
+        }
+        if (sval <= 0)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_OPERATOR, SCIDB_LE_PARAMETER_NOT_POSITIVE_INTEGER) << parameterString;
+        }
+        return sval;
+    }
+
+    static void checkNotSet(bool isSet, string const& paramHeader)
+    {
+        if (isSet)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_OPERATOR, SCIDB_LE_CANNOT_BE_SET_MORE_THAN_ONCE) << paramHeader;
+        }
+    }
+
+public:
+    /**
+     * @param inputSchema the schema of the input array
+     * @param operatorParameters as passed to the operator: the attribute reference, then the string parameters
+     * @param logical true if called with Logical parameters, else physical
+     * @param query the query context
+     */
+    BuildIndexSettings(ArrayDesc const& inputSchema,
+                       vector<shared_ptr<OperatorParam> > const& operatorParameters,
+                       bool logical,
+                       shared_ptr<Query>& query):
+        _inputSchema            (inputSchema),
+        _inputAttributeId       (((shared_ptr<OperatorParamReference> const&) operatorParameters[0])->getObjectNo()),
+        _memoryLimit            (Config::getInstance()->getOption<size_t>(CONFIG_MEM_ARRAY_THRESHOLD) * MiB),
+        _memoryLimitSet         (false),
+        _chunkSize              (DEFAULT_CHUNK_SIZE),
+        _chunkSizeSet           (false)
+    {
+        if (((shared_ptr<OperatorParamReference> const&) operatorParameters[0])->getInputNo() != 0)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_OPERATOR, SCIDB_LE_NOT_AN_ATTRIBUTE_IN_INPUT)
+                  << ((shared_ptr<OperatorParamReference> const&) operatorParameters[0])->getObjectName();
+        }
+        string const memLimitHeader       = "memory_limit=";
+        string const chunkSizeHeader      = "chunk_size=";
+        size_t nParams = operatorParameters.size();
+        if (nParams > MAX_PARAMETERS)
+        {   //assert-like exception. Caller should have taken care of this!
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION)
+                  << "illegal number of parameters passed to BuildIndexSettings";
+        }
+        for (size_t i = 1; i<nParams; ++i)
+        {
+            shared_ptr<OperatorParam>const& param = operatorParameters[i];
+            string parameterString;
+            if (logical)
+            {
+                parameterString = evaluate(((shared_ptr<OperatorParamLogicalExpression>&) param)->
+                                           getExpression(),query, TID_STRING).getString();
+            }
+            else
+            {
+                parameterString = ((shared_ptr<OperatorParamPhysicalExpression>&) param)->
+                                  getExpression()->evaluate().getString();
+            }
+            if (starts_with(parameterString, memLimitHeader))
+            {
+                checkNotSet(_memoryLimitSet, memLimitHeader);
+                _memoryLimit = parsePositiveInteger(parameterString, memLimitHeader) * MiB;
+                _memoryLimitSet = true;
+            }
+            else if (starts_with(parameterString, chunkSizeHeader))
+            {
+                checkNotSet(_chunkSizeSet, chunkSizeHeader);
+                _chunkSize = parsePositiveInteger(parameterString, chunkSizeHeader);
+                _chunkSizeSet = true;
+            }
+            else
+            {
+                throw SYSTEM_EXCEPTION(SCIDB_SE_OPERATOR, SCIDB_LE_UNRECOGNIZED_PARAMETER) << parameterString;
+            }
+        }
+    }
+
+    /**
+     * @return the id of the indexed attribute
+     */
+    AttributeID getInputAttributeId() const
+    {
+        return _inputAttributeId;
+    }
+
+    /**
+     * @return the memory limit (converted to bytes) of the hash tables of distinct values
+     */
+    size_t getMemoryLimit() const
+    {
+        return _memoryLimit;
+    }
+
+    /**
+     * @return the chunk size of the output array
+     */
+    size_t getChunkSize() const
+    {
+        return _chunkSize;
+    }
+
+    /**
+     * The output has the indexed attribute, no longer nullable, along [i=0:*,chunk_size,0].
+     */
+    ArrayDesc getOutputSchema() const
+    {
+        AttributeDesc const& input = _inputSchema.getAttributes()[_inputAttributeId];
+        Attributes outputAttributes;
+        outputAttributes.push_back(AttributeDesc(0,
+                                                 input.getName(),
+                                                 input.getType(),
+                                                 0,
+                                                 input.getDefaultCompressionMethod()));
+        outputAttributes = addEmptyTagAttribute(outputAttributes);
+        Dimensions outputDimensions;
+        outputDimensions.push_back(DimensionDesc("i", 0, MAX_COORDINATE, _chunkSize, 0));
+        return ArrayDesc(_inputSchema.getName(), outputAttributes, outputDimensions);
+    }
+};
+
+}
+
+#endif //BUILD_INDEX_SETTINGS
@@ -0,0 +1,99 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.
+* Copyright (C) 2008-2014 SciDB, Inc.
+*
+* SciDB is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with SciDB.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+#include <query/Operator.h>
+#include "BuildIndexSettings.h"
+
+namespace scidb
+{
+
+/**
+ * @brief The operator: build_index()
+ *
+ * @par Synopsis: build_index (input_array, input_array.attribute_name [,'memory_limit=MEMORY_LIMIT']
+ *                             [,'chunk_size=CHUNK_SIZE'])
+ *
+ * @par Examples:
+ *   <br> build_index(stock_trades, stock_trades.ticker)
+ *   <br> store(build_index(stock_trades, stock_trades.ticker, 'chunk_size=100000'), stock_symbols)
+ *
+ * @par Summary:
+ *   <br>
+ *   Builds the index of the distinct values of an attribute of the input array: a dense one-dimensional array of
+ *   the values in ascending order, starting at 0, as index_lookup() expects. It gives the same result as
+ *   uniq(sort(project(input_array, attribute_name))), but the input need not be sorted and every instance takes an
+ *   equal part of the work: the distinct values are found with hash tables and sorted by key range, without
+ *   merging the whole array on one instance. Null values are discarded. The comparison "<" function must be
+ *   registered in SciDB for the datatype of the attribute.
+ *   <br>
+ *   <br>
+ *   The hash tables of distinct values of an instance take at most 'memory_limit' mebibytes (MEM_ARRAY_THRESHOLD by
+ *   default); larger tables are flushed and merged in parts.
+ *
+ * @par Input:
+ *   <br> input_array <..., input_attribute: type,... > [*]
+ *   <br> input_attribute                --the attribute whose values are indexed
+ *   <br> ['memory_limit=MEMORY_LIMIT']  --the memory limit of the hash tables (MB)
+ *   <br> ['chunk_size=CHUNK_SIZE']      --the chunk size of the output (default 1000000)
+ *
+ * @par Output array:
+ *   <br> <
+ *   <br>   input_attribute: type not null
+ *   <br> >
+ *   <br> [ i=0:*,CHUNK_SIZE,0 ]
+ *   <br>
+ *
+ * @see PhysicalBuildIndex.cpp for a description of the algorithm.
+ * @see LogicalIndexLookup.cpp
+ */
+class LogicalBuildIndex : public LogicalOperator
+{
+public:
+    LogicalBuildIndex(const string& logicalName, const string& alias):
+        LogicalOperator(logicalName, alias)
+    {
+        ADD_PARAM_INPUT()
+        ADD_PARAM_IN_ATTRIBUTE_NAME("void")
+        ADD_PARAM_VARIES()
+    }
+
+    vector<shared_ptr<OperatorParamPlaceholder> > nextVaryParamPlaceholder(vector< ArrayDesc> const& schemas)
+    {
+        vector<shared_ptr<OperatorParamPlaceholder> > res;
+        res.push_back(END_OF_VARIES_PARAMS());
+        if (_parameters.size() < BuildIndexSettings::MAX_PARAMETERS)
+        {
+            res.push_back(PARAM_CONSTANT(TID_STRING));
+        }
+        return res;
+    }
+
+    ArrayDesc inferSchema(vector< ArrayDesc> schemas, shared_ptr< Query> query)
+    {
+        BuildIndexSettings settings(schemas[0], _parameters, true, query);
+        return settings.getOutputSchema();
+    }
+};
+
+DECLARE_LOGICAL_OPERATOR_FACTORY(LogicalBuildIndex, "build_index")
+
+} //namespace scidb
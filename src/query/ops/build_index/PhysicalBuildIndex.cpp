@@ -0,0 +1,312 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.
+* Copyright (C) 2008-2014 SciDB, Inc.
+*
+* SciDB is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with SciDB.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+#include <boost/foreach.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include "BuildIndexSettings.h"
+#include "../grouped_aggregate/AggregateHashTable.h"
+#include <query/Operator.h>
+#include <query/TupleExchange.h>
+#include <array/DelegateArray.h>
+#include <array/RowCollection.h>
+#include <array/SortArray.h>
+
+namespace scidb
+{
+
+static log4cxx::LoggerPtr buildIndexLogger(log4cxx::Logger::getLogger("scidb.operators.build_index"));
+
+/**
+ * @par Algorithm:
+ * <br>
+ * <br>
+ * 1. Every instance puts the values of its input cells in a hash table of distinct values (an AggregateHashTable
+ * without aggregates), flushed whenever it grows past the memory limit, and sends them to the instance given by a
+ * hash of the value (see TupleExchange). All the copies of a value end up on the same instance.
+ * <br>
+ * 2. Every instance removes the duplicates among the values it received, with a hash table again. When the table
+ * could exceed the memory limit, the values are first split into partitions by another hash, like grouped_aggregate
+ * does. Every value now exists exactly once.
+ * <br>
+ * 3. The instances agree on one key range per instance from samples of these distinct values (see RangePartitioner),
+ * so that heavily repeated values do not skew the ranges, and every instance sends its distinct values to the
+ * instances of their key ranges.
+ * <br>
+ * 4. Every instance sorts its key range with SortArray, which spills to disk as needed, and writes it after the
+ * values of the lower key ranges, whose number it learns from an exchange of the counts. The first and the last
+ * output chunks of an instance may be partial; the optimizer merges them.
+ * <br>
+ * <br>
+ * Unlike sort() followed by uniq(), no step passes the whole array through one instance.
+ */
+class PhysicalBuildIndex : public PhysicalOperator
+{
+private:
+    typedef RowCollection<size_t> Partitions;
+
+    /**
+     * Seeds of the independent hashes of the values. The hash table uses a third one.
+     */
+    static const uint32_t EXCHANGE_SEED  = 0;
+    static const uint32_t PARTITION_SEED = 0x85ebca6b;
+
+    /**
+     * Number of values per chunk of the exchanged arrays.
+     */
+    static const size_t EXCHANGE_CHUNK_SIZE = 10000;
+
+    /**
+     * Number of values an instance contributes to the choice of the key ranges.
+     */
+    static const size_t SAMPLES_PER_INSTANCE = 128;
+
+    /**
+     * Send the distinct values of a table to the instances given by their hash.
+     */
+    static void flush(AggregateHashTable const& table, TupleExchange::KeyKinds const& keys,
+                      TupleExchange& exchange, size_t nInstances)
+    {
+        for (size_t i = 0, n = table.size(); i < n; ++i)
+        {
+            vector<Value> const& entry = table.getEntry(i);
+            exchange.append(TupleExchange::hashTuple(entry, keys, EXCHANGE_SEED) % nInstances, entry);
+        }
+    }
+
+    /**
+     * Keep the distinct values of a table.
+     */
+    static void flushDistinct(AggregateHashTable const& table, TupleWriter& distinct)
+    {
+        for (size_t i = 0, n = table.size(); i < n; ++i)
+        {
+            distinct.write(table.getEntry(i));
+        }
+    }
+
+    /**
+     * @return how the values are hashed and compared: floating-point values by value
+     */
+    TupleExchange::KeyKinds getValueKeys() const
+    {
+        return TupleExchange::getKeyKinds(_schema.getAttributes(true), 1);
+    }
+
+    /**
+     * Find the distinct values of the local input and send them to the instances given by their hash.
+     * @return the values received by this instance
+     */
+    shared_ptr<Array> distributeValues(shared_ptr<Array> const& input,
+                                       BuildIndexSettings const& settings,
+                                       shared_ptr<Query> const& query)
+    {
+        size_t const nInstances = query->getInstancesCount();
+        size_t const memoryLimit = settings.getMemoryLimit();
+        TupleExchange exchange(input->getArrayDesc().getName() + "_values", _schema.getAttributes(true),
+                               EXCHANGE_CHUNK_SIZE, query);
+        TupleExchange::KeyKinds const keys = getValueKeys();
+        AggregateHashTable table(keys, vector<AggregatePtr>());
+        vector<Value> value(1);
+        vector<Value> const noInputs;
+        size_t nFlushes = 0;
+        for (shared_ptr<ConstArrayIterator> arrayIter = input->getConstIterator(settings.getInputAttributeId());
+             !arrayIter->end();
+             ++(*arrayIter))
+        {
+            for (shared_ptr<ConstChunkIterator> chunkIter =
+                     arrayIter->getChunk().getConstIterator(ChunkIterator::IGNORE_EMPTY_CELLS |
+                                                            ChunkIterator::IGNORE_OVERLAPS);
+                 !chunkIter->end();
+                 ++(*chunkIter))
+            {
+                value[0] = chunkIter->getItem();
+                if (value[0].isNull())
+                {
+                    continue;
+                }
+                table.accumulate(value, noInputs);
+                if (table.getUsedBytes() > memoryLimit)
+                {
+                    flush(table, keys, exchange, nInstances);
+                    table.clear();
+                    ++nFlushes;
+                }
+            }
+        }
+        flush(table, keys, exchange, nInstances);
+        LOG4CXX_DEBUG(buildIndexLogger, "build_index: sending " << exchange.getTupleCount()
+                      << " values after " << nFlushes << " early flush(es)");
+        return exchange.exchange();
+    }
+
+    /**
+     * Remove the duplicates among the received values, partition by partition, so that the distinct values of a
+     * partition fit in memory.
+     */
+    void distinctPartitioned(shared_ptr<Array> const& values,
+                             size_t nPartitions,
+                             AggregateHashTable& table,
+                             TupleWriter& distinct,
+                             shared_ptr<Query> const& query)
+    {
+        Attributes const& attributes = values->getArrayDesc().getAttributes(true);
+        Partitions partitions(query, "", attributes);
+        TupleExchange::KeyKinds const keys = getValueKeys();
+        for (TupleReader reader(values); !reader.end(); ++reader)
+        {
+            vector<Value> const& tuple = reader.getTuple();
+            size_t rowId = UNKNOWN_ROW_ID;
+            partitions.appendItem(rowId, TupleExchange::hashTuple(tuple, keys, PARTITION_SEED) % nPartitions, tuple);
+        }
+        partitions.switchMode(RowCollectionModeRead);
+
+        vector<Value> tuple(attributes.size());
+        for (size_t p = 0; p < nPartitions; ++p)
+        {
+            if (!partitions.existsGroup(p))
+            {
+                continue;
+            }
+            table.clear();
+            boost::scoped_ptr<Partitions::MyRowIterator> rowIter(
+                partitions.openRow(partitions.rowIdFromExistingGroup(p)));
+            while (!rowIter->end())
+            {
+                rowIter->getItem(tuple);
+                table.merge(tuple);
+                ++(*rowIter);
+            }
+            flushDistinct(table, distinct);
+            query->validate();
+        }
+    }
+
+public:
+    PhysicalBuildIndex(string const& logicalName,
+                       string const& physicalName,
+                       Parameters const& parameters,
+                       ArrayDesc const& schema):
+        PhysicalOperator(logicalName, physicalName, parameters, schema)
+    {}
+
+    /**
+     * Every instance writes its own key range, with partial chunks at the range boundaries.
+     */
+    virtual bool changesDistribution(std::vector<ArrayDesc> const&) const
+    {
+        return true;
+    }
+
+    virtual bool outputFullChunks(std::vector<ArrayDesc> const&) const
+    {
+        return false;
+    }
+
+    virtual ArrayDistribution getOutputDistribution(vector<ArrayDistribution> const&,
+                                                    vector<ArrayDesc> const&) const
+    {
+        return ArrayDistribution(psUndefined);
+    }
+
+    /**
+     * There are at most as many distinct values as input cells.
+     */
+    virtual PhysicalBoundaries getOutputBoundaries(vector<PhysicalBoundaries> const& inputBoundaries,
+                                                   vector<ArrayDesc> const& inputSchemas) const
+    {
+        uint64_t numCells = inputBoundaries[0].getNumCells();
+        if (numCells == 0)
+        {
+            return PhysicalBoundaries::createEmpty(1);
+        }
+        Coordinates start(1, 0);
+        Coordinates end(1, numCells - 1);
+        return PhysicalBoundaries(start, end);
+    }
+
+    shared_ptr<Array> execute(vector< shared_ptr< Array> >& inputArrays, shared_ptr<Query> query)
+    {
+        BuildIndexSettings settings(inputArrays[0]->getArrayDesc(), _parameters, false, query);
+        shared_ptr<Array> values = distributeValues(inputArrays[0], settings, query);
+
+        uint64_t const count = getCellCount(values);
+        uint64_t const distinctSize = getChunksSize(values) + count * AggregateHashTable::getEntryOverhead(1);
+        size_t const nPartitions = (distinctSize + settings.getMemoryLimit() - 1) / settings.getMemoryLimit();
+        LOG4CXX_DEBUG(buildIndexLogger, "build_index: received " << count << " values"
+                      << ", estimated size " << distinctSize << " bytes, " << nPartitions << " partition(s)");
+
+        Dimensions dims(2);
+        dims[0] = DimensionDesc("instance_id", 0, query->getInstancesCount() - 1, 1, 0);
+        dims[1] = DimensionDesc("value_no", 0, MAX_COORDINATE, EXCHANGE_CHUNK_SIZE, 0);
+        TupleWriter distinct(ArrayDesc(_schema.getName() + "_distinct",
+                                       addEmptyTagAttribute(_schema.getAttributes(true)), dims),
+                             query);
+        AggregateHashTable table(getValueKeys(), vector<AggregatePtr>());
+        if (nPartitions <= 1)
+        {
+            for (TupleReader reader(values); !reader.end(); ++reader)
+            {
+                table.merge(reader.getTuple());
+            }
+            flushDistinct(table, distinct);
+        }
+        else
+        {
+            distinctPartitioned(values, nPartitions, table, distinct, query);
+        }
+        table.clear();
+        values.reset();
+        shared_ptr<Array> distinctValues = distinct.finish();
+
+        vector<Key> keys(1);
+        keys[0].columnNo = 0;
+        keys[0].ascent = true;
+        shared_ptr<TupleComparator> tcomp(new TupleComparator(keys, _schema));
+        RangePartitioner partitioner(distinctValues, tcomp, SAMPLES_PER_INSTANCE, query);
+
+        TupleExchange ranges(_schema.getName() + "_ranges", _schema.getAttributes(true), EXCHANGE_CHUNK_SIZE, query);
+        {
+            Tuple tuple(1);
+            for (TupleReader reader(distinctValues); !reader.end(); ++reader)
+            {
+                tuple[0] = reader.getTuple()[0];
+                ranges.append(partitioner.getRange(tuple), reader.getTuple());
+            }
+        }
+        distinctValues.reset();
+        shared_ptr<Array> received = ranges.exchange();
+
+        uint64_t const nDistinct = getCellCount(received);
+        uint64_t const start = RangePartitioner::getRangeStart(nDistinct, query);
+        LOG4CXX_DEBUG(buildIndexLogger, "build_index: key range of " << nDistinct << " values at position " << start);
+
+        SortArray sorter(_schema, settings.getChunkSize());
+        shared_ptr<Array> sorted = sorter.getSortedArray(received, query, tcomp, start);
+        //SortArray names its dimension n
+        return shared_ptr<Array>(new DelegateArray(_schema, sorted, true));
+    }
+};
+
+DECLARE_PHYSICAL_OPERATOR_FACTORY(PhysicalBuildIndex, "build_index", "PhysicalBuildIndex")
+
+} //namespace scidb
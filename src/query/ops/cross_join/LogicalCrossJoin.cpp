@@ -94,6 +94,9 @@ namespace scidb
  *
  * @par Notes:
  *   - Joining non-integer dimensions does not work.
+ *   - On execution the instances compare the sizes of the inputs and either replicate the smaller one,
+ *     or hash both on their join dimensions. explain_physical shows the choice predicted from the
+ *     estimated sizes.
  *
  */
 class LogicalCrossJoin: public LogicalOperator
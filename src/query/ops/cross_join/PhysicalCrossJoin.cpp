@@ -27,8 +27,15 @@
  *      Author: Knizhnik
  */
 
+#include <limits>
+#include <log4cxx/logger.h>
 #include "query/Operator.h"
+#include "query/Network.h"
+#include "query/QueryPlanUtilites.h"
 #include "array/Metadata.h"
+#include "array/MemArray.h"
+#include "system/Config.h"
+#include "system/SciDBConfigOptions.h"
 #include "CrossJoinArray.h"
 
 
@@ -37,8 +44,260 @@ using namespace boost;
 
 namespace scidb {
 
+static log4cxx::LoggerPtr logger(log4cxx::Logger::getLogger("scidb.query.ops.cross_join"));
+
+/**
+ * How the chunks of the two inputs are brought together.
+ * Every left chunk has to meet every right chunk with the same join dimension positions on exactly one
+ * instance. Replicating one input to all the instances does that whatever the distribution of the
+ * other one; hashing both inputs on the chunk coordinates of their join dimensions does it by moving
+ * every chunk once.
+ */
+enum CrossJoinStrategy
+{
+    CROSS_JOIN_BROADCAST_RIGHT = 0,
+    CROSS_JOIN_BROADCAST_LEFT,
+    CROSS_JOIN_PARTITION,
+    CROSS_JOIN_UNKNOWN
+};
+
+static char const* getStrategyName(CrossJoinStrategy strategy)
+{
+    switch (strategy)
+    {
+    case CROSS_JOIN_BROADCAST_RIGHT:    return "broadcast right";
+    case CROSS_JOIN_BROADCAST_LEFT:     return "broadcast left";
+    case CROSS_JOIN_PARTITION:          return "partition on join dimensions";
+    default:                            return "unknown";
+    }
+}
+
+/**
+ * Choose the strategy that moves the fewest bytes over the network. Broadcasting an input of S bytes
+ * sends S * (N-1) of them and leaves a copy of all of it on every instance; partitioning both inputs
+ * sends about (L + R) * (N-1) / N and spreads them. An input is broadcast only if it fits the
+ * memory limit, since every instance holds it whole; partitioned inputs land in MemArrays, which
+ * spill to disk past mem-array-threshold.
+ * @param leftBytes size of the left input over all the instances
+ * @param rightBytes size of the right input over all the instances
+ * @param nInstances number of instances
+ * @param canPartition whether the inputs can be partitioned on their join dimensions
+ * @param memoryLimit the largest input that may be broadcast
+ */
+static CrossJoinStrategy chooseStrategy(double leftBytes, double rightBytes, size_t nInstances,
+                                        bool canPartition, double memoryLimit)
+{
+    if (nInstances == 1)
+    {
+        return CROSS_JOIN_BROADCAST_RIGHT;
+    }
+    bool const leftSmaller = leftBytes < rightBytes;
+    double const smaller = leftSmaller ? leftBytes : rightBytes;
+    if (canPartition && (smaller > memoryLimit || smaller * nInstances > leftBytes + rightBytes))
+    {
+        return CROSS_JOIN_PARTITION;
+    }
+    return leftSmaller ? CROSS_JOIN_BROADCAST_LEFT : CROSS_JOIN_BROADCAST_RIGHT;
+}
+
+/**
+ * The local part of an input: its number of chunks, and the sizes of its chunks over all the attributes.
+ */
+struct CrossJoinInputSize
+{
+    uint64_t nChunks;
+    uint64_t nBytes;
+};
+
 class PhysicalCrossJoin: public PhysicalOperator
 {
+private:
+    /**
+     * Both inputs may be hashed on their join dimensions if there are some and they pair up in the
+     * same order in both inputs, so that the hash keys of matching chunks are the same.
+     */
+    static bool canPartition(vector<int> const& rjd)
+    {
+        int last = -1;
+        for (size_t i = 0; i < rjd.size(); i++)
+        {
+            if (rjd[i] != -1)
+            {
+                if (rjd[i] < last)
+                {
+                    return false;
+                }
+                last = rjd[i];
+            }
+        }
+        return last != -1;
+    }
+
+    /**
+     * Pair the right join dimensions with the left ones: rjd[i] is the left dimension joined with the right
+     * dimension i, or -1.
+     */
+    vector<int> getRightJoinDims(ArrayDesc const& right) const
+    {
+        vector<int> rjd(right.getDimensions().size(), -1);
+        for (size_t p = 0, np = _parameters.size(); p < np; p += 2)
+        {
+            rjd[((shared_ptr<OperatorParamDimensionReference>&)_parameters[p+1])->getObjectNo()] =
+                ((shared_ptr<OperatorParamDimensionReference>&)_parameters[p])->getObjectNo();
+        }
+        return rjd;
+    }
+
+    /**
+     * Predict the strategy from the estimated boundaries of the inputs. This is what explain_physical shows;
+     * the instances choose again on execution from the actual sizes.
+     */
+    CrossJoinStrategy estimateStrategy(vector<PhysicalBoundaries> const& inputBoundaries,
+                                       vector<ArrayDesc> const& inputSchemas) const
+    {
+        shared_ptr<Query> query(_query.lock());
+        if (!query)
+        {
+            return CROSS_JOIN_UNKNOWN;
+        }
+        double const memoryLimit =
+            Config::getInstance()->getOption<size_t>(CONFIG_MEM_ARRAY_THRESHOLD) * (double) MiB;
+        return chooseStrategy(inputBoundaries[0].getSizeEstimateBytes(inputSchemas[0]),
+                              inputBoundaries[1].getSizeEstimateBytes(inputSchemas[1]),
+                              query->getInstancesCount(), canPartition(getRightJoinDims(inputSchemas[1])),
+                              memoryLimit);
+    }
+
+    /**
+     * Measure the local part of an input. The chunks of a materialized array know their sizes without
+     * reading their data. An input that is not materialized is not evaluated here: its chunks are
+     * counted from the positions of its array iterator and estimated as full, and a single-pass input,
+     * which cannot be scanned twice, is estimated from its schema. Only the input that the chosen
+     * strategy redistributes is then materialized, by redistribute().
+     */
+    CrossJoinInputSize getInputSize(shared_ptr<Array> const& input, shared_ptr<Query> const& query)
+    {
+        CrossJoinInputSize size;
+        size.nChunks = 0;
+        size.nBytes = 0;
+        ArrayDesc const& desc = input->getArrayDesc();
+        Attributes const& attrs = desc.getAttributes();
+        if (input->isMaterialized())
+        {
+            for (AttributeID i = 0; i < attrs.size(); i++)
+            {
+                for (shared_ptr<ConstArrayIterator> iter = input->getConstIterator(i); !iter->end(); ++(*iter))
+                {
+                    if (i == 0)
+                    {
+                        size.nChunks += 1;
+                    }
+                    size.nBytes += iter->getChunk().getSize();
+                }
+            }
+            return size;
+        }
+
+        uint64_t const maxBytes = std::numeric_limits<uint64_t>::max() / query->getInstancesCount();
+        double estimate;
+        if (input->getSupportedAccess() == Array::SINGLE_PASS)
+        {
+            estimate = PhysicalBoundaries::createFromFullSchema(desc).getSizeEstimateBytes(desc)
+                / query->getInstancesCount();
+        }
+        else
+        {
+            for (shared_ptr<ConstArrayIterator> iter = input->getConstIterator(0); !iter->end(); ++(*iter))
+            {
+                size.nChunks += 1;
+            }
+            Dimensions const& dims = desc.getDimensions();
+            Coordinates chunkStart(dims.size());
+            Coordinates chunkEnd(dims.size());
+            for (size_t i = 0; i < dims.size(); i++)
+            {
+                chunkStart[i] = dims[i].getStartMin();
+                chunkEnd[i] = chunkStart[i] + dims[i].getChunkInterval() - 1;
+            }
+            estimate = PhysicalBoundaries(chunkStart, chunkEnd).getSizeEstimateBytes(desc) * size.nChunks;
+        }
+        size.nBytes = estimate < maxBytes ? static_cast<uint64_t>(estimate) : maxBytes;
+        LOG4CXX_DEBUG(logger, "cross_join: estimated " << size.nBytes << " bytes of input " << desc.getName());
+        return size;
+    }
+
+    /**
+     * Sum the sizes of the inputs on the coordinator, which makes the choice for all the instances.
+     */
+    CrossJoinStrategy exchangeInputSizes(shared_ptr<Array> const& left, shared_ptr<Array> const& right,
+                                         bool partitionable, shared_ptr<Query>& query)
+    {
+        uint64_t sizes[4];
+        CrossJoinInputSize const leftSize = getInputSize(left, query);
+        CrossJoinInputSize const rightSize = getInputSize(right, query);
+        sizes[0] = leftSize.nChunks;
+        sizes[1] = leftSize.nBytes;
+        sizes[2] = rightSize.nChunks;
+        sizes[3] = rightSize.nBytes;
+
+        uint64_t strategy;
+        if (query->getCoordinatorID() != INVALID_INSTANCE)
+        {
+            shared_ptr<SharedBuffer> buf(new MemoryBuffer(sizes, sizeof(sizes)));
+            BufSend(query->getCoordinatorID(), buf, query);
+            buf = BufReceive(query->getCoordinatorID(), query);
+            strategy = *static_cast<uint64_t*>(buf->getData());
+        }
+        else
+        {
+            size_t const nInstances = query->getInstancesCount();
+            InstanceID const myId = query->getInstanceID();
+            for (InstanceID i = 0; i < nInstances; i++)
+            {
+                if (i != myId)
+                {
+                    shared_ptr<SharedBuffer> buf = BufReceive(i, query);
+                    uint64_t const* other = static_cast<uint64_t*>(buf->getData());
+                    for (size_t j = 0; j < 4; j++)
+                    {
+                        sizes[j] += other[j];
+                    }
+                }
+            }
+            double const memoryLimit =
+                Config::getInstance()->getOption<size_t>(CONFIG_MEM_ARRAY_THRESHOLD) * (double) MiB;
+            strategy = chooseStrategy(sizes[1], sizes[3], nInstances, partitionable, memoryLimit);
+            LOG4CXX_DEBUG(logger, "cross_join: left " << sizes[0] << " chunks " << sizes[1]
+                          << " bytes, right " << sizes[2] << " chunks " << sizes[3]
+                          << " bytes, strategy " << getStrategyName((CrossJoinStrategy) strategy));
+            shared_ptr<SharedBuffer> buf(new MemoryBuffer(&strategy, sizeof(strategy)));
+            for (InstanceID i = 0; i < nInstances; i++)
+            {
+                if (i != myId)
+                {
+                    BufSend(i, buf, query);
+                }
+            }
+        }
+        return (CrossJoinStrategy) strategy;
+    }
+
+    /**
+     * Hash an input on the chunk coordinates of its join dimensions.
+     */
+    static shared_ptr<Array> partition(shared_ptr<Array> const& input, vector<int> const& joinDims,
+                                       shared_ptr<Query> const& query)
+    {
+        PartitioningSchemaDataGroupby psdGroupby;
+        psdGroupby._arrIsGroupbyDim.reserve(joinDims.size());
+        for (size_t i = 0; i < joinDims.size(); i++)
+        {
+            psdGroupby._arrIsGroupbyDim.push_back(joinDims[i] != -1);
+        }
+        return redistribute(input, query, psGroupby, "", ALL_INSTANCES_MASK,
+                            shared_ptr<DistributionMapper>(), 0, &psdGroupby);
+    }
+
 public:
     PhysicalCrossJoin(std::string const& logicalName,
                       std::string const& physicalName,
@@ -48,6 +307,16 @@ public:
 	{
 	}
 
+    virtual void inputsToString(std::ostream &out, int indent,
+                                std::vector<PhysicalBoundaries> const& inputBoundaries,
+                                std::vector<ArrayDesc> const& inputSchemas) const
+    {
+        Indent prefix(indent);
+        out << prefix(' ', false);
+        out << "strategy " << getStrategyName(estimateStrategy(inputBoundaries, inputSchemas))
+            << " (estimated, chosen on execution)\n";
+    }
+
     virtual PhysicalBoundaries getOutputBoundaries(
             std::vector<PhysicalBoundaries> const& inputBoundaries,
             std::vector< ArrayDesc> const& inputSchemas) const
@@ -140,6 +409,9 @@ public:
     /***
      * Join is a pipelined operator, hence it executes by returning an iterator-based array to the consumer
      * that overrides the chunkiterator method.
+     * The right input is scanned once per left chunk. Before that, the instances agree on how to bring
+     * the chunks of the inputs together, from the sizes of their local parts, see getInputSize() and
+     * chooseStrategy().
      */
     boost::shared_ptr<Array> execute(
             vector< boost::shared_ptr<Array> >& inputArrays,
@@ -147,12 +419,6 @@ public:
     {
         assert(inputArrays.size() == 2);
 
-        shared_ptr<Array> input1 = inputArrays[1];
-        if (query->getInstancesCount() == 1 )
-        {
-            input1 = ensureRandomAccess(input1, query);
-        }
-
         size_t lDimsSize = inputArrays[0]->getArrayDesc().getDimensions().size();
         size_t rDimsSize = inputArrays[1]->getArrayDesc().getDimensions().size();
 
@@ -177,7 +443,29 @@ public:
             }
         }
         
-        return boost::shared_ptr<Array>(new CrossJoinArray(_schema, inputArrays[0], redistribute(input1, query, psReplication), ljd, rjd));
+        shared_ptr<Array> input0 = inputArrays[0];
+        shared_ptr<Array> input1 = inputArrays[1];
+        if (query->getInstancesCount() == 1 )
+        {
+            input1 = ensureRandomAccess(input1, query);
+            return boost::shared_ptr<Array>(new CrossJoinArray(_schema, input0, input1, ljd, rjd));
+        }
+
+        switch (exchangeInputSizes(input0, input1, canPartition(rjd), query))
+        {
+        case CROSS_JOIN_BROADCAST_LEFT:
+            input0 = redistribute(input0, query, psReplication);
+            input1 = ensureRandomAccess(input1, query);
+            break;
+        case CROSS_JOIN_PARTITION:
+            input0 = partition(input0, ljd, query);
+            input1 = partition(input1, rjd, query);
+            break;
+        default:
+            input1 = redistribute(input1, query, psReplication);
+            break;
+        }
+        return boost::shared_ptr<Array>(new CrossJoinArray(_schema, input0, input1, ljd, rjd));
     }
 };
     
@@ -0,0 +1,445 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.
+* Copyright (C) 2008-2014 SciDB, Inc.
+*
+* SciDB is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with SciDB.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+/*
+ * @file EquiJoinSettings.h
+ * The settings structure for the equi_join operator.
+ * @see IndexLookupSettings.h
+ */
+
+#include <map>
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <query/Operator.h>
+
+#ifndef EQUI_JOIN_SETTINGS
+#define EQUI_JOIN_SETTINGS
+
+namespace scidb
+{
+
+/*
+ * Settings for the EquiJoin operator.
+ */
+class EquiJoinSettings
+{
+public:
+    /**
+     * The two inputs of the join.
+     */
+    enum Side
+    {
+        LEFT  = 0,
+        RIGHT = 1
+    };
+
+    /**
+     * Which inputs contribute their dimensions or attributes to the output.
+     */
+    enum Keep
+    {
+        KEEP_NONE  = 0,
+        KEEP_LEFT  = 1,
+        KEEP_RIGHT = 2,
+        KEEP_BOTH  = 3
+    };
+
+    /**
+     * The input the hash table is built on.
+     */
+    enum Build
+    {
+        BUILD_AUTO,
+        BUILD_LEFT,
+        BUILD_RIGHT
+    };
+
+    static const size_t DEFAULT_CHUNK_SIZE = 1000000;
+
+private:
+    ArrayDesc const& _leftSchema;
+    ArrayDesc const& _rightSchema;
+    vector<AttributeID> _keys[2];
+    vector<string> _keyNames[2];
+    Keep _keepDimensions;
+    bool _keepDimensionsSet;
+    Keep _keepAttributes;
+    bool _keepAttributesSet;
+    size_t _memoryLimit;
+    bool _memoryLimitSet;
+    size_t _chunkSize;
+    bool _chunkSizeSet;
+    Build _build;
+    bool _buildSet;
+
+    static int64_t parsePositiveInteger(string const& parameterString, string const& paramHeader)
+    {
+        string paramContent = parameterString.substr(paramHeader.size());
+        trim(paramContent);
+        int64_t sval;
+        try
+        {
+            sval = lexical_cast<int64_t> (paramContent);
+        }
+        catch (bad_lexical_cast const& exn)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_OPERATOR, SCIDB_LE_CANNOT_PARSE_INTEGER_PARAMETER) << parameterString;
+        }
+        if (sval <= 0)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_OPERATOR, SCIDB_LE_PARAMETER_NOT_POSITIVE_INTEGER) << parameterString;
+        }
+        return sval;
+    }
+
+    static void checkNotSet(bool isSet, string const& paramHeader)
+    {
+        if (isSet)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_OPERATOR, SCIDB_LE_CANNOT_BE_SET_MORE_THAN_ONCE) << paramHeader;
+        }
+    }
+
+    static Keep parseKeep(string const& parameterString, string const& paramHeader)
+    {
+        string paramContent = parameterString.substr(paramHeader.size());
+        trim(paramContent);
+        to_lower(paramContent);
+        if (paramContent == "none")
+        {
+            return KEEP_NONE;
+        }
+        else if (paramContent == "left")
+        {
+            return KEEP_LEFT;
+        }
+        else if (paramContent == "right")
+        {
+            return KEEP_RIGHT;
+        }
+        else if (paramContent == "both")
+        {
+            return KEEP_BOTH;
+        }
+        throw SYSTEM_EXCEPTION(SCIDB_SE_OPERATOR, SCIDB_LE_UNRECOGNIZED_PARAMETER) << parameterString;
+    }
+
+    static Build parseBuild(string const& parameterString, string const& paramHeader)
+    {
+        string paramContent = parameterString.substr(paramHeader.size());
+        trim(paramContent);
+        to_lower(paramContent);
+        if (paramContent == "auto")
+        {
+            return BUILD_AUTO;
+        }
+        else if (paramContent == "left")
+        {
+            return BUILD_LEFT;
+        }
+        else if (paramContent == "right")
+        {
+            return BUILD_RIGHT;
+        }
+        throw SYSTEM_EXCEPTION(SCIDB_SE_OPERATOR, SCIDB_LE_UNRECOGNIZED_PARAMETER) << parameterString;
+    }
+
+    void addKey(shared_ptr<OperatorParam>const& param)
+    {
+        shared_ptr<OperatorParamReference> const& ref = (shared_ptr<OperatorParamReference> const&) param;
+        size_t side = ref->getInputNo();
+        if (side > RIGHT)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_OPERATOR, SCIDB_LE_NOT_AN_ATTRIBUTE_IN_INPUT) << ref->getObjectName();
+        }
+        _keys[side].push_back(ref->getObjectNo());
+        _keyNames[side].push_back(ref->getObjectName());
+    }
+
+    void checkKeys()
+    {
+        if (_keys[LEFT].empty() || _keys[LEFT].size() != _keys[RIGHT].size())
+        {
+            throw USER_EXCEPTION(SCIDB_SE_OPERATOR, SCIDB_LE_EQUI_JOIN_KEYS_MISMATCH);
+        }
+        for (size_t i = 0; i < _keys[LEFT].size(); ++i)
+        {
+            AttributeDesc const& leftKey = _leftSchema.getAttributes()[_keys[LEFT][i]];
+            AttributeDesc const& rightKey = _rightSchema.getAttributes()[_keys[RIGHT][i]];
+            if (leftKey.getType() != rightKey.getType())
+            {
+                throw SYSTEM_EXCEPTION(SCIDB_SE_OPERATOR, SCIDB_LE_ATTRIBUTES_DO_NOT_MATCH_TYPES)
+                        << _keyNames[LEFT][i]
+                        << leftKey.getType()
+                        << _keyNames[RIGHT][i]
+                        << rightKey.getType();
+            }
+        }
+    }
+
+public:
+    EquiJoinSettings(ArrayDesc const& leftSchema,
+                     ArrayDesc const& rightSchema,
+                     vector<shared_ptr<OperatorParam> > const& operatorParameters,
+                     bool logical,
+                     shared_ptr<Query>& query):
+        _leftSchema             (leftSchema),
+        _rightSchema            (rightSchema),
+        _keepDimensions         (KEEP_NONE),
+        _keepDimensionsSet      (false),
+        _keepAttributes         (KEEP_BOTH),
+        _keepAttributesSet      (false),
+        _memoryLimit            (Config::getInstance()->getOption<size_t>(CONFIG_MEM_ARRAY_THRESHOLD) * MiB),
+        _memoryLimitSet         (false),
+        _chunkSize              (DEFAULT_CHUNK_SIZE),
+        _chunkSizeSet           (false),
+        _build                  (BUILD_AUTO),
+        _buildSet               (false)
+    {
+        string const keepDimensionsHeader = "keep_dimensions=";
+        string const keepAttributesHeader = "keep_attributes=";
+        string const memLimitHeader       = "memory_limit=";
+        string const chunkSizeHeader      = "chunk_size=";
+        string const buildHeader          = "build=";
+        size_t nParams = operatorParameters.size();
+        for (size_t i = 0; i<nParams; ++i)
+        {
+            shared_ptr<OperatorParam>const& param = operatorParameters[i];
+            if (param->getParamType()== PARAM_ATTRIBUTE_REF)
+            {
+                addKey(param);
+                continue;
+            }
+            string parameterString;
+            if (logical)
+            {
+                parameterString = evaluate(((shared_ptr<OperatorParamLogicalExpression>&) param)->
+                                           getExpression(),query, TID_STRING).getString();
+            }
+            else
+            {
+                parameterString = ((shared_ptr<OperatorParamPhysicalExpression>&) param)->
+                                  getExpression()->evaluate().getString();
+            }
+            if (starts_with(parameterString, keepDimensionsHeader))
+            {
+                checkNotSet(_keepDimensionsSet, keepDimensionsHeader);
+                _keepDimensions = parseKeep(parameterString, keepDimensionsHeader);
+                _keepDimensionsSet = true;
+            }
+            else if (starts_with(parameterString, keepAttributesHeader))
+            {
+                checkNotSet(_keepAttributesSet, keepAttributesHeader);
+                _keepAttributes = parseKeep(parameterString, keepAttributesHeader);
+                _keepAttributesSet = true;
+            }
+            else if (starts_with(parameterString, memLimitHeader))
+            {
+                checkNotSet(_memoryLimitSet, memLimitHeader);
+                _memoryLimit = parsePositiveInteger(parameterString, memLimitHeader) * MiB;
+                _memoryLimitSet = true;
+            }
+            else if (starts_with(parameterString, chunkSizeHeader))
+            {
+                checkNotSet(_chunkSizeSet, chunkSizeHeader);
+                _chunkSize = parsePositiveInteger(parameterString, chunkSizeHeader);
+                _chunkSizeSet = true;
+            }
+            else if (starts_with(parameterString, buildHeader))
+            {
+                checkNotSet(_buildSet, buildHeader);
+                _build = parseBuild(parameterString, buildHeader);
+                _buildSet = true;
+            }
+            else
+            {
+                throw SYSTEM_EXCEPTION(SCIDB_SE_OPERATOR, SCIDB_LE_UNRECOGNIZED_PARAMETER) << parameterString;
+            }
+        }
+        checkKeys();
+    }
+
+    ArrayDesc const& getSchema(Side side) const
+    {
+        return side == LEFT ? _leftSchema : _rightSchema;
+    }
+
+    /**
+     * @return the number of join attributes of each input
+     */
+    size_t getNumKeys() const
+    {
+        return _keys[LEFT].size();
+    }
+
+    /**
+     * @return the ids of the join attributes of an input
+     */
+    vector<AttributeID> const& getKeys(Side side) const
+    {
+        return _keys[side];
+    }
+
+    /**
+     * @return true if the dimensions of an input are returned as attributes
+     */
+    bool keepDimensions(Side side) const
+    {
+        return _keepDimensions & (side == LEFT ? KEEP_LEFT : KEEP_RIGHT);
+    }
+
+    /**
+     * @return true if the attributes of an input other than the join attributes are returned
+     */
+    bool keepAttributes(Side side) const
+    {
+        return _keepAttributes & (side == LEFT ? KEEP_LEFT : KEEP_RIGHT);
+    }
+
+    /**
+     * @return the memory limit (converted to bytes) of the hash table
+     */
+    size_t getMemoryLimit() const
+    {
+        return _memoryLimit;
+    }
+
+    /**
+     * @return the chunk size of the output array
+     */
+    size_t getChunkSize() const
+    {
+        return _chunkSize;
+    }
+
+    Build getBuild() const
+    {
+        return _build;
+    }
+
+    /**
+     * @return the ids of the non-join attributes of an input that are returned, without the empty tag
+     */
+    vector<AttributeID> getCarriedAttributes(Side side) const
+    {
+        vector<AttributeID> result;
+        if (!keepAttributes(side))
+        {
+            return result;
+        }
+        ArrayDesc const& schema = getSchema(side);
+        Attributes const& attributes = schema.getAttributes(true);
+        for (size_t i = 0; i < attributes.size(); ++i)
+        {
+            if (std::find(_keys[side].begin(), _keys[side].end(), attributes[i].getId()) == _keys[side].end())
+            {
+                result.push_back(attributes[i].getId());
+            }
+        }
+        return result;
+    }
+
+    /**
+     * The tuple of an input holds the join attributes, then the carried attributes, then the
+     * dimensions as int64 values if they are kept.
+     * @return the attributes of the tuples of an input
+     */
+    Attributes getTupleAttributes(Side side) const
+    {
+        ArrayDesc const& schema = getSchema(side);
+        Attributes result;
+        for (size_t i = 0; i < _keys[side].size(); ++i)
+        {
+            AttributeDesc const& a = schema.getAttributes()[_keys[side][i]];
+            result.push_back(AttributeDesc(result.size(), a.getName(), a.getType(), a.getFlags(), 0));
+        }
+        vector<AttributeID> carried = getCarriedAttributes(side);
+        for (size_t i = 0; i < carried.size(); ++i)
+        {
+            AttributeDesc const& a = schema.getAttributes()[carried[i]];
+            result.push_back(AttributeDesc(result.size(), a.getName(), a.getType(), a.getFlags(), 0));
+        }
+        if (keepDimensions(side))
+        {
+            Dimensions const& dims = schema.getDimensions();
+            for (size_t i = 0; i < dims.size(); ++i)
+            {
+                result.push_back(AttributeDesc(result.size(), dims[i].getBaseName(), TID_INT64, 0, 0));
+            }
+        }
+        return result;
+    }
+
+    /**
+     * The output has the join attributes (named after the left input), the carried attributes of
+     * the left then the right input, then the kept dimensions of the left then the right input.
+     * Like store() does for join(), a name that is already taken gets the suffix _2, _3 and so on;
+     * every attribute also keeps the name of its input as an alias.
+     * Its cells are numbered per instance: [instance_id=0:N-1,1,0, value_no=0:*,chunk_size,0].
+     */
+    ArrayDesc getOutputSchema(shared_ptr<Query> const& query) const
+    {
+        Dimensions dims(2);
+        dims[0] = DimensionDesc("instance_id", 0, query->getInstancesCount() - 1, 1, 0);
+        dims[1] = DimensionDesc("value_no", 0, MAX_COORDINATE, _chunkSize, 0);
+        Attributes left = getTupleAttributes(LEFT);
+        Attributes right = getTupleAttributes(RIGHT);
+        size_t const nKeys = getNumKeys();
+        size_t const nLeftCarried = getCarriedAttributes(LEFT).size();
+        size_t const nRightCarried = getCarriedAttributes(RIGHT).size();
+        vector<AttributeDesc> attrs;
+        vector<string> aliases;
+        attrs.insert(attrs.end(), left.begin(), left.begin() + nKeys + nLeftCarried);
+        aliases.resize(attrs.size(), _leftSchema.getName());
+        attrs.insert(attrs.end(), right.begin() + nKeys, right.begin() + nKeys + nRightCarried);
+        aliases.resize(attrs.size(), _rightSchema.getName());
+        attrs.insert(attrs.end(), left.begin() + nKeys + nLeftCarried, left.end());
+        aliases.resize(attrs.size(), _leftSchema.getName());
+        attrs.insert(attrs.end(), right.begin() + nKeys + nRightCarried, right.end());
+        aliases.resize(attrs.size(), _rightSchema.getName());
+
+        std::map<string, uint64_t> names;
+        names[dims[0].getBaseName()] = 1;
+        names[dims[1].getBaseName()] = 1;
+        Attributes result;
+        for (size_t i = 0; i < attrs.size(); ++i)
+        {
+            string name = attrs[i].getName();
+            if (names.count(name))
+            {
+                string const base = name;
+                do
+                {
+                    name = base + "_" + boost::lexical_cast<string>(++names[base]);
+                } while (names.count(name));
+            }
+            names[name] = 1;
+            result.push_back(AttributeDesc(i, name, attrs[i].getType(), attrs[i].getFlags(), 0));
+            result.back().addAlias(aliases[i]);
+        }
+        return addEmptyTagAttribute(ArrayDesc(_leftSchema.getName() + "_" + _rightSchema.getName(), result, dims));
+    }
+};
+
+}
+
+#endif //EQUI_JOIN_SETTINGS
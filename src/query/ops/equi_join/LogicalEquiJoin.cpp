@@ -0,0 +1,115 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.
+* Copyright (C) 2008-2014 SciDB, Inc.
+*
+* SciDB is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with SciDB.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+#include <query/Operator.h>
+#include "EquiJoinSettings.h"
+
+namespace scidb
+{
+
+/**
+ * @brief The operator: equi_join()
+ *
+ * @par Synopsis: equi_join (left_array, right_array, left_array.attribute [,...], right_array.attribute [,...]
+ *                           [,'keep_dimensions=none|left|right|both'] [,'keep_attributes=left|right|both']
+ *                           [,'memory_limit=MEMORY_LIMIT'] [,'chunk_size=CHUNK_SIZE'] [,'build=auto|left|right'])
+ *
+ * @par Examples:
+ *   <br> equi_join(trades, customers, trades.customer_id, customers.id)
+ *   <br> equi_join(readings, sensors, readings.sensor_id, sensors.sensor_id, 'keep_dimensions=left')
+ *
+ * @par Summary:
+ *   <br>
+ *   Joins the cells of two arrays whose join attributes are equal, regardless of their coordinates. The join
+ *   attributes are given as a list of attribute references: the references to the attributes of the left array are
+ *   the left join attributes, in order, and the references to the attributes of the right array are the right join
+ *   attributes. Both inputs must have the same number of join attributes, and the i-th left and right join attributes
+ *   must have the same type. Cells with a null join attribute match nothing.
+ *   <br>
+ *   <br>
+ *   The output holds one cell per matching pair of input cells. Its attributes are the join attributes (named after
+ *   the left array), the other attributes of the left array, the other attributes of the right array, then the
+ *   dimensions of the left and right arrays as int64 attributes if requested with 'keep_dimensions'.
+ *   'keep_attributes' drops the non-join attributes of one of the inputs. A name that is already taken gets the
+ *   suffix _2 (or _3 and so on), and every attribute can also be referred to with the name of its input array.
+ *   <br>
+ *   <br>
+ *   The output has no meaningful coordinates: every instance numbers the cells it produces along value_no.
+ *   <br>
+ *   <br>
+ *   A hash table is built on one of the inputs, the one with fewer cells on each instance unless 'build' says
+ *   otherwise. If it does not fit in 'memory_limit' mebibytes (MEM_ARRAY_THRESHOLD by default), both inputs are
+ *   split into partitions processed one at a time.
+ *
+ * @par Input:
+ *   <br> left_array <...> [*]
+ *   <br> right_array <...> [*]
+ *   <br> attribute references                   --the join attributes of both arrays
+ *   <br> ['keep_dimensions=none|left|right|both'] --the dimensions returned as attributes (default none)
+ *   <br> ['keep_attributes=left|right|both']      --the inputs whose other attributes are returned (default both)
+ *   <br> ['memory_limit=MEMORY_LIMIT']             --the memory limit of the hash table (MB)
+ *   <br> ['chunk_size=CHUNK_SIZE']                 --the chunk size of value_no (default 1000000)
+ *   <br> ['build=auto|left|right']                 --the input the hash table is built on (default auto)
+ *
+ * @par Output array:
+ *   <br> <
+ *   <br>   join attributes, left attributes, right attributes, left dimensions, right dimensions
+ *   <br> >
+ *   <br> [ instance_id=0:N-1,1,0, value_no=0:*,CHUNK_SIZE,0 ]
+ *   <br>
+ *
+ * @see PhysicalEquiJoin.cpp for a description of the algorithm.
+ */
+class LogicalEquiJoin : public LogicalOperator
+{
+public:
+    LogicalEquiJoin(const string& logicalName, const string& alias):
+        LogicalOperator(logicalName, alias)
+    {
+        ADD_PARAM_INPUT()
+        ADD_PARAM_INPUT()
+        ADD_PARAM_VARIES()
+    }
+
+    vector<shared_ptr<OperatorParamPlaceholder> > nextVaryParamPlaceholder(vector< ArrayDesc> const& schemas)
+    {
+        vector<shared_ptr<OperatorParamPlaceholder> > res;
+        if (_parameters.size() >= 2)
+        {
+            res.push_back(END_OF_VARIES_PARAMS());
+        }
+        res.push_back(PARAM_IN_ATTRIBUTE_NAME("void"));
+        res.push_back(PARAM_CONSTANT(TID_STRING));
+        return res;
+    }
+
+    ArrayDesc inferSchema(vector< ArrayDesc> schemas, shared_ptr< Query> query)
+    {
+        //The settings object also checks the join attributes for validity
+        EquiJoinSettings settings(schemas[0], schemas[1], _parameters, true, query);
+        return settings.getOutputSchema(query);
+    }
+};
+
+DECLARE_LOGICAL_OPERATOR_FACTORY(LogicalEquiJoin, "equi_join")
+
+} //namespace scidb
@@ -0,0 +1,430 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.
+* Copyright (C) 2008-2014 SciDB, Inc.
+*
+* SciDB is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with SciDB.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+#include <boost/foreach.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/unordered_map.hpp>
+
+#include "EquiJoinSettings.h"
+#include <query/Operator.h>
+#include <query/TupleExchange.h>
+#include <array/RowCollection.h>
+
+namespace scidb
+{
+
+static log4cxx::LoggerPtr equiJoinLogger(log4cxx::Logger::getLogger("scidb.operators.equi_join"));
+
+/**
+ * @par Algorithm:
+ * <br>
+ * <br>
+ * Every instance turns the cells of both inputs into tuples holding the join attributes, the returned attributes and
+ * the returned dimensions, and sends each tuple to the instance given by a hash of its join attributes (see
+ * TupleExchange). After the exchange, cells that can match are on the same instance, and every instance joins its
+ * part independently.
+ * <br>
+ * <br>
+ * The hash table is built on the input with fewer tuples on the instance (the build input) and the tuples of the
+ * other input (the probe input) are streamed against it. When the build tuples would exceed the memory limit, both
+ * inputs are first split into partitions by another hash of the join attributes, kept in RowCollections - MemArrays
+ * that are swapped out to disk as needed - and the partitions are joined one at a time.
+ * <br>
+ * <br>
+ * Every instance writes the cells it produces to its own row of the output, [instance_id, 0..].
+ */
+class PhysicalEquiJoin : public PhysicalOperator
+{
+private:
+    typedef EquiJoinSettings::Side Side;
+    typedef RowCollection<size_t> Partitions;
+
+    /**
+     * Seeds of the independent hashes of the join attributes.
+     */
+    static const uint32_t EXCHANGE_SEED  = 0;
+    static const uint32_t TABLE_SEED     = 0x9e3779b9;
+    static const uint32_t PARTITION_SEED = 0x85ebca6b;
+
+    /**
+     * Number of tuples per chunk of the exchanged arrays.
+     */
+    static const size_t EXCHANGE_CHUNK_SIZE = 10000;
+
+    /**
+     * Estimated memory overhead of a tuple in the hash table, besides its values.
+     */
+    static const size_t TUPLE_OVERHEAD = sizeof(vector<Value>) + 4*sizeof(void*) + sizeof(uint64_t) + sizeof(size_t);
+
+    /**
+     * The build tuples of a partition, indexed by the hash of their join attributes.
+     */
+    class HashTable
+    {
+    private:
+        typedef boost::unordered_multimap<uint64_t, size_t> Index;
+
+        TupleExchange::KeyKinds const _keys;
+        vector< vector<Value> > _tuples;
+        Index _index;
+
+    public:
+        HashTable(TupleExchange::KeyKinds const& keys):
+            _keys(keys)
+        {}
+
+        void insert(vector<Value> const& tuple)
+        {
+            _index.insert(std::make_pair(TupleExchange::hashTuple(tuple, _keys, TABLE_SEED), _tuples.size()));
+            _tuples.push_back(tuple);
+        }
+
+        /**
+         * Find the build tuples whose join attributes equal those of the probe tuple.
+         * @param probe the probe tuple
+         * @param[out] matches the indices of the matching tuples
+         */
+        void find(vector<Value> const& probe, vector<size_t>& matches) const
+        {
+            matches.clear();
+            std::pair<Index::const_iterator, Index::const_iterator> range =
+                _index.equal_range(TupleExchange::hashTuple(probe, _keys, TABLE_SEED));
+            for (Index::const_iterator i = range.first; i != range.second; ++i)
+            {
+                if (TupleExchange::equalTuples(_tuples[i->second], probe, _keys))
+                {
+                    matches.push_back(i->second);
+                }
+            }
+        }
+
+        vector<Value> const& getTuple(size_t i) const
+        {
+            return _tuples[i];
+        }
+
+        size_t size() const
+        {
+            return _tuples.size();
+        }
+
+        void clear()
+        {
+            _index.clear();
+            _tuples.clear();
+        }
+    };
+
+    /**
+     * Assembles output cells from a left and a right tuple.
+     */
+    class CellBuilder
+    {
+    private:
+        size_t const _nKeys;
+        size_t const _nLeftCarried;
+        size_t const _nRightCarried;
+        vector<Value> _cell;
+
+    public:
+        CellBuilder(EquiJoinSettings const& settings, size_t nAttrs):
+            _nKeys(settings.getNumKeys()),
+            _nLeftCarried(settings.getCarriedAttributes(EquiJoinSettings::LEFT).size()),
+            _nRightCarried(settings.getCarriedAttributes(EquiJoinSettings::RIGHT).size()),
+            _cell(nAttrs)
+        {}
+
+        vector<Value> const& build(vector<Value> const& left, vector<Value> const& right)
+        {
+            size_t const leftEnd = _nKeys + _nLeftCarried;
+            size_t const rightEnd = _nKeys + _nRightCarried;
+            size_t j = 0;
+            for (size_t i = 0; i < leftEnd; ++i)
+            {
+                _cell[j++] = left[i];
+            }
+            for (size_t i = _nKeys; i < rightEnd; ++i)
+            {
+                _cell[j++] = right[i];
+            }
+            for (size_t i = leftEnd; i < left.size(); ++i)
+            {
+                _cell[j++] = left[i];
+            }
+            for (size_t i = rightEnd; i < right.size(); ++i)
+            {
+                _cell[j++] = right[i];
+            }
+            assert(j == _cell.size());
+            return _cell;
+        }
+    };
+
+    /**
+     * Send the tuples of an input to the instances that join them.
+     * @return the tuples of the input received by this instance
+     */
+    shared_ptr<Array> exchangeInput(shared_ptr<Array> const& input,
+                                    Side side,
+                                    EquiJoinSettings const& settings,
+                                    shared_ptr<Query> const& query)
+    {
+        Attributes tupleAttributes = settings.getTupleAttributes(side);
+        vector<AttributeID> ids = settings.getKeys(side);
+        vector<AttributeID> carried = settings.getCarriedAttributes(side);
+        ids.insert(ids.end(), carried.begin(), carried.end());
+        size_t const nKeys = settings.getNumKeys();
+        TupleExchange::KeyKinds const keys = TupleExchange::getKeyKinds(tupleAttributes, nKeys);
+        size_t const nIds = ids.size();
+        size_t const nDims = settings.keepDimensions(side) ? input->getArrayDesc().getDimensions().size() : 0;
+        size_t const nInstances = query->getInstancesCount();
+        assert(tupleAttributes.size() == nIds + nDims);
+
+        TupleExchange exchange(input->getArrayDesc().getName() + (side == EquiJoinSettings::LEFT ? "_left" : "_right"),
+                               tupleAttributes, EXCHANGE_CHUNK_SIZE, query);
+        vector<shared_ptr<ConstArrayIterator> > arrayIters(nIds);
+        vector<shared_ptr<ConstChunkIterator> > chunkIters(nIds);
+        for (size_t i = 0; i < nIds; ++i)
+        {
+            arrayIters[i] = input->getConstIterator(ids[i]);
+        }
+        vector<Value> tuple(nIds + nDims);
+        while (!arrayIters[0]->end())
+        {
+            for (size_t i = 0; i < nIds; ++i)
+            {
+                chunkIters[i] = arrayIters[i]->getChunk().getConstIterator(ChunkIterator::IGNORE_EMPTY_CELLS |
+                                                                           ChunkIterator::IGNORE_OVERLAPS);
+            }
+            while (!chunkIters[0]->end())
+            {
+                bool nullKey = false;
+                for (size_t i = 0; i < nIds; ++i)
+                {
+                    tuple[i] = chunkIters[i]->getItem();
+                    nullKey = nullKey || (i < nKeys && tuple[i].isNull());
+                }
+                if (!nullKey)
+                {
+                    Coordinates const& pos = chunkIters[0]->getPosition();
+                    for (size_t d = 0; d < nDims; ++d)
+                    {
+                        tuple[nIds + d].setInt64(pos[d]);
+                    }
+                    exchange.append(TupleExchange::hashTuple(tuple, keys, EXCHANGE_SEED) % nInstances, tuple);
+                }
+                for (size_t i = 0; i < nIds; ++i)
+                {
+                    ++(*chunkIters[i]);
+                }
+            }
+            for (size_t i = 0; i < nIds; ++i)
+            {
+                chunkIters[i].reset();
+                ++(*arrayIters[i]);
+            }
+        }
+        return exchange.exchange();
+    }
+
+    /**
+     * Probe the hash table with a tuple and write the matching cells.
+     */
+    static void probe(HashTable const& table,
+                      vector<Value> const& tuple,
+                      bool buildIsLeft,
+                      vector<size_t>& matches,
+                      CellBuilder& builder,
+                      TupleWriter& output)
+    {
+        table.find(tuple, matches);
+        for (size_t i = 0; i < matches.size(); ++i)
+        {
+            vector<Value> const& match = table.getTuple(matches[i]);
+            output.write(buildIsLeft ? builder.build(match, tuple) : builder.build(tuple, match));
+        }
+    }
+
+    /**
+     * Join with the whole build input in one hash table.
+     */
+    void joinInMemory(shared_ptr<Array> const& buildTuples,
+                      shared_ptr<Array> const& probeTuples,
+                      bool buildIsLeft,
+                      TupleExchange::KeyKinds const& keys,
+                      CellBuilder& builder,
+                      TupleWriter& output,
+                      shared_ptr<Query> const& query)
+    {
+        HashTable table(keys);
+        for (TupleReader reader(buildTuples); !reader.end(); ++reader)
+        {
+            table.insert(reader.getTuple());
+        }
+        query->validate();
+        vector<size_t> matches;
+        for (TupleReader reader(probeTuples); !reader.end(); ++reader)
+        {
+            probe(table, reader.getTuple(), buildIsLeft, matches, builder, output);
+        }
+    }
+
+    /**
+     * Split the tuples of an input into partitions by a hash of their join attributes.
+     */
+    static void partition(shared_ptr<Array> const& tuples,
+                          TupleExchange::KeyKinds const& keys,
+                          size_t nPartitions,
+                          Partitions& partitions)
+    {
+        for (TupleReader reader(tuples); !reader.end(); ++reader)
+        {
+            vector<Value> const& tuple = reader.getTuple();
+            size_t rowId = UNKNOWN_ROW_ID;
+            partitions.appendItem(rowId, TupleExchange::hashTuple(tuple, keys, PARTITION_SEED) % nPartitions, tuple);
+        }
+        partitions.switchMode(RowCollectionModeRead);
+    }
+
+    /**
+     * Join partition by partition, so that the hash table of a partition fits in memory.
+     */
+    void joinPartitioned(shared_ptr<Array> const& buildTuples,
+                         shared_ptr<Array> const& probeTuples,
+                         bool buildIsLeft,
+                         TupleExchange::KeyKinds const& keys,
+                         size_t nPartitions,
+                         CellBuilder& builder,
+                         TupleWriter& output,
+                         shared_ptr<Query> const& query)
+    {
+        Partitions buildPartitions(query, "", buildTuples->getArrayDesc().getAttributes(true));
+        Partitions probePartitions(query, "", probeTuples->getArrayDesc().getAttributes(true));
+        partition(buildTuples, keys, nPartitions, buildPartitions);
+        partition(probeTuples, keys, nPartitions, probePartitions);
+
+        HashTable table(keys);
+        vector<size_t> matches;
+        vector<Value> tuple(buildTuples->getArrayDesc().getAttributes(true).size());
+        for (size_t p = 0; p < nPartitions; ++p)
+        {
+            if (!buildPartitions.existsGroup(p) || !probePartitions.existsGroup(p))
+            {
+                continue;
+            }
+            table.clear();
+            {
+                boost::scoped_ptr<Partitions::MyRowIterator> rowIter(
+                    buildPartitions.openRow(buildPartitions.rowIdFromExistingGroup(p)));
+                while (!rowIter->end())
+                {
+                    rowIter->getItem(tuple);
+                    table.insert(tuple);
+                    ++(*rowIter);
+                }
+            }
+            query->validate();
+            vector<Value> probeTuple(probeTuples->getArrayDesc().getAttributes(true).size());
+            boost::scoped_ptr<Partitions::MyRowIterator> rowIter(
+                probePartitions.openRow(probePartitions.rowIdFromExistingGroup(p)));
+            while (!rowIter->end())
+            {
+                rowIter->getItem(probeTuple);
+                probe(table, probeTuple, buildIsLeft, matches, builder, output);
+                ++(*rowIter);
+            }
+        }
+    }
+
+public:
+    PhysicalEquiJoin(string const& logicalName,
+                     string const& physicalName,
+                     Parameters const& parameters,
+                     ArrayDesc const& schema):
+        PhysicalOperator(logicalName, physicalName, parameters, schema)
+    {}
+
+    /**
+     * Every instance writes to its own row of the output. That is not psHashPartitioned.
+     */
+    virtual bool changesDistribution(std::vector<ArrayDesc> const&) const
+    {
+        return true;
+    }
+
+    virtual bool outputFullChunks(std::vector<ArrayDesc> const&) const
+    {
+        return false;
+    }
+
+    virtual ArrayDistribution getOutputDistribution(vector<ArrayDistribution> const&,
+                                                    vector<ArrayDesc> const&) const
+    {
+        return ArrayDistribution(psUndefined);
+    }
+
+    shared_ptr<Array> execute(vector< shared_ptr< Array> >& inputArrays, shared_ptr<Query> query)
+    {
+        EquiJoinSettings settings(inputArrays[0]->getArrayDesc(), inputArrays[1]->getArrayDesc(), _parameters, false,
+                                  query);
+        shared_ptr<Array> tuples[2];
+        tuples[EquiJoinSettings::LEFT] = exchangeInput(inputArrays[0], EquiJoinSettings::LEFT, settings, query);
+        tuples[EquiJoinSettings::RIGHT] = exchangeInput(inputArrays[1], EquiJoinSettings::RIGHT, settings, query);
+
+        uint64_t const leftCount = getCellCount(tuples[EquiJoinSettings::LEFT]);
+        uint64_t const rightCount = getCellCount(tuples[EquiJoinSettings::RIGHT]);
+        bool buildIsLeft = settings.getBuild() == EquiJoinSettings::BUILD_AUTO ? leftCount <= rightCount
+                                                                              : settings.getBuild() == EquiJoinSettings::BUILD_LEFT;
+        shared_ptr<Array> const& buildTuples = tuples[buildIsLeft ? EquiJoinSettings::LEFT : EquiJoinSettings::RIGHT];
+        shared_ptr<Array> const& probeTuples = tuples[buildIsLeft ? EquiJoinSettings::RIGHT : EquiJoinSettings::LEFT];
+        uint64_t const buildCount = buildIsLeft ? leftCount : rightCount;
+
+        size_t const nBuildAttrs = buildTuples->getArrayDesc().getAttributes(true).size();
+        uint64_t const buildSize = getChunksSize(buildTuples) + buildCount * (nBuildAttrs * sizeof(Value) + TUPLE_OVERHEAD);
+        size_t const nPartitions = (buildSize + settings.getMemoryLimit() - 1) / settings.getMemoryLimit();
+        LOG4CXX_DEBUG(equiJoinLogger, "equi_join: left " << leftCount << " tuples, right " << rightCount
+                      << " tuples, building on " << (buildIsLeft ? "left" : "right")
+                      << ", estimated size " << buildSize << " bytes, " << nPartitions << " partition(s)");
+
+        TupleExchange::KeyKinds const keys =
+            TupleExchange::getKeyKinds(settings.getTupleAttributes(EquiJoinSettings::LEFT), settings.getNumKeys());
+        TupleWriter output(_schema, query);
+        CellBuilder builder(settings, _schema.getAttributes(true).size());
+        if (buildCount != 0)
+        {
+            if (nPartitions <= 1)
+            {
+                joinInMemory(buildTuples, probeTuples, buildIsLeft, keys, builder, output, query);
+            }
+            else
+            {
+                joinPartitioned(buildTuples, probeTuples, buildIsLeft, keys, nPartitions, builder, output, query);
+            }
+        }
+        LOG4CXX_DEBUG(equiJoinLogger, "equi_join: produced " << output.getTupleCount() << " cells");
+        return output.finish();
+    }
+};
+
+DECLARE_PHYSICAL_OPERATOR_FACTORY(PhysicalEquiJoin, "equi_join", "PhysicalEquiJoin")
+
+} //namespace scidb
@@ -0,0 +1,250 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.
+* Copyright (C) 2008-2014 SciDB, Inc.
+*
+* SciDB is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with SciDB.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+/*
+ * @file AggregateHashTable.h
+ * An open-addressing hash table from group values to aggregate states.
+ */
+
+#ifndef AGGREGATE_HASH_TABLE
+#define AGGREGATE_HASH_TABLE
+
+#include <deque>
+
+#include <query/Aggregate.h>
+#include <query/TupleExchange.h>
+
+namespace scidb
+{
+
+/**
+ * Maps groups - the first nGroups values of a tuple - to one state per aggregate. Every entry is a
+ * tuple of the group values followed by the states, the layout of the partial tuples exchanged by
+ * grouped_aggregate.
+ * <br>
+ * <br>
+ * The slots hold the hash and the index of an entry and are probed linearly; the table doubles
+ * when it is half full. Entries live in a deque, so that growing does not copy them. They are
+ * never removed one by one, only all at once by clear().
+ */
+class AggregateHashTable
+{
+private:
+    struct Slot
+    {
+        uint64_t hash;
+        size_t entry;
+    };
+
+    static const size_t EMPTY = static_cast<size_t>(-1);
+    static const size_t INITIAL_SLOTS = 1024;
+    static const uint32_t SEED = 0x9e3779b9;
+
+    TupleExchange::KeyKinds const _groups;
+    size_t const _nGroups;
+    vector<AggregatePtr> _aggregates;
+    std::deque< vector<Value> > _entries;
+    vector<Slot> _slots;
+    size_t _mask;
+    size_t _valueBytes;
+
+    void resetSlots(size_t nSlots)
+    {
+        Slot empty;
+        empty.hash = 0;
+        empty.entry = EMPTY;
+        _slots.assign(nSlots, empty);
+        _mask = nSlots - 1;
+    }
+
+    void grow()
+    {
+        vector<Slot> old;
+        old.swap(_slots);
+        resetSlots(old.size() * 2);
+        for (size_t i = 0; i < old.size(); ++i)
+        {
+            if (old[i].entry != EMPTY)
+            {
+                size_t s = old[i].hash & _mask;
+                while (_slots[s].entry != EMPTY)
+                {
+                    s = (s + 1) & _mask;
+                }
+                _slots[s] = old[i];
+            }
+        }
+    }
+
+    /**
+     * @return the entry of the group of a tuple, inserted with initialized states if it is new
+     */
+    vector<Value>& findOrInsert(vector<Value> const& tuple)
+    {
+        uint64_t const hash = TupleExchange::hashTuple(tuple, _groups, SEED);
+        size_t s = hash & _mask;
+        while (_slots[s].entry != EMPTY)
+        {
+            if (_slots[s].hash == hash && TupleExchange::equalTuples(_entries[_slots[s].entry], tuple, _groups))
+            {
+                return _entries[_slots[s].entry];
+            }
+            s = (s + 1) & _mask;
+        }
+        _slots[s].hash = hash;
+        _slots[s].entry = _entries.size();
+        _entries.push_back(vector<Value>(_nGroups + _aggregates.size()));
+        vector<Value>& entry = _entries.back();
+        for (size_t i = 0; i < _nGroups; ++i)
+        {
+            entry[i] = tuple[i];
+            _valueBytes += tuple[i].size();
+        }
+        for (size_t i = 0; i < _aggregates.size(); ++i)
+        {
+            _aggregates[i]->initializeState(entry[_nGroups + i]);
+            _valueBytes += entry[_nGroups + i].size();
+        }
+        if (_entries.size() * 2 > _slots.size())
+        {
+            grow();
+        }
+        return entry;
+    }
+
+public:
+    /**
+     * @param groups the kinds of the group values of a tuple, see TupleExchange::getKeyKinds
+     * @param aggregates the aggregates; the table uses its own copies
+     */
+    AggregateHashTable(TupleExchange::KeyKinds const& groups, vector<AggregatePtr> const& aggregates):
+        _groups(groups),
+        _nGroups(groups.size()),
+        _aggregates(aggregates.size()),
+        _mask(0),
+        _valueBytes(0)
+    {
+        for (size_t i = 0; i < aggregates.size(); ++i)
+        {
+            _aggregates[i] = aggregates[i]->clone();
+        }
+        resetSlots(INITIAL_SLOTS);
+    }
+
+    /**
+     * Accumulate input values into the states of a group.
+     * @param groups a tuple starting with the group values
+     * @param inputs one input value per aggregate
+     */
+    void accumulate(vector<Value> const& groups, vector<Value> const& inputs)
+    {
+        vector<Value>& entry = findOrInsert(groups);
+        for (size_t i = 0; i < _aggregates.size(); ++i)
+        {
+            if (inputs[i].isNull() && _aggregates[i]->ignoreNulls())
+            {
+                continue;
+            }
+            _aggregates[i]->accumulate(entry[_nGroups + i], inputs[i]);
+        }
+    }
+
+    /**
+     * Merge the states of a partial tuple into the states of its group.
+     * @param partial the group values followed by one state per aggregate
+     */
+    void merge(vector<Value> const& partial)
+    {
+        vector<Value>& entry = findOrInsert(partial);
+        for (size_t i = 0; i < _aggregates.size(); ++i)
+        {
+            Value const& state = partial[_nGroups + i];
+            if (state.getMissingReason() != 0)
+            {
+                _aggregates[i]->merge(entry[_nGroups + i], state);
+            }
+        }
+    }
+
+    /**
+     * @return the entry number i: the group values, then the states
+     */
+    vector<Value> const& getEntry(size_t i) const
+    {
+        return _entries[i];
+    }
+
+    /**
+     * Compute the final results of an entry.
+     * @param i the entry number
+     * @param[out] result the group values, then one result per aggregate
+     */
+    void getResult(size_t i, vector<Value>& result) const
+    {
+        vector<Value> const& entry = _entries[i];
+        result.resize(entry.size());
+        for (size_t j = 0; j < _nGroups; ++j)
+        {
+            result[j] = entry[j];
+        }
+        for (size_t j = 0; j < _aggregates.size(); ++j)
+        {
+            _aggregates[j]->finalResult(result[_nGroups + j], entry[_nGroups + j]);
+        }
+    }
+
+    /**
+     * @return the number of groups
+     */
+    size_t size() const
+    {
+        return _entries.size();
+    }
+
+    /**
+     * @return an estimate of the memory used by the table, in bytes
+     */
+    size_t getUsedBytes() const
+    {
+        size_t const entryBytes = sizeof(vector<Value>) + (_nGroups + _aggregates.size()) * sizeof(Value);
+        return _valueBytes + _entries.size() * entryBytes + _slots.size() * sizeof(Slot);
+    }
+
+    /**
+     * @return an estimate of the memory used by one group, besides the values that do not fit in a Value
+     */
+    static size_t getEntryOverhead(size_t nValues)
+    {
+        return sizeof(vector<Value>) + nValues * sizeof(Value) + 2 * sizeof(Slot);
+    }
+
+    void clear()
+    {
+        std::deque< vector<Value> >().swap(_entries);
+        resetSlots(INITIAL_SLOTS);
+        _valueBytes = 0;
+    }
+};
+
+}
+
+#endif //AGGREGATE_HASH_TABLE
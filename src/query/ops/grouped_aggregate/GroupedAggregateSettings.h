@@ -0,0 +1,281 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.
+* Copyright (C) 2008-2014 SciDB, Inc.
+*
+* SciDB is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with SciDB.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+/*
+ * @file GroupedAggregateSettings.h
+ * The settings structure for the grouped_aggregate operator.
+ * @see EquiJoinSettings.h
+ */
+
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <query/Operator.h>
+#include <query/Aggregate.h>
+
+#ifndef GROUPED_AGGREGATE_SETTINGS
+#define GROUPED_AGGREGATE_SETTINGS
+
+namespace scidb
+{
+
+/*
+ * Settings for the GroupedAggregate operator.
+ */
+class GroupedAggregateSettings
+{
+public:
+    static const size_t DEFAULT_CHUNK_SIZE = 1000000;
+
+private:
+    ArrayDesc const& _inputSchema;
+    vector<AttributeID> _groups;
+    vector<shared_ptr<OperatorParamAggregateCall> > _aggregateCalls;
+    vector<AggregatePtr> _aggregates;
+    vector<AttributeID> _inputs;
+    size_t _memoryLimit;
+    bool _memoryLimitSet;
+    size_t _chunkSize;
+    bool _chunkSizeSet;
+
+    static int64_t parsePositiveInteger(string const& parameterString, string const& paramHeader)
+    {
+        string paramContent = parameterString.substr(paramHeader.size());
+        trim(paramContent);
+        int64_t sval;
+        try
+        {
+            sval = lexical_cast<int64_t> (paramContent);
+        }
+        catch (bad_lexical_cast const& exn)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_OPERATOR, SCIDB_LE_CANNOT_PARSE_INTEGER_PARAMETER) << parameterString;
+        }
+        if (sval <= 0)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_OPERATOR, SCIDB_LE_PARAMETER_NOT_POSITIVE_INTEGER) << parameterString;
+        }
+        return sval;
+    }
+
+    static void checkNotSet(bool isSet, string const& paramHeader)
+    {
+        if (isSet)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_OPERATOR, SCIDB_LE_CANNOT_BE_SET_MORE_THAN_ONCE) << paramHeader;
+        }
+    }
+
+    void addGroup(shared_ptr<OperatorParam>const& param)
+    {
+        shared_ptr<OperatorParamReference> const& ref = (shared_ptr<OperatorParamReference> const&) param;
+        if (ref->getInputNo() != 0)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_OPERATOR, SCIDB_LE_NOT_AN_ATTRIBUTE_IN_INPUT) << ref->getObjectName();
+        }
+        _groups.push_back(ref->getObjectNo());
+    }
+
+    void addAggregate(shared_ptr<OperatorParam>const& param)
+    {
+        shared_ptr<OperatorParamAggregateCall> const& call = (shared_ptr<OperatorParamAggregateCall> const&) param;
+        AttributeID inputId;
+        AggregatePtr agg = resolveAggregate(call, _inputSchema.getAttributes(), &inputId);
+        if (agg->isOrderSensitive())
+        {
+            throw USER_EXCEPTION(SCIDB_SE_OPERATOR, SCIDB_LE_AGGREGATION_ORDER_MISMATCH) << agg->getName();
+        }
+        _aggregateCalls.push_back(call);
+        _aggregates.push_back(agg);
+        _inputs.push_back(inputId);
+    }
+
+public:
+    GroupedAggregateSettings(ArrayDesc const& inputSchema,
+                             vector<shared_ptr<OperatorParam> > const& operatorParameters,
+                             bool logical,
+                             shared_ptr<Query>& query):
+        _inputSchema            (inputSchema),
+        _memoryLimit            (Config::getInstance()->getOption<size_t>(CONFIG_MEM_ARRAY_THRESHOLD) * MiB),
+        _memoryLimitSet         (false),
+        _chunkSize              (DEFAULT_CHUNK_SIZE),
+        _chunkSizeSet           (false)
+    {
+        string const memLimitHeader       = "memory_limit=";
+        string const chunkSizeHeader      = "chunk_size=";
+        size_t nParams = operatorParameters.size();
+        for (size_t i = 0; i<nParams; ++i)
+        {
+            shared_ptr<OperatorParam>const& param = operatorParameters[i];
+            if (param->getParamType() == PARAM_ATTRIBUTE_REF)
+            {
+                addGroup(param);
+                continue;
+            }
+            if (param->getParamType() == PARAM_AGGREGATE_CALL)
+            {
+                addAggregate(param);
+                continue;
+            }
+            string parameterString;
+            if (logical)
+            {
+                parameterString = evaluate(((shared_ptr<OperatorParamLogicalExpression>&) param)->
+                                           getExpression(),query, TID_STRING).getString();
+            }
+            else
+            {
+                parameterString = ((shared_ptr<OperatorParamPhysicalExpression>&) param)->
+                                  getExpression()->evaluate().getString();
+            }
+            if (starts_with(parameterString, memLimitHeader))
+            {
+                checkNotSet(_memoryLimitSet, memLimitHeader);
+                _memoryLimit = parsePositiveInteger(parameterString, memLimitHeader) * MiB;
+                _memoryLimitSet = true;
+            }
+            else if (starts_with(parameterString, chunkSizeHeader))
+            {
+                checkNotSet(_chunkSizeSet, chunkSizeHeader);
+                _chunkSize = parsePositiveInteger(parameterString, chunkSizeHeader);
+                _chunkSizeSet = true;
+            }
+            else
+            {
+                throw SYSTEM_EXCEPTION(SCIDB_SE_OPERATOR, SCIDB_LE_UNRECOGNIZED_PARAMETER) << parameterString;
+            }
+        }
+        if (_groups.empty() || _aggregates.empty())
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_SYNTAX, SCIDB_LE_WRONG_OPERATOR_ARGUMENTS_COUNT2) << "grouped_aggregate";
+        }
+        //count(*) has no input of its own: it reads the first group attribute, which is never skipped
+        for (size_t i = 0; i < _inputs.size(); ++i)
+        {
+            if (_inputs[i] == INVALID_ATTRIBUTE_ID)
+            {
+                _inputs[i] = _groups[0];
+            }
+        }
+    }
+
+    /**
+     * @return the ids of the group attributes
+     */
+    vector<AttributeID> const& getGroups() const
+    {
+        return _groups;
+    }
+
+    size_t getNumGroups() const
+    {
+        return _groups.size();
+    }
+
+    /**
+     * @return the aggregates, in the order they were given
+     */
+    vector<AggregatePtr> const& getAggregates() const
+    {
+        return _aggregates;
+    }
+
+    size_t getNumAggregates() const
+    {
+        return _aggregates.size();
+    }
+
+    /**
+     * @return the ids of the input attributes of the aggregates
+     */
+    vector<AttributeID> const& getAggregateInputs() const
+    {
+        return _inputs;
+    }
+
+    /**
+     * @return the memory limit (converted to bytes) of the hash table
+     */
+    size_t getMemoryLimit() const
+    {
+        return _memoryLimit;
+    }
+
+    /**
+     * @return the chunk size of the output array
+     */
+    size_t getChunkSize() const
+    {
+        return _chunkSize;
+    }
+
+    /**
+     * The partial tuples exchanged between instances hold the group values, then one aggregate
+     * state per aggregate.
+     * @return the attributes of the partial tuples
+     */
+    Attributes getPartialAttributes() const
+    {
+        Attributes result;
+        for (size_t i = 0; i < _groups.size(); ++i)
+        {
+            AttributeDesc const& a = _inputSchema.getAttributes()[_groups[i]];
+            result.push_back(AttributeDesc(result.size(), a.getName(), a.getType(), a.getFlags(), 0));
+        }
+        for (size_t i = 0; i < _aggregates.size(); ++i)
+        {
+            Value defaultNull;
+            defaultNull.setNull(0);
+            std::ostringstream name;
+            name << "state_" << i;
+            result.push_back(AttributeDesc(result.size(), name.str(), _aggregates[i]->getStateType().typeId(),
+                                           AttributeDesc::IS_NULLABLE, 0, std::set<std::string>(), &defaultNull, ""));
+        }
+        return result;
+    }
+
+    /**
+     * The output has the group attributes then the aggregate results. Its cells are numbered per
+     * instance: [instance_id=0:N-1,1,0, value_no=0:*,chunk_size,0].
+     */
+    ArrayDesc getOutputSchema(shared_ptr<Query> const& query) const
+    {
+        Dimensions dims(2);
+        dims[0] = DimensionDesc("instance_id", 0, query->getInstancesCount() - 1, 1, 0);
+        dims[1] = DimensionDesc("value_no", 0, MAX_COORDINATE, _chunkSize, 0);
+        ArrayDesc result(_inputSchema.getName(), Attributes(), dims);
+        for (size_t i = 0; i < _groups.size(); ++i)
+        {
+            AttributeDesc const& a = _inputSchema.getAttributes()[_groups[i]];
+            //checks that the name of the attribute is unique
+            result.addAttribute(AttributeDesc(i, a.getName(), a.getType(), a.getFlags(), 0));
+        }
+        for (size_t i = 0; i < _aggregateCalls.size(); ++i)
+        {
+            addAggregatedAttribute(_aggregateCalls[i], _inputSchema, result, false);
+        }
+        return addEmptyTagAttribute(result);
+    }
+};
+
+}
+
+#endif //GROUPED_AGGREGATE_SETTINGS
@@ -0,0 +1,104 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.
+* Copyright (C) 2008-2014 SciDB, Inc.
+*
+* SciDB is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with SciDB.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+#include <query/Operator.h>
+#include "GroupedAggregateSettings.h"
+
+namespace scidb
+{
+
+/**
+ * @brief The operator: grouped_aggregate()
+ *
+ * @par Synopsis: grouped_aggregate (input_array, AGGREGATE_CALL [,...], group_attribute [,...]
+ *                                   [,'memory_limit=MEMORY_LIMIT'] [,'chunk_size=CHUNK_SIZE'])
+ *   <br> AGGREGATE_CALL := AGGREGATE_FUNC(inputAttr) [as resultName]
+ *
+ * @par Examples:
+ *   <br> grouped_aggregate(trades, sum(quantity), count(*), symbol)
+ *   <br> grouped_aggregate(readings, avg(value) as mean, sensor_id, day, 'memory_limit=256')
+ *
+ * @par Summary:
+ *   <br>
+ *   Calculates aggregates over the groups of cells that have equal values of the group attributes, without
+ *   redimensioning the input first. Cells with null group attributes form groups of their own, one per missing
+ *   reason. Like aggregate(), all the aggregate functions ignore null values, except count(*). Order-sensitive
+ *   aggregates are not supported.
+ *   <br>
+ *   <br>
+ *   The output has one cell per group, with no meaningful coordinates: every instance numbers the groups it
+ *   produces along value_no.
+ *   <br>
+ *   <br>
+ *   The states of the groups of an instance are kept in a hash table of at most 'memory_limit' mebibytes
+ *   (MEM_ARRAY_THRESHOLD by default).
+ *
+ * @par Input:
+ *   <br> input_array <...> [*]
+ *   <br> aggregate calls                            --the aggregates to compute
+ *   <br> attribute references                       --the group attributes
+ *   <br> ['memory_limit=MEMORY_LIMIT']              --the memory limit of the hash table (MB)
+ *   <br> ['chunk_size=CHUNK_SIZE']                  --the chunk size of value_no (default 1000000)
+ *
+ * @par Output array:
+ *   <br> <
+ *   <br>   group attributes, aggregate results
+ *   <br> >
+ *   <br> [ instance_id=0:N-1,1,0, value_no=0:*,CHUNK_SIZE,0 ]
+ *   <br>
+ *
+ * @see PhysicalGroupedAggregate.cpp for a description of the algorithm.
+ */
+class LogicalGroupedAggregate : public LogicalOperator
+{
+public:
+    LogicalGroupedAggregate(const string& logicalName, const string& alias):
+        LogicalOperator(logicalName, alias)
+    {
+        ADD_PARAM_INPUT()
+        ADD_PARAM_VARIES()
+    }
+
+    vector<shared_ptr<OperatorParamPlaceholder> > nextVaryParamPlaceholder(vector< ArrayDesc> const& schemas)
+    {
+        vector<shared_ptr<OperatorParamPlaceholder> > res;
+        if (_parameters.size() >= 2)
+        {
+            res.push_back(END_OF_VARIES_PARAMS());
+        }
+        res.push_back(PARAM_AGGREGATE_CALL());
+        res.push_back(PARAM_IN_ATTRIBUTE_NAME("void"));
+        res.push_back(PARAM_CONSTANT(TID_STRING));
+        return res;
+    }
+
+    ArrayDesc inferSchema(vector< ArrayDesc> schemas, shared_ptr< Query> query)
+    {
+        //The settings object also checks the aggregates and the group attributes for validity
+        GroupedAggregateSettings settings(schemas[0], _parameters, true, query);
+        return settings.getOutputSchema(query);
+    }
+};
+
+DECLARE_LOGICAL_OPERATOR_FACTORY(LogicalGroupedAggregate, "grouped_aggregate")
+
+} //namespace scidb
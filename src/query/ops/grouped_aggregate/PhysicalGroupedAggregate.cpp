@@ -0,0 +1,291 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.
+* Copyright (C) 2008-2014 SciDB, Inc.
+*
+* SciDB is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with SciDB.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+#include <boost/foreach.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include "GroupedAggregateSettings.h"
+#include "AggregateHashTable.h"
+#include <query/Operator.h>
+#include <query/TupleExchange.h>
+#include <array/RowCollection.h>
+
+namespace scidb
+{
+
+static log4cxx::LoggerPtr groupedAggregateLogger(log4cxx::Logger::getLogger("scidb.operators.grouped_aggregate"));
+
+/**
+ * @par Algorithm:
+ * <br>
+ * <br>
+ * Every instance accumulates its input cells into a hash table from group values to aggregate states (see
+ * AggregateHashTable). Whenever the table grows past the memory limit, its partial states are written out and the
+ * table starts over; a group may then have several partial states on the same instance, which is harmless because
+ * partial states are merged anyway.
+ * <br>
+ * <br>
+ * The partial states are sent to the instance given by a hash of their group values (see TupleExchange), so that all
+ * the partial states of a group end up on the same instance, where they are merged with Aggregate::merge and turned
+ * into final results.
+ * <br>
+ * <br>
+ * When the merged states of an instance could exceed the memory limit, the received partial states are first split
+ * into partitions by another hash of the group values, kept in RowCollections - MemArrays that are swapped out to
+ * disk as needed - and merged one partition at a time. A group never spans two partitions.
+ */
+class PhysicalGroupedAggregate : public PhysicalOperator
+{
+private:
+    typedef RowCollection<size_t> Partitions;
+
+    /**
+     * Seeds of the independent hashes of the group values. The hash table uses a third one.
+     */
+    static const uint32_t EXCHANGE_SEED  = 0;
+    static const uint32_t PARTITION_SEED = 0x85ebca6b;
+
+    /**
+     * Number of partial tuples per chunk of the exchanged array.
+     */
+    static const size_t EXCHANGE_CHUNK_SIZE = 10000;
+
+    /**
+     * Send the partial states of a table to the instances that merge them.
+     */
+    static void flush(AggregateHashTable const& table, TupleExchange::KeyKinds const& groupKeys,
+                      TupleExchange& exchange, size_t nInstances)
+    {
+        for (size_t i = 0, n = table.size(); i < n; ++i)
+        {
+            vector<Value> const& entry = table.getEntry(i);
+            exchange.append(TupleExchange::hashTuple(entry, groupKeys, EXCHANGE_SEED) % nInstances, entry);
+        }
+    }
+
+    /**
+     * Accumulate the input into partial states and send them to the instances that merge them.
+     * @return the partial states received by this instance
+     */
+    shared_ptr<Array> accumulateInput(shared_ptr<Array> const& input,
+                                      GroupedAggregateSettings const& settings,
+                                      shared_ptr<Query> const& query)
+    {
+        vector<AttributeID> const& groups = settings.getGroups();
+        vector<AttributeID> const& inputs = settings.getAggregateInputs();
+        size_t const nGroups = groups.size();
+        size_t const nAggs = inputs.size();
+        size_t const nInstances = query->getInstancesCount();
+        size_t const memoryLimit = settings.getMemoryLimit();
+
+        //every attribute is scanned once, even if it is both a group and the input of aggregates
+        vector<AttributeID> scanned;
+        vector<size_t> groupPos(nGroups);
+        vector<size_t> inputPos(nAggs);
+        for (size_t i = 0; i < nGroups + nAggs; ++i)
+        {
+            AttributeID const id = i < nGroups ? groups[i] : inputs[i - nGroups];
+            size_t pos = std::find(scanned.begin(), scanned.end(), id) - scanned.begin();
+            if (pos == scanned.size())
+            {
+                scanned.push_back(id);
+            }
+            if (i < nGroups)
+            {
+                groupPos[i] = pos;
+            }
+            else
+            {
+                inputPos[i - nGroups] = pos;
+            }
+        }
+        size_t const nScanned = scanned.size();
+
+        TupleExchange exchange(input->getArrayDesc().getName() + "_partial", settings.getPartialAttributes(),
+                               EXCHANGE_CHUNK_SIZE, query);
+        TupleExchange::KeyKinds const groupKeys = TupleExchange::getKeyKinds(settings.getPartialAttributes(), nGroups);
+        AggregateHashTable table(groupKeys, settings.getAggregates());
+        vector<shared_ptr<ConstArrayIterator> > arrayIters(nScanned);
+        vector<shared_ptr<ConstChunkIterator> > chunkIters(nScanned);
+        for (size_t i = 0; i < nScanned; ++i)
+        {
+            arrayIters[i] = input->getConstIterator(scanned[i]);
+        }
+        vector<Value> groupValues(nGroups);
+        vector<Value> inputValues(nAggs);
+        size_t nFlushes = 0;
+        while (!arrayIters[0]->end())
+        {
+            for (size_t i = 0; i < nScanned; ++i)
+            {
+                chunkIters[i] = arrayIters[i]->getChunk().getConstIterator(ChunkIterator::IGNORE_EMPTY_CELLS |
+                                                                           ChunkIterator::IGNORE_OVERLAPS);
+            }
+            while (!chunkIters[0]->end())
+            {
+                for (size_t i = 0; i < nGroups; ++i)
+                {
+                    groupValues[i] = chunkIters[groupPos[i]]->getItem();
+                }
+                for (size_t i = 0; i < nAggs; ++i)
+                {
+                    inputValues[i] = chunkIters[inputPos[i]]->getItem();
+                }
+                table.accumulate(groupValues, inputValues);
+                if (table.getUsedBytes() > memoryLimit)
+                {
+                    flush(table, groupKeys, exchange, nInstances);
+                    table.clear();
+                    ++nFlushes;
+                }
+                for (size_t i = 0; i < nScanned; ++i)
+                {
+                    ++(*chunkIters[i]);
+                }
+            }
+            for (size_t i = 0; i < nScanned; ++i)
+            {
+                chunkIters[i].reset();
+                ++(*arrayIters[i]);
+            }
+        }
+        flush(table, groupKeys, exchange, nInstances);
+        LOG4CXX_DEBUG(groupedAggregateLogger, "grouped_aggregate: sending " << exchange.getTupleCount()
+                      << " partial states after " << nFlushes << " early flush(es)");
+        return exchange.exchange();
+    }
+
+    static void writeResults(AggregateHashTable const& table, TupleWriter& output)
+    {
+        vector<Value> result;
+        for (size_t i = 0, n = table.size(); i < n; ++i)
+        {
+            table.getResult(i, result);
+            output.write(result);
+        }
+    }
+
+    /**
+     * Merge the received partial states partition by partition, so that the states of a partition fit in memory.
+     */
+    void mergePartitioned(shared_ptr<Array> const& partial,
+                          size_t nPartitions,
+                          AggregateHashTable& table,
+                          TupleExchange::KeyKinds const& groupKeys,
+                          TupleWriter& output,
+                          shared_ptr<Query> const& query)
+    {
+        Attributes const& attributes = partial->getArrayDesc().getAttributes(true);
+        Partitions partitions(query, "", attributes);
+        for (TupleReader reader(partial); !reader.end(); ++reader)
+        {
+            vector<Value> const& tuple = reader.getTuple();
+            size_t rowId = UNKNOWN_ROW_ID;
+            partitions.appendItem(rowId, TupleExchange::hashTuple(tuple, groupKeys, PARTITION_SEED) % nPartitions,
+                                  tuple);
+        }
+        partitions.switchMode(RowCollectionModeRead);
+
+        vector<Value> tuple(attributes.size());
+        for (size_t p = 0; p < nPartitions; ++p)
+        {
+            if (!partitions.existsGroup(p))
+            {
+                continue;
+            }
+            table.clear();
+            boost::scoped_ptr<Partitions::MyRowIterator> rowIter(
+                partitions.openRow(partitions.rowIdFromExistingGroup(p)));
+            while (!rowIter->end())
+            {
+                rowIter->getItem(tuple);
+                table.merge(tuple);
+                ++(*rowIter);
+            }
+            writeResults(table, output);
+            query->validate();
+        }
+    }
+
+public:
+    PhysicalGroupedAggregate(string const& logicalName,
+                             string const& physicalName,
+                             Parameters const& parameters,
+                             ArrayDesc const& schema):
+        PhysicalOperator(logicalName, physicalName, parameters, schema)
+    {}
+
+    /**
+     * Every instance writes to its own row of the output. That is not psHashPartitioned.
+     */
+    virtual bool changesDistribution(std::vector<ArrayDesc> const&) const
+    {
+        return true;
+    }
+
+    virtual bool outputFullChunks(std::vector<ArrayDesc> const&) const
+    {
+        return false;
+    }
+
+    virtual ArrayDistribution getOutputDistribution(vector<ArrayDistribution> const&,
+                                                    vector<ArrayDesc> const&) const
+    {
+        return ArrayDistribution(psUndefined);
+    }
+
+    shared_ptr<Array> execute(vector< shared_ptr< Array> >& inputArrays, shared_ptr<Query> query)
+    {
+        GroupedAggregateSettings settings(inputArrays[0]->getArrayDesc(), _parameters, false, query);
+        shared_ptr<Array> partial = accumulateInput(inputArrays[0], settings, query);
+
+        size_t const nGroups = settings.getNumGroups();
+        uint64_t const count = getCellCount(partial);
+        uint64_t const mergedSize = getChunksSize(partial) +
+            count * AggregateHashTable::getEntryOverhead(nGroups + settings.getNumAggregates());
+        size_t const nPartitions = (mergedSize + settings.getMemoryLimit() - 1) / settings.getMemoryLimit();
+        LOG4CXX_DEBUG(groupedAggregateLogger, "grouped_aggregate: received " << count << " partial states"
+                      << ", estimated size " << mergedSize << " bytes, " << nPartitions << " partition(s)");
+
+        TupleWriter output(_schema, query);
+        TupleExchange::KeyKinds const groupKeys = TupleExchange::getKeyKinds(settings.getPartialAttributes(), nGroups);
+        AggregateHashTable table(groupKeys, settings.getAggregates());
+        if (nPartitions <= 1)
+        {
+            for (TupleReader reader(partial); !reader.end(); ++reader)
+            {
+                table.merge(reader.getTuple());
+            }
+            writeResults(table, output);
+        }
+        else
+        {
+            mergePartitioned(partial, nPartitions, table, groupKeys, output, query);
+        }
+        LOG4CXX_DEBUG(groupedAggregateLogger, "grouped_aggregate: produced " << output.getTupleCount() << " groups");
+        return output.finish();
+    }
+};
+
+DECLARE_PHYSICAL_OPERATOR_FACTORY(PhysicalGroupedAggregate, "grouped_aggregate", "PhysicalGroupedAggregate")
+
+} //namespace scidb
@@ -53,6 +53,8 @@ private:
     bool _memoryLimitSet;
     bool _indexSorted;
     bool _indexSortedSet;
+    bool _hashLayout;
+    bool _layoutSet;
 
     void parseMemoryLimit(string const& parameterString, string const& paramHeader)
     {
@@ -101,6 +103,34 @@ private:
          _indexSortedSet = true;
      }
 
+    void parseLayout(string const& parameterString, string const& paramHeader)
+    {
+        if(_layoutSet)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_OPERATOR, SCIDB_LE_CANNOT_BE_SET_MORE_THAN_ONCE) << paramHeader;
+        }
+        string paramContent = parameterString.substr(paramHeader.size());
+        trim(paramContent);
+        if (paramContent == "hash")
+        {
+            if (_indexSchema.getAttributes()[0].getType() != TID_STRING)
+            {
+                throw SYSTEM_EXCEPTION(SCIDB_SE_OPERATOR, SCIDB_LE_ILLEGAL_OPERATION)
+                      << "layout=hash requires an index of type string";
+            }
+            _hashLayout = true;
+        }
+        else if (paramContent == "sorted")
+        {
+            _hashLayout = false;
+        }
+        else
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_OPERATOR, SCIDB_LE_UNRECOGNIZED_PARAMETER) << parameterString;
+        }
+        _layoutSet = true;
+    }
+
     void setOutputAttributeName(shared_ptr<OperatorParam>const& param)
     {
         if(_outputAttributeNameSet)
@@ -139,7 +169,7 @@ private:
     }
 
 public:
-    static const size_t MAX_PARAMETERS = 4;
+    static const size_t MAX_PARAMETERS = 5;
 
     IndexLookupSettings(ArrayDesc const& inputSchema,
                         ArrayDesc const& indexSchema,
@@ -155,7 +185,9 @@ public:
         _memoryLimit            (Config::getInstance()->getOption<size_t>(CONFIG_MEM_ARRAY_THRESHOLD) * MiB),
         _memoryLimitSet         (false),
         _indexSorted            (false),
-        _indexSortedSet         (false)
+        _indexSortedSet         (false),
+        _hashLayout             (false),
+        _layoutSet              (false)
 
     {
         if (dynamic_pointer_cast<OperatorParamReference> (operatorParameters[0])->getInputNo() != 0)
@@ -166,6 +198,7 @@ public:
         checkInputSchemas();
         string const memLimitHeader    = "memory_limit=";
         string const indexSortedHeader = "index_sorted=";
+        string const layoutHeader      = "layout=";
         size_t nParams = operatorParameters.size();
         if (nParams > MAX_PARAMETERS)
         {   //assert-like exception. Caller should have taken care of this!
@@ -200,6 +233,10 @@ public:
                 {
                     parseIndexSorted(parameterString, indexSortedHeader);
                 }
+                else if (starts_with(parameterString, layoutHeader))
+                {
+                    parseLayout(parameterString, layoutHeader);
+                }
                 else
                 {
                     throw SYSTEM_EXCEPTION(SCIDB_SE_OPERATOR, SCIDB_LE_UNRECOGNIZED_PARAMETER) << parameterString;
@@ -240,6 +277,15 @@ public:
     {
         return _indexSorted;
     }
+
+    /**
+     * @return true if the user asked for a hash table of the string index values instead of the
+     * sorted vector, false otherwise (default).
+     */
+    bool isHashLayout() const
+    {
+        return _hashLayout;
+    }
 };
 
 }
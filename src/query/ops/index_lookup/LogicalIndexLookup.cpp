@@ -40,11 +40,12 @@ namespace scidb
  *
  * @brief The operator: index_lookup()
  *
- * @par Synopsis: index_lookup (input_array, index_array, input_array.attribute_name [,output_attribute_name] [,'memory_limit=MEMORY_LIMIT'])
+ * @par Synopsis: index_lookup (input_array, index_array, input_array.attribute_name [,output_attribute_name] [,'memory_limit=MEMORY_LIMIT'] [,'index_sorted=true'] [,'layout=hash'])
  *
  * @par Examples:
  *   <br> index_lookup(stock_trades, stock_symbols, stock_trades.ticker)
  *   <br> index_lookup(stock_trades, stock_symbols, stock_trades.ticker, ticker_id, 'memory_limit=1024')
+ *   <br> index_lookup(stock_trades, stock_symbols, stock_trades.ticker, 'layout=hash')
  *
  * @par Summary:
  *   <br>
@@ -69,6 +70,15 @@ namespace scidb
  *   used. It is provided in units of mebibytes and must be at least 1.
  *   <br>
  *   <br>
+ *   If the whole index_array fits in the memory limit and index_array is a stored array, the lookup structure is kept
+ *   after the query, up to a total of INDEX_LOOKUP_CACHE mebibytes, and reused by the following queries that look
+ *   into the same version of index_array. Storing a new version of index_array invalidates it.
+ *   <br>
+ *   <br>
+ *   For a string index_attribute, 'layout=hash' replaces the sorted lookup structure with a hash table, which needs
+ *   no sort of index_array. It is used only if the whole index_array fits in the memory limit.
+ *   <br>
+ *   <br>
  *   The operator may be further optimized to reduce memory footprint, optimized with a more clever data distribution
  *   pattern and/or extended to use multiple index arrays at the same time.
  *
@@ -78,6 +88,8 @@ namespace scidb
  *   <br> input_attribute                --the name of the input attribute
  *   <br> [output_attribute_name]        --the name for the output attribute if desired
  *   <br> ['memory_limit=MEMORY_LIMIT']  --the memory limit to use MB)
+ *   <br> ['index_sorted=true']          --if the index array is already sorted
+ *   <br> ['layout=hash']                --look string values up in a hash table instead of a sorted vector
  *
  * @par Output array:
  *   <br> <
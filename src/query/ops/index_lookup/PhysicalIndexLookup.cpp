@@ -20,13 +20,20 @@
 * END_COPYRIGHT
 */
 
+#include <list>
+#include <boost/unordered_map.hpp>
 #include "IndexLookupSettings.h"
 #include <query/Operator.h>
 #include <query/Network.h>
+#include <array/DBArray.h>
 #include <array/DelegateArray.h>
 #include <array/SortArray.h>
+#include <system/Config.h>
+#include <system/SciDBConfigOptions.h>
 #include <util/arena/Vector.h>
 #include <util/Arena.h>
+#include <util/Mutex.h>
+#include <util/Singleton.h>
 
 namespace scidb
 {
@@ -53,6 +60,12 @@ using arena::ArenaPtr;
  * the next smallest value in the vector. We use those coordinates to select a chunk in the index array. We then use
  * binary search over the chunk to find the value.
  *
+ * When the memory limit allows every value of the index into the vector, the vector is complete: a value that is not
+ * in it is not in the index, and the index array is not needed after the vector is built. A complete vector of a
+ * stored index array is kept across queries in the LookupCache, keyed by the version of the index array, so that
+ * later lookups into the same version skip the redistribution, the sort and the scan. With 'layout=hash', the values
+ * of a string index go into a hash table instead, built straight from the unsorted index.
+ *
  * @author apoliakov@paradigm4.com
  */
 class PhysicalIndexLookup : public PhysicalOperator
@@ -83,6 +96,8 @@ private:
         mgd::vector<Coordinate> _positionsInSortedArray;   //NOT used if index array was initally sorted
         AttributeComparator _lessThan;
         bool const _indexPreSorted;
+        bool _complete;         //true if every value of the index is in the vector
+        size_t _memorySize;
 
     public:
         LookupVector(TypeId const& tid, size_t initialSize, bool indexPreSorted, ArenaPtr const& arena):
@@ -90,7 +105,9 @@ private:
             _positionsInOriginalArray(arena.get()),
             _positionsInSortedArray(arena.get()),
             _lessThan(tid),
-            _indexPreSorted(indexPreSorted)
+            _indexPreSorted(indexPreSorted),
+            _complete(false),
+            _memorySize(sizeof(LookupVector))
         {
             _values.reserve(initialSize);
             _positionsInOriginalArray.reserve(initialSize);
@@ -110,18 +127,45 @@ private:
         {
             _values.push_back(v);
             _positionsInOriginalArray.push_back(positionInOriginalArray);
+            _memorySize += sizeof(Value) + sizeof(Coordinate) + (v.size() > sizeof(int64_t) ? v.size() : 0);
             if(_indexPreSorted)
             {
                 return;
             }
             _positionsInSortedArray.push_back(positionInSortedArray);
+            _memorySize += sizeof(Coordinate);
+        }
+
+        /**
+         * Record that all the values of the index have been added. Must be called once the vector is built.
+         */
+        void setComplete()
+        {
+            _complete = true;
+        }
+
+        /**
+         * @return true if every value of the index is in the vector, so that the index array is not needed.
+         */
+        bool isComplete() const
+        {
+            return _complete;
+        }
+
+        /**
+         * @return the approximate number of bytes used by the vector and its values
+         */
+        size_t getMemorySize() const
+        {
+            return _memorySize;
         }
 
         /**
          * Find an element in the vector, or find the coordinates of two elements it could be between.
          * If found - return true and set lb = ub = positionInOriginalArray.
          * If not found but out of range, return false set lb to previous positionInSortedArray, ub to next
-         * positionInSortedArray. If out of range, return false, set lb to 0, set ub to -1
+         * positionInSortedArray. If out of range, or not found in a complete vector, return false, set lb to 0,
+         * set ub to -1
          * @param v the value to find
          * @param[out] lb the lower bound coordinate placeholder
          * @param[out] ub the upper bound coordinate placeholder
@@ -143,7 +187,7 @@ private:
                 ub = _positionsInOriginalArray[index];
                 return true;
             }
-            if (iter == _values.begin())
+            if (_complete || iter == _values.begin())
             {
                 VALUE_OUT_OF_RANGE;
             }
@@ -162,6 +206,204 @@ private:
         }
     };
 
+    /**
+     * A hash table from all the values of a string index to their positions, for exact-match lookups with
+     * 'layout=hash'. Unlike the LookupVector it needs no sorted copy of the index.
+     */
+    class LookupHash
+    {
+    private:
+        boost::unordered_map<string, Coordinate> _positions;
+        size_t _memorySize;
+
+    public:
+        LookupHash(size_t initialSize):
+            _memorySize(sizeof(LookupHash))
+        {
+            _positions.rehash(initialSize);
+        }
+
+        /**
+         * Add v and its position to the table. If v is already in it, the first position is kept.
+         */
+        void addElement(Value const& v, Coordinate const position)
+        {
+            string const key(v.getString());
+            if (_positions.insert(std::make_pair(key, position)).second)
+            {
+                //the string, the node with its hash and link, and the bucket
+                _memorySize += key.size() + sizeof(string) + sizeof(Coordinate) + 3 * sizeof(void*);
+            }
+        }
+
+        /**
+         * @param v the value to find
+         * @param[out] result set to the position of v if it is found
+         * @return true if v is found, false otherwise
+         */
+        bool findElement(Value const& v, Coordinate& result) const
+        {
+            boost::unordered_map<string, Coordinate>::const_iterator iter = _positions.find(v.getString());
+            if (iter == _positions.end())
+            {
+                return false;
+            }
+            result = iter->second;
+            return true;
+        }
+
+        /**
+         * @return the approximate number of bytes used by the table and its values
+         */
+        size_t getMemorySize() const
+        {
+            return _memorySize;
+        }
+    };
+
+    /**
+     * The structure that values are looked up in: either a hash table, or a vector and, unless the vector is
+     * complete, the prepared index array. Shared by all the chunk iterators of the output and never modified.
+     */
+    struct LookupTable
+    {
+        shared_ptr<Array> indexArray;
+        shared_ptr<LookupVector const> lookupVector;
+        shared_ptr<LookupHash const> lookupHash;
+
+        size_t getMemorySize() const
+        {
+            return lookupHash ? lookupHash->getMemorySize() : lookupVector->getMemorySize();
+        }
+    };
+
+    /**
+     * The complete lookup tables of stored index arrays, kept across queries and shared by all of them. A table is
+     * keyed by the versioned id of its index array, so a new version of the array never finds the tables of the
+     * older ones; these are dropped when the table of a new version is added, and otherwise age out. The tables
+     * take at most CONFIG_INDEX_LOOKUP_CACHE MiB; the least recently used ones are evicted first.
+     */
+    class LookupCache : public Singleton<LookupCache>
+    {
+    public:
+        struct Key
+        {
+            ArrayUAID uaid;
+            ArrayID versionedId;
+            bool indexPreSorted;
+            bool hashed;
+
+            Key(ArrayDesc const& indexSchema, bool indexPreSorted, bool hashed):
+                uaid(indexSchema.getUAId()),
+                versionedId(indexSchema.getId()),
+                indexPreSorted(indexPreSorted),
+                hashed(hashed)
+            {}
+
+            bool operator< (Key const& other) const
+            {
+                if (uaid != other.uaid)
+                {
+                    return uaid < other.uaid;
+                }
+                if (versionedId != other.versionedId)
+                {
+                    return versionedId < other.versionedId;
+                }
+                if (indexPreSorted != other.indexPreSorted)
+                {
+                    return indexPreSorted < other.indexPreSorted;
+                }
+                return hashed < other.hashed;
+            }
+        };
+
+        LookupCache():
+            _usedBytes(0)
+        {}
+
+        /**
+         * @param key the index array version and layout
+         * @param[out] table set to the cached table of key, if any
+         * @return true if the table of key was found, false otherwise
+         */
+        bool get(Key const& key, LookupTable& table)
+        {
+            ScopedMutexLock lock(_mutex);
+            EntryMap::iterator iter = _entries.find(key);
+            if (iter == _entries.end())
+            {
+                return false;
+            }
+            _lru.splice(_lru.begin(), _lru, iter->second.lruPosition);
+            table = iter->second.table;
+            return true;
+        }
+
+        /**
+         * Add a complete table, evicting the tables of the older versions of its index array and then the least
+         * recently used tables until it fits. Does nothing if the table alone exceeds the budget.
+         */
+        void put(Key const& key, LookupTable const& table)
+        {
+            assert(!table.indexArray);
+            size_t const budget = Config::getInstance()->getOption<size_t>(CONFIG_INDEX_LOOKUP_CACHE) * MiB;
+            size_t const size = table.getMemorySize();
+            if (size > budget)
+            {
+                return;
+            }
+            ScopedMutexLock lock(_mutex);
+            for (EntryMap::iterator iter = _entries.begin(); iter != _entries.end(); )
+            {
+                EntryMap::iterator next = iter;
+                ++next;
+                if (iter->first.uaid == key.uaid &&
+                    (iter->first.versionedId < key.versionedId || !(iter->first < key || key < iter->first)))
+                {
+                    erase(iter);
+                }
+                iter = next;
+            }
+            while (_usedBytes + size > budget)
+            {
+                erase(_entries.find(_lru.back()));
+            }
+            _lru.push_front(key);
+            Entry& entry = _entries[key];
+            entry.table = table;
+            entry.size = size;
+            entry.lruPosition = _lru.begin();
+            _usedBytes += size;
+            LOG4CXX_DEBUG(logger, "Cached the lookup table of array " << key.versionedId << ", " << size
+                                  << " bytes; " << _entries.size() << " tables, " << _usedBytes << " bytes cached");
+        }
+
+    private:
+        typedef std::list<Key> LruList;
+
+        struct Entry
+        {
+            LookupTable table;
+            size_t size;
+            LruList::iterator lruPosition;
+        };
+
+        typedef std::map<Key, Entry> EntryMap;
+
+        Mutex _mutex;
+        EntryMap _entries;
+        LruList _lru;           //most recently used first
+        size_t _usedBytes;
+
+        void erase(EntryMap::iterator iter)
+        {
+            _usedBytes -= iter->second.size;
+            _lru.erase(iter->second.lruPosition);
+            _entries.erase(iter);
+        }
+    };
+
     /**
      * An object that contains a pointer to the LookupVector and a pointer to the index array, and can be used
      * to look up the coordinate of a particular value.
@@ -173,6 +415,7 @@ private:
         AttributeComparator _lessThan;
         //Important: the map stays constant throughout the process and the ValueIndex may not mutate it.
         shared_ptr<LookupVector const> _lookupVector;
+        shared_ptr<LookupHash const> _lookupHash;
         shared_ptr<ConstArrayIterator> _valueArrayIter;
         shared_ptr<ConstChunkIterator> _valueChunkIter;
         Coordinates _currentChunkPosition; //the position of the currently opened chunk
@@ -246,15 +489,19 @@ private:
         }
 
     public:
-        ValueIndex(shared_ptr<Array> const& indexArray, shared_ptr<LookupVector const> const& partialVector,
-                   bool indexPreSorted):
-            _indexArray(indexArray),
-            _lessThan(indexArray->getArrayDesc().getAttributes()[0].getType()),
-            _lookupVector(partialVector),
-            _valueArrayIter(indexArray->getConstIterator(0)),
-            _positionArrayIter(indexArray->getConstIterator(1)),
+        ValueIndex(LookupTable const& table, TypeId const& tid, bool indexPreSorted):
+            _indexArray(table.indexArray),
+            _lessThan(tid),
+            _lookupVector(table.lookupVector),
+            _lookupHash(table.lookupHash),
             _indexPreSorted(indexPreSorted)
-        {}
+        {
+            if (_indexArray)
+            {
+                _valueArrayIter = _indexArray->getConstIterator(0);
+                _positionArrayIter = _indexArray->getConstIterator(1);
+            }
+        }
 
         /**
          * Find the position of input in the index, first looking at the vector, then at the array chunks.
@@ -264,6 +511,10 @@ private:
          */
         bool findPosition(Value const& input, Coordinate& result)
         {
+            if (_lookupHash)
+            {
+                return _lookupHash->findElement(input, result);
+            }
             Coordinate lb, ub;
             bool ret = _lookupVector->findElement(input,lb,ub);
             if (ret)
@@ -303,11 +554,11 @@ private:
     public:
         IndexLookupChunkIterator(DelegateChunk const* chunk,
                                  int iterationMode,
-                                 shared_ptr<Array> const& indexArray,
-                                 shared_ptr<LookupVector const> const& partialMap,
+                                 LookupTable const& table,
+                                 TypeId const& indexType,
                                  bool indexPreSorted):
             DelegateChunkIterator(chunk, iterationMode),
-            _index(indexArray, partialMap, indexPreSorted)
+            _index(table, indexType, indexPreSorted)
         {}
 
         virtual Value& getItem()
@@ -350,14 +601,14 @@ private:
         AttributeID const _dstAttributeId;
 
         /**
-         * A pointer to the index array.
+         * The index array, if needed, and the partial map or hash table.
          */
-        shared_ptr<Array>const _indexArray;
+        LookupTable const _table;
 
         /**
-         * A pointer to the partial map.
+         * The type of the index values.
          */
-        shared_ptr<LookupVector const> const _partialMap;
+        TypeId const _indexType;
 
         /**
          * True if the index array was pre-sorted. False otherwise.
@@ -368,14 +619,14 @@ private:
         IndexLookupArray(ArrayDesc const& desc,
                          shared_ptr<Array>& input,
                          AttributeID const sourceAttribute,
-                         shared_ptr<Array> indexArray,
-                         shared_ptr<LookupVector const> partialMap,
+                         LookupTable const& table,
+                         TypeId const& indexType,
                          bool indexPreSorted):
             DelegateArray(desc, input, true),
             _sourceAttributeId(sourceAttribute),
             _dstAttributeId(desc.getAttributes(true).size() -1),
-            _indexArray(indexArray),
-            _partialMap(partialMap),
+            _table(table),
+            _indexType(indexType),
             _indexPreSorted(indexPreSorted)
         {}
 
@@ -407,7 +658,7 @@ private:
         {
             if (chunk->getAttributeDesc().getId() == _dstAttributeId)
             {
-                return new IndexLookupChunkIterator(chunk, iterationMode, _indexArray, _partialMap, _indexPreSorted);
+                return new IndexLookupChunkIterator(chunk, iterationMode, _table, _indexType, _indexPreSorted);
             }
             return DelegateArray::createChunkIterator(chunk, iterationMode);
         }
@@ -512,10 +763,16 @@ private:
          */
         size_t chunkCount;
 
+        /**
+         * The number of values in the array
+         */
+        size_t cellCount;
+
         MemoryLimits():
             insertionProbability(0),
             numOptionalValues(0),
-            chunkCount(0)
+            chunkCount(0),
+            cellCount(0)
         {}
     };
 
@@ -540,6 +797,7 @@ private:
             cellCount += chunk.count();
             totalSize += chunk.getSize();
         }
+        result.cellCount = cellCount;
         double averageValueSize = totalSize * 1.0 / cellCount;
         double averageVectorMemberSize;
         size_t numCoordinatesNeeded = indexPreSorted ? 1 : 2;
@@ -580,12 +838,12 @@ private:
      * Scan the data from the index array and insert a portion of it into the vector.
      */
     shared_ptr<LookupVector const> buildLookupVector(shared_ptr<Array>& indexArray, MemoryLimits const& limits,
-                                                     bool indexPreSorted)
+                                                     bool indexPreSorted, ArenaPtr const& arena)
     {
         size_t mapSize = limits.numOptionalValues + 2 * limits.chunkCount;
         shared_ptr<LookupVector> result = make_shared<LookupVector>(
                                      indexArray->getArrayDesc().getAttributes()[0].getType(), mapSize, indexPreSorted,
-                                     this->_arena);
+                                     arena);
         size_t optionalValuesInserted = 0;
         shared_ptr<ConstArrayIterator> valueArrayIter = indexArray->getConstIterator(0);
         //note: if indexPreSorted is true, this is just an iterator over the empty tag; harmless
@@ -642,13 +900,76 @@ private:
         {   //add the last element in the array if we haven't already
             result->addElement(indexValueToAdd, positionInOriginalArray, positionInSortedArray);
         }
+        if (limits.insertionProbability >= 1.0)
+        {
+            result->setComplete();
+        }
         LOG4CXX_DEBUG(logger, "Lookup vector built. Inserted "<<optionalValuesInserted<<" optional values");
         return result;
     }
 
-    shared_ptr<Array> prepareIndexArray(shared_ptr<Array> & inputIndex, shared_ptr<Query>& query, bool const indexPreSorted)
+    /**
+     * Scan the values of the (replicated, unsorted) index array into a hash table.
+     */
+    shared_ptr<LookupHash const> buildLookupHash(shared_ptr<Array>& indexArray, size_t cellCount)
+    {
+        shared_ptr<LookupHash> result = make_shared<LookupHash>(cellCount);
+        for (shared_ptr<ConstArrayIterator> valueArrayIter = indexArray->getConstIterator(0);
+             !valueArrayIter->end();
+             ++(*valueArrayIter))
+        {
+            for (shared_ptr<ConstChunkIterator> valueChunkIter = valueArrayIter->getChunk().getConstIterator();
+                 !valueChunkIter->end();
+                 ++(*valueChunkIter))
+            {
+                result->addElement(valueChunkIter->getItem(), valueChunkIter->getPosition()[0]);
+            }
+        }
+        LOG4CXX_DEBUG(logger, "Lookup hash built, "<<result->getMemorySize()<<" bytes");
+        return result;
+    }
+
+    /**
+     * Tell whether every instance found the lookup table in its cache. The index is replicated collectively, so
+     * either all instances skip the replication or none does.
+     */
+    bool allInstancesCached(bool cached, shared_ptr<Query>& query)
+    {
+        size_t const nInstances = query->getInstancesCount();
+        if (nInstances == 1)
+        {
+            return cached;
+        }
+        uint64_t result = cached;
+        if (query->getCoordinatorID() != INVALID_INSTANCE)
+        {
+            shared_ptr<SharedBuffer> buf(new MemoryBuffer(&result, sizeof(result)));
+            BufSend(query->getCoordinatorID(), buf, query);
+            buf = BufReceive(query->getCoordinatorID(), query);
+            return *static_cast<uint64_t*>(buf->getData()) != 0;
+        }
+        InstanceID const myId = query->getInstanceID();
+        for (InstanceID i = 0; i < nInstances; i++)
+        {
+            if (i != myId)
+            {
+                shared_ptr<SharedBuffer> buf = BufReceive(i, query);
+                result = result && *static_cast<uint64_t*>(buf->getData());
+            }
+        }
+        shared_ptr<SharedBuffer> buf(new MemoryBuffer(&result, sizeof(result)));
+        for (InstanceID i = 0; i < nInstances; i++)
+        {
+            if (i != myId)
+            {
+                BufSend(i, buf, query);
+            }
+        }
+        return result != 0;
+    }
+
+    shared_ptr<Array> sortIndexArray(shared_ptr<Array> & replicated, shared_ptr<Query>& query, bool const indexPreSorted)
     {
-        shared_ptr<Array> replicated = redistribute(inputIndex, query, psReplication);
         if(indexPreSorted)
         {
             return replicated;
@@ -682,11 +1003,57 @@ public:
         ArrayDesc const& indexSchema = inputArrays[1]->getArrayDesc();
         IndexLookupSettings settings(inputSchema, indexSchema, _parameters, false, query);
         bool indexPreSorted = settings.isIndexPreSorted();
-        shared_ptr<Array> preparedIndex = prepareIndexArray(inputArrays[1], query, indexPreSorted);
-        MemoryLimits vectorLimits = computeVectorLimits(preparedIndex, settings.getMemoryLimit(), indexPreSorted);
-        shared_ptr<LookupVector const> partialVector = buildLookupVector(preparedIndex, vectorLimits, indexPreSorted);
+        bool hashed = settings.isHashLayout();
+        TypeId const indexType = indexSchema.getAttributes()[0].getType();
+        bool const cacheable = dynamic_pointer_cast<DBArray>(inputArrays[1]) &&
+                               Config::getInstance()->getOption<size_t>(CONFIG_INDEX_LOOKUP_CACHE) > 0;
+        LookupCache::Key const key(indexSchema, indexPreSorted, hashed);
+        LookupTable table;
+        bool const cached = cacheable && LookupCache::getInstance()->get(key, table);
+        if (allInstancesCached(cached, query))
+        {
+            LOG4CXX_DEBUG(logger, "Using the cached lookup table of "<<indexSchema.getName());
+            return shared_ptr<Array>(new IndexLookupArray(_schema, inputArrays[0], settings.getInputAttributeId(),
+                                                          table, indexType, indexPreSorted));
+        }
+        shared_ptr<Array> replicated = redistribute(inputArrays[1], query, psReplication);
+        if (cached)
+        {   //another instance had to replicate the index; we still have our table
+            return shared_ptr<Array>(new IndexLookupArray(_schema, inputArrays[0], settings.getInputAttributeId(),
+                                                          table, indexType, indexPreSorted));
+        }
+        if (hashed)
+        {
+            MemoryLimits hashLimits = computeVectorLimits(replicated, settings.getMemoryLimit(), true);
+            if (hashLimits.insertionProbability >= 1.0)
+            {
+                table.lookupHash = buildLookupHash(replicated, hashLimits.cellCount);
+            }
+            else
+            {
+                LOG4CXX_DEBUG(logger, "The index does not fit in a hash table; falling back to the sorted vector");
+                hashed = false;
+            }
+        }
+        if (!hashed)
+        {
+            shared_ptr<Array> preparedIndex = sortIndexArray(replicated, query, indexPreSorted);
+            MemoryLimits vectorLimits = computeVectorLimits(preparedIndex, settings.getMemoryLimit(), indexPreSorted);
+            //a complete vector that may be cached must outlive the query and its arena
+            bool const complete = vectorLimits.insertionProbability >= 1.0;
+            table.lookupVector = buildLookupVector(preparedIndex, vectorLimits, indexPreSorted,
+                                                   complete && cacheable ? arena::getArena() : this->_arena);
+            if (!complete)
+            {
+                table.indexArray = preparedIndex;
+            }
+        }
+        if (cacheable && !table.indexArray)
+        {
+            LookupCache::getInstance()->put(key, table);
+        }
         return shared_ptr<Array>(new IndexLookupArray(_schema, inputArrays[0], settings.getInputAttributeId(),
-                                                      preparedIndex, partialVector, indexPreSorted));
+                                                      table, indexType, indexPreSorted));
     }
 };
 
@@ -0,0 +1,140 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.
+* Copyright (C) 2008-2014 SciDB, Inc.
+*
+* SciDB is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with SciDB.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+
+/*
+ * @file LogicalLoadRedimension.cpp
+ *
+ * Load operator that redimensions the data of a file into an existing array
+ */
+#include "query/Operator.h"
+#include "query/OperatorLibrary.h"
+#include "system/Exceptions.h"
+#include "system/SystemCatalog.h"
+#include "system/Cluster.h"
+#include "LogicalLoadRedimension.h"
+
+using namespace std;
+using namespace boost;
+
+namespace scidb
+{
+
+LogicalLoadRedimension::LogicalLoadRedimension(const std::string& logicalName, const std::string& alias):
+    LogicalOperator(logicalName, alias)
+{
+    ADD_PARAM_OUT_ARRAY_NAME();  //0
+    ADD_PARAM_SCHEMA();          //1
+    ADD_PARAM_CONSTANT("string");//2
+    ADD_PARAM_VARIES();          //3
+}
+
+std::vector<boost::shared_ptr<OperatorParamPlaceholder> > LogicalLoadRedimension::nextVaryParamPlaceholder(const std::vector< ArrayDesc> &schemas)
+{
+    // the parameters after the output array are those of input()
+    std::vector<boost::shared_ptr<OperatorParamPlaceholder> > res;
+    res.push_back(END_OF_VARIES_PARAMS());
+    switch (_parameters.size()) {
+      case 0:
+      case 1:
+      case 2:
+        assert(false);
+        break;
+      case 3:
+        res.push_back(PARAM_CONSTANT("int64"));
+        break;
+      case 4:
+        res.push_back(PARAM_CONSTANT("string"));
+        break;
+      case 5:
+        res.push_back(PARAM_CONSTANT("int64"));
+        break;
+      case 6:
+        res.push_back(PARAM_OUT_ARRAY_NAME());
+        break;
+    }
+    return res;
+}
+
+ArrayDesc LogicalLoadRedimension::inferSchema(std::vector< ArrayDesc> inputSchemas, boost::shared_ptr< Query> query)
+{
+    assert(inputSchemas.size() == 0);
+
+    const string& arrayName = ((boost::shared_ptr<OperatorParamReference>&)_parameters[0])->getObjectName();
+    ArrayDesc dstDesc;
+    if (!SystemCatalog::getInstance()->getArrayDesc(arrayName, dstDesc, false))
+    {
+        throw USER_QUERY_EXCEPTION(SCIDB_SE_QPROC, SCIDB_LE_ARRAY_DOESNT_EXIST,
+                                   _parameters[0]->getParsingContext()) << arrayName;
+    }
+
+    // Infer the schemas of store(redimension(input(...), dstDesc), outputArray) bottom up,
+    // so that every operator checks its parameters as it would in the spelled out query.
+    OperatorLibrary* olib = OperatorLibrary::getInstance();
+
+    _input = olib->createLogicalOperator("input");
+    _input->setParameters(Parameters(_parameters.begin() + 1, _parameters.end()));
+    _input->setSchema(_input->inferSchema(vector<ArrayDesc>(), query));
+
+    _redimension = olib->createLogicalOperator("redimension");
+    _redimension->addParameter(boost::shared_ptr<OperatorParam>(
+                                   new OperatorParamSchema(_parameters[0]->getParsingContext(), dstDesc)));
+    _redimension->setSchema(_redimension->inferSchema(vector<ArrayDesc>(1, _input->getSchema()), query));
+
+    _store = olib->createLogicalOperator("store");
+    _store->addParameter(_parameters[0]);
+    _store->setSchema(_store->inferSchema(vector<ArrayDesc>(1, _redimension->getSchema()), query));
+
+    return _store->getSchema();
+}
+
+void LogicalLoadRedimension::inferArrayAccess(boost::shared_ptr<Query>& query)
+{
+    LogicalOperator::inferArrayAccess(query);
+
+    vector<string> arrayNames;
+    assert(_parameters[0]->getParamType() == PARAM_ARRAY_REF);
+    arrayNames.push_back(((boost::shared_ptr<OperatorParamReference>&)_parameters[0])->getObjectName());
+    if (_parameters.size() >= 7) {
+        assert(_parameters[6]->getParamType() == PARAM_ARRAY_REF);
+        arrayNames.push_back(((boost::shared_ptr<OperatorParamReference>&)_parameters[6])->getObjectName());
+    }
+    for (size_t i = 0; i < arrayNames.size(); i++) {
+        if (arrayNames[i].empty()) {
+            continue;
+        }
+        assert(arrayNames[i].find('@') == std::string::npos);
+        boost::shared_ptr<SystemCatalog::LockDesc>  lock(new SystemCatalog::LockDesc(arrayNames[i],
+                                                                                     query->getQueryID(),
+                                                                                     Cluster::getInstance()->getLocalInstanceId(),
+                                                                                     SystemCatalog::LockDesc::COORD,
+                                                                                     SystemCatalog::LockDesc::WR));
+        boost::shared_ptr<SystemCatalog::LockDesc> resLock = query->requestLock(lock);
+        assert(resLock);
+        assert(resLock->getLockMode() >= SystemCatalog::LockDesc::WR);
+    }
+}
+
+DECLARE_LOGICAL_OPERATOR_FACTORY(LogicalLoadRedimension, "load_redimension")
+
+
+} //namespace
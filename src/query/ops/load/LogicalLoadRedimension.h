@@ -0,0 +1,102 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.
+* Copyright (C) 2008-2014 SciDB, Inc.
+*
+* SciDB is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with SciDB.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+
+/*
+ * @file LogicalLoadRedimension.h
+ *
+ * Load operator that redimensions the data of a file into an existing array
+ */
+#ifndef LOGICAL_LOAD_REDIMENSION_H
+#define LOGICAL_LOAD_REDIMENSION_H
+
+#include "query/Operator.h"
+
+namespace scidb
+{
+
+/**
+ * @brief The operator: load_redimension().
+ *
+ * @par Synopsis:
+ *   load_redimension( outputArray, inputSchema, filename, instanceId=-2, format="", maxErrors=0, shadowArray="" )
+ *
+ * @par Summary:
+ *   Loads data from a given file laid out as inputSchema, redimensions it to the schema of the existing outputArray and stores it there,
+ *   and optionally stores the errors of reading to shadowArray.
+ *
+ * @par Input:
+ *   - outputArray: the output array to store data into.
+ *   - inputSchema: the schema of the data in the file, as for input(); usually one-dimensional. Its attributes and dimensions are mapped
+ *     to those of outputArray by name, as for redimension().
+ *   - filename, instanceId, format, maxErrors, shadowArray: as for load(). The shadow array has the schema of inputSchema.
+ *
+ * @par Output array:
+ *   n/a
+ *
+ * @par Examples:
+ *   n/a
+ *
+ * @par Errors:
+ *   n/a
+ *
+ * @par Notes:
+ *   - The optimizer rewrites load_redimension(A, S, 'file') into store(redimension(input(S, 'file'), A), A). The parsed cells go straight
+ *     from input() to the per-chunk buffers of redimension(), and from its redistributed chunks to A: unlike a load() into a staging array
+ *     followed by a redimension into A, the data is never written out in the layout of the file.
+ *   - Collisions are handled as by redimension() without aggregates. To aggregate them, use store(redimension(input(...), A, ...), A).
+ */
+class LogicalLoadRedimension: public LogicalOperator
+{
+public:
+    LogicalLoadRedimension(const std::string& logicalName, const std::string& alias);
+    std::vector<boost::shared_ptr<OperatorParamPlaceholder> > nextVaryParamPlaceholder(const std::vector< ArrayDesc> &schemas);
+    ArrayDesc inferSchema(std::vector< ArrayDesc> inputSchemas, boost::shared_ptr< Query> query);
+    void inferArrayAccess(boost::shared_ptr<Query>& query);
+
+    /**
+     * @return the operators of the rewritten plan, with their schemas inferred by inferSchema()
+     */
+    boost::shared_ptr<LogicalOperator> const& getInputOperator() const
+    {
+        return _input;
+    }
+
+    boost::shared_ptr<LogicalOperator> const& getRedimensionOperator() const
+    {
+        return _redimension;
+    }
+
+    boost::shared_ptr<LogicalOperator> const& getStoreOperator() const
+    {
+        return _store;
+    }
+
+private:
+    boost::shared_ptr<LogicalOperator> _input;
+    boost::shared_ptr<LogicalOperator> _redimension;
+    boost::shared_ptr<LogicalOperator> _store;
+};
+
+} //namespace
+
+#endif /* LOGICAL_LOAD_REDIMENSION_H */
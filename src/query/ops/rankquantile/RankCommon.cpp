@@ -25,6 +25,11 @@
 #include <iostream>
 #include <iomanip>
 
+#include <system/Config.h>
+#include <system/SciDBConfigOptions.h>
+#include <util/Job.h>
+#include <util/Mutex.h>
+
 using namespace boost;
 
 namespace scidb
@@ -95,6 +100,78 @@ bool GroupbyRankChunkIterator::setPosition(const Coordinates& pos) {
     return ret1;
 }
 
+class PreSortMap::FinishJob : public Job
+{
+private:
+    PreSortMap& _preSortMap;
+    size_t _nGroups;
+    size_t& _next;
+    Mutex& _mutex;
+
+public:
+    FinishJob(PreSortMap& preSortMap, size_t nGroups, size_t& next, Mutex& mutex, shared_ptr<Query> const& query):
+        Job(query),
+        _preSortMap(preSortMap),
+        _nGroups(nGroups),
+        _next(next),
+        _mutex(mutex)
+    {
+    }
+
+    virtual void run()
+    {
+        Query::setCurrentQueryID(_query->getQueryID());
+        while (true)
+        {
+            size_t group;
+            {
+                ScopedMutexLock cs(_mutex);
+                if (_next == _nGroups)
+                {
+                    break;
+                }
+                group = _next++;
+            }
+            _preSortMap.finishGroup(group);
+        }
+    }
+};
+
+void PreSortMap::finishGroups(size_t nGroups, shared_ptr<Query> const& query)
+{
+    size_t const nJobs = PhysicalOperator::getParallelJobsCount(nGroups);
+    if (nJobs <= 1)
+    {
+        for (size_t i = 0; i < nGroups; i++)
+        {
+            finishGroup(i);
+        }
+        return;
+    }
+
+    shared_ptr<JobQueue> queue = PhysicalOperator::getGlobalQueueForOperators();
+    size_t next = 0;
+    Mutex mutex;
+    vector< shared_ptr<FinishJob> > jobs(nJobs);
+    for (size_t i = 0; i < nJobs; i++)
+    {
+        jobs[i].reset(new FinishJob(*this, nGroups, next, mutex, query));
+        queue->pushJob(jobs[i]);
+    }
+    int errorJob = -1;
+    for (size_t i = 0; i < nJobs; i++)
+    {
+        if (!jobs[i]->wait())
+        {
+            errorJob = i;
+        }
+    }
+    if (errorJob >= 0)
+    {
+        jobs[errorJob]->rethrow();
+    }
+}
+
 shared_ptr<SharedBuffer> rMapToBuffer( CountsMap const& input, size_t nCoords)
 {
     size_t totalSize = input.size() * (nCoords * sizeof(Coordinate) + sizeof(uint64_t));
@@ -210,7 +287,7 @@ ArrayDesc getRankingSchema(ArrayDesc const& inputSchema,
 
 
 static shared_ptr<PreSortMap>
-makePreSortMap(shared_ptr<Array>& ary, AttributeID aId, Dimensions const& dims)
+makePreSortMap(shared_ptr<Array>& ary, AttributeID aId, Dimensions const& dims, shared_ptr<Query> const& query)
 {
     const ArrayDesc& desc = ary->getArrayDesc();
     TypeEnum type = typeId2TypeEnum(desc.getAttributes()[aId].getType(),
@@ -219,46 +296,46 @@ makePreSortMap(shared_ptr<Array>& ary, AttributeID aId, Dimensions const& dims)
     shared_ptr<PreSortMap> preSortMap;
     switch (type) {
     case TE_DOUBLE:
-        preSortMap.reset(new PrimitivePreSortMap<double>(ary, aId, dims));
+        preSortMap.reset(new PrimitivePreSortMap<double>(ary, aId, dims, query));
         break;
     case TE_FLOAT:
-        preSortMap.reset(new PrimitivePreSortMap<float>(ary, aId, dims));
+        preSortMap.reset(new PrimitivePreSortMap<float>(ary, aId, dims, query));
         break;
     case TE_INT64:
-        preSortMap.reset(new PrimitivePreSortMap<int64_t>(ary, aId, dims));
+        preSortMap.reset(new PrimitivePreSortMap<int64_t>(ary, aId, dims, query));
         break;
     case TE_UINT64:
-        preSortMap.reset(new PrimitivePreSortMap<uint64_t>(ary, aId, dims));
+        preSortMap.reset(new PrimitivePreSortMap<uint64_t>(ary, aId, dims, query));
         break;
     case TE_INT32:
-        preSortMap.reset(new PrimitivePreSortMap<int32_t>(ary, aId, dims));
+        preSortMap.reset(new PrimitivePreSortMap<int32_t>(ary, aId, dims, query));
         break;
     case TE_UINT32:
-        preSortMap.reset(new PrimitivePreSortMap<uint32_t>(ary, aId, dims));
+        preSortMap.reset(new PrimitivePreSortMap<uint32_t>(ary, aId, dims, query));
         break;
     case TE_INT16:
-        preSortMap.reset(new PrimitivePreSortMap<int16_t>(ary, aId, dims));
+        preSortMap.reset(new PrimitivePreSortMap<int16_t>(ary, aId, dims, query));
         break;
     case TE_UINT16:
-        preSortMap.reset(new PrimitivePreSortMap<uint16_t>(ary, aId, dims));
+        preSortMap.reset(new PrimitivePreSortMap<uint16_t>(ary, aId, dims, query));
         break;
     case TE_INT8:
-        preSortMap.reset(new PrimitivePreSortMap<int8_t>(ary, aId, dims));
+        preSortMap.reset(new PrimitivePreSortMap<int8_t>(ary, aId, dims, query));
         break;
     case TE_UINT8:
-        preSortMap.reset(new PrimitivePreSortMap<uint8_t>(ary, aId, dims));
+        preSortMap.reset(new PrimitivePreSortMap<uint8_t>(ary, aId, dims, query));
         break;
     case TE_CHAR:
-        preSortMap.reset(new PrimitivePreSortMap<char>(ary, aId, dims));
+        preSortMap.reset(new PrimitivePreSortMap<char>(ary, aId, dims, query));
         break;
     case TE_BOOL:
-        preSortMap.reset(new PrimitivePreSortMap<bool>(ary, aId, dims));
+        preSortMap.reset(new PrimitivePreSortMap<bool>(ary, aId, dims, query));
         break;
     case TE_DATETIME:
-        preSortMap.reset(new PrimitivePreSortMap<time_t>(ary, aId, dims));
+        preSortMap.reset(new PrimitivePreSortMap<time_t>(ary, aId, dims, query));
         break;
     default:
-        preSortMap.reset(new ValuePreSortMap(ary, aId, dims));
+        preSortMap.reset(new ValuePreSortMap(ary, aId, dims, query));
         break;
     }
 
@@ -273,7 +350,7 @@ shared_ptr<Array> buildRankArray(shared_ptr<Array>& inputArray,
                                  shared_ptr<RankingStats> rstats)
 {
     shared_ptr<PreSortMap> preSortMap =
-        makePreSortMap(inputArray, rankedAttributeID, groupedDimensions);
+        makePreSortMap(inputArray, rankedAttributeID, groupedDimensions, query);
 
     const ArrayDesc& input = inputArray->getArrayDesc();
     ArrayDesc outputSchema = getRankingSchema(input,rankedAttributeID);
@@ -305,7 +382,7 @@ shared_ptr<Array> buildDualRankArray(shared_ptr<Array>& inputArray,
                                      shared_ptr<RankingStats> rstats)
 {
     shared_ptr<PreSortMap> preSortMap =
-        makePreSortMap(inputArray, rankedAttributeID, groupedDimensions);
+        makePreSortMap(inputArray, rankedAttributeID, groupedDimensions, query);
 
     const ArrayDesc& input = inputArray->getArrayDesc();
     ArrayDesc dualRankSchema = getRankingSchema(input,rankedAttributeID, true);
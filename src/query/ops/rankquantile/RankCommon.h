@@ -38,6 +38,9 @@
 #include <log4cxx/logger.h>
 #include <sys/time.h>
 #include <boost/unordered_map.hpp>
+#include <algorithm>
+#include <functional>
+#include <vector>
 
 #include <query/Operator.h>
 #include <system/Exceptions.h>
@@ -87,6 +90,130 @@ class BlockTimer
 };
 
 
+/**
+ * The values of one group in sorted order, with their counts: a sorted contiguous replacement for a
+ * std::map from value to count. Values are appended to a pending buffer, which is sorted and merged
+ * into the sorted arrays, run by run, whenever it grows as large as they are; so the memory stays
+ * proportional to the number of distinct values and every value takes part in O(log n) merges.
+ * After finish(), _counts[i] is the number of values smaller than _values[i], and a rank is a binary
+ * search over the contiguous values.
+ */
+template <typename T, typename Less>
+class SortedValueCounts
+{
+public:
+    explicit SortedValueCounts(Less const& less):
+        _less(less),
+        _total(0)
+    {}
+
+    void add(T const& value)
+    {
+        _pending.push_back(value);
+        if (_pending.size() >= std::max(MIN_PENDING, _values.size()))
+        {
+            compact();
+        }
+    }
+
+    /**
+     * Merge the pending values and turn the counts into numbers of smaller values.
+     * No values may be added afterwards.
+     */
+    void finish()
+    {
+        compact();
+        std::vector<T>().swap(_pending);
+        uint64_t below = 0;
+        for (size_t i = 0; i < _counts.size(); i++)
+        {
+            uint64_t const count = _counts[i];
+            _counts[i] = below;
+            below += count;
+        }
+        _total = below;
+    }
+
+    /**
+     * @return the number of distinct values
+     */
+    size_t size() const
+    {
+        return _values.size();
+    }
+
+    /**
+     * @return the number of values smaller than value
+     */
+    uint64_t getLowerCount(T const& value) const
+    {
+        size_t const i = std::lower_bound(_values.begin(), _values.end(), value, _less) - _values.begin();
+        return i == _values.size() ? _total : _counts[i];
+    }
+
+    /**
+     * @return the number of values smaller than or equal to value
+     */
+    uint64_t getUpperCount(T const& value) const
+    {
+        size_t const i = std::upper_bound(_values.begin(), _values.end(), value, _less) - _values.begin();
+        return i == _values.size() ? _total : _counts[i];
+    }
+
+private:
+    static const size_t MIN_PENDING = 1024;
+
+    Less _less;
+    std::vector<T> _values;
+    std::vector<uint64_t> _counts;
+    uint64_t _total;
+    std::vector<T> _pending;
+
+    void compact()
+    {
+        if (_pending.empty())
+        {
+            return;
+        }
+        std::sort(_pending.begin(), _pending.end(), _less);
+        std::vector<T> values;
+        std::vector<uint64_t> counts;
+        values.reserve(_values.size() + _pending.size());
+        counts.reserve(_values.size() + _pending.size());
+        size_t i = 0, j = 0;
+        while (i < _values.size() || j < _pending.size())
+        {
+            if (j == _pending.size() || (i < _values.size() && _less(_values[i], _pending[j])))
+            {
+                values.push_back(_values[i]);
+                counts.push_back(_counts[i]);
+                ++i;
+                continue;
+            }
+            uint64_t count = 0;
+            if (i < _values.size() && !_less(_pending[j], _values[i]))
+            {
+                count = _counts[i];
+                ++i;
+            }
+            size_t k = j + 1;
+            while (k < _pending.size() && !_less(_pending[j], _pending[k]))
+            {
+                ++k;
+            }
+            values.push_back(_pending[j]);
+            counts.push_back(count + (k - j));
+            j = k;
+        }
+        _values.swap(values);
+        _counts.swap(counts);
+        _pending.clear();
+    }
+};
+
+template <typename T, typename Less>
+const size_t SortedValueCounts<T, Less>::MIN_PENDING;
+
 class PreSortMap
 {
 public:
@@ -105,35 +232,47 @@ public:
 
 protected:
     DimensionGrouping _dimGrouping;
-};
 
+    /**
+     * Call finishGroup() for every group in [0, nGroups). The groups are spread over
+     * CONFIG_AGGREGATE_THREADS jobs, or CONFIG_EXEC_THREADS if that is 0.
+     */
+    void finishGroups(size_t nGroups, boost::shared_ptr<Query> const& query);
+
+    /**
+     * Sort the values of a group; called concurrently for different groups.
+     */
+    virtual void finishGroup(size_t group) = 0;
+
+private:
+    class FinishJob;
+};
 
+/**
+ * The presort of the values of any type, compared with the less-than function of the type.
+ */
 class ValuePreSortMap : public PreSortMap
 {
-    typedef std::map<Value, uint64_t, AttributeComparator> ValueCountMap;
-    typedef boost::shared_ptr<ValueCountMap> ValueCountMapPtr;
-    typedef boost::unordered_map<Coordinates, ValueCountMapPtr> CoordinatesCountsMap;
-    typedef boost::unordered_map<Coordinates, uint64_t> CoordinatesMaxMap;
+    typedef SortedValueCounts<Value, AttributeComparator> ValueCounts;
+    typedef boost::unordered_map<Coordinates, size_t> GroupMap;
 
 public:
 
-    ValuePreSortMap(boost::shared_ptr<Array>& input, AttributeID neededAttributeID, Dimensions const& groupedDims):
+    ValuePreSortMap(boost::shared_ptr<Array>& input, AttributeID neededAttributeID, Dimensions const& groupedDims,
+                    boost::shared_ptr<Query> const& query):
         PreSortMap(input, neededAttributeID, groupedDims)
     {
         ArrayDesc const& inputSchema = input->getArrayDesc();
-        TypeId tid = inputSchema.getAttributes()[neededAttributeID].getType();
+        AttributeComparator less(inputSchema.getAttributes()[neededAttributeID].getType());
 
-        size_t numPresorts = 0;
         size_t actualValues = 0;
-        size_t distinctValues = 0;
 
         const unsigned CHUNK_FLAGS =
             ConstChunkIterator::IGNORE_OVERLAPS |
             ConstChunkIterator::IGNORE_EMPTY_CELLS |
             ConstChunkIterator::IGNORE_NULL_VALUES;
 
-        CoordinatesCountsMap::iterator mIter;
-        ValueCountMap::iterator iter;
+        GroupMap::iterator mIter;
         {
             boost::shared_ptr<ConstArrayIterator> arrayIterator = input->getConstIterator(neededAttributeID);
             while (!arrayIterator->end())
@@ -153,24 +292,13 @@ public:
                         actualValues++;
                         Coordinates pos = _dimGrouping.reduceToGroup(chunkIterator->getPosition());
 
-                        mIter = _preSortMaps.find(pos);
-                        if (mIter == _preSortMaps.end())
+                        mIter = _groupMap.find(pos);
+                        if (mIter == _groupMap.end())
                         {
-                            ValueCountMapPtr ptr(new ValueCountMap(AttributeComparator(tid)));
-                            mIter=_preSortMaps.insert(std::make_pair(pos, ptr)).first;
-                            numPresorts++;
-                        }
-
-                        iter = mIter->second->find(v);
-                        if (iter == mIter->second->end())
-                        {
-                            mIter->second->insert(std::make_pair(v,1));
-                            distinctValues++;
-                        }
-                        else
-                        {
-                            iter->second++;
+                            mIter = _groupMap.insert(std::make_pair(pos, _groups.size())).first;
+                            _groups.push_back(boost::shared_ptr<ValueCounts>(new ValueCounts(less)));
                         }
+                        _groups[mIter->second]->add(v);
                         ++(*chunkIterator);
                     }
                 }
@@ -178,29 +306,16 @@ public:
             }
         }
 
-        LOG4CXX_DEBUG(logger, "Processed "<<actualValues<<" values into "
-                      << numPresorts << " presort maps with "<< distinctValues
-                      <<" distinct values");
+        finishGroups(_groups.size(), query);
 
-        mIter = _preSortMaps.begin();
-        while (mIter != _preSortMaps.end())
+        size_t distinctValues = 0;
+        for (size_t i = 0; i < _groups.size(); i++)
         {
-           ValueCountMap::iterator iter = mIter->second->begin();
-           uint64_t count = 0, tmp = 0;
-           while (iter != mIter->second->end())
-           {
-               tmp=iter->second;
-               (*iter).second=count;
-               count += tmp;
-               iter++;
-           }
-
-           Coordinates const& pos = mIter->first;
-           _maxMap[pos] = count;
-           mIter++;
+            distinctValues += _groups[i]->size();
         }
-
-        LOG4CXX_DEBUG(logger, "Computed counts");
+        LOG4CXX_DEBUG(logger, "Processed "<<actualValues<<" values into "
+                      << _groups.size() << " presort maps with "<< distinctValues
+                      <<" distinct values");
     }
 
     virtual ~ValuePreSortMap()
@@ -208,49 +323,33 @@ public:
 
     virtual double lookupRanking( Value const& input, Coordinates const& inCoords)
     {
-        Coordinates pos = getGroupCoords(inCoords);
-        CoordinatesCountsMap::iterator iter = _preSortMaps.find(pos);
-        if(iter == _preSortMaps.end())
+        GroupMap::const_iterator iter = _groupMap.find(getGroupCoords(inCoords));
+        if(iter == _groupMap.end())
         {
             return 0;
         }
-        else
-        {
-           ValueCountMapPtr& innerMap = iter->second;
-           ValueCountMap::iterator innerIter = innerMap->lower_bound(input);
-           if(innerIter == innerMap->end())
-           {
-               return (double) _maxMap[pos];
-           }
-           return (double) innerIter->second;
-        }
-
-        return 0;   // dummy code to avoid warning
+        return (double) _groups[iter->second]->getLowerCount(input);
     }
 
     virtual double lookupHiRanking( Value const& input, Coordinates const& inCoords)
     {
-        Coordinates pos = getGroupCoords(inCoords);
-        CoordinatesCountsMap::iterator iter = _preSortMaps.find(pos);
-        if(iter == _preSortMaps.end())
+        GroupMap::const_iterator iter = _groupMap.find(getGroupCoords(inCoords));
+        if(iter == _groupMap.end())
         {
             return 0;
         }
-        else
-        {
-           ValueCountMapPtr& innerMap = iter->second;
-           ValueCountMap::iterator innerIter = innerMap->upper_bound(input);
-           if(innerIter == innerMap->end())
-           {
-               return (double) _maxMap[pos];
-           }
-           return (double) innerIter->second;
-        }
+        return (double) _groups[iter->second]->getUpperCount(input);
+    }
+
+protected:
+    virtual void finishGroup(size_t group)
+    {
+        _groups[group]->finish();
     }
 
 private:
-    CoordinatesCountsMap        _preSortMaps;
-    CoordinatesMaxMap           _maxMap;
+    GroupMap                                        _groupMap;
+    std::vector< boost::shared_ptr<ValueCounts> >   _groups;
 };
 
 template <class T>
@@ -277,30 +376,23 @@ struct IsFP <double>
 template <typename INPUT>
 class PrimitivePreSortMap : public PreSortMap
 {
-    typedef std::map<INPUT, uint64_t> ValueCountMap;
-    typedef boost::shared_ptr<ValueCountMap> ValueCountMapPtr;
-    typedef boost::unordered_map<Coordinates, ValueCountMapPtr> CoordinatesCountsMap;
-    typedef boost::unordered_map<Coordinates, uint64_t> CoordinatesMaxMap;
+    typedef SortedValueCounts<INPUT, std::less<INPUT> > ValueCounts;
+    typedef boost::unordered_map<Coordinates, size_t> GroupMap;
 
 public:
 
-    PrimitivePreSortMap(boost::shared_ptr<Array>& input, AttributeID neededAttributeID, Dimensions const& groupedDims):
+    PrimitivePreSortMap(boost::shared_ptr<Array>& input, AttributeID neededAttributeID, Dimensions const& groupedDims,
+                        boost::shared_ptr<Query> const& query):
         PreSortMap(input, neededAttributeID, groupedDims)
     {
-        ArrayDesc const& inputSchema = input->getArrayDesc();
-        TypeId tid = inputSchema.getAttributes()[neededAttributeID].getType();
-
-        size_t numPresorts = 0;
         size_t actualValues = 0;
-        size_t distinctValues = 0;
 
         const unsigned CHUNK_FLAGS =
             ConstChunkIterator::IGNORE_OVERLAPS |
             ConstChunkIterator::IGNORE_EMPTY_CELLS |
             ConstChunkIterator::IGNORE_NULL_VALUES;
 
-        typename CoordinatesCountsMap::iterator mIter;
-        typename ValueCountMap::iterator iter;
+        typename GroupMap::iterator mIter;
         {
             boost::shared_ptr<ConstArrayIterator> arrayIterator = input->getConstIterator(neededAttributeID);
             while (!arrayIterator->end())
@@ -310,7 +402,7 @@ public:
                         arrayIterator->getChunk().getConstIterator(CHUNK_FLAGS);
                     while (!chunkIterator->end())
                     {
-                        Value v = chunkIterator->getItem();
+                        Value& v = chunkIterator->getItem();
                         if (v.isNull() || (IsFP<INPUT>::value && isnan( *(INPUT*) v.data())))
                         {
                             ++(*chunkIterator);
@@ -320,24 +412,13 @@ public:
                         actualValues++;
                         Coordinates pos = _dimGrouping.reduceToGroup(chunkIterator->getPosition());
 
-                        mIter = _preSortMaps.find(pos);
-                        if (mIter == _preSortMaps.end())
-                        {
-                            mIter=_preSortMaps.insert(std::make_pair(pos, ValueCountMapPtr(new ValueCountMap))).first;
-                            numPresorts++;
-                        }
-
-                        INPUT* val = static_cast<INPUT*>(v.data());
-                        iter = mIter->second->find(*val);
-                        if (iter == mIter->second->end())
+                        mIter = _groupMap.find(pos);
+                        if (mIter == _groupMap.end())
                         {
-                            mIter->second->insert(std::make_pair(*val,1));
-                            distinctValues++;
-                        }
-                        else
-                        {
-                            iter->second++;
+                            mIter = _groupMap.insert(std::make_pair(pos, _groups.size())).first;
+                            _groups.push_back(boost::shared_ptr<ValueCounts>(new ValueCounts(std::less<INPUT>())));
                         }
+                        _groups[mIter->second]->add(*static_cast<INPUT*>(v.data()));
                         ++(*chunkIterator);
                     }
                 }
@@ -345,29 +426,16 @@ public:
             }
         }
 
-        LOG4CXX_DEBUG(logger, "Processed "<<actualValues<<" values into "
-                      << numPresorts << " presort maps with "<< distinctValues
-                      <<" distinct values");
+        finishGroups(_groups.size(), query);
 
-        mIter = _preSortMaps.begin();
-        while (mIter != _preSortMaps.end())
+        size_t distinctValues = 0;
+        for (size_t i = 0; i < _groups.size(); i++)
         {
-            typename ValueCountMap::iterator iter = mIter->second->begin();
-            uint64_t count = 0, tmp = 0;
-            while (iter != mIter->second->end())
-            {
-                tmp=iter->second;
-                (*iter).second=count;
-                count += tmp;
-                iter++;
-            }
-
-            Coordinates const& pos = mIter->first;
-            _maxMap[pos] = count;
-            mIter++;
+            distinctValues += _groups[i]->size();
         }
-
-        LOG4CXX_DEBUG(logger, "Computed counts");
+        LOG4CXX_DEBUG(logger, "Processed "<<actualValues<<" values into "
+                      << _groups.size() << " presort maps with "<< distinctValues
+                      <<" distinct values");
     }
 
     virtual ~PrimitivePreSortMap()
@@ -381,22 +449,12 @@ public:
             return -1;
         }
 
-        Coordinates pos = getGroupCoords(inCoords);
-        typename CoordinatesCountsMap::iterator iter = _preSortMaps.find(pos);
-        if(iter == _preSortMaps.end())
+        typename GroupMap::const_iterator iter = _groupMap.find(getGroupCoords(inCoords));
+        if(iter == _groupMap.end())
         {
             return 0;
         }
-        else
-        {
-           ValueCountMapPtr&  innerMap = iter->second;
-           typename ValueCountMap::iterator innerIter = innerMap->lower_bound(*val);
-           if(innerIter == innerMap->end())
-           {
-               return (double) _maxMap[pos];
-           }
-           return (double) innerIter->second;
-        }
+        return (double) _groups[iter->second]->getLowerCount(*val);
     }
 
     virtual double lookupHiRanking( Value const& input, Coordinates const& inCoords)
@@ -407,27 +465,23 @@ public:
             return -1;
         }
 
-        Coordinates pos = getGroupCoords(inCoords);
-        typename CoordinatesCountsMap::iterator iter = _preSortMaps.find(pos);
-        if(iter == _preSortMaps.end())
+        typename GroupMap::const_iterator iter = _groupMap.find(getGroupCoords(inCoords));
+        if(iter == _groupMap.end())
         {
             return 0;
         }
-        else
-        {
-           ValueCountMapPtr&  innerMap = iter->second;
-           typename ValueCountMap::iterator innerIter = innerMap->upper_bound(*val);
-           if(innerIter == innerMap->end())
-           {
-               return (double) _maxMap[pos];
-           }
-           return (double) innerIter->second;
-        }
+        return (double) _groups[iter->second]->getUpperCount(*val);
+    }
+
+protected:
+    virtual void finishGroup(size_t group)
+    {
+        _groups[group]->finish();
     }
 
 private:
-    CoordinatesCountsMap        _preSortMaps;
-    CoordinatesMaxMap           _maxMap;
+    GroupMap                                        _groupMap;
+    std::vector< boost::shared_ptr<ValueCounts> >   _groups;
 };
 
 
@@ -21,7 +21,10 @@
 */
 #include "RedimensionCommon.h"
 #include <array/SortArray.h>
+#include <array/SortRun.h>
 #include <system/Config.h>
+#include <util/Job.h>
+#include <util/Mutex.h>
 
 namespace scidb
 {
@@ -148,40 +151,12 @@ Coordinates& RedimensionCommon::mapIdToChunkPos(size_t id, ChunkIdMaps& maps)
 }
 
 
-shared_ptr<MemArray> RedimensionCommon::initializeRedimensionedArray(
-    shared_ptr<Query> const& query,
-    Attributes const& srcAttrs,
-    Attributes const& destAttrs,
-    vector<size_t> const& attrMapping,
-    vector<AggregatePtr> const& aggregates,
-    vector< shared_ptr<ArrayIterator> >& redimArrayIters,
-    vector< shared_ptr<ChunkIterator> >& redimChunkIters,
-    size_t& redimCount,
-    size_t const& redimChunkSize)
+ArrayDesc RedimensionCommon::getRedimensionedArrayDesc(Attributes const& srcAttrs,
+                                                       Attributes const& destAttrs,
+                                                       vector<size_t> const& attrMapping,
+                                                       vector<AggregatePtr> const& aggregates,
+                                                       size_t redimChunkSize)
 {
-    // Create a 1-D MemArray called 'redimensioned' to hold the redimensioned records.
-    // Each cell in the array corresponds to a cell in the destination array,
-    // where its position within the destination array is determined by two
-    // additional attributes: the destination chunk identifier, and the
-    // position within the destination chunk.
-
-    // The schema is adapted from destArrayDesc, with the following differences:
-    //    (a) An aggregate field's type is replaced with the source field type, but still uses the name of the dest attribute.
-    //        The motivation is that multiple dest aggregate attribute may come from the same source attribute,
-    //        in which case storing under the source attribute name would cause a conflict.
-    //    (b) Two additional attributes are appended to the end:
-    //        (1) 'tmpDestChunkPosition', that stores the location of the item in the dest chunk
-    //        (2) 'tmpDestChunkId', that stores the id of the destination chunk
-    //
-    // The data is derived from the inputarray as follows.
-    //    (a) They are "redimensioned".
-    //    (b) Each record is stored as a distinct record in the MemArray. For an aggregate field, no aggregation is performed;
-    //        For a synthetic dimension, just use dimStartSynthetic.
-    //
-    // Local aggregation will be performed at a later step, when generating the MemArray called 'beforeRedistribute'.
-    // Global aggregation will be performed at the redistributeAggregate() step.
-    //
-
     Dimensions dimsRedimensioned(1);
     Attributes attrsRedimensioned;
     for (size_t i=0; i<destAttrs.size(); ++i) {
@@ -216,13 +191,57 @@ shared_ptr<MemArray> RedimensionCommon::initializeRedimensionedArray(
     ArrayDesc schemaRedimensioned("",
                                   attrsRedimensionedWithET,
                                   dimsRedimensioned);
+    return schemaRedimensioned;
+}
+
+
+shared_ptr<MemArray> RedimensionCommon::initializeRedimensionedArray(
+    shared_ptr<Query> const& query,
+    Attributes const& srcAttrs,
+    Attributes const& destAttrs,
+    vector<size_t> const& attrMapping,
+    vector<AggregatePtr> const& aggregates,
+    vector< shared_ptr<ArrayIterator> >& redimArrayIters,
+    vector< shared_ptr<ChunkIterator> >& redimChunkIters,
+    size_t& redimCount,
+    size_t const& redimChunkSize)
+{
+    // Create a 1-D MemArray called 'redimensioned' to hold the redimensioned records.
+    // Each cell in the array corresponds to a cell in the destination array,
+    // where its position within the destination array is determined by two
+    // additional attributes: the destination chunk identifier, and the
+    // position within the destination chunk.
+
+    // The schema is adapted from destArrayDesc, with the following differences:
+    //    (a) An aggregate field's type is replaced with the source field type, but still uses the name of the dest attribute.
+    //        The motivation is that multiple dest aggregate attribute may come from the same source attribute,
+    //        in which case storing under the source attribute name would cause a conflict.
+    //    (b) Two additional attributes are appended to the end:
+    //        (1) 'tmpDestChunkPosition', that stores the location of the item in the dest chunk
+    //        (2) 'tmpDestChunkId', that stores the id of the destination chunk
+    //
+    // The data is derived from the inputarray as follows.
+    //    (a) They are "redimensioned".
+    //    (b) Each record is stored as a distinct record in the MemArray. For an aggregate field, no aggregation is performed;
+    //        For a synthetic dimension, just use dimStartSynthetic.
+    //
+    // Local aggregation will be performed at a later step, when generating the MemArray called 'beforeRedistribute'.
+    // Global aggregation will be performed at the redistributeAggregate() step.
+    //
+
+    ArrayDesc schemaRedimensioned = getRedimensionedArrayDesc(srcAttrs,
+                                                              destAttrs,
+                                                              attrMapping,
+                                                              aggregates,
+                                                              redimChunkSize);
     shared_ptr<MemArray> redimensioned(new MemArray(schemaRedimensioned, query));
+    size_t nAttrsRedimensioned = schemaRedimensioned.getAttributes(true).size();
 
     // Initialize the iterators
     redimCount = 0;
-    redimArrayIters.resize(attrsRedimensioned.size());
-    redimChunkIters.resize(attrsRedimensioned.size());
-    for (size_t i = 0; i < attrsRedimensioned.size(); i++)
+    redimArrayIters.resize(nAttrsRedimensioned);
+    redimChunkIters.resize(nAttrsRedimensioned);
+    for (size_t i = 0; i < nAttrsRedimensioned; i++)
     {
         redimArrayIters[i] = redimensioned->getIterator(i);
     }
@@ -427,6 +446,364 @@ void RedimensionCommon::appendItemToBeforeRedistribution(ArrayCoordinatesMapper
 }
 
 
+/**
+ * The tuples of the 'redimensioned' array, partitioned by destination chunk id. Under the hash
+ * partitioning of the output every chunk goes to exactly one instance, so a partition holds cells
+ * that always end up together, and only needs to be ordered by the position within its chunk.
+ * The partitions are buffered in memory. Once the buffers take more than CONFIG_MERGE_SORT_BUFFER,
+ * the largest partitions are sorted and spilled to run files (see SortRun) until they take less
+ * than half of it.
+ */
+class RedimensionCommon::ChunkPartitions
+{
+public:
+    struct Partition
+    {
+        Coordinates chunkPos;
+        vector< shared_ptr<Tuple> > tuples;
+        vector< shared_ptr<SortRun> > runs;
+    };
+
+    /**
+     * @param desc the schema of the 'redimensioned' array
+     * @param positionAttr the attribute of the position in the destination chunk
+     * @param memLimit bytes of tuples to buffer before spilling
+     */
+    ChunkPartitions(ArrayDesc const& desc, size_t positionAttr, size_t memLimit):
+        _desc(desc),
+        _tupleSize(TupleArray::getTupleFootprint(desc.getAttributes())),
+        _memLimit(memLimit),
+        _nBuffered(0),
+        _nSpilled(0)
+    {
+        vector<Key> keys(1);
+        keys[0].columnNo = positionAttr;
+        keys[0].ascent = true;
+        _keys = keys;
+    }
+
+    /**
+     * Append an item of the 'redimensioned' array, i.e. the values of the destination
+     * attributes followed by the position and the chunk id, to the partition of its chunk.
+     */
+    void append(size_t chunkId, Coordinates const& chunkPos, vector<Value> const& item)
+    {
+        if (chunkId == _partitions.size())
+        {
+            _partitions.push_back(Partition());
+            _partitions.back().chunkPos = chunkPos;
+        }
+        assert(chunkId < _partitions.size());
+
+        size_t nAttrs = _desc.getAttributes().size();
+        shared_ptr<Tuple> tuple(new Tuple(nAttrs));
+        for (size_t i = 0; i < item.size(); ++i)
+        {
+            (*tuple)[i] = item[i];
+        }
+        (*tuple)[nAttrs-1].setBool(true);
+        _partitions[chunkId].tuples.push_back(tuple);
+
+        if (++_nBuffered * _tupleSize > _memLimit)
+        {
+            spill();
+        }
+    }
+
+    size_t size() const
+    {
+        return _partitions.size();
+    }
+
+    size_t getNumberOfSpilledTuples() const
+    {
+        return _nSpilled;
+    }
+
+    ArrayDesc const& getArrayDesc() const
+    {
+        return _desc;
+    }
+
+    Partition& getPartition(size_t chunkId)
+    {
+        return _partitions[chunkId];
+    }
+
+    /**
+     * @return a comparator of the tuples by position; one per job, as the comparator is not shared
+     */
+    shared_ptr<TupleComparator> getComparator() const
+    {
+        return shared_ptr<TupleComparator>(new TupleComparator(_keys, _desc));
+    }
+
+private:
+    ArrayDesc _desc;
+    vector<Key> _keys;
+    size_t _tupleSize;
+    size_t _memLimit;
+    size_t _nBuffered;
+    size_t _nSpilled;
+    vector<Partition> _partitions;
+
+    struct LargerPartition
+    {
+        vector<Partition> const& _partitions;
+
+        LargerPartition(vector<Partition> const& partitions): _partitions(partitions) {}
+
+        bool operator()(size_t p1, size_t p2) const
+        {
+            return _partitions[p1].tuples.size() > _partitions[p2].tuples.size();
+        }
+    };
+
+    void spill()
+    {
+        vector<size_t> order(_partitions.size());
+        for (size_t i = 0; i < order.size(); ++i)
+        {
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), LargerPartition(_partitions));
+
+        shared_ptr<TupleComparator> tcomp = getComparator();
+        for (size_t i = 0; i < order.size() && _nBuffered * _tupleSize > _memLimit / 2; ++i)
+        {
+            Partition& partition = _partitions[order[i]];
+            TupleArray buffer(_desc, partition.tuples);
+            buffer.sort(tcomp);
+            SortRunWriter writer(_desc);
+            vector< shared_ptr<Tuple> > const& tuples = buffer.getTuples();
+            for (size_t j = 0, n = tuples.size(); j < n; j++)
+            {
+                writer.append(*tuples[j]);
+            }
+            partition.runs.push_back(writer.finish());
+
+            _nBuffered -= tuples.size();
+            _nSpilled += tuples.size();
+            vector< shared_ptr<Tuple> >().swap(partition.tuples);
+        }
+        LOG4CXX_DEBUG(logger, "[RedimStore] spilled partitions, " << _nBuffered << " tuples left in memory");
+    }
+};
+
+
+/**
+ * Writes the chunks of the partitions handed out by a shared counter, until there is none left.
+ */
+class RedimensionCommon::PartitionJob : public Job
+{
+private:
+    RedimensionCommon& _op;
+    ChunkPartitions& _partitions;
+    ArrayCoordinatesMapper const& _coordMapper;
+    vector<AggregatePtr> _aggregates;
+    shared_ptr<MemArray> _output;
+    size_t& _next;
+    Mutex& _mutex;
+
+public:
+    PartitionJob(RedimensionCommon& op,
+                 ChunkPartitions& partitions,
+                 ArrayCoordinatesMapper const& coordMapper,
+                 vector<AggregatePtr> const& aggregates,
+                 shared_ptr<MemArray> const& output,
+                 size_t& next,
+                 Mutex& mutex,
+                 shared_ptr<Query> const& query):
+        Job(query),
+        _op(op),
+        _partitions(partitions),
+        _coordMapper(coordMapper),
+        _aggregates(aggregates.size()),
+        _output(output),
+        _next(next),
+        _mutex(mutex)
+    {
+        // every job accumulates with its own copies of the aggregates
+        for (size_t i = 0; i < aggregates.size(); ++i)
+        {
+            if (aggregates[i])
+            {
+                _aggregates[i] = aggregates[i]->clone();
+            }
+        }
+    }
+
+    virtual void run()
+    {
+        Query::setCurrentQueryID(_query->getQueryID());
+        size_t nAttrs = _output->getArrayDesc().getAttributes(true).size();
+        vector< shared_ptr<ArrayIterator> > arrayIters(nAttrs);
+        for (size_t i = 0; i < nAttrs; ++i)
+        {
+            arrayIters[i] = _output->getIterator(i);
+        }
+        while (true)
+        {
+            size_t chunkId;
+            {
+                ScopedMutexLock cs(_mutex);
+                if (_next == _partitions.size())
+                {
+                    break;
+                }
+                chunkId = _next++;
+            }
+            _op.writePartition(_partitions, chunkId, _coordMapper, _aggregates, arrayIters, _query);
+        }
+    }
+};
+
+
+void RedimensionCommon::writePartition(ChunkPartitions& partitions,
+                                       size_t chunkId,
+                                       ArrayCoordinatesMapper const& coordMapper,
+                                       vector<AggregatePtr> const& aggregates,
+                                       vector< shared_ptr<ArrayIterator> >& arrayIters,
+                                       shared_ptr<Query> const& query)
+{
+    ChunkPartitions::Partition& partition = partitions.getPartition(chunkId);
+    ArrayDesc const& desc = partitions.getArrayDesc();
+    shared_ptr<TupleComparator> tcomp = partitions.getComparator();
+
+    // The cells of the chunk in position order: the buffered tuples, sorted, merged with the spilled runs.
+    // The partition is released as it is read.
+    vector< shared_ptr<SortRunReader> > readers;
+    if (!partition.tuples.empty())
+    {
+        shared_ptr<TupleArray> buffer = make_shared<TupleArray>(desc, partition.tuples);
+        vector< shared_ptr<Tuple> >().swap(partition.tuples);
+        buffer->sort(tcomp);
+        readers.push_back(make_shared<SortRunReader>(make_shared<SortRun>(buffer), desc));
+    }
+    for (size_t i = 0; i < partition.runs.size(); ++i)
+    {
+        readers.push_back(make_shared<SortRunReader>(partition.runs[i], desc));
+    }
+    partition.runs.clear();
+    if (readers.empty())
+    {
+        return;
+    }
+    LoserTree cells(readers, *tcomp);
+
+    size_t nDestAttrs = aggregates.size();
+    size_t positionAttr = nDestAttrs;
+    size_t nDims = coordMapper.getDims().size();
+    Coordinates lows(nDims), intervals(nDims);
+    coordMapper.chunkPos2LowsAndIntervals(partition.chunkPos, lows, intervals);
+
+    // The first attribute does NOT use NO_EMPTY_CHECK (so as to help take care of the empty tag); Others do.
+    vector< shared_ptr<ChunkIterator> > chunkIters(nDestAttrs);
+    int iterMode = 0;
+    for (size_t i = 0; i < nDestAttrs; ++i)
+    {
+        Chunk& chunk = arrayIters[i]->newChunk(partition.chunkPos);
+        chunkIters[i] = chunk.getIterator(query, iterMode);
+        iterMode |= ConstChunkIterator::NO_EMPTY_CHECK;
+    }
+
+    // Same as the scan of the sorted 'redimensioned' array, within one chunk.
+    StateVector stateVector(aggregates, 0);
+    position_t prevPosition = 0;
+    vector<Value> destItem(nDestAttrs);
+    for (; !cells.end(); cells.next())
+    {
+        Tuple const& tuple = cells.getTuple();
+        for (size_t i = 0; i < nDestAttrs; ++i)
+        {
+            destItem[i] = tuple[i];
+        }
+        position_t currPosition = tuple[positionAttr].getInt64();
+        if (currPosition != prevPosition)
+        {
+            appendItemToBeforeRedistribution(coordMapper, lows, intervals, prevPosition, chunkIters, stateVector);
+            prevPosition = currPosition;
+            stateVector.init();
+        }
+        stateVector.accumulate(destItem);
+    }
+    appendItemToBeforeRedistribution(coordMapper, lows, intervals, prevPosition, chunkIters, stateVector);
+
+    for (size_t i = 0; i < nDestAttrs; ++i)
+    {
+        chunkIters[i]->flush();
+        chunkIters[i].reset();
+    }
+}
+
+
+void RedimensionCommon::writePartitions(ChunkPartitions& partitions,
+                                        ArrayCoordinatesMapper const& coordMapper,
+                                        vector<AggregatePtr> const& aggregates,
+                                        shared_ptr<MemArray>& beforeRedistribution,
+                                        shared_ptr<Query> const& query)
+{
+    // The chunks are independent and are spread over parallel jobs, each writing to an array of its own.
+    size_t const nJobs = PhysicalOperator::getParallelJobsCount(partitions.size());
+    size_t nDestAttrs = aggregates.size();
+
+    if (nJobs <= 1)
+    {
+        vector< shared_ptr<ArrayIterator> > arrayIters(nDestAttrs);
+        for (size_t i = 0; i < nDestAttrs; ++i)
+        {
+            arrayIters[i] = beforeRedistribution->getIterator(i);
+        }
+        for (size_t chunkId = 0; chunkId < partitions.size(); ++chunkId)
+        {
+            writePartition(partitions, chunkId, coordMapper, aggregates, arrayIters, query);
+        }
+        return;
+    }
+    LOG4CXX_DEBUG(logger, "[RedimStore] writing " << partitions.size() << " chunks with " << nJobs << " jobs");
+
+    shared_ptr<JobQueue> queue = PhysicalOperator::getGlobalQueueForOperators();
+    size_t next = 0;
+    Mutex mutex;
+    vector< shared_ptr<MemArray> > jobOutputs(nJobs);
+    vector< shared_ptr<PartitionJob> > jobs(nJobs);
+    for (size_t i = 0; i < nJobs; i++)
+    {
+        jobOutputs[i].reset(new MemArray(beforeRedistribution->getArrayDesc(), query));
+        jobs[i].reset(new PartitionJob(*this, partitions, coordMapper, aggregates, jobOutputs[i], next, mutex, query));
+        queue->pushJob(jobs[i]);
+    }
+    int errorJob = -1;
+    for (size_t i = 0; i < nJobs; i++)
+    {
+        if (!jobs[i]->wait())
+        {
+            errorJob = i;
+        }
+    }
+    if (errorJob >= 0)
+    {
+        jobs[errorJob]->rethrow();
+    }
+
+    // Copy the chunks of every attribute, and of the empty tag
+    size_t nAttrs = beforeRedistribution->getArrayDesc().getAttributes().size();
+    for (size_t i = 0; i < nAttrs; ++i)
+    {
+        shared_ptr<ArrayIterator> daiter = beforeRedistribution->getIterator(i);
+        for (size_t j = 0; j < nJobs; j++)
+        {
+            shared_ptr<ConstArrayIterator> saiter = jobOutputs[j]->getConstIterator(i);
+            while (!saiter->end())
+            {
+                daiter->copyChunk(saiter->getChunk());
+                ++(*saiter);
+            }
+        }
+    }
+}
+
+
 shared_ptr<Array> RedimensionCommon::redimensionArray(shared_ptr<Array> const& srcArray,
                                                       vector<size_t> const& attrMapping,
                                                       vector<size_t> const& dimMapping,
@@ -489,15 +866,30 @@ shared_ptr<Array> RedimensionCommon::redimensionArray(shared_ptr<Array> const& s
     if (redimChunkSize < redimMinChunkSize)
         redimChunkSize = redimMinChunkSize;
 
-    redimensioned = initializeRedimensionedArray(query,
-                                                 srcAttrs,
-                                                 destAttrs,
-                                                 attrMapping,
-                                                 aggregates,
-                                                 redimArrayIters,
-                                                 redimChunkIters,
-                                                 redimCount,
-                                                 redimChunkSize);
+    // Without a synthetic dimension, the cells of a destination chunk do not depend on the cells of the
+    // other chunks, so the records are partitioned by destination chunk rather than sorted globally.
+    // With a synthetic dimension, duplicates are told apart in the globally sorted 'redimensioned' array.
+    shared_ptr<ChunkPartitions> partitions;
+    if (hasSynthetic) {
+        redimensioned = initializeRedimensionedArray(query,
+                                                     srcAttrs,
+                                                     destAttrs,
+                                                     attrMapping,
+                                                     aggregates,
+                                                     redimArrayIters,
+                                                     redimChunkIters,
+                                                     redimCount,
+                                                     redimChunkSize);
+    } else {
+        size_t memLimit = Config::getInstance()->getOption<int>(CONFIG_MERGE_SORT_BUFFER)*MiB;
+        partitions = make_shared<ChunkPartitions>(getRedimensionedArrayDesc(srcAttrs,
+                                                                            destAttrs,
+                                                                            attrMapping,
+                                                                            aggregates,
+                                                                            redimChunkSize),
+                                                  destAttrs.size(),
+                                                  memLimit);
+    }
 
     // Iterate through the input array, generate the output data, and append to the MemArray.
     // Note: For an aggregate field, its source value (in the input array) is used.
@@ -601,12 +993,16 @@ shared_ptr<Array> RedimensionCommon::redimensionArray(shared_ptr<Array> const& s
                     valuesInRedimArray[destAttrs.size()].setInt64(pos);
                     position_t chunkId = mapChunkPosToId(overlappingChunkPos, arrayChunkIdMaps);
                     valuesInRedimArray[destAttrs.size()+1].setInt64(chunkId);
-                    appendItemToRedimArray(valuesInRedimArray,
-                                           query,
-                                           redimArrayIters,
-                                           redimChunkIters,
-                                           redimCount,
-                                           redimChunkSize);
+                    if (partitions) {
+                        partitions->append(chunkId, overlappingChunkPos, valuesInRedimArray);
+                    } else {
+                        appendItemToRedimArray(valuesInRedimArray,
+                                               query,
+                                               redimArrayIters,
+                                               redimChunkIters,
+                                               redimCount,
+                                               redimChunkSize);
+                    }
 
                     // Must increment after overlappingChunkPos is no longer needed, because the increment will modify overlappingChunkPos.
                     ++allChunks;
@@ -616,12 +1012,16 @@ shared_ptr<Array> RedimensionCommon::redimensionArray(shared_ptr<Array> const& s
                 valuesInRedimArray[destAttrs.size()].setInt64(pos);
                 position_t chunkId = mapChunkPosToId(chunkPos, arrayChunkIdMaps);
                 valuesInRedimArray[destAttrs.size()+1].setInt64(chunkId);
-                appendItemToRedimArray(valuesInRedimArray,
-                                       query,
-                                       redimArrayIters,
-                                       redimChunkIters,
-                                       redimCount,
-                                       redimChunkSize);
+                if (partitions) {
+                    partitions->append(chunkId, chunkPos, valuesInRedimArray);
+                } else {
+                    appendItemToRedimArray(valuesInRedimArray,
+                                           query,
+                                           redimArrayIters,
+                                           redimChunkIters,
+                                           redimCount,
+                                           redimChunkSize);
+                }
             }
 
             // Advance chunk iterators
@@ -658,54 +1058,6 @@ shared_ptr<Array> RedimensionCommon::redimensionArray(shared_ptr<Array> const& s
 
     timing.logTiming(logger, "[RedimStore] inputArray --> redimensioned");
 
-    // LOG4CXX_DEBUG(logger, "[RedimStore] redimensioned values: ");
-    // redimensioned->printArrayToLogger();
-
-    // Sort the redimensioned array based on the chunkid, followed by the position in the chunk
-    //
-    vector<Key> keys(2);
-    Key k;
-    k.columnNo = destAttrs.size() + 1;
-    k.ascent = true;
-    keys[0] = k;
-    k.columnNo = destAttrs.size();
-    k.ascent = true;
-    keys[1] = k;
-
-    SortArray sorter(redimensioned->getArrayDesc());
-    shared_ptr<TupleComparator> tcomp(new TupleComparator(keys, redimensioned->getArrayDesc()));
-    if (redimCount)
-    {
-        shared_ptr<MemArray> sortedRedimensioned = sorter.getSortedArray(redimensioned, query, tcomp);
-        redimensioned = sortedRedimensioned;
-    }
-
-    timing.logTiming(logger, "[RedimStore] redimensioned sorted");
-
-    // LOG4CXX_DEBUG(logger, "[RedimStore] redimensioned sorted values: ");
-    // redimensioned->printArrayToLogger();
-
-    // If hasSynthetic, each record with the same position get assigned a distinct value in the synthetic dimension, effectively
-    // assigning a distinct position to every record.  After updating the redimensioned array, it will need to be re-sorted.
-    //
-    if (hasSynthetic && redimCount)
-    {
-        if (updateSyntheticDimForRedimArray(query,
-                                            arrayCoordinatesMapper,
-                                            arrayChunkIdMaps,
-                                            dimSynthetic,
-                                            redimensioned))
-        {
-            shared_ptr<MemArray> sortedRedimSynthetic = sorter.getSortedArray(redimensioned, query, tcomp);
-            redimensioned = sortedRedimSynthetic;
-        }
-
-        // LOG4CXX_DEBUG(logger, "[RedimStore] redimensioned after update synthetic: ");
-        // redimensioned->printArrayToLogger();
-    }
-
-    timing.logTiming(logger, "[RedimStore] synthetic dimension populated");
-
     // Create a MemArray call 'beforeRedistribution'.
     //
     // The schema is adapted from destArrayDesc as follows:
@@ -735,171 +1087,226 @@ shared_ptr<Array> RedimensionCommon::redimensionArray(shared_ptr<Array> const& s
     shared_ptr<MemArray> beforeRedistribution = make_shared<MemArray>(
               ArrayDesc(_schema.getName(), addEmptyTagAttribute(attrsBeforeRedistribution), _schema.getDimensions() ),query);
 
-    // Write data from the 'redimensioned' array to the 'beforeRedistribution' array
-    //
+    if (partitions) {
+        LOG4CXX_DEBUG(logger, "[RedimStore] " << partitions->size() << " destination chunks, "
+                      << partitions->getNumberOfSpilledTuples() << " records spilled");
+        writePartitions(*partitions, arrayCoordinatesMapper, aggregates, beforeRedistribution, query);
+        partitions.reset();
+    } else {
+        // LOG4CXX_DEBUG(logger, "[RedimStore] redimensioned values: ");
+        // redimensioned->printArrayToLogger();
 
-    // Initialize iterators
-    //
-    vector<shared_ptr<ArrayIterator> > arrayItersBeforeRedistribution(attrsBeforeRedistribution.size());
-    vector<shared_ptr<ChunkIterator> > chunkItersBeforeRedistribution(attrsBeforeRedistribution.size());
-    for (size_t i=0; i<destAttrs.size(); ++i)
-    {
-        arrayItersBeforeRedistribution[i] = beforeRedistribution->getIterator(i);
-    }
-    SCIDB_ASSERT(redimArrayIters.size() == destAttrs.size() + 2);
-    vector< shared_ptr<ConstArrayIterator> > redimArrayConstIters(redimArrayIters.size());
-    vector< shared_ptr<ConstChunkIterator> > redimChunkConstIters(redimChunkIters.size());
-    for (size_t i = 0; i < redimArrayConstIters.size(); ++i)
-    {
-        redimArrayConstIters[i] = redimensioned->getConstIterator(i);
-    }
+        // Sort the redimensioned array based on the chunkid, followed by the position in the chunk
+        //
+        vector<Key> keys(2);
+        Key k;
+        k.columnNo = destAttrs.size() + 1;
+        k.ascent = true;
+        keys[0] = k;
+        k.columnNo = destAttrs.size();
+        k.ascent = true;
+        keys[1] = k;
+
+        SortArray sorter(redimensioned->getArrayDesc());
+        shared_ptr<TupleComparator> tcomp(new TupleComparator(keys, redimensioned->getArrayDesc()));
+        if (redimCount)
+        {
+            shared_ptr<MemArray> sortedRedimensioned = sorter.getSortedArray(redimensioned, query, tcomp);
+            redimensioned = sortedRedimensioned;
+        }
 
-    // Initialize current chunk id to a value that is never in the map
-    //
-    size_t chunkIdAttr = redimArrayConstIters.size() - 1;
-    size_t positionAttr = redimArrayConstIters.size() - 2;
-    size_t nDestAttrs = _schema.getDimensions().size();
-    size_t chunkId = arrayChunkIdMaps._chunkPosToIdMap.size();
-    Coordinates lows(nDestAttrs), intervals(nDestAttrs);
-    Coordinates outputCoord(nDestAttrs);
-
-    // Init state vector and prev position
-    StateVector stateVector(aggregates, 0);
-    position_t prevPosition = 0;
+        timing.logTiming(logger, "[RedimStore] redimensioned sorted");
 
-    // Scan through the items, aggregate (if apply), and write to the MemArray.
-    //
-    while (!redimArrayConstIters[0]->end())
-    {
-        // Set up chunk iters for the input chunk
-        for (size_t i = 0; i < redimChunkConstIters.size(); ++i)
+        // LOG4CXX_DEBUG(logger, "[RedimStore] redimensioned sorted values: ");
+        // redimensioned->printArrayToLogger();
+
+        // If hasSynthetic, each record with the same position get assigned a distinct value in the synthetic dimension, effectively
+        // assigning a distinct position to every record.  After updating the redimensioned array, it will need to be re-sorted.
+        //
+        if (hasSynthetic && redimCount)
+        {
+            if (updateSyntheticDimForRedimArray(query,
+                                                arrayCoordinatesMapper,
+                                                arrayChunkIdMaps,
+                                                dimSynthetic,
+                                                redimensioned))
+            {
+                shared_ptr<MemArray> sortedRedimSynthetic = sorter.getSortedArray(redimensioned, query, tcomp);
+                redimensioned = sortedRedimSynthetic;
+            }
+
+            // LOG4CXX_DEBUG(logger, "[RedimStore] redimensioned after update synthetic: ");
+            // redimensioned->printArrayToLogger();
+        }
+
+        timing.logTiming(logger, "[RedimStore] synthetic dimension populated");
+
+        // Write data from the 'redimensioned' array to the 'beforeRedistribution' array
+        //
+
+        // Initialize iterators
+        //
+        vector<shared_ptr<ArrayIterator> > arrayItersBeforeRedistribution(attrsBeforeRedistribution.size());
+        vector<shared_ptr<ChunkIterator> > chunkItersBeforeRedistribution(attrsBeforeRedistribution.size());
+        for (size_t i=0; i<destAttrs.size(); ++i)
         {
-            redimChunkConstIters[i] = redimArrayConstIters[i]->getChunk().getConstIterator(i);
+            arrayItersBeforeRedistribution[i] = beforeRedistribution->getIterator(i);
+        }
+        SCIDB_ASSERT(redimArrayIters.size() == destAttrs.size() + 2);
+        vector< shared_ptr<ConstArrayIterator> > redimArrayConstIters(redimArrayIters.size());
+        vector< shared_ptr<ConstChunkIterator> > redimChunkConstIters(redimChunkIters.size());
+        for (size_t i = 0; i < redimArrayConstIters.size(); ++i)
+        {
+            redimArrayConstIters[i] = redimensioned->getConstIterator(i);
         }
 
-        while (!redimChunkConstIters[0]->end())
+        // Initialize current chunk id to a value that is never in the map
+        //
+        size_t chunkIdAttr = redimArrayConstIters.size() - 1;
+        size_t positionAttr = redimArrayConstIters.size() - 2;
+        size_t nDestAttrs = _schema.getDimensions().size();
+        size_t chunkId = arrayChunkIdMaps._chunkPosToIdMap.size();
+        Coordinates lows(nDestAttrs), intervals(nDestAttrs);
+        Coordinates outputCoord(nDestAttrs);
+
+        // Init state vector and prev position
+        StateVector stateVector(aggregates, 0);
+        position_t prevPosition = 0;
+
+        // Scan through the items, aggregate (if apply), and write to the MemArray.
+        //
+        while (!redimArrayConstIters[0]->end())
         {
-            // Have we found a new output chunk?
-            //
-            size_t nextChunkId = redimChunkConstIters[chunkIdAttr]->getItem().getInt64();
-            if (chunkId != nextChunkId)
+            // Set up chunk iters for the input chunk
+            for (size_t i = 0; i < redimChunkConstIters.size(); ++i)
             {
-                // Write the left-over stateVector
-                //
-                appendItemToBeforeRedistribution(arrayCoordinatesMapper,
-                                                 lows,
-                                                 intervals,
-                                                 prevPosition,
-                                                 chunkItersBeforeRedistribution,
-                                                 stateVector);
-
-                // Flush current output iters
+                redimChunkConstIters[i] = redimArrayConstIters[i]->getChunk().getConstIterator(i);
+            }
+
+            while (!redimChunkConstIters[0]->end())
+            {
+                // Have we found a new output chunk?
                 //
-                for (size_t i = 0; i < destAttrs.size(); ++i)
+                size_t nextChunkId = redimChunkConstIters[chunkIdAttr]->getItem().getInt64();
+                if (chunkId != nextChunkId)
                 {
-                    if (chunkItersBeforeRedistribution[i].get())
+                    // Write the left-over stateVector
+                    //
+                    appendItemToBeforeRedistribution(arrayCoordinatesMapper,
+                                                     lows,
+                                                     intervals,
+                                                     prevPosition,
+                                                     chunkItersBeforeRedistribution,
+                                                     stateVector);
+
+                    // Flush current output iters
+                    //
+                    for (size_t i = 0; i < destAttrs.size(); ++i)
                     {
-                        chunkItersBeforeRedistribution[i]->flush();
-                        chunkItersBeforeRedistribution[i].reset();
+                        if (chunkItersBeforeRedistribution[i].get())
+                        {
+                            chunkItersBeforeRedistribution[i]->flush();
+                            chunkItersBeforeRedistribution[i].reset();
+                        }
                     }
+
+                    // Init the coordinate mapper for the new chunk
+                    //
+                    chunkId = nextChunkId;
+                    arrayCoordinatesMapper.chunkPos2LowsAndIntervals(mapIdToChunkPos(chunkId, arrayChunkIdMaps),
+                                                                     lows,
+                                                                     intervals);
+
+                    // Create new chunks and get the iterators.
+                    // The first non-empty-tag attribute does NOT use NO_EMPTY_CHECK (so as to help take care of the empty tag); Others do.
+                    //
+                    int iterMode = 0;
+                    for (size_t i=0; i<destAttrs.size(); ++i)
+                    {
+                        Chunk& chunk = arrayItersBeforeRedistribution[i]->newChunk(mapIdToChunkPos(chunkId, arrayChunkIdMaps));
+                        chunkItersBeforeRedistribution[i] = chunk.getIterator(query, iterMode);
+                        iterMode |= ConstChunkIterator::NO_EMPTY_CHECK;
+                    }
+
+                    // Update prevPosition, reset state vector
+                    //
+                    prevPosition = 0;
+                    stateVector.init();
                 }
 
-                // Init the coordinate mapper for the new chunk
+                // When seeing the first item with a new position, the attribute values in the item are populated into the destItem as follows.
+                //  - For a scalar field, the value is copied.
+                //  - For an aggregate field, the value is initialized and accumulated.
                 //
-                chunkId = nextChunkId;
-                arrayCoordinatesMapper.chunkPos2LowsAndIntervals(mapIdToChunkPos(chunkId, arrayChunkIdMaps),
-                                                                 lows,
-                                                                 intervals);
-
-                // Create new chunks and get the iterators.
-                // The first non-empty-tag attribute does NOT use NO_EMPTY_CHECK (so as to help take care of the empty tag); Others do.
+                // When seeing subsequent items with the same position, the attribute values in the item are populated as follows.
+                //  - For a scalar field, the value is ignored (just select the first item).
+                //  - For an aggregate field, the value is accumulated.
                 //
-                int iterMode = 0;
-                for (size_t i=0; i<destAttrs.size(); ++i)
+                vector<Value> destItem(destAttrs.size());
+                for (size_t i = 0; i < destAttrs.size(); ++i)
                 {
-                    Chunk& chunk = arrayItersBeforeRedistribution[i]->newChunk(mapIdToChunkPos(chunkId, arrayChunkIdMaps));
-                    chunkItersBeforeRedistribution[i] = chunk.getIterator(query, iterMode);
-                    iterMode |= ConstChunkIterator::NO_EMPTY_CHECK;
+                    destItem[i] = redimChunkConstIters[i]->getItem();
                 }
 
-                // Update prevPosition, reset state vector
-                //
-                prevPosition = 0;
-                stateVector.init();
-            }
+                position_t currPosition = redimChunkConstIters[positionAttr]->getItem().getInt64();
+                if (currPosition == prevPosition)
+                {
+                    stateVector.accumulate(destItem);
+                }
+                else
+                {
+                    // Output the previous state vector.
+                    appendItemToBeforeRedistribution(arrayCoordinatesMapper,
+                                                     lows,
+                                                     intervals,
+                                                     prevPosition,
+                                                     chunkItersBeforeRedistribution,
+                                                     stateVector);
+
+                    // record the new prevPosition
+                    prevPosition = currPosition;
+
+                    // Init and accumulate with the current item.
+                    stateVector.init();
+                    stateVector.accumulate(destItem);
+                }
 
-            // When seeing the first item with a new position, the attribute values in the item are populated into the destItem as follows.
-            //  - For a scalar field, the value is copied.
-            //  - For an aggregate field, the value is initialized and accumulated.
-            //
-            // When seeing subsequent items with the same position, the attribute values in the item are populated as follows.
-            //  - For a scalar field, the value is ignored (just select the first item).
-            //  - For an aggregate field, the value is accumulated.
-            //
-            vector<Value> destItem(destAttrs.size());
-            for (size_t i = 0; i < destAttrs.size(); ++i)
-            {
-                destItem[i] = redimChunkConstIters[i]->getItem();
-            }
+                // Advance chunk iterators
+                for (size_t i = 0; i < redimChunkConstIters.size(); ++i)
+                {
+                    ++(*redimChunkConstIters[i]);
+                }
+            } // while chunk iterator
 
-            position_t currPosition = redimChunkConstIters[positionAttr]->getItem().getInt64();
-            if (currPosition == prevPosition)
-            {
-                stateVector.accumulate(destItem);
-            }
-            else
+            // Advance array iterators
+            for (size_t i = 0; i < redimArrayConstIters.size(); ++i)
             {
-                // Output the previous state vector.
-                appendItemToBeforeRedistribution(arrayCoordinatesMapper,
-                                                 lows,
-                                                 intervals,
-                                                 prevPosition,
-                                                 chunkItersBeforeRedistribution,
-                                                 stateVector);
-
-                // record the new prevPosition
-                prevPosition = currPosition;
-
-                // Init and accumulate with the current item.
-                stateVector.init();
-                stateVector.accumulate(destItem);
+                ++(*redimArrayConstIters[i]);
             }
-
-            // Advance chunk iterators
-            for (size_t i = 0; i < redimChunkConstIters.size(); ++i)
+        } // while array iterator
+
+        // Flush the leftover statevector
+        appendItemToBeforeRedistribution(arrayCoordinatesMapper,
+                                         lows,
+                                         intervals,
+                                         prevPosition,
+                                         chunkItersBeforeRedistribution,
+                                         stateVector);
+
+        // Flush the chunks one last time
+        for (size_t i=0; i<destAttrs.size(); ++i)
+        {
+            if (chunkItersBeforeRedistribution[i].get())
             {
-                ++(*redimChunkConstIters[i]);
+                chunkItersBeforeRedistribution[i]->flush();
             }
-        } // while chunk iterator
-
-        // Advance array iterators
-        for (size_t i = 0; i < redimArrayConstIters.size(); ++i)
-        {
-            ++(*redimArrayConstIters[i]);
-        }
-    } // while array iterator
-
-    // Flush the leftover statevector
-    appendItemToBeforeRedistribution(arrayCoordinatesMapper,
-                                     lows,
-                                     intervals,
-                                     prevPosition,
-                                     chunkItersBeforeRedistribution,
-                                     stateVector);
-
-    // Flush the chunks one last time
-    for (size_t i=0; i<destAttrs.size(); ++i)
-    {
-        if (chunkItersBeforeRedistribution[i].get())
-        {
-            chunkItersBeforeRedistribution[i]->flush();
+            chunkItersBeforeRedistribution[i].reset();
         }
-        chunkItersBeforeRedistribution[i].reset();
-    }
 
-    for (size_t i=0; i<destAttrs.size(); ++i) {
-        arrayItersBeforeRedistribution[i].reset();
-        chunkItersBeforeRedistribution[i].reset();
+        for (size_t i=0; i<destAttrs.size(); ++i) {
+            arrayItersBeforeRedistribution[i].reset();
+            chunkItersBeforeRedistribution[i].reset();
+        }
     }
 
     timing.logTiming(logger, "[RedimStore] redimensioned --> beforeRedistribution");
@@ -271,6 +271,11 @@ private:
 
     /* Private interface to manage the 1-d 'redimensioned' array
      */
+    ArrayDesc getRedimensionedArrayDesc(Attributes const& srcAttrs,
+                                        Attributes const& destAttrs,
+                                        vector<size_t> const& attrMapping,
+                                        vector<AggregatePtr> const& aggregates,
+                                        size_t redimChunkSize);
     shared_ptr<MemArray> initializeRedimensionedArray(shared_ptr<Query> const& query,
                                                       Attributes const& srcAttrs,
                                                       Attributes const& destAttrs,
@@ -300,6 +305,24 @@ private:
                                           position_t prevPosition,
                                           vector< shared_ptr<ChunkIterator> >& chunkItersBeforeRedist,
                                           StateVector& stateVector);
+
+    /* Private interface of the sort-free path, taken when there is no synthetic dimension:
+     * the 'redimensioned' tuples are partitioned by destination chunk rather than sorted globally
+     */
+    class ChunkPartitions;
+    class PartitionJob;
+
+    void writePartitions(ChunkPartitions& partitions,
+                         ArrayCoordinatesMapper const& coordMapper,
+                         vector<AggregatePtr> const& aggregates,
+                         shared_ptr<MemArray>& beforeRedistribution,
+                         shared_ptr<Query> const& query);
+    void writePartition(ChunkPartitions& partitions,
+                        size_t chunkId,
+                        ArrayCoordinatesMapper const& coordMapper,
+                        vector<AggregatePtr> const& aggregates,
+                        vector< shared_ptr<ArrayIterator> >& arrayIters,
+                        shared_ptr<Query> const& query);
 };
 
 } //namespace scidb
@@ -0,0 +1,105 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.
+* Copyright (C) 2008-2014 SciDB, Inc.
+*
+* SciDB is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with SciDB.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+
+#include <query/Operator.h>
+#include <system/Exceptions.h>
+
+namespace scidb
+{
+
+/**
+ * @brief The operator: reservoir_sample()
+ *
+ * @par Synopsis: reservoir_sample (input_array, k [, seed])
+ *
+ * @par Examples:
+ *   <br> reservoir_sample(trades, 1000)
+ *   <br> reservoir_sample(readings, 100, 2011)
+ *
+ * @par Summary:
+ *   <br>
+ *   Produces exactly k non-empty cells of the input, or all of them if there are fewer, chosen uniformly at random
+ *   among all the cells of all the instances. The cells keep their positions and stay on their instances. Unlike
+ *   bernoulli(), the size of the sample is exact; the chunks without a sampled cell are skipped by their element
+ *   counts, only the chunks of the sampled cells are read for their values.
+ *
+ * @par Input:
+ *   <br> input_array <...> [*]
+ *   <br> k                                          --the number of cells to return, positive
+ *   <br> seed                                       --an optional seed for the random number generator
+ *
+ * @par Output array:
+ *   <br> <
+ *   <br>   srcAttrs: all the attributes are retained.
+ *   <br> >
+ *   <br> [
+ *   <br>   srcDims
+ *   <br> ]
+ *
+ * @see PhysicalReservoirSample.cpp for a description of the algorithm.
+ */
+class LogicalReservoirSample : public LogicalOperator
+{
+public:
+    LogicalReservoirSample(const string& logicalName, const string& alias):
+        LogicalOperator(logicalName, alias)
+    {
+        ADD_PARAM_INPUT()
+        ADD_PARAM_CONSTANT("int64")
+        ADD_PARAM_VARIES()
+    }
+
+    vector<shared_ptr<OperatorParamPlaceholder> > nextVaryParamPlaceholder(vector< ArrayDesc> const& schemas)
+    {
+        vector<shared_ptr<OperatorParamPlaceholder> > res;
+        res.push_back(END_OF_VARIES_PARAMS());
+        if (_parameters.size() == 1)
+        {
+            res.push_back(PARAM_CONSTANT("int64"));
+        }
+        return res;
+    }
+
+    ArrayDesc inferSchema(vector< ArrayDesc> schemas, shared_ptr< Query> query)
+    {
+        assert(schemas.size() == 1);
+        int64_t const k = evaluate(((shared_ptr<OperatorParamLogicalExpression>&)_parameters[0])->getExpression(),
+                                   query, TID_INT64).getInt64();
+        if (k <= 0)
+        {
+            throw USER_QUERY_EXCEPTION(SCIDB_SE_INFER_SCHEMA, SCIDB_LE_PARAMETER_NOT_POSITIVE_INTEGER,
+                                       _parameters[0]->getParsingContext()) << "k";
+        }
+        if (_parameters.size() == 2
+            && evaluate(((shared_ptr<OperatorParamLogicalExpression>&)_parameters[1])->getExpression(),
+                        query, TID_INT64).getInt64() < 0)
+        {
+            throw USER_EXCEPTION(SCIDB_SE_OPERATOR, SCIDB_LE_OP_SAMPLE_ERROR1);
+        }
+        return addEmptyTagAttribute(schemas[0]);
+    }
+};
+
+DECLARE_LOGICAL_OPERATOR_FACTORY(LogicalReservoirSample, "reservoir_sample")
+
+} //namespace scidb
@@ -0,0 +1,345 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.
+* Copyright (C) 2008-2014 SciDB, Inc.
+*
+* SciDB is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with SciDB.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+
+#include <math.h>
+#include <time.h>
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <boost/random/mersenne_twister.hpp>
+
+#include <query/Operator.h>
+#include <query/Network.h>
+#include <query/TupleExchange.h>
+#include <array/MemArray.h>
+
+namespace scidb
+{
+
+static log4cxx::LoggerPtr reservoirLogger(log4cxx::Logger::getLogger("scidb.operators.reservoir_sample"));
+
+/**
+ * @return a uniform random number in [0, n). The draws of 64 bits at or above the largest multiple of n
+ *         are rejected, so that the numbers below n are equally likely, unlike those of rng() % n.
+ */
+static uint64_t randomBelow(boost::mt19937& rng, uint64_t n)
+{
+    assert(n > 0);
+    uint64_t const max = std::numeric_limits<uint64_t>::max();
+    uint64_t const limit = max - max % n;
+    uint64_t r;
+    do
+    {
+        r = (static_cast<uint64_t>(rng()) << 32) | rng();
+    } while (r >= limit);
+    return r % n;
+}
+
+/**
+ * A uniform sample of k of the positions seen so far, by Algorithm L (Li 1994): once the reservoir is full, the
+ * number of positions to skip before the next one that replaces a random position of the reservoir is drawn
+ * directly, so the random numbers drawn grow with k log(n/k) rather than with the number n of positions.
+ */
+class PositionReservoir
+{
+private:
+    size_t _k;
+    boost::mt19937& _rng;
+    vector<Coordinates> _positions;
+    uint64_t _next;             // index of the next position to take
+    double _w;
+
+    double uniform()
+    {
+        return (_rng() + 0.5) / 4294967296.0;
+    }
+
+    void skip(uint64_t index)
+    {
+        double const gap = floor(log(uniform()) / log(1 - _w));
+        _next = gap < 1e18 ? index + 1 + static_cast<uint64_t>(gap) : std::numeric_limits<uint64_t>::max();
+    }
+
+public:
+    PositionReservoir(size_t k, boost::mt19937& rng):
+        _k(k),
+        _rng(rng),
+        _next(0),
+        _w(1)
+    {}
+
+    /**
+     * @return the index of the next position to take; the ones before it are not needed
+     */
+    uint64_t getNext() const
+    {
+        return _next;
+    }
+
+    /**
+     * Take the position of index getNext().
+     */
+    void take(Coordinates const& pos)
+    {
+        if (_positions.size() < _k)
+        {
+            _positions.push_back(pos);
+            if (_positions.size() < _k)
+            {
+                _next += 1;
+                return;
+            }
+        }
+        else
+        {
+            _positions[randomBelow(_rng, _k)] = pos;
+        }
+        _w *= exp(log(uniform()) / _k);
+        skip(_next);
+    }
+
+    vector<Coordinates>& getPositions()
+    {
+        return _positions;
+    }
+};
+
+/**
+ * The operator reservoir_sample() runs in three steps:
+ * <br>
+ * <br> 1. Every instance samples up to k of its positions with a PositionReservoir, over the iterator of the empty
+ *         bitmap attribute only. A chunk before whose end the reservoir takes nothing is skipped by its element
+ *         count, which for a stored array is kept in the chunk header, without reading the chunk.
+ * <br> 2. The instances exchange their cell counts, and all of them split k among the instances the same way,
+ *         with the same seed: k draws without replacement from all the cells, one instance per draw with a
+ *         probability proportional to its cells not drawn yet. Every instance keeps that many positions of its
+ *         reservoir, chosen at random, so the k positions are a uniform sample of all the cells.
+ * <br> 3. The values at the kept positions are read chunk by chunk into the output, on the same instance.
+ */
+class PhysicalReservoirSample : public PhysicalOperator
+{
+private:
+    /**
+     * Step 1: a sample of the positions of the local cells.
+     * @return the number of local cells
+     */
+    uint64_t samplePositions(shared_ptr<Array> const& input, PositionReservoir& reservoir)
+    {
+        ArrayDesc const& desc = input->getArrayDesc();
+        AttributeDesc const* emptyBitmap = desc.getEmptyBitmapAttribute();
+        AttributeID const scanAttr = emptyBitmap != NULL ? emptyBitmap->getId() : 0;
+        uint64_t seen = 0;
+        size_t nRead = 0;
+        size_t nChunks = 0;
+        for (shared_ptr<ConstArrayIterator> arrayIter = input->getConstIterator(scanAttr);
+             !arrayIter->end();
+             ++(*arrayIter), ++nChunks)
+        {
+            ConstChunk const& chunk = arrayIter->getChunk();
+            uint64_t const nElems = chunk.count();
+            if (reservoir.getNext() >= seen + nElems)
+            {
+                seen += nElems;
+                continue;
+            }
+            nRead++;
+            shared_ptr<ConstChunkIterator> chunkIter =
+                chunk.getConstIterator(ConstChunkIterator::IGNORE_OVERLAPS | ConstChunkIterator::IGNORE_EMPTY_CELLS);
+            uint64_t index = seen;
+            while (reservoir.getNext() < seen + nElems && !chunkIter->end())
+            {
+                while (index < reservoir.getNext())
+                {
+                    ++(*chunkIter);
+                    ++index;
+                }
+                if (chunkIter->end())
+                {
+                    break;
+                }
+                reservoir.take(chunkIter->getPosition());
+            }
+            seen += nElems;
+        }
+        LOG4CXX_DEBUG(reservoirLogger, "reservoir_sample: read " << nRead << " of " << nChunks << " chunks");
+        return seen;
+    }
+
+    /**
+     * Step 2: the number of sampled cells of every instance.
+     * @param count the number of local cells
+     * @param seed the local seed; the split uses the seed of instance 0
+     * @return the number of positions to keep on this instance
+     */
+    uint64_t splitSample(uint64_t k, uint64_t count, int seed, shared_ptr<Query> const& query)
+    {
+        size_t const nInstances = query->getInstancesCount();
+        InstanceID const myInstanceId = query->getInstanceID();
+        vector<uint64_t> counts(nInstances);
+        counts[myInstanceId] = count;
+        uint64_t splitSeed = seed;
+
+        shared_ptr<SharedBuffer> buf(make_shared<MemoryBuffer>(static_cast<void*>(NULL), 2 * sizeof(uint64_t)));
+        static_cast<uint64_t*>(buf->getData())[0] = count;
+        static_cast<uint64_t*>(buf->getData())[1] = seed;
+        for (InstanceID i = 0; i < nInstances; ++i)
+        {
+            if (i != myInstanceId)
+            {
+                BufSend(i, buf, query);
+            }
+        }
+        for (InstanceID i = 0; i < nInstances; ++i)
+        {
+            if (i != myInstanceId)
+            {
+                shared_ptr<SharedBuffer> received = BufReceive(i, query);
+                counts[i] = static_cast<uint64_t*>(received->getData())[0];
+                if (i == 0)
+                {
+                    splitSeed = static_cast<uint64_t*>(received->getData())[1];
+                }
+            }
+        }
+
+        uint64_t remaining = 0;
+        for (size_t i = 0; i < nInstances; ++i)
+        {
+            remaining += counts[i];
+        }
+        boost::mt19937 rng(static_cast<uint32_t>(splitSeed));
+        vector<uint64_t> drawn(nInstances, 0);
+        for (uint64_t d = std::min(k, remaining); d != 0; --d, --remaining)
+        {
+            uint64_t r = randomBelow(rng, remaining);
+            size_t i = 0;
+            while (r >= counts[i] - drawn[i])
+            {
+                r -= counts[i] - drawn[i];
+                ++i;
+            }
+            ++drawn[i];
+        }
+        return drawn[myInstanceId];
+    }
+
+    /**
+     * Step 3: the cells at positions, sorted by chunk.
+     */
+    shared_ptr<Array> writeOutput(shared_ptr<Array> const& input, vector<Coordinates>& positions,
+                                  shared_ptr<Query> const& query)
+    {
+        typedef std::map<Coordinates, vector<Coordinates>, CoordinatesLess> ChunkPositions;
+        ChunkPositions chunks;
+        for (size_t i = 0; i < positions.size(); i++)
+        {
+            Coordinates chunkPos = positions[i];
+            _schema.getChunkPositionFor(chunkPos);
+            chunks[chunkPos].push_back(positions[i]);
+        }
+
+        shared_ptr<MemArray> output(new MemArray(_schema, query));
+        size_t const nAttrs = _schema.getAttributes(true).size();
+        vector< shared_ptr<ConstArrayIterator> > inputIters(nAttrs);
+        vector< shared_ptr<ArrayIterator> > outputIters(nAttrs);
+        for (size_t attr = 0; attr < nAttrs; attr++)
+        {
+            inputIters[attr] = input->getConstIterator(attr);
+            outputIters[attr] = output->getIterator(attr);
+        }
+        vector< shared_ptr<ConstChunkIterator> > inputChunkIters(nAttrs);
+        vector< shared_ptr<ChunkIterator> > outputChunkIters(nAttrs);
+        for (ChunkPositions::iterator c = chunks.begin(); c != chunks.end(); ++c)
+        {
+            vector<Coordinates>& cells = c->second;
+            std::sort(cells.begin(), cells.end(), CoordinatesLess());
+            for (size_t attr = 0; attr < nAttrs; attr++)
+            {
+                if (!inputIters[attr]->setPosition(c->first))
+                {
+                    throw SYSTEM_EXCEPTION(SCIDB_SE_EXECUTION, SCIDB_LE_OPERATION_FAILED) << "setPosition";
+                }
+                inputChunkIters[attr] = inputIters[attr]->getChunk().getConstIterator(
+                    ConstChunkIterator::IGNORE_OVERLAPS | ConstChunkIterator::IGNORE_EMPTY_CELLS);
+            }
+            newChunks(outputIters, outputChunkIters, c->first, query);
+            for (size_t i = 0; i < cells.size(); i++)
+            {
+                for (size_t attr = 0; attr < nAttrs; attr++)
+                {
+                    if (!inputChunkIters[attr]->setPosition(cells[i]) || !outputChunkIters[attr]->setPosition(cells[i]))
+                    {
+                        throw SYSTEM_EXCEPTION(SCIDB_SE_EXECUTION, SCIDB_LE_OPERATION_FAILED) << "setPosition";
+                    }
+                    outputChunkIters[attr]->writeItem(inputChunkIters[attr]->getItem());
+                }
+            }
+        }
+        flushChunks(outputChunkIters);
+        return output;
+    }
+
+public:
+    PhysicalReservoirSample(string const& logicalName,
+                            string const& physicalName,
+                            Parameters const& parameters,
+                            ArrayDesc const& schema):
+        PhysicalOperator(logicalName, physicalName, parameters, schema)
+    {}
+
+    virtual PhysicalBoundaries getOutputBoundaries(vector<PhysicalBoundaries> const& inputBoundaries,
+                                                   vector<ArrayDesc> const& inputSchemas) const
+    {
+        return inputBoundaries[0];
+    }
+
+    shared_ptr<Array> execute(vector< shared_ptr< Array> >& inputArrays, shared_ptr<Query> query)
+    {
+        assert(inputArrays.size() == 1);
+        shared_ptr<Array> input = ensureRandomAccess(inputArrays[0], query);
+        uint64_t const k = ((shared_ptr<OperatorParamPhysicalExpression>&)_parameters[0])->getExpression()
+            ->evaluate().getInt64();
+        int const seed = _parameters.size() == 2
+            ? (int)((shared_ptr<OperatorParamPhysicalExpression>&)_parameters[1])->getExpression()->evaluate().getInt64()
+            : (int)time(NULL);
+
+        // every instance samples its cells with a different generator
+        boost::mt19937 rng(static_cast<uint32_t>(seed) + static_cast<uint32_t>(query->getInstanceID()));
+        PositionReservoir reservoir(k, rng);
+        uint64_t const count = samplePositions(input, reservoir);
+        uint64_t const nKept = splitSample(k, count, seed, query);
+
+        vector<Coordinates>& positions = reservoir.getPositions();
+        assert(nKept <= positions.size());
+        for (size_t i = 0; i < nKept; i++)
+        {
+            std::swap(positions[i], positions[i + randomBelow(rng, positions.size() - i)]);
+        }
+        positions.resize(nKept);
+        return writeOutput(input, positions, query);
+    }
+};
+
+DECLARE_PHYSICAL_OPERATOR_FACTORY(PhysicalReservoirSample, "reservoir_sample", "PhysicalReservoirSample")
+
+} //namespace scidb
@@ -31,6 +31,8 @@
 #include <query/Operator.h>
 #include <array/SortArray.h>
 #include <system/Exceptions.h>
+#include <system/Config.h>
+#include <query/LogicalExpression.h>
 
 namespace scidb {
 
@@ -65,18 +67,40 @@ namespace scidb {
  *
  * @par Notes:
  *   Assuming null < NaN < other values
+ *   <br> With the distributed-sort config option, every instance sorts a range of the sort keys and the
+ *   ranges are placed one after another; otherwise the sorted runs of all instances are merged on the
+ *   coordinator.
  *
  */
 class LogicalSort: public LogicalOperator
 {
+private:
+    bool _distributed;
+
+    /**
+     * The choice of the distributed sort is read from the config once, here, and passed to
+     * PhysicalSort as a trailing boolean constant parameter, so that the plan and its execution
+     * on every instance agree even if the option changes in between.
+     */
+    static bool isDistributedParameter(boost::shared_ptr<OperatorParam> const& param)
+    {
+        return param->getParamType() == PARAM_LOGICAL_EXPRESSION &&
+            ((boost::shared_ptr<OperatorParamLogicalExpression>&)param)->getExpectedType().typeId() == TID_BOOL;
+    }
+
 public:
 	LogicalSort(const std::string& logicalName, const std::string& alias):
-	    LogicalOperator(logicalName, alias)
+	    LogicalOperator(logicalName, alias),
+	    _distributed(Config::getInstance()->getOption<bool>(CONFIG_DISTRIBUTED_SORT))
 	{
 		ADD_PARAM_INPUT()
 		ADD_PARAM_VARIES()
 
-        _globalOperatorName = std::pair<std::string, std::string>("sort2", "physicalSort2");
+        // the distributed sort leaves the key ranges of the instances in place, without a global merge
+        if (!_distributed)
+        {
+            _globalOperatorName = std::pair<std::string, std::string>("sort2", "physicalSort2");
+        }
 	}
 
         std::vector<boost::shared_ptr<OperatorParamPlaceholder> > nextVaryParamPlaceholder(const std::vector< ArrayDesc> &schemas)
@@ -97,9 +121,14 @@ public:
             assert(schemas.size() >= 1);
             ArrayDesc const& schema = schemas[0];
             size_t chunkSize = 0;
+            bool hasDistributedParameter = false;
             for(size_t i =0; i<_parameters.size(); i++)
             {
-                if(_parameters[i]->getParamType()==PARAM_LOGICAL_EXPRESSION)
+                if (isDistributedParameter(_parameters[i]))
+                {
+                    hasDistributedParameter = true;
+                }
+                else if(_parameters[i]->getParamType()==PARAM_LOGICAL_EXPRESSION && chunkSize == 0)
                 {
                     chunkSize = evaluate(((boost::shared_ptr<OperatorParamLogicalExpression>&)_parameters[i])->getExpression(),
                                          query, TID_INT64).getInt64();
@@ -107,9 +136,18 @@ public:
                     {
                         throw SYSTEM_EXCEPTION(SCIDB_SE_INFER_SCHEMA, SCIDB_LE_CHUNK_SIZE_MUST_BE_POSITIVE);
                     }
-                    break;
                 }
             }
+            if (!hasDistributedParameter)
+            {
+                Value distributed(TypeLibrary::getType(TID_BOOL));
+                distributed.setBool(_distributed);
+                boost::shared_ptr<ParsingContext> context = boost::make_shared<ParsingContext>();
+                addParameter(boost::shared_ptr<OperatorParam>(
+                                 new OperatorParamLogicalExpression(context,
+                                                                    boost::make_shared<Constant>(context, distributed, TID_BOOL),
+                                                                    TypeLibrary::getType(TID_BOOL), true)));
+            }
 
             // Use a SortArray object to build the schema
             SortArray sorter(schema, chunkSize);
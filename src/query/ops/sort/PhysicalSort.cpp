@@ -39,6 +39,8 @@
 #include "array/MergeSortArray.h"
 #include "array/SortArray.h"
 #include "array/ParallelAccumulatorArray.h"
+#include "query/Network.h"
+#include "query/TupleExchange.h"
 
 using namespace std;
 using namespace boost;
@@ -47,14 +49,130 @@ namespace scidb {
 
 static log4cxx::LoggerPtr logger(log4cxx::Logger::getLogger("scidb.query.ops.sort"));
 
+/**
+ * Sort every instance's part of the array with SortArray. By default the sorted runs of the instances are
+ * then merged on the coordinator by sort2. The distributed sort (config option distributed-sort) instead
+ * sorts in three steps:
+ * <br>
+ * <br>
+ * 1. Every instance sorts its part, picks SAMPLES_PER_INSTANCE regularly spaced tuples of the sorted part
+ * and sends them to all instances, weighted by the number of tuples each one stands for.
+ * <br>
+ * 2. All the instances pick the same N-1 splitters - the weighted quantiles of the samples - and send
+ * every tuple to the instance of its key range (see RangePartitioner).
+ * <br>
+ * 3. Every instance sorts what it received and writes it after the tuples of the lower key ranges, whose
+ * number it learns from an exchange of the counts, like uniq() does. The first and the last output
+ * chunks of an instance may be partial; the optimizer merges them.
+ */
 class PhysicalSort: public PhysicalOperator
 {
+private:
+    /**
+     * Number of sorted tuples an instance contributes to the choice of the splitters.
+     */
+    static const size_t SAMPLES_PER_INSTANCE = 128;
+
+    /**
+     * Number of tuples per chunk of the exchanged arrays.
+     */
+    static const size_t EXCHANGE_CHUNK_SIZE = 10000;
+
+    /**
+     * Whether LogicalSort chose the distributed sort, from its trailing boolean parameter.
+     */
+    bool _distributed;
+
+    bool isDistributed() const
+    {
+        return _distributed;
+    }
+
+    static void toTuple(vector<Value> const& values, Tuple& tuple)
+    {
+        for (size_t i = 0, n = values.size(); i < n; i++)
+        {
+            tuple[i] = values[i];
+        }
+    }
+
+    shared_ptr<Array> distributedSort(shared_ptr<Array> const& input,
+                                      vector<Key> const& keys,
+                                      shared_ptr<Query> const& query)
+    {
+        size_t const chunkSize = _schema.getDimensions()[0].getChunkInterval();
+        shared_ptr<TupleComparator> tcomp(new TupleComparator(keys, _schema));
+        shared_ptr<Array> sorted;
+        {
+            SortArray sorter(_schema, chunkSize);
+            sorted = sorter.getSortedArray(input, query, tcomp);
+        }
+
+        RangePartitioner partitioner(sorted, tcomp, SAMPLES_PER_INSTANCE, query);
+
+        TupleExchange ranges(_schema.getName() + "_ranges", _schema.getAttributes(true), EXCHANGE_CHUNK_SIZE, query);
+        {
+            Tuple tuple(_schema.getAttributes(true).size());
+            for (TupleReader reader(sorted); !reader.end(); ++reader)
+            {
+                toTuple(reader.getTuple(), tuple);
+                ranges.append(partitioner.getRange(tuple), reader.getTuple());
+            }
+        }
+        sorted.reset();
+        shared_ptr<Array> received = ranges.exchange();
+
+        uint64_t const count = getCellCount(received);
+        uint64_t const start = RangePartitioner::getRangeStart(count, query);
+        LOG4CXX_DEBUG(logger, "sort: key range of " << count << " tuples at position " << start);
+
+        SortArray sorter(_schema, chunkSize);
+        return sorter.getSortedArray(received, query, tcomp, start);
+    }
+
 public:
     PhysicalSort(const string& logicalName, const string& physicalName, const Parameters& parameters, const ArrayDesc& schema):
-        PhysicalOperator(logicalName, physicalName, parameters, schema)
+        PhysicalOperator(logicalName, physicalName, parameters, schema),
+        _distributed(false)
 	{
+        for (size_t i = 0; i < _parameters.size(); i++)
+        {
+            if (_parameters[i]->getParamType() == PARAM_PHYSICAL_EXPRESSION)
+            {
+                shared_ptr<Expression> const& expr =
+                    ((shared_ptr<OperatorParamPhysicalExpression>&)_parameters[i])->getExpression();
+                if (expr->getType() == TID_BOOL)
+                {
+                    _distributed = expr->evaluate().getBool();
+                }
+            }
+        }
 	}
 
+    /**
+     * The distributed sort leaves the key range of every instance on that instance, with partial
+     * chunks at the range boundaries.
+     */
+    virtual bool changesDistribution(std::vector<ArrayDesc> const&) const
+    {
+        return isDistributed();
+    }
+
+    virtual bool outputFullChunks(std::vector<ArrayDesc> const&) const
+    {
+        return !isDistributed();
+    }
+
+    virtual ArrayDistribution getOutputDistribution(std::vector<ArrayDistribution> const& inputDistributions,
+                                                    std::vector<ArrayDesc> const& inputSchemas) const
+    {
+        if (isDistributed())
+        {
+            return ArrayDistribution(psUndefined);
+        }
+        return PhysicalOperator::getOutputDistribution(inputDistributions, inputSchemas);
+    }
+
     virtual PhysicalBoundaries getOutputBoundaries(const std::vector<PhysicalBoundaries> & inputBoundaries,
                                                    const std::vector< ArrayDesc> & inputSchemas) const
     {
@@ -104,6 +222,11 @@ public:
             keys.push_back(k);
         }
 
+        if (query->getInstancesCount() > 1 && isDistributed())
+        {
+            return distributedSort(inputArrays[0], keys, query);
+        }
+
         if ( query->getInstancesCount() > 1) { 
             // Prepare context for second phase
             SortContext* ctx = new SortContext();
@@ -0,0 +1,98 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.
+* Copyright (C) 2008-2014 SciDB, Inc.
+*
+* SciDB is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with SciDB.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+
+#include <query/Operator.h>
+#include <array/SortArray.h>
+#include <system/Exceptions.h>
+
+namespace scidb
+{
+
+/**
+ * @brief The operator: topk()
+ *
+ * @par Synopsis: topk (input_array, k {, attr [asc | desc]}*)
+ *
+ * @par Examples:
+ *   <br> topk(trades, 100, price desc)
+ *   <br> topk(readings, 10, sensor_id, value desc)
+ *
+ * @par Summary:
+ *   <br>
+ *   Produces a 1D array of the first k non-empty cells of the input in the order of the given attributes, i.e. the
+ *   first k cells of sort() with the same attributes, without sorting the whole input. If no attribute is given, the
+ *   first attribute is used in ascending order. Like sort(), null < NaN < other values. Cells with equal sort keys
+ *   may come in a different order than in sort().
+ *
+ * @par Input:
+ *   <br> input_array <...> [*]
+ *   <br> k                                          --the number of cells to return, positive
+ *   <br> attr [asc | desc]                          --the sort keys; ascending by default
+ *
+ * @par Output array:
+ *   <br> <
+ *   <br>   srcAttrs: all the attributes are retained.
+ *   <br> >
+ *   <br> [
+ *   <br>   n: start=0, end=MAX_COORDINATE, chunk interval = min{k, 1000000}
+ *   <br> ]
+ *
+ * @see PhysicalTopK.cpp for a description of the algorithm.
+ */
+class LogicalTopK : public LogicalOperator
+{
+public:
+    LogicalTopK(const string& logicalName, const string& alias):
+        LogicalOperator(logicalName, alias)
+    {
+        ADD_PARAM_INPUT()
+        ADD_PARAM_CONSTANT("int64")
+        ADD_PARAM_VARIES()
+    }
+
+    vector<shared_ptr<OperatorParamPlaceholder> > nextVaryParamPlaceholder(vector< ArrayDesc> const& schemas)
+    {
+        vector<shared_ptr<OperatorParamPlaceholder> > res;
+        res.push_back(PARAM_IN_ATTRIBUTE_NAME("void"));
+        res.push_back(END_OF_VARIES_PARAMS());
+        return res;
+    }
+
+    ArrayDesc inferSchema(vector< ArrayDesc> schemas, shared_ptr< Query> query)
+    {
+        assert(schemas.size() == 1);
+        int64_t const k = evaluate(((shared_ptr<OperatorParamLogicalExpression>&)_parameters[0])->getExpression(),
+                                   query, TID_INT64).getInt64();
+        if (k <= 0)
+        {
+            throw USER_QUERY_EXCEPTION(SCIDB_SE_INFER_SCHEMA, SCIDB_LE_PARAMETER_NOT_POSITIVE_INTEGER,
+                                       _parameters[0]->getParsingContext()) << "k";
+        }
+        SortArray sorter(schemas[0], std::min<int64_t>(k, 1000000));
+        return sorter.getOutputArrayDesc();
+    }
+};
+
+DECLARE_LOGICAL_OPERATOR_FACTORY(LogicalTopK, "topk")
+
+} //namespace scidb
@@ -0,0 +1,447 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.
+* Copyright (C) 2008-2014 SciDB, Inc.
+*
+* SciDB is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with SciDB.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+
+#include <algorithm>
+
+#include <query/Operator.h>
+#include <query/TupleExchange.h>
+#include <array/TupleArray.h>
+#include <array/MemArray.h>
+#include <system/Config.h>
+#include <util/Job.h>
+#include <util/Mutex.h>
+
+namespace scidb
+{
+
+static log4cxx::LoggerPtr topkLogger(log4cxx::Logger::getLogger("scidb.operators.topk"));
+
+/**
+ * The k first tuples seen so far in the order of a TupleComparator, kept in a max-heap: the top of the heap is the
+ * last tuple kept, the one that a better tuple replaces.
+ */
+class TopKHeap
+{
+private:
+    class TupleLess
+    {
+    public:
+        TupleLess(TupleComparator& tcomp): _tcomp(&tcomp)
+        {}
+
+        bool operator()(shared_ptr<Tuple> const& t1, shared_ptr<Tuple> const& t2) const
+        {
+            return _tcomp->compare(*t1, *t2) < 0;
+        }
+
+    private:
+        TupleComparator* _tcomp;
+    };
+
+    size_t _k;
+    TupleComparator& _tcomp;
+    vector< shared_ptr<Tuple> > _tuples;
+
+public:
+    TopKHeap(size_t k, TupleComparator& tcomp):
+        _k(k),
+        _tcomp(tcomp)
+    {}
+
+    /**
+     * @param tuple a tuple whose key columns are set
+     * @return true if the tuple is among the first k seen so far
+     */
+    bool accepts(Tuple const& tuple)
+    {
+        return _tuples.size() < _k || _tcomp.compare(tuple, *_tuples.front()) < 0;
+    }
+
+    /**
+     * Add a tuple that accepts() the heap, replacing the last tuple if the heap is full.
+     */
+    void push(Tuple const& tuple)
+    {
+        if (_tuples.size() < _k)
+        {
+            _tuples.push_back(shared_ptr<Tuple>(new Tuple(tuple)));
+        }
+        else
+        {
+            std::pop_heap(_tuples.begin(), _tuples.end(), TupleLess(_tcomp));
+            *_tuples.back() = tuple;
+        }
+        std::push_heap(_tuples.begin(), _tuples.end(), TupleLess(_tcomp));
+    }
+
+    void merge(TopKHeap const& other)
+    {
+        for (size_t i = 0, n = other._tuples.size(); i < n; i++)
+        {
+            if (accepts(*other._tuples[i]))
+            {
+                push(*other._tuples[i]);
+            }
+        }
+    }
+
+    vector< shared_ptr<Tuple> > const& getTuples() const
+    {
+        return _tuples;
+    }
+
+    /**
+     * Sort the tuples in order; the heap may not be used afterwards.
+     */
+    vector< shared_ptr<Tuple> > const& sort()
+    {
+        std::sort_heap(_tuples.begin(), _tuples.end(), TupleLess(_tcomp));
+        return _tuples;
+    }
+};
+
+/**
+ * @par Algorithm:
+ * <br>
+ * <br>
+ * Every instance scans its chunks with several jobs (CONFIG_AGGREGATE_THREADS, or CONFIG_EXEC_THREADS if that is 0),
+ * which take the chunks one at a time. Each job keeps a TopKHeap of its first k tuples. The sort keys of a cell are
+ * read first and compared with the last tuple of the heap, so that the other attributes of a cell are only read if
+ * the cell makes it into the heap - once the heap is full, most cells don't.
+ * <br>
+ * <br>
+ * The heaps of the jobs are merged, and the k tuples of every instance are sent to the coordinator (see
+ * TupleExchange), which merges them once more and writes the k first tuples in order. The other instances return
+ * empty arrays.
+ */
+class PhysicalTopK : public PhysicalOperator
+{
+private:
+    /**
+     * Number of tuples per chunk of the array sent to the coordinator.
+     */
+    static const size_t EXCHANGE_CHUNK_SIZE = 10000;
+
+    /**
+     * The positions of the input chunks, handed out to the scan jobs one at a time.
+     */
+    class ChunkPositions
+    {
+    private:
+        vector<Coordinates> _positions;
+        size_t _next;
+        Mutex _mutex;
+
+    public:
+        explicit ChunkPositions(shared_ptr<Array> const& input):
+            _next(0)
+        {
+            for (shared_ptr<ConstArrayIterator> i = input->getConstIterator(0); !i->end(); ++(*i))
+            {
+                _positions.push_back(i->getPosition());
+            }
+        }
+
+        size_t size() const
+        {
+            return _positions.size();
+        }
+
+        /**
+         * @return the position of the next chunk to scan, or NULL if there are no more
+         */
+        Coordinates const* next()
+        {
+            ScopedMutexLock cs(_mutex);
+            return _next < _positions.size() ? &_positions[_next++] : NULL;
+        }
+    };
+
+    class ScanJob : public Job
+    {
+    private:
+        PhysicalTopK& _op;
+        shared_ptr<Array> _input;
+        ChunkPositions& _chunks;
+        TopKHeap& _heap;
+
+    public:
+        ScanJob(PhysicalTopK& op,
+                shared_ptr<Array> const& input,
+                ChunkPositions& chunks,
+                TopKHeap& heap,
+                shared_ptr<Query> const& query):
+            Job(query),
+            _op(op),
+            _input(input),
+            _chunks(chunks),
+            _heap(heap)
+        {}
+
+        virtual void run()
+        {
+            Query::setCurrentQueryID(_query->getQueryID());
+            _op.scan(_input, _chunks, _heap);
+        }
+    };
+
+    vector<Key> _keys;
+
+    /**
+     * Add the cells of the chunks taken from chunks to a heap.
+     */
+    void scan(shared_ptr<Array> const& input, ChunkPositions& chunks, TopKHeap& heap)
+    {
+        size_t const nAttrs = _schema.getAttributes(true).size();
+        vector<bool> isKey(nAttrs, false);
+        for (size_t i = 0; i < _keys.size(); i++)
+        {
+            isKey[_keys[i].columnNo] = true;
+        }
+        vector< shared_ptr<ConstArrayIterator> > arrayIters(nAttrs);
+        vector< shared_ptr<ConstChunkIterator> > chunkIters(nAttrs);
+        for (size_t i = 0; i < nAttrs; i++)
+        {
+            arrayIters[i] = input->getConstIterator(i);
+        }
+        Tuple candidate(_schema.getAttributes().size());
+        for (Coordinates const* pos = chunks.next(); pos != NULL; pos = chunks.next())
+        {
+            for (size_t i = 0; i < nAttrs; i++)
+            {
+                if (!arrayIters[i]->setPosition(*pos))
+                {
+                    throw SYSTEM_EXCEPTION(SCIDB_SE_QPROC, SCIDB_LE_OPERATION_FAILED) << "setPosition";
+                }
+                chunkIters[i] = arrayIters[i]->getChunk().getConstIterator(ChunkIterator::IGNORE_EMPTY_CELLS |
+                                                                           ChunkIterator::IGNORE_OVERLAPS);
+            }
+            while (!chunkIters[0]->end())
+            {
+                for (size_t i = 0; i < _keys.size(); i++)
+                {
+                    candidate[_keys[i].columnNo] = chunkIters[_keys[i].columnNo]->getItem();
+                }
+                if (heap.accepts(candidate))
+                {
+                    for (size_t i = 0; i < nAttrs; i++)
+                    {
+                        if (!isKey[i])
+                        {
+                            candidate[i] = chunkIters[i]->getItem();
+                        }
+                    }
+                    heap.push(candidate);
+                }
+                for (size_t i = 0; i < nAttrs; i++)
+                {
+                    ++(*chunkIters[i]);
+                }
+            }
+        }
+    }
+
+    /**
+     * Scan the local chunks with parallel jobs and merge their heaps into heap.
+     */
+    void scanParallel(shared_ptr<Array> const& input, TopKHeap& heap, size_t k, TupleComparator& tcomp,
+                      shared_ptr<Query> const& query)
+    {
+        ChunkPositions chunks(input);
+        size_t const nJobs = getParallelJobsCount(chunks.size());
+        if (nJobs <= 1)
+        {
+            scan(input, chunks, heap);
+            return;
+        }
+
+        vector< shared_ptr<TopKHeap> > heaps(nJobs);
+        vector< shared_ptr<ScanJob> > jobs(nJobs);
+        shared_ptr<JobQueue> queue = PhysicalOperator::getGlobalQueueForOperators();
+        for (size_t i = 0; i < nJobs; i++)
+        {
+            heaps[i].reset(new TopKHeap(k, tcomp));
+            jobs[i].reset(new ScanJob(*this, input, chunks, *heaps[i], query));
+            queue->pushJob(jobs[i]);
+        }
+        int errorJob = -1;
+        for (size_t i = 0; i < nJobs; i++)
+        {
+            if (!jobs[i]->wait())
+            {
+                errorJob = i;
+            }
+        }
+        if (errorJob >= 0)
+        {
+            jobs[errorJob]->rethrow();
+        }
+        for (size_t i = 0; i < nJobs; i++)
+        {
+            heap.merge(*heaps[i]);
+        }
+        LOG4CXX_DEBUG(topkLogger, "topk: scanned " << chunks.size() << " chunks with " << nJobs << " jobs");
+    }
+
+    /**
+     * Write tuples in order as the cells 0, 1, ... of the output.
+     */
+    shared_ptr<Array> writeOutput(vector< shared_ptr<Tuple> > const& tuples, shared_ptr<Query> const& query)
+    {
+        shared_ptr<MemArray> output(new MemArray(_schema, query));
+        size_t const nAttrs = _schema.getAttributes(true).size();
+        Coordinate const chunkSize = _schema.getDimensions()[0].getChunkInterval();
+        vector< shared_ptr<ArrayIterator> > arrayIters(nAttrs);
+        vector< shared_ptr<ChunkIterator> > chunkIters(nAttrs);
+        for (size_t i = 0; i < nAttrs; i++)
+        {
+            arrayIters[i] = output->getIterator(i);
+        }
+        Coordinates pos(1, 0);
+        for (size_t t = 0; t < tuples.size(); t++)
+        {
+            if (pos[0] % chunkSize == 0)
+            {
+                newChunks(arrayIters, chunkIters, pos, query);
+            }
+            for (size_t i = 0; i < nAttrs; i++)
+            {
+                chunkIters[i]->writeItem((*tuples[t])[i]);
+                ++(*chunkIters[i]);
+            }
+            pos[0] += 1;
+        }
+        flushChunks(chunkIters);
+        return output;
+    }
+
+public:
+    PhysicalTopK(string const& logicalName,
+                 string const& physicalName,
+                 Parameters const& parameters,
+                 ArrayDesc const& schema):
+        PhysicalOperator(logicalName, physicalName, parameters, schema)
+    {}
+
+    /**
+     * All the output is on the coordinator.
+     */
+    virtual bool changesDistribution(std::vector<ArrayDesc> const&) const
+    {
+        return true;
+    }
+
+    virtual ArrayDistribution getOutputDistribution(vector<ArrayDistribution> const&,
+                                                    vector<ArrayDesc> const&) const
+    {
+        return ArrayDistribution(psUndefined);
+    }
+
+    virtual PhysicalBoundaries getOutputBoundaries(vector<PhysicalBoundaries> const& inputBoundaries,
+                                                   vector<ArrayDesc> const& inputSchemas) const
+    {
+        uint64_t const k = ((shared_ptr<OperatorParamPhysicalExpression>&)_parameters[0])->getExpression()
+            ->evaluate().getInt64();
+        uint64_t const numCells = std::min<uint64_t>(inputBoundaries[0].getNumCells(), k);
+        if (numCells == 0)
+        {
+            return PhysicalBoundaries::createEmpty(1);
+        }
+        Coordinates start(1, 0);
+        Coordinates end(1, numCells - 1);
+        return PhysicalBoundaries(start, end);
+    }
+
+    shared_ptr<Array> execute(vector< shared_ptr< Array> >& inputArrays, shared_ptr<Query> query)
+    {
+        size_t const k = ((shared_ptr<OperatorParamPhysicalExpression>&)_parameters[0])->getExpression()
+            ->evaluate().getInt64();
+        Attributes const& attrs = _schema.getAttributes();
+        _keys.clear();
+        for (size_t i = 1; i < _parameters.size(); i++)
+        {
+            shared_ptr<OperatorParamAttributeReference> const& sortColumn =
+                (shared_ptr<OperatorParamAttributeReference> const&)_parameters[i];
+            Key key;
+            key.columnNo = sortColumn->getObjectNo();
+            key.ascent = sortColumn->getSortAscent();
+            if ((size_t)key.columnNo >= attrs.size())
+            {
+                throw USER_EXCEPTION(SCIDB_SE_EXECUTION, SCIDB_LE_OP_SORT_ERROR2);
+            }
+            _keys.push_back(key);
+        }
+        if (_keys.empty())
+        {
+            Key key;
+            key.columnNo = 0;
+            key.ascent = true;
+            _keys.push_back(key);
+        }
+
+        TupleComparator tcomp(_keys, _schema);
+        TopKHeap heap(k, tcomp);
+        scanParallel(ensureRandomAccess(inputArrays[0], query), heap, k, tcomp, query);
+        inputArrays[0].reset();
+
+        InstanceID const coordinator = query->getCoordinatorInstanceID();
+        size_t const nAttrs = _schema.getAttributes(true).size();
+        TupleExchange gather(_schema.getName() + "_topk", _schema.getAttributes(true), EXCHANGE_CHUNK_SIZE, query);
+        vector<Value> values(nAttrs);
+        for (size_t t = 0, n = heap.getTuples().size(); t < n; t++)
+        {
+            Tuple const& tuple = *heap.getTuples()[t];
+            for (size_t i = 0; i < nAttrs; i++)
+            {
+                values[i] = tuple[i];
+            }
+            gather.append(coordinator, values);
+        }
+        LOG4CXX_DEBUG(topkLogger, "topk: sending " << gather.getTupleCount() << " tuples to the coordinator");
+        shared_ptr<Array> received = gather.exchange();
+        if (query->getInstanceID() != coordinator)
+        {
+            return shared_ptr<Array>(new MemArray(_schema, query));
+        }
+
+        TopKHeap merged(k, tcomp);
+        Tuple tuple(_schema.getAttributes().size());
+        for (TupleReader reader(received); !reader.end(); ++reader)
+        {
+            vector<Value> const& cell = reader.getTuple();
+            for (size_t i = 0; i < nAttrs; i++)
+            {
+                tuple[i] = cell[i];
+            }
+            if (merged.accepts(tuple))
+            {
+                merged.push(tuple);
+            }
+        }
+        return writeOutput(merged.sort(), query);
+    }
+};
+
+DECLARE_PHYSICAL_OPERATOR_FACTORY(PhysicalTopK, "topk", "PhysicalTopK")
+
+} //namespace scidb
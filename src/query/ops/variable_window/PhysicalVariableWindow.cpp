@@ -33,6 +33,10 @@
 #include "array/Metadata.h"
 #include "array/MemArray.h"
 #include "array/FileArray.h"
+#include "system/Config.h"
+#include "system/SciDBConfigOptions.h"
+#include "util/Job.h"
+#include "util/Mutex.h"
 #include "VariableWindow.h"
 
 #include <log4cxx/logger.h>
@@ -1082,6 +1086,195 @@ public:
         output.flushAll();
     }
 
+    /**
+     * The local chunks, grouped by axis, handed out one axis at a time to the jobs of
+     * parallelVariableWindow().
+     */
+    class AxisQueue
+    {
+    private:
+        vector< vector<ChunkLocation> > _axes;
+        size_t _next;
+        Mutex _mutex;
+
+    public:
+        explicit AxisQueue(ChunkInstanceMap const& chunkMap):
+            _next(0)
+        {
+            ChunkInstanceMap::axial_iterator iter = chunkMap.getAxialIterator();
+            bool newAxis = true;
+            while (!iter.end())
+            {
+                bool moreChunksInAxis;
+                ChunkLocation cl = iter.getNextChunk(moreChunksInAxis);
+                if (newAxis)
+                {
+                    _axes.push_back(vector<ChunkLocation>());
+                }
+                _axes.back().push_back(cl);
+                newAxis = !moreChunksInAxis;
+            }
+        }
+
+        size_t size() const
+        {
+            return _axes.size();
+        }
+
+        /**
+         * @return the chunks of the next axis in order, NULL if there is none left
+         */
+        vector<ChunkLocation> const* next()
+        {
+            ScopedMutexLock cs(_mutex);
+            return _next < _axes.size() ? &_axes[_next++] : NULL;
+        }
+    };
+
+    class AxisJob : public Job
+    {
+    private:
+        PhysicalVariableWindow& _op;
+        shared_ptr<Array> _srcArray;
+        shared_ptr<MemArray> _dstArray;
+        AggIOMapping const& _mapping;
+        size_t _sizeLimit;
+        bool _useSwap;
+        AxisQueue& _axes;
+
+    public:
+        AxisJob(PhysicalVariableWindow& op,
+                shared_ptr<Array> const& srcArray,
+                shared_ptr<MemArray> const& dstArray,
+                AggIOMapping const& mapping,
+                size_t sizeLimit,
+                bool useSwap,
+                AxisQueue& axes,
+                shared_ptr<Query> const& query):
+            Job(query),
+            _op(op),
+            _srcArray(srcArray),
+            _dstArray(dstArray),
+            _mapping(mapping),
+            _sizeLimit(sizeLimit),
+            _useSwap(useSwap),
+            _axes(axes)
+        {}
+
+        virtual void run()
+        {
+            Query::setCurrentQueryID(_query->getQueryID());
+            if (_useSwap)
+            {   _op.processAxes<true>(_srcArray, _dstArray, _mapping, _sizeLimit, _axes); }
+            else
+            {   _op.processAxes<false>(_srcArray, _dstArray, _mapping, _sizeLimit, _axes); }
+        }
+    };
+
+    /**
+     * Compute the windows of the axes taken from a queue until it is empty. Every chunk of an
+     * axis must be local: the edges of the windows then pass from a chunk to the next without
+     * any message. The job has its own copies of the aggregates, and writes to its own array.
+     */
+    template <bool USE_SWAP>
+    void processAxes(shared_ptr<Array> const& srcArray,
+                     shared_ptr<MemArray> const& dstArray,
+                     AggIOMapping const& mapping,
+                     size_t sizeLimit,
+                     AxisQueue& axes)
+    {
+        shared_ptr<Query> query = Query::getValidQueryPtr(_query);
+        vector<AggregatePtr> aggs;
+        for (size_t i = 0; i < mapping.size(); i++)
+        {
+            aggs.push_back(mapping.getAggregate(i)->clone());
+        }
+        vector<VariableWindowMessage> outMessages(_nInstances);
+        unordered_map<Coordinates, shared_ptr<ChunkEdge> > leftEdges;
+        shared_ptr<ConstArrayIterator> saiter = srcArray->getConstIterator(mapping.getInputAttributeId());
+        AttributeWriter<USE_SWAP> output(_chunkCounts, dstArray, sizeLimit, query, mapping);
+        shared_ptr<ChunkEdge> currentRightEdge;
+        shared_ptr<ChunkEdge> currentLeftEdge;
+
+        for (vector<ChunkLocation> const* axis = axes.next(); axis != NULL; axis = axes.next())
+        {
+            for (size_t i = 0; i < axis->size(); i++)
+            {
+                processChunk <USE_SWAP> ((*axis)[i], saiter, currentRightEdge, currentLeftEdge, leftEdges, output, outMessages, aggs);
+            }
+        }
+        assert(leftEdges.empty());
+        output.flushAll();
+    }
+
+    /**
+     * When no axis is split between instances, every output chunk depends only on the chunks
+     * before it in its axis, and the axes are independent. They are then spread over several
+     * jobs on the operator queue (see PhysicalOperator::getParallelJobsCount), and the result
+     * does not depend on their scheduling.
+     * <br>
+     * <br>
+     * The choice of this path must not depend on the local chunks: the other paths exchange
+     * messages with every instance, and this one none. An instance with a single axis, or none,
+     * computes it on its own thread.
+     */
+    void parallelVariableWindow(shared_ptr<Array> const& srcArray,
+                                shared_ptr<MemArray>& dstArray,
+                                AggIOMapping const& mapping,
+                                size_t sizeLimit,
+                                bool useSwap)
+    {
+        shared_ptr<Query> query = Query::getValidQueryPtr(_query);
+        AxisQueue axes(*_localChunkMap);
+        size_t const nJobs = getParallelJobsCount(axes.size());
+        if (nJobs <= 1)
+        {
+            if (useSwap)
+            {   processAxes<true>(srcArray, dstArray, mapping, sizeLimit, axes); }
+            else
+            {   processAxes<false>(srcArray, dstArray, mapping, sizeLimit, axes); }
+            return;
+        }
+        LOG4CXX_DEBUG(logger, "Processing " << axes.size() << " axes with " << nJobs << " jobs");
+
+        shared_ptr<JobQueue> queue = PhysicalOperator::getGlobalQueueForOperators();
+        vector< shared_ptr<MemArray> > jobOutputs(nJobs);
+        vector< shared_ptr<AxisJob> > jobs(nJobs);
+        for (size_t i = 0; i < nJobs; i++)
+        {
+            jobOutputs[i].reset(new MemArray(_schema, query));
+            jobs[i].reset(new AxisJob(*this, srcArray, jobOutputs[i], mapping, sizeLimit / nJobs, useSwap, axes, query));
+            queue->pushJob(jobs[i]);
+        }
+        int errorJob = -1;
+        for (size_t i = 0; i < nJobs; i++)
+        {
+            if (!jobs[i]->wait())
+            {
+                errorJob = i;
+            }
+        }
+        if (errorJob >= 0)
+        {
+            jobs[errorJob]->rethrow();
+        }
+
+        for (size_t i = 0; i < mapping.size(); i++)
+        {
+            AttributeID const attID = mapping.getOutputAttributeId(i);
+            shared_ptr<ArrayIterator> daiter = dstArray->getIterator(attID);
+            for (size_t j = 0; j < nJobs; j++)
+            {
+                shared_ptr<ConstArrayIterator> saiter = jobOutputs[j]->getConstIterator(attID);
+                while (!saiter->end())
+                {
+                    daiter->copyChunk(saiter->getChunk());
+                    ++(*saiter);
+                }
+            }
+        }
+    }
+
     shared_ptr<Array> execute(vector< shared_ptr<Array> >& inputArrays, shared_ptr<Query> query)
     {
 #if 0
@@ -1164,7 +1357,9 @@ public:
                 useSwap = true;
             }
 
-            if (useSwap && useAxialSync)
+            if (stats._splitAxisLinks == 0)
+            {   parallelVariableWindow(srcArray, dstArray, mapping, maxSize, useSwap); }
+            else if (useSwap && useAxialSync)
             {   axialMultiInstanceVariableWindow<true, true>(srcArray, dstArray, mapping, maxSize); }
             else if (useSwap && !useAxialSync)
             {   axialMultiInstanceVariableWindow<true, false>(srcArray, dstArray, mapping, maxSize); }
@@ -30,6 +30,7 @@
  */
 #include "query/optimizer/Optimizer.h"
 #include "network/NetworkManager.h"
+#include "query/ops/load/LogicalLoadRedimension.h"
 
 using namespace boost;
 
@@ -131,6 +132,33 @@ namespace scidb
                 return sgNode;
             }
         }
+        else if (node->getLogicalOperator()->getLogicalName()=="load_redimension")
+        {
+            //rewrite load_redimension(array,schema,'filename') into store(redimension(input(schema,'filename'),array),array)
+            //The operators were made and their schemas inferred by LogicalLoadRedimension::inferSchema.
+            boost::shared_ptr< LogicalLoadRedimension> loadOperator =
+                boost::dynamic_pointer_cast<LogicalLoadRedimension>(node->getLogicalOperator());
+            assert(loadOperator);
+
+            boost::shared_ptr< LogicalQueryPlanNode> inputNode(
+                new  LogicalQueryPlanNode (node->getParsingContext(),
+                                                 loadOperator->getInputOperator()));
+
+            boost::shared_ptr< LogicalQueryPlanNode> redimensionNode(
+                new  LogicalQueryPlanNode (node->getParsingContext(),
+                                                 loadOperator->getRedimensionOperator()));
+
+            boost::shared_ptr< LogicalQueryPlanNode> storeNode(
+                new  LogicalQueryPlanNode (node->getParsingContext(),
+                                                 loadOperator->getStoreOperator()));
+
+            //load_redimension node does not have any children. so the input node will also have none.
+            assert(node->getChildren().size()==0);
+
+            redimensionNode->addChild(inputNode);
+            storeNode->addChild(redimensionNode);
+            return storeNode;
+        }
         else if (AggregateLibrary::getInstance()->hasAggregate(node->getLogicalOperator()->getLogicalName()))
         {
            boost::shared_ptr< LogicalOperator> oldStyleOperator = node->getLogicalOperator();
@@ -188,6 +188,16 @@ void initConfig(int argc, char* argv[])
         (CONFIG_MAX_OPEN_FDS, 0, "max-open-fds", "MAX_OPEN_FDS", "", Config::INTEGER, "Maximum number of fds that will be opened by the storage manager at once", 256, false)
         (CONFIG_PREALLOCATE_SHM, 0, "preallocate-shared-mem", "PREALLOCATE_SHM", "", Config::BOOLEAN, "Make sure shared memory backing (e.g. /dev/shm) is preallocated", true, false)
         (CONFIG_INSTALL_ROOT, 0, "install_root", "INSTALL_ROOT", "", Config::STRING, "The installation directory from which SciDB runs", string(SCIDB_INSTALL_PREFIX()), false)
+        (CONFIG_MEM_ARRAY_SPILL_PATHS, 0, "mem-array-spill-paths", "MEM_ARRAY_SPILL_PATHS", "", Config::STRING, "Comma-separated list of directories over which swapped-out temporary array chunks are striped. Default is the tmp-path directory", string(""), false)
+        (CONFIG_MEM_ARRAY_SPILL_QUEUE, 0, "mem-array-spill-queue", "MEM_ARRAY_SPILL_QUEUE", "", Config::SIZE, "Maximal size of swapped-out temporary array chunks waiting to be written by the background spill threads (MiB). 0 writes them synchronously", DEFAULT_MEM_SPILL_QUEUE, false)
+        (CONFIG_MEM_ARRAY_PREFETCH, 0, "mem-array-prefetch", "MEM_ARRAY_PREFETCH", "", Config::INTEGER, "Number of swapped-out temporary array chunks read ahead of a sequential scan", 2, false)
+        (CONFIG_MEM_ARRAY_COMPRESS_SPILL, 0, "mem-array-compress-spill", "MEM_ARRAY_COMPRESS_SPILL", "", Config::BOOLEAN, "Compress swapped-out temporary array chunks", true, false)
+        (CONFIG_PREFETCH_BUDGET, 0, "prefetch-budget", "PREFETCH_BUDGET", "", Config::INTEGER, "Maximal number of result chunks prefetched concurrently by all queries. 0 means prefetch-queue-size times jobs", 0, false)
+        (CONFIG_AGGREGATE_THREADS, 0, "aggregate-threads", "AGGREGATE_THREADS", "", Config::INTEGER, "Number of parallel jobs over which aggregate, redimension, rank, quantile, topk, window and variable_window spread the local chunks of an array. 0 means the number of execution threads, 1 disables these parallel jobs", 0, false)
+        (CONFIG_DISTRIBUTED_SORT, 0, "distributed-sort", "DISTRIBUTED_SORT", "", Config::BOOLEAN, "True if sort should range-partition the array across the instances instead of merging all the sorted runs on the coordinator", false, false)
+        (CONFIG_QUANTILE_SKETCH_K, 0, "quantile-sketch-k", "QUANTILE_SKETCH_K", "", Config::INTEGER, "Accuracy parameter of the approximate quantile aggregates: the rank error is about 1.7/k of the number of values, the state holds at most about 3k values (8..65535)", 200, false)
+        (CONFIG_APPROX_COUNT_DISTINCT_PRECISION, 0, "approx-count-distinct-precision", "APPROX_COUNT_DISTINCT_PRECISION", "", Config::INTEGER, "Precision p of approx_count_distinct: the state has at most 2^p one-byte registers and the standard error is 1.04/sqrt(2^p) (4..18)", 14, false)
+        (CONFIG_INDEX_LOOKUP_CACHE, 0, "index-lookup-cache", "INDEX_LOOKUP_CACHE", "", Config::SIZE, "Memory for the lookup tables that index_lookup keeps across queries for stored index arrays (MiB). 0 disables the cache", DEFAULT_INDEX_LOOKUP_CACHE, false)
         ;
 
     cfg->addHook(configHook);
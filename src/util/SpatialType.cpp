@@ -27,10 +27,123 @@
  *      Author: Donghui Zhang
  */
 
+#include <math.h>
+#include <algorithm>
 #include <util/SpatialType.h>
 
+using namespace std;
+
 namespace scidb
 {
+const size_t SpatialRanges::RTREE_FANOUT;
+const size_t SpatialRanges::RTREE_MIN_RANGES;
+
+namespace
+{
+/**
+ * @return whether the box [low, high] contains the box [queryLow, queryHigh].
+ */
+inline bool boxContains(Coordinate const* low, Coordinate const* high,
+                        Coordinate const* queryLow, Coordinate const* queryHigh, size_t numDims)
+{
+    for (size_t i=0; i<numDims; ++i) {
+        if (queryLow[i] < low[i] || queryHigh[i] > high[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @return whether the box [low, high] intersects the box [queryLow, queryHigh].
+ */
+inline bool boxIntersects(Coordinate const* low, Coordinate const* high,
+                          Coordinate const* queryLow, Coordinate const* queryHigh, size_t numDims)
+{
+    for (size_t i=0; i<numDims; ++i) {
+        if (queryHigh[i] < low[i] || queryLow[i] > high[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Orders the indices of boxes by the centers of the boxes in one dimension.
+ */
+class CenterLess
+{
+public:
+    CenterLess(vector<SpatialRange> const& boxes, size_t dim)
+    : _boxes(boxes), _dim(dim)
+    {}
+
+    bool operator()(size_t left, size_t right) const
+    {
+        return center(left) < center(right);
+    }
+
+private:
+    vector<SpatialRange> const& _boxes;
+    size_t _dim;
+
+    Coordinate center(size_t i) const
+    {
+        // halves first, the sum may not fit a Coordinate
+        return _boxes[i]._low[_dim]/2 + _boxes[i]._high[_dim]/2;
+    }
+};
+
+/**
+ * Sort-Tile-Recursive order of boxes[order[begin, end)]: sort by the centers in dimension dim,
+ * cut into slabs of whole nodes, and order every slab likewise by the next dimension.
+ */
+void strOrder(vector<SpatialRange> const& boxes, vector<size_t>& order, size_t begin, size_t end, size_t dim)
+{
+    size_t const fanout = SpatialRanges::RTREE_FANOUT;
+    size_t const numDims = boxes[order[begin]]._low.size();
+    size_t const n = end - begin;
+    sort(order.begin()+begin, order.begin()+end, CenterLess(boxes, dim));
+    if (dim+1 == numDims || n <= fanout) {
+        return;
+    }
+    size_t const numNodes = (n + fanout - 1) / fanout;
+    size_t const numSlabs = static_cast<size_t>(ceil(pow(static_cast<double>(numNodes), 1.0 / (numDims - dim))));
+    size_t const slabSize = fanout * ((numNodes + numSlabs - 1) / numSlabs);
+    for (size_t i=begin; i<end; i+=slabSize) {
+        strOrder(boxes, order, i, min(i+slabSize, end), dim+1);
+    }
+}
+
+/**
+ * Reorder items[begin, begin+order.size()): the i-th becomes items[begin+order[i]].
+ */
+template<class T>
+void permute(vector<T>& items, size_t begin, vector<size_t> const& order)
+{
+    vector<T> ordered;
+    ordered.reserve(order.size());
+    for (size_t i=0, n=order.size(); i<n; ++i) {
+        ordered.push_back(items[begin + order[i]]);
+    }
+    copy(ordered.begin(), ordered.end(), items.begin()+begin);
+}
+
+/**
+ * @return the bounding box of boxes[begin, end).
+ */
+SpatialRange boundingBox(vector<SpatialRange> const& boxes, size_t begin, size_t end)
+{
+    SpatialRange box(boxes[begin]);
+    for (size_t i=begin+1; i<end; ++i) {
+        for (size_t d=0, numDims=box._low.size(); d<numDims; ++d) {
+            box._low[d] = min(box._low[d], boxes[i]._low[d]);
+            box._high[d] = max(box._high[d], boxes[i]._high[d]);
+        }
+    }
+    return box;
+}
+}
 DominanceRelationship calculateDominance(Coordinates const& left, Coordinates const& right)
 {
     assert(left.size() == right.size() && !left.empty());
@@ -69,6 +182,11 @@ bool SpatialRanges::findOneThatIntersects(SpatialRange const& queryRange, size_t
             return true;
         }
     }
+    if (hasIndex()) {
+        assert(queryRange.valid() && queryRange._low.size()==_numDims);
+        hint = searchIndex(&queryRange._low[0], &queryRange._high[0], false);
+        return hint != static_cast<size_t>(-1);
+    }
     for (size_t i=0, n=_ranges.size(); i<n; ++i) {
         if (_ranges[i].intersects(queryRange)) {
             hint = i;
@@ -86,6 +204,11 @@ bool SpatialRanges::findOneThatContains(Coordinates const& queryPoint, size_t& h
             return true;
         }
     }
+    if (hasIndex()) {
+        assert(queryPoint.size()==_numDims);
+        hint = searchIndex(&queryPoint[0], &queryPoint[0], true);
+        return hint != static_cast<size_t>(-1);
+    }
     for (size_t i=0, n=_ranges.size(); i<n; ++i) {
         if (_ranges[i].contains(queryPoint)) {
             hint = i;
@@ -103,6 +226,11 @@ bool SpatialRanges::findOneThatContains(SpatialRange const& queryRange, size_t&
             return true;
         }
     }
+    if (hasIndex()) {
+        assert(queryRange.valid() && queryRange._low.size()==_numDims);
+        hint = searchIndex(&queryRange._low[0], &queryRange._high[0], true);
+        return hint != static_cast<size_t>(-1);
+    }
     for (size_t i=0, n=_ranges.size(); i<n; ++i) {
         if (_ranges[i].contains(queryRange)) {
             hint = i;
@@ -113,5 +241,104 @@ bool SpatialRanges::findOneThatContains(SpatialRange const& queryRange, size_t&
     return false;
 }
 
+void SpatialRanges::buildIndex()
+{
+    _nodes.clear();
+    _bounds.clear();
+    _numLeaves = 0;
+    _numIndexed = 0;
+    if (_ranges.size() < RTREE_MIN_RANGES) {
+        return;
+    }
+
+    // The leaves: STR order of the ranges themselves, cut into nodes.
+    vector<size_t> order(_ranges.size());
+    for (size_t i=0, n=order.size(); i<n; ++i) {
+        order[i] = i;
+    }
+    strOrder(_ranges, order, 0, order.size(), 0);
+    permute(_ranges, 0, order);
+
+    vector<SpatialRange> boxes;
+    for (size_t i=0, n=_ranges.size(); i<n; i+=RTREE_FANOUT) {
+        RTreeNode node;
+        node._begin = i;
+        node._end = min(i+RTREE_FANOUT, n);
+        _nodes.push_back(node);
+        boxes.push_back(boundingBox(_ranges, node._begin, node._end));
+    }
+    _numLeaves = _nodes.size();
+
+    // The levels above: STR order of the nodes of the level below, cut into parents, up to the root.
+    size_t levelBegin = 0;
+    while (_nodes.size() - levelBegin > 1) {
+        size_t const levelEnd = _nodes.size();
+        vector<SpatialRange> levelBoxes(boxes.begin()+levelBegin, boxes.end());
+        order.resize(levelEnd - levelBegin);
+        for (size_t i=0, n=order.size(); i<n; ++i) {
+            order[i] = i;
+        }
+        strOrder(levelBoxes, order, 0, order.size(), 0);
+        permute(_nodes, levelBegin, order);
+        permute(boxes, levelBegin, order);
+
+        for (size_t i=levelBegin; i<levelEnd; i+=RTREE_FANOUT) {
+            RTreeNode node;
+            node._begin = i;
+            node._end = min(i+RTREE_FANOUT, levelEnd);
+            _nodes.push_back(node);
+            boxes.push_back(boundingBox(boxes, node._begin, node._end));
+        }
+        levelBegin = levelEnd;
+    }
+
+    _bounds.resize(_nodes.size() * 2 * _numDims);
+    for (size_t i=0, n=_nodes.size(); i<n; ++i) {
+        copy(boxes[i]._low.begin(), boxes[i]._low.end(), _bounds.begin() + i*2*_numDims);
+        copy(boxes[i]._high.begin(), boxes[i]._high.end(), _bounds.begin() + i*2*_numDims + _numDims);
+    }
+    _numIndexed = _ranges.size();
+}
+
+size_t SpatialRanges::searchIndex(size_t node, Coordinate const* queryLow, Coordinate const* queryHigh, bool containment) const
+{
+    RTreeNode const& parent = _nodes[node];
+    if (node < _numLeaves) {
+        for (size_t i=parent._begin; i<parent._end; ++i) {
+            Coordinate const* low = &_ranges[i]._low[0];
+            Coordinate const* high = &_ranges[i]._high[0];
+            if (containment ? boxContains(low, high, queryLow, queryHigh, _numDims)
+                            : boxIntersects(low, high, queryLow, queryHigh, _numDims)) {
+                return i;
+            }
+        }
+        return static_cast<size_t>(-1);
+    }
+    for (size_t child=parent._begin; child<parent._end; ++child) {
+        Coordinate const* low = &_bounds[child*2*_numDims];
+        Coordinate const* high = low + _numDims;
+        if (containment ? boxContains(low, high, queryLow, queryHigh, _numDims)
+                        : boxIntersects(low, high, queryLow, queryHigh, _numDims)) {
+            size_t const found = searchIndex(child, queryLow, queryHigh, containment);
+            if (found != static_cast<size_t>(-1)) {
+                return found;
+            }
+        }
+    }
+    return static_cast<size_t>(-1);
+}
+
+size_t SpatialRanges::searchIndex(Coordinate const* queryLow, Coordinate const* queryHigh, bool containment) const
+{
+    assert(hasIndex());
+    size_t const root = _nodes.size() - 1;
+    Coordinate const* low = &_bounds[root*2*_numDims];
+    Coordinate const* high = low + _numDims;
+    if (containment ? boxContains(low, high, queryLow, queryHigh, _numDims)
+                    : boxIntersects(low, high, queryLow, queryHigh, _numDims)) {
+        return searchIndex(root, queryLow, queryHigh, containment);
+    }
+    return static_cast<size_t>(-1);
 }
 
+}
@@ -0,0 +1,75 @@
+#!/bin/sh
+#
+# BEGIN_COPYRIGHT
+#
+# This file is part of SciDB.
+# Copyright (C) 2008-2014 SciDB, Inc.
+#
+# SciDB is free software: you can redistribute it and/or modify
+# it under the terms of the AFFERO GNU General Public License as published by
+# the Free Software Foundation.
+#
+# SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+# INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+# NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+# the AFFERO GNU General Public License for the complete license terms.
+#
+# You should have received a copy of the AFFERO GNU General Public License
+# along with SciDB.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+#
+# END_COPYRIGHT
+#
+#
+#    File:   run.sh
+#
+#   About:
+#
+#   This script measures the throughput of the builtin aggregates over the
+#  fixed-size numeric types. The values of the array are all distinct within
+#  a chunk, so the aggregates go through the run kernels that accumulate whole
+#  runs of payload values (see TileFunctions.h) rather than repeated values.
+#
+#   For each type, a 1-D array of Cell_Count cells is built and stored, then
+#  every aggregate is computed over it several times. Each line of output is
+#  "AGG <aggregate> <type> <cells> <seconds>".
+#
+#   Usage: ./run.sh Port [Cell_Count]
+#
+usage()
+{
+  echo "Usage: run.sh Port [Cell_Count]"
+  echo " Port must be a the SciDB coordinate server TCP/IP port number."
+  echo " Cell_Count is the number of cells of the aggregated array."
+  echo "Default: 100000000."
+  exit;
+}
+
+if [ $# -lt 1 ]; then
+  usage
+fi
+
+Port=$1
+Cell_Count=${2:-100000000}
+#
+#  Cells per chunk, and repetitions of each query.
+Chunk_Len=1000000
+Repeat=3
+Types="int8 int16 int32 int64 float double"
+Aggregates="sum count min max avg var stdev"
+LEN=`expr $Cell_Count - 1`
+
+for Type in $Types; do
+  iquery --port $Port -aq "remove ( Agg_Kernel_Array )" > /dev/null 2>&1
+  iquery --port $Port -naq "store ( build ( <v : $Type> [ I=0:$LEN,$Chunk_Len,0 ], I % 127 - 63 ), Agg_Kernel_Array )"
+  #
+  for Agg in $Aggregates; do
+    CMD="consume ( aggregate ( Agg_Kernel_Array, $Agg ( v ) ) )"
+    I=0
+    while [ $I -lt $Repeat ]; do
+      /usr/bin/time -f "AGG $Agg $Type $Cell_Count %e" iquery --port $Port -naq "$CMD;"
+      I=`expr $I + 1`
+    done
+  done
+done
+
+iquery --port $Port -aq "remove ( Agg_Kernel_Array )" > /dev/null 2>&1
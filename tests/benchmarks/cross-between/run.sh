@@ -0,0 +1,81 @@
+#!/bin/sh
+#
+# BEGIN_COPYRIGHT
+#
+# This file is part of SciDB.
+# Copyright (C) 2008-2014 SciDB, Inc.
+#
+# SciDB is free software: you can redistribute it and/or modify
+# it under the terms of the AFFERO GNU General Public License as published by
+# the Free Software Foundation.
+#
+# SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+# INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+# NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+# the AFFERO GNU General Public License for the complete license terms.
+#
+# You should have received a copy of the AFFERO GNU General Public License
+# along with SciDB.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+#
+# END_COPYRIGHT
+#
+#
+#    File:   run.sh
+#
+#   About:
+#
+#   This script measures cross_between with 10, 1K and 100K query boxes.
+#  With many boxes, the chunks and cells are tested against an R-tree packed
+#  over the boxes (see SpatialRanges::buildIndex()) rather than box by box.
+#
+#   A 2-D array of Side x Side cells is built and stored once. For each box
+#  count, a ranges array of that many random boxes of about the same total
+#  area is built, then cross_between is computed several times. Each line of
+#  output is "XBETWEEN <boxes> <cells> <seconds>".
+#
+#   Usage: ./run.sh Port [Side]
+#
+usage()
+{
+  echo "Usage: run.sh Port [Side]"
+  echo " Port must be a the SciDB coordinate server TCP/IP port number."
+  echo " Side is the number of cells along each dimension of the array."
+  echo "Default: 10000."
+  exit;
+}
+
+if [ $# -lt 1 ]; then
+  usage
+fi
+
+Port=$1
+Side=${2:-10000}
+#
+#  Cells per chunk side, and repetitions of each query.
+Chunk_Len=1000
+Repeat=3
+Box_Counts="10 1000 100000"
+LEN=`expr $Side - 1`
+CELLS=`expr $Side \* $Side`
+
+iquery --port $Port -aq "remove ( XBetween_Array )" > /dev/null 2>&1
+iquery --port $Port -naq "store ( build ( <v : double> [ I=0:$LEN,$Chunk_Len,0, J=0:$LEN,$Chunk_Len,0 ], I + J ), XBetween_Array )"
+
+for Boxes in $Box_Counts; do
+  #
+  #  Boxes of side Side / sqrt(Boxes) / 2, so every box count covers about a quarter of the array.
+  BOX_SIDE=`awk "BEGIN { b = int ( $Side / sqrt ( $Boxes ) / 2 ); print ( b < 1 ? 1 : b ) }"`
+  LAST=`expr $Boxes - 1`
+  iquery --port $Port -aq "remove ( XBetween_Ranges )" > /dev/null 2>&1
+  iquery --port $Port -naq "store ( apply ( apply ( build ( <ilo : int64> [ K=0:$LAST,100000,0 ], int64 ( random() % $Side ) ), jlo, int64 ( random() % $Side ) ), ihi, ilo + $BOX_SIDE, jhi, jlo + $BOX_SIDE ), XBetween_Ranges )"
+  #
+  CMD="consume ( cross_between ( XBetween_Array, XBetween_Ranges ) )"
+  I=0
+  while [ $I -lt $Repeat ]; do
+    /usr/bin/time -f "XBETWEEN $Boxes $CELLS %e" iquery --port $Port -naq "$CMD;"
+    I=`expr $I + 1`
+  done
+done
+
+iquery --port $Port -aq "remove ( XBetween_Ranges )" > /dev/null 2>&1
+iquery --port $Port -aq "remove ( XBetween_Array )" > /dev/null 2>&1
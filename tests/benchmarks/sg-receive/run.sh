@@ -0,0 +1,78 @@
+#!/bin/sh
+#
+# BEGIN_COPYRIGHT
+#
+# This file is part of SciDB.
+# Copyright (C) 2008-2014 SciDB, Inc.
+#
+# SciDB is free software: you can redistribute it and/or modify
+# it under the terms of the AFFERO GNU General Public License as published by
+# the Free Software Foundation.
+#
+# SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+# INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+# NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+# the AFFERO GNU General Public License for the complete license terms.
+#
+# You should have received a copy of the AFFERO GNU General Public License
+# along with SciDB.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+#
+# END_COPYRIGHT
+#
+#
+#    File:   run.sh
+#
+#   About:
+#
+#   This script measures the throughput of SG receive with many small chunks.
+#  Every chunk holds a handful of cells, so the time goes into the per-chunk
+#  overhead of the receiving side: looking the chunk up in the MemArray that
+#  collects it, merging it and iterating over the collected chunks afterwards.
+#
+#   For each chunk count, a 2-D array of tiny chunks is built and stored, then
+#  repartitioned by row with sg() several times. The chunks arrive at the
+#  receivers in no particular order.
+#
+#   Usage: ./run.sh Port [Chunk_Count ...]
+#
+usage()
+{
+  echo "Usage: run.sh Port [Chunk_Count ...]"
+  echo " Port must be a the SciDB coordinate server TCP/IP port number."
+  echo " Chunk_Count is the number of chunks of the array to redistribute;"
+  echo "it is rounded down to a square. Default: 10000 40000 160000 640000."
+  exit;
+}
+
+if [ $# -lt 1 ]; then
+  usage
+fi
+
+Port=$1
+shift
+Chunk_Counts=${*:-"10000 40000 160000 640000"}
+#
+#  Cells per chunk along each dimension, and repetitions of each query.
+Chunk_Len=2
+Repeat=3
+
+for Chunk_Count in $Chunk_Counts; do
+  #
+  #  Chunks along each dimension
+  N=`echo "sqrt($Chunk_Count)" | bc`
+  LEN=`expr $N \* $Chunk_Len - 1`
+  #
+  iquery --port $Port -aq "remove ( SG_Receive_Array )" > /dev/null 2>&1
+  iquery --port $Port -naq "store ( build ( <v : int64> [ I=0:$LEN,$Chunk_Len,0, J=0:$LEN,$Chunk_Len,0 ], I * $LEN + J ), SG_Receive_Array )"
+  #
+  CMD="consume ( sg ( SG_Receive_Array, 3 ) )"
+  #
+  echo "${CMD} with `expr $N \* $N` chunks"
+  I=0
+  while [ $I -lt $Repeat ]; do
+    /usr/bin/time -f "SG_RECEIVE `expr $N \* $N` %e" iquery --port $Port -naq "$CMD;"
+    I=`expr $I + 1`
+  done
+done
+
+iquery --port $Port -aq "remove ( SG_Receive_Array )" > /dev/null 2>&1
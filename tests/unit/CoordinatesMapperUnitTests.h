@@ -0,0 +1,248 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.
+* Copyright (C) 2008-2014 SciDB, Inc.
+*
+* SciDB is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with SciDB.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+
+#ifndef COORDINATES_MAPPER_UNIT_TESTS
+#define COORDINATES_MAPPER_UNIT_TESTS
+
+/****************************************************************************/
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <iostream>
+#include <iomanip>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <util/CoordinatesMapper.h>
+
+/****************************************************************************/
+
+using namespace scidb;
+
+/**
+ * Checks the fast paths of CoordinatesMapper against plain div/mod arithmetic, and times
+ * the conversions over typical chunk shapes.
+ */
+class CoordinatesMapperTests : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(CoordinatesMapperTests);
+    CPPUNIT_TEST(testShapes);
+    CPPUNIT_TEST(testLargeChunk);
+    CPPUNIT_TEST(benchmark);
+    CPPUNIT_TEST_SUITE_END();
+
+private:
+    /// Make a chunk of the given shape at an arbitrary (possibly negative) origin.
+    static void makeChunk(size_t nDims, Coordinate const* shape, Coordinates& first, Coordinates& last)
+    {
+        first.resize(nDims);
+        last.resize(nDims);
+        for (size_t i = 0; i < nDims; i++) {
+            first[i] = Coordinate(i * 1000) - 500;
+            last[i] = first[i] + shape[i] - 1;
+        }
+    }
+
+    /// Reference conversion of a position to coordinates.
+    static void refPos2coord(Coordinates const& first, Coordinates const& last, position_t pos, Coordinates& coord)
+    {
+        coord.resize(first.size());
+        for (size_t i = first.size(); i-- > 0; ) {
+            Coordinate interval = last[i] - first[i] + 1;
+            coord[i] = first[i] + pos % interval;
+            pos /= interval;
+        }
+    }
+
+    /// Check every cell of a chunk, or a sample of its cells if the chunk is big.
+    static void checkShape(size_t nDims, Coordinate const* shape)
+    {
+        Coordinates first, last;
+        makeChunk(nDims, shape, first, last);
+        CoordinatesMapper mapper(first, last);
+
+        position_t size = 1;
+        for (size_t i = 0; i < nDims; i++) {
+            size *= shape[i];
+        }
+        position_t step = size <= 1000000 ? 1 : size / 1000000 + 7;
+        Coordinates coord, ref;
+        for (position_t pos = 0; pos < size; pos += step) {
+            mapper.pos2coord(pos, coord);
+            refPos2coord(first, last, pos, ref);
+            CPPUNIT_ASSERT(coord == ref);
+            CPPUNIT_ASSERT_EQUAL(pos, mapper.coord2pos(coord));
+        }
+        // the last cell
+        mapper.pos2coord(size - 1, coord);
+        CPPUNIT_ASSERT(coord == last);
+        CPPUNIT_ASSERT_EQUAL(size - 1, mapper.coord2pos(last));
+    }
+
+    /// The per-dimension division of pos2coord before the fast paths, as the baseline of benchmark().
+    static void divPos2coord(Coordinates const& origin, Coordinates const& intervals, position_t pos,
+                             Coordinates& coord)
+    {
+        for (size_t i = origin.size(); i-- > 0; ) {
+            coord[i] = origin[i] + (pos % intervals[i]);
+            pos /= intervals[i];
+        }
+    }
+
+    /// A sum over the cells that depends on the order of the coordinates.
+    static Coordinate checksum(Coordinates const& coord)
+    {
+        Coordinate sum = 0;
+        for (size_t i = 0; i < coord.size(); i++) {
+            sum = sum * 31 + coord[i];
+        }
+        return sum;
+    }
+
+    static double now()
+    {
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        return tv.tv_sec + tv.tv_usec / 1e6;
+    }
+
+public:
+    void testShapes()
+    {
+        Coordinate const s1[] = {1000000};
+        Coordinate const s2a[] = {1024, 512};       // powers of two
+        Coordinate const s2b[] = {1000, 1000};
+        Coordinate const s2c[] = {1, 7};
+        Coordinate const s2d[] = {7, 1};
+        Coordinate const s3a[] = {64, 64, 64};
+        Coordinate const s3b[] = {10, 20, 30};
+        Coordinate const s4a[] = {32, 32, 32, 32};
+        Coordinate const s4b[] = {5, 1, 3, 7};
+        Coordinate const s4c[] = {31, 37, 41, 43};
+        Coordinate const s5[] = {3, 4, 5, 6, 7};
+        Coordinate const s6[] = {65536, 65536};     // 2^32 cells, still uses reciprocals
+
+        checkShape(1, s1);
+        checkShape(2, s2a);
+        checkShape(2, s2b);
+        checkShape(2, s2c);
+        checkShape(2, s2d);
+        checkShape(3, s3a);
+        checkShape(3, s3b);
+        checkShape(4, s4a);
+        checkShape(4, s4b);
+        checkShape(4, s4c);
+        checkShape(5, s5);
+        checkShape(2, s6);
+    }
+
+    void testLargeChunk()
+    {
+        // more than 2^32 cells: div/mod
+        Coordinate const s2[] = {100000, 100003};
+        Coordinate const s3[] = {3000, 3001, 3002};
+        checkShape(2, s2);
+        checkShape(3, s3);
+    }
+
+    /**
+     * Time pos2coord against the per-dimension division it replaced, over every cell of typical
+     * chunk shapes. Both must give the same coordinates for every cell; the figures go to stdout
+     * only if SCIDB_UNIT_BENCHMARK is set in the environment.
+     */
+    void benchmark()
+    {
+        struct Shape
+        {
+            size_t nDims;
+            Coordinate shape[4];
+            char const* name;
+        };
+        Shape const shapes[] = {
+            { 1, {1000000, 0, 0, 0},   "1-D 1000000" },
+            { 2, {1000, 1000, 0, 0},   "2-D 1000x1000" },
+            { 2, {1024, 1024, 0, 0},   "2-D 1024x1024" },
+            { 3, {100, 100, 100, 0},   "3-D 100x100x100" },
+            { 3, {128, 128, 64, 0},    "3-D 128x128x64" },
+            { 4, {30, 30, 30, 30},     "4-D 30x30x30x30" },
+            { 4, {32, 32, 32, 32},     "4-D 32x32x32x32" }
+        };
+        const int repeat = 5;
+        bool const report = getenv("SCIDB_UNIT_BENCHMARK") != NULL;
+
+        if (report) {
+            std::cout << std::endl;
+        }
+        for (size_t s = 0; s < sizeof(shapes) / sizeof(shapes[0]); s++) {
+            size_t const nDims = shapes[s].nDims;
+            checkShape(nDims, shapes[s].shape);
+
+            Coordinates first, last;
+            makeChunk(nDims, shapes[s].shape, first, last);
+            CoordinatesMapper mapper(first, last);
+            Coordinates intervals(nDims);
+            position_t size = 1;
+            for (size_t i = 0; i < nDims; i++) {
+                intervals[i] = shapes[s].shape[i];
+                size *= shapes[s].shape[i];
+            }
+
+            Coordinates coord(nDims);
+            Coordinate divSum = 0;
+            double start = now();
+            for (int r = 0; r < repeat; r++) {
+                for (position_t pos = 0; pos < size; pos++) {
+                    divPos2coord(first, intervals, pos, coord);
+                    divSum += checksum(coord);
+                }
+            }
+            double divElapsed = now() - start;
+
+            Coordinate mapperSum = 0;
+            start = now();
+            for (int r = 0; r < repeat; r++) {
+                for (position_t pos = 0; pos < size; pos++) {
+                    mapper.pos2coord(pos, coord);
+                    mapperSum += checksum(coord);
+                }
+            }
+            double mapperElapsed = now() - start;
+            CPPUNIT_ASSERT_EQUAL(divSum, mapperSum);
+
+            if (report) {
+                double const cells = double(size) * repeat;
+                std::cout << "CoordinatesMapper " << std::setw(18) << std::left << shapes[s].name
+                          << std::right << std::fixed << std::setprecision(2)
+                          << divElapsed * 1e9 / cells << " ns/cell with divisions, "
+                          << mapperElapsed * 1e9 / cells << " ns/cell" << std::endl;
+            }
+        }
+    }
+};
+
+/****************************************************************************/
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CoordinatesMapperTests);
+
+/****************************************************************************/
+#endif
+/****************************************************************************/
@@ -0,0 +1,122 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.
+* Copyright (C) 2008-2014 SciDB, Inc.
+*
+* SciDB is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with SciDB.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+#ifndef SORTED_VALUE_COUNTS_UNIT_TESTS
+#define SORTED_VALUE_COUNTS_UNIT_TESTS
+
+/****************************************************************************/
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <functional>
+#include <vector>
+#include <query/ops/rankquantile/RankCommon.h>
+
+/****************************************************************************/
+
+using namespace scidb;
+
+/**
+ * Checks the counts of SortedValueCounts against a sorted copy of the values, with groups large
+ * enough for the pending values to be merged into the sorted ones several times.
+ */
+class SortedValueCountsTests : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(SortedValueCountsTests);
+    CPPUNIT_TEST(testRandom);
+    CPPUNIT_TEST(testOrdered);
+    CPPUNIT_TEST(testFewDistinct);
+    CPPUNIT_TEST_SUITE_END();
+
+private:
+    typedef SortedValueCounts<int64_t, std::less<int64_t> > Counts;
+
+    /// Add the values, then compare every count, for the values and their neighbours, with the sorted values.
+    static void check(std::vector<int64_t> const& values)
+    {
+        Counts counts((std::less<int64_t>()));
+        for (size_t i = 0; i < values.size(); i++) {
+            counts.add(values[i]);
+        }
+        counts.finish();
+
+        std::vector<int64_t> sorted(values);
+        std::sort(sorted.begin(), sorted.end());
+        CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(std::unique(sorted.begin(), sorted.end()) - sorted.begin()),
+                             counts.size());
+
+        sorted = values;
+        std::sort(sorted.begin(), sorted.end());
+        for (size_t i = 0; i < sorted.size(); i++) {
+            for (int64_t v = sorted[i] - 1; v <= sorted[i] + 1; v++) {
+                uint64_t const lower = std::lower_bound(sorted.begin(), sorted.end(), v) - sorted.begin();
+                uint64_t const upper = std::upper_bound(sorted.begin(), sorted.end(), v) - sorted.begin();
+                CPPUNIT_ASSERT_EQUAL(lower, counts.getLowerCount(v));
+                CPPUNIT_ASSERT_EQUAL(upper, counts.getUpperCount(v));
+            }
+        }
+    }
+
+public:
+    /// 20K values out of 5K, in random order.
+    void testRandom()
+    {
+        ::srandom(0);
+        std::vector<int64_t> values;
+        for (size_t i = 0; i < 20000; i++) {
+            values.push_back(::random() % 5000);
+        }
+        check(values);
+    }
+
+    /// Ascending values, then the same values descending, so that every later value meets an equal sorted one.
+    void testOrdered()
+    {
+        std::vector<int64_t> values;
+        for (int64_t i = 0; i < 3000; i++) {
+            values.push_back(i * 2);
+        }
+        for (int64_t i = 3000; i-- > 0; ) {
+            values.push_back(i * 2);
+        }
+        check(values);
+    }
+
+    /// Many more values than distinct ones: the sorted values stay smaller than the pending buffer.
+    void testFewDistinct()
+    {
+        ::srandom(1);
+        std::vector<int64_t> values;
+        for (size_t i = 0; i < 10000; i++) {
+            values.push_back(::random() % 7);
+        }
+        check(values);
+    }
+};
+
+/****************************************************************************/
+
+CPPUNIT_TEST_SUITE_REGISTRATION(SortedValueCountsTests);
+
+#endif
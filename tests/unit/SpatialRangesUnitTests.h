@@ -0,0 +1,213 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* This file is part of SciDB.
+* Copyright (C) 2008-2014 SciDB, Inc.
+*
+* SciDB is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* SciDB is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with SciDB.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+
+#ifndef SPATIAL_RANGES_UNIT_TESTS
+#define SPATIAL_RANGES_UNIT_TESTS
+
+/****************************************************************************/
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <iostream>
+#include <iomanip>
+#include <stdlib.h>
+#include <math.h>
+#include <sys/time.h>
+#include <util/SpatialType.h>
+
+/****************************************************************************/
+
+using namespace scidb;
+
+/**
+ * Checks the R-tree of SpatialRanges against the linear scan, and times both over
+ * 10, 1K and 100K query boxes, as cross_between sees them.
+ */
+class SpatialRangesTests : public CppUnit::TestFixture
+{
+    CPPUNIT_TEST_SUITE(SpatialRangesTests);
+    CPPUNIT_TEST(testIndex);
+    CPPUNIT_TEST(benchmark);
+    CPPUNIT_TEST_SUITE_END();
+
+private:
+    /// Side of the space the boxes are drawn from, in every dimension.
+    static const Coordinate SPACE = 100000;
+
+    static Coordinate random(Coordinate n)
+    {
+        return static_cast<Coordinate>(::random() % n);
+    }
+
+    /// Fill both with the same random boxes of sides up to maxSide.
+    static void makeRanges(size_t nRanges, Coordinate maxSide, SpatialRanges& indexed, SpatialRanges& linear)
+    {
+        for (size_t i = 0; i < nRanges; i++) {
+            SpatialRange& range = indexed.addOne();
+            for (size_t d = 0; d < indexed._numDims; d++) {
+                range._low[d] = random(SPACE);
+                range._high[d] = range._low[d] + random(maxSide);
+            }
+            linear._ranges.push_back(range);
+        }
+        indexed.buildIndex();
+    }
+
+    static void makePoint(size_t nDims, Coordinates& point)
+    {
+        point.resize(nDims);
+        for (size_t d = 0; d < nDims; d++) {
+            point[d] = random(SPACE + 1000) - 500;
+        }
+    }
+
+    static void makeRange(size_t nDims, Coordinate maxSide, SpatialRange& range)
+    {
+        makePoint(nDims, range._low);
+        range._high = range._low;
+        for (size_t d = 0; d < nDims; d++) {
+            range._high[d] += random(maxSide);
+        }
+    }
+
+    static double now()
+    {
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        return tv.tv_sec + tv.tv_usec / 1e6;
+    }
+
+    /// @return nanoseconds per point query
+    static double timeQueries(SpatialRanges const& ranges, std::vector<Coordinates> const& points, size_t& nFound)
+    {
+        size_t hint = 0;
+        nFound = 0;
+        double start = now();
+        for (size_t i = 0; i < points.size(); i++) {
+            nFound += ranges.findOneThatContains(points[i], hint);
+        }
+        return (now() - start) * 1e9 / points.size();
+    }
+
+public:
+    void setUp()
+    {
+        ::srandom(0x5C1DB);
+    }
+
+    void testIndex()
+    {
+        size_t const nDims[] = {1, 2, 3};
+        size_t const nRanges[] = {SpatialRanges::RTREE_MIN_RANGES - 1, SpatialRanges::RTREE_MIN_RANGES, 1000, 20000};
+        for (size_t i = 0; i < sizeof(nDims) / sizeof(nDims[0]); i++) {
+            for (size_t j = 0; j < sizeof(nRanges) / sizeof(nRanges[0]); j++) {
+                SpatialRanges indexed(nDims[i]);
+                SpatialRanges linear(nDims[i]);
+                Coordinate const maxSide = SPACE / 10 / nDims[i];
+                makeRanges(nRanges[j], maxSide, indexed, linear);
+                CPPUNIT_ASSERT_EQUAL(nRanges[j] >= SpatialRanges::RTREE_MIN_RANGES, indexed.hasIndex());
+                CPPUNIT_ASSERT_EQUAL(nRanges[j], indexed._ranges.size());
+
+                Coordinates point;
+                SpatialRange range(nDims[i]);
+                for (size_t q = 0; q < 2000; q++) {
+                    size_t hint = 0;
+                    size_t linearHint = 0;
+                    makePoint(nDims[i], point);
+                    bool found = indexed.findOneThatContains(point, hint);
+                    CPPUNIT_ASSERT_EQUAL(linear.findOneThatContains(point, linearHint), found);
+                    CPPUNIT_ASSERT(!found || indexed._ranges[hint].contains(point));
+
+                    makeRange(nDims[i], maxSide, range);
+                    hint = 0;
+                    found = indexed.findOneThatContains(range, hint);
+                    CPPUNIT_ASSERT_EQUAL(linear.findOneThatContains(range, linearHint), found);
+                    CPPUNIT_ASSERT(!found || indexed._ranges[hint].contains(range));
+
+                    hint = 0;
+                    found = indexed.findOneThatIntersects(range, hint);
+                    CPPUNIT_ASSERT_EQUAL(linear.findOneThatIntersects(range, linearHint), found);
+                    CPPUNIT_ASSERT(!found || indexed._ranges[hint].intersects(range));
+                }
+
+                // ranges added after buildIndex() are found by the linear scan
+                SpatialRange& added = indexed.addOne();
+                added._low.assign(nDims[i], -10);
+                added._high.assign(nDims[i], -5);
+                CPPUNIT_ASSERT(!indexed.hasIndex());
+                point.assign(nDims[i], -7);
+                size_t hint = 0;
+                CPPUNIT_ASSERT(indexed.findOneThatContains(point, hint));
+                CPPUNIT_ASSERT_EQUAL(indexed._ranges.size() - 1, hint);
+            }
+        }
+    }
+
+    /**
+     * Time point containment, the test of every cell of cross_between, over 2-D boxes covering
+     * about half of the space, with and without the R-tree. The figures go to stdout only if
+     * SCIDB_UNIT_BENCHMARK is set in the environment; the test only fails if the two disagree.
+     */
+    void benchmark()
+    {
+        size_t const nRanges[] = {10, 1000, 100000};
+        size_t const nQueries = 100000;
+        bool const report = getenv("SCIDB_UNIT_BENCHMARK") != NULL;
+
+        if (report) {
+            std::cout << std::endl;
+        }
+        for (size_t j = 0; j < sizeof(nRanges) / sizeof(nRanges[0]); j++) {
+            SpatialRanges indexed(2);
+            SpatialRanges linear(2);
+            Coordinate const maxSide = std::max(static_cast<Coordinate>(SPACE / sqrt(double(nRanges[j]))), Coordinate(2));
+            makeRanges(nRanges[j], maxSide, indexed, linear);
+
+            // the linear scan over 100K boxes takes a while: fewer queries
+            std::vector<Coordinates> points(std::min(nQueries, 100000000 / nRanges[j]));
+            for (size_t q = 0; q < points.size(); q++) {
+                makePoint(2, points[q]);
+            }
+
+            size_t nFound = 0;
+            size_t nLinearFound = 0;
+            double const indexedTime = timeQueries(indexed, points, nFound);
+            double const linearTime = timeQueries(linear, points, nLinearFound);
+            CPPUNIT_ASSERT_EQUAL(nLinearFound, nFound);
+
+            if (report) {
+                std::cout << "SpatialRanges " << std::setw(7) << nRanges[j] << " boxes: "
+                          << std::fixed << std::setprecision(1)
+                          << std::setw(10) << linearTime << " ns/point linear, "
+                          << std::setw(8) << indexedTime << " ns/point "
+                          << (indexed.hasIndex() ? "R-tree" : "(no R-tree)") << std::endl;
+            }
+        }
+    }
+};
+
+/****************************************************************************/
+
+CPPUNIT_TEST_SUITE_REGISTRATION(SpatialRangesTests);
+
+#endif
@@ -60,10 +60,15 @@
 #include "query/optimizer/OptUnitTests.h"
 #include "query/AggregateUnitTests.h"
 #include "array/BitmaskUnitTests.h"
+#include "array/NormalizedKeysUnitTests.h"
+#include "array/SortRunUnitTests.h"
 #include "query/AuxUnitTests.h"
 //#include "system/ExceptionUnitTests.h"
 #include "PointerRangeUnitTests.h"
 #include "ArenaUnitTests.h"
+#include "CoordinatesMapperUnitTests.h"
+#include "SpatialRangesUnitTests.h"
+#include "SortedValueCountsUnitTests.h"
 
 using namespace std;
 